@@ -13,13 +13,28 @@
 #include <string.h>
 
 #include <linux/i2c-dev.h>
-#include <sys/ioctl.h>
 
 #include "adc108s022.h"
+#include "i2c.h"
 #include "novena-gpbb.h"
+#include "stats.h"
+#include "trace.h"
+#include "state.h"
+#include "regwait.h"
 
 #define ADC108S022_I2C_ADR  (0x3c >> 1) // actually, the whole FPGA sits here
 
+// each VALID poll is a whole I2C transaction, much longer than a conversion,
+// so the first poll nearly always succeeds; back off quickly if it doesn't
+static const struct regwait_policy adc_valid_policy = {
+  .spins = 2,
+  .min_delay_ns = 20000,
+  .max_delay_ns = 1000000,
+  .timeout_ns = 100000000,
+};
+
+struct regwait_stats adc_valid_wait;
+
 //#define DEBUG
 //#define DEBUG_STANDALONE   // add a main routine for stand-alone debug
 
@@ -41,31 +56,12 @@ void dump(void *buf, int count) {
 #endif
 
 int adc108s022_write_byte( unsigned char adr, unsigned char data ) {
-  int i2cfd;
   char i2cbuf[2]; 
-  int slave_address = -1;
+  int slave_address = ADC108S022_I2C_ADR;
 
   struct i2c_msg msg[2];
 		
-  struct i2c_ioctl_rdwr_data {
-    struct i2c_msg *msgs;  /* ptr to array of simple messages */              
-    int nmsgs;             /* number of messages to exchange */ 
-  } msgst;
-  
-  slave_address = ADC108S022_I2C_ADR;
-  
-  i2cfd = open("/dev/i2c-2", O_RDWR);
-  if( i2cfd < 0 ) {
-    perror("Unable to open /dev/i2c-2\n");
-    i2cfd = 0;
-    return 1;
-  }
-  if( ioctl( i2cfd, I2C_SLAVE, slave_address) < 0 ) {
-    perror("Unable to set I2C slave device\n" );
-    printf( "Address: %02x\n", slave_address );
-    close( i2cfd );
-    return 1;
-  }
+  STATS_SCOPE(STATS_ADC_I2C_WRITE);
 
   i2cbuf[0] = adr; i2cbuf[1] = data;
   // set address for read
@@ -78,46 +74,21 @@ int adc108s022_write_byte( unsigned char adr, unsigned char data ) {
   dump(i2cbuf, 2);
 #endif
 
-  msgst.msgs = msg;	
-  msgst.nmsgs = 1;
-
-  if (ioctl(i2cfd, I2C_RDWR, &msgst) < 0){
-    perror("Transaction failed\n" );
-    close( i2cfd );
+  if( i2c_transfer(I2C_BUS_FPGA, slave_address, msg, 1) < 0 )
     return -1;
-  }
 
-  close( i2cfd );
+  TRACE(TRACE_BUS_I2C2, TRACE_WRITE, 1, TRACE_I2C_ADDR(slave_address, adr), data);
   
   return 0;
 }
 
 
 int adc108s022_read_byte( unsigned char adr, unsigned char *data ) {
-  int i2cfd;
-  int slave_address = -1;
+  int slave_address = ADC108S022_I2C_ADR;
 
   struct i2c_msg msg[2];
 		
-  struct i2c_ioctl_rdwr_data {
-    struct i2c_msg *msgs;  /* ptr to array of simple messages */              
-    int nmsgs;             /* number of messages to exchange */ 
-  } msgst;
-  
-  slave_address = ADC108S022_I2C_ADR;
-  
-  i2cfd = open("/dev/i2c-2", O_RDWR);
-  if( i2cfd < 0 ) {
-    perror("Unable to open /dev/i2c-2\n");
-    i2cfd = 0;
-    return -1;
-  }
-  if( ioctl( i2cfd, I2C_SLAVE, slave_address) < 0 ) {
-    perror("Unable to set I2C slave device\n" );
-    printf( "Address: %02x\n", slave_address );
-    close( i2cfd );
-    return -1;
-  }
+  STATS_SCOPE(STATS_ADC_I2C_READ);
 
   // set write address
   msg[0].addr = slave_address;
@@ -132,16 +103,10 @@ int adc108s022_read_byte( unsigned char adr, unsigned char *data ) {
   msg[1].len = 1;
   msg[1].buf = (char *) data;
 
-  msgst.msgs = msg;	
-  msgst.nmsgs = 2;
-
-  if (ioctl(i2cfd, I2C_RDWR, &msgst) < 0){
-    perror("Transaction failed\n" );
-    close( i2cfd );
+  if( i2c_transfer(I2C_BUS_FPGA, slave_address, msg, 2) < 0 )
     return -1;
-  }
 
-  close( i2cfd );
+  TRACE(TRACE_BUS_I2C2, TRACE_READ, 1, TRACE_I2C_ADDR(slave_address, adr), *data);
   
   return 0;
 }
@@ -173,30 +138,95 @@ void adc_chan(unsigned int chan) {
 
 }
 
-unsigned int adc_read() {
+// start a conversion on the current channel; returns the channel, for adc_finish()
+int adc_start() {
   unsigned char chan;
-  unsigned char valid = 0;
+
+  if( adc108s022_read_byte( FPGA_I2C_ADC_CTL, &chan ) < 0 )
+    return -1;
+
+  if( adc108s022_write_byte( FPGA_I2C_ADC_CTL, chan | 0x8 ) < 0 ) // initiate conversion
+    return -1;
+
+  return chan;
+}
+
+// adc_start() on chan; only a channel change costs the write and the
+// thrown-away conversion adc_chan() does
+int adc_start_chan(unsigned int chan) {
+  unsigned char ctl;
+
+  if( chan > 0x7 )
+    return -1;
+  if( adc108s022_read_byte( FPGA_I2C_ADC_CTL, &ctl ) < 0 )
+    return -1;
+
+  if( (ctl & 7) != chan ) {
+    if( adc108s022_write_byte( FPGA_I2C_ADC_CTL, (unsigned char) chan ) < 0 )
+      return -1;
+    if( adc108s022_write_byte( FPGA_I2C_ADC_CTL, chan | 0x8 ) < 0 )
+      return -1;
+    if( adc_finish(chan) < 0 ) // throw away result
+      return -1;
+    ctl = chan;
+  }
+
+  if( adc108s022_write_byte( FPGA_I2C_ADC_CTL, ctl | 0x8 ) < 0 ) // initiate conversion
+    return -1;
+
+  return ctl;
+}
+
+static int adc_valid_read(void *ctx, unsigned int *value) {
+  unsigned char valid;
+
+  if( adc108s022_read_byte( FPGA_I2C_ADC_VALID, &valid ) < 0 )
+    return -1;
+  *value = valid != 0;
+  return 0;
+}
+
+// wait for the conversion adc_start() began and return its result
+int adc_finish(int chan) {
   unsigned char data;
   unsigned int retval;
-  
-  adc108s022_read_byte( FPGA_I2C_ADC_CTL, &chan );
+  int ret;
 
-  adc108s022_write_byte( FPGA_I2C_ADC_CTL, chan | 0x8 ); // initiate conversion
+  if( chan < 0 )
+    return -EIO;
 
-  while( !valid ) {
-    adc108s022_read_byte( FPGA_I2C_ADC_VALID, &valid );
+  {
+    STATS_SCOPE(STATS_ADC_VALID_WAIT);
+    ret = regwait(adc_valid_read, NULL, 1, 1, &adc_valid_policy, &adc_valid_wait, NULL);
   }
+  if( ret == -ETIMEDOUT ) {
+    printf( "Warning: ADC conversion timed out; is the FPGA loaded?\n" );
+    adc108s022_write_byte( FPGA_I2C_ADC_CTL, chan ); // leave it ready for the next one
+    return -ETIMEDOUT;
+  }
+  if( ret < 0 )
+    return -EIO;
 
-  adc108s022_read_byte( FPGA_I2C_ADC_DAT_L, &data );
+  if( adc108s022_read_byte( FPGA_I2C_ADC_DAT_L, &data ) < 0 )
+    return -EIO;
   retval = data;
-  adc108s022_read_byte( FPGA_I2C_ADC_DAT_H, &data );
+  if( adc108s022_read_byte( FPGA_I2C_ADC_DAT_H, &data ) < 0 )
+    return -EIO;
   retval |= (data << 8);
 
   adc108s022_write_byte( FPGA_I2C_ADC_CTL, chan ); // clear initiation bit
 
+  STATE(state_set_adc(chan & 7, retval));
   return retval;
 }
 
+// 0 when the conversion fails, as it always has
+unsigned int adc_read() {
+  int ret = adc_finish(adc_start());
+
+  return ret < 0 ? 0 : ret;
+}
+
 
 #ifdef DEBUG_STANDALONE
 int main() {
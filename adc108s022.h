@@ -1,2 +1,14 @@
+#include "regwait.h"
+
 void adc_chan(unsigned int chan);
 unsigned int adc_read();
+// adc_read() in two halves, so other bus traffic can run during the conversion
+int adc_start();
+int adc_start_chan(unsigned int chan);
+// the code, or -ETIMEDOUT when VALID never came, -EIO on a bus error
+int adc_finish(int chan);
+// polls adc_finish() needed on its VALID bit
+extern struct regwait_stats adc_valid_wait;
+
+int adc108s022_write_byte( unsigned char adr, unsigned char data );
+int adc108s022_read_byte( unsigned char adr, unsigned char *data );
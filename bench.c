@@ -0,0 +1,436 @@
+///
+// Regression benchmark for the CLI operations.
+//
+// Each operation is run N times in process, the way main() would run it
+// once, and costs wall time (best of five rounds) plus the open/close/mmap/
+// munmap/ioctl calls it makes.  Those calls are counted by wrappers linked in with -Wl,--wrap, so
+// the backends are measured unmodified.
+//
+// Without the board (or with -sim) the same wrappers stand in for the
+// devices: /dev/mem and /dev/i2c-N opens get a /dev/null descriptor, mmaps
+// of physical offsets are backed by anonymous pages that persist across
+// remaps, and I2C_RDWR is served by the sim I2C models.  The backends then
+// take their hardware path, so the counts are the ones the board would see.
+//
+// Results are written as JSON, one op per line; -check compares a run
+// against such a baseline and fails on any extra syscall, or on wall time
+// beyond the tolerance.
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+
+#include <linux/i2c-dev.h>
+
+#include "novena-gpbb.h"
+#include "libgpbb.h"
+#include "sim.h"
+#include "stats.h"
+
+enum bench_call {
+	CALL_OPEN,
+	CALL_CLOSE,
+	CALL_MMAP,
+	CALL_MUNMAP,
+	CALL_IOCTL,
+	CALL_COUNT
+};
+
+static const char *call_names[CALL_COUNT] = {
+	"open", "close", "mmap", "munmap", "ioctl",
+};
+
+static unsigned long calls[CALL_COUNT];
+static int fake_devices;
+
+#define FAKE_FDS   64
+#define FAKE_MAPS  16
+#define MAP_LEN    0x10000
+
+static struct {
+	int bus;    // -1 for /dev/mem, else I2C adapter
+	int slave;
+} fake_fd[FAKE_FDS];
+static char fake_fd_used[FAKE_FDS];
+
+static struct {
+	off_t offset;
+	void *mem;
+} fake_map[FAKE_MAPS];
+
+int __real_open(const char *path, int flags, ...);
+int __real_close(int fd);
+void *__real_mmap(void *addr, size_t len, int prot, int flags, int fd, off_t offset);
+int __real_munmap(void *addr, size_t len);
+int __real_ioctl(int fd, unsigned long request, ...);
+
+int __wrap_open(const char *path, int flags, ...) {
+	va_list ap;
+	mode_t mode;
+	int bus = -1;
+	int fd;
+
+	calls[CALL_OPEN]++;
+
+	va_start(ap, flags);
+	mode = (flags & O_CREAT) ? va_arg(ap, int) : 0;
+	va_end(ap);
+
+	if (fake_devices && (!strcmp(path, "/dev/mem")
+			     || sscanf(path, "/dev/i2c-%d", &bus) == 1)) {
+		fd = __real_open("/dev/null", O_RDWR);
+		if (fd >= 0 && fd < FAKE_FDS) {
+			fake_fd_used[fd] = 1;
+			fake_fd[fd].bus = bus;
+			fake_fd[fd].slave = -1;
+		}
+		return fd;
+	}
+	return __real_open(path, flags, mode);
+}
+
+int __wrap_close(int fd) {
+	calls[CALL_CLOSE]++;
+	if (fd >= 0 && fd < FAKE_FDS)
+		fake_fd_used[fd] = 0;
+	return __real_close(fd);
+}
+
+void *__wrap_mmap(void *addr, size_t len, int prot, int flags, int fd, off_t offset) {
+	int i;
+
+	calls[CALL_MMAP]++;
+	if (fd < 0 || fd >= FAKE_FDS || !fake_fd_used[fd])
+		return __real_mmap(addr, len, prot, flags, fd, offset);
+
+	for (i = 0; i < FAKE_MAPS && fake_map[i].mem; i++)
+		if (fake_map[i].offset == offset)
+			return fake_map[i].mem;
+	if (i == FAKE_MAPS || len > MAP_LEN) {
+		errno = ENOMEM;
+		return MAP_FAILED;
+	}
+	fake_map[i].mem = __real_mmap(NULL, MAP_LEN, PROT_READ | PROT_WRITE,
+				      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	fake_map[i].offset = offset;
+	return fake_map[i].mem;
+}
+
+int __wrap_munmap(void *addr, size_t len) {
+	int i;
+
+	calls[CALL_MUNMAP]++;
+	for (i = 0; i < FAKE_MAPS; i++)
+		if (fake_map[i].mem == addr)
+			return 0;  // keep the contents for the next mapping
+	return __real_munmap(addr, len);
+}
+
+int __wrap_ioctl(int fd, unsigned long request, ...) {
+	struct i2c_rdwr_ioctl_data *rdwr;
+	va_list ap;
+	void *arg;
+
+	calls[CALL_IOCTL]++;
+
+	va_start(ap, request);
+	arg = va_arg(ap, void *);
+	va_end(ap);
+
+	if (fd < 0 || fd >= FAKE_FDS || !fake_fd_used[fd] || fake_fd[fd].bus < 0)
+		return __real_ioctl(fd, request, arg);
+
+	switch (request) {
+	case I2C_SLAVE:
+		fake_fd[fd].slave = (long)arg;
+		return 0;
+	case I2C_RDWR:
+		rdwr = arg;
+		return sim_i2c_transfer(fake_fd[fd].bus, rdwr->msgs, rdwr->nmsgs);
+	default:
+		errno = ENOTTY;
+		return -1;
+	}
+}
+
+
+/*
+ * The operations, as main() performs them for the corresponding option.
+ */
+static void op_version(void) {
+	uint16_t major, minor;
+
+	gpbb_version(board_get(), &major, &minor);
+}
+
+static void op_port_read(void) {
+	gpbb_output_state(PORT_A);
+}
+
+static void op_port_write(void) {
+	gpbb_port_write(PORT_A, PORT_VAL, 0x55);
+}
+
+static void op_port_set(void) {
+	gpbb_port_write(PORT_A, PORT_SET, 3);
+}
+
+static void op_read_port(void) {
+	gpbb_read();
+}
+
+static void op_dac(void) {
+	gpbb_dac(board_get(), GPBB_DAC_A, 512);
+}
+
+static void op_adc(void) {
+	gpbb_adc(board_get(), 0);
+}
+
+static void op_oe(void) {
+	oe_state(1, OE_A);
+}
+
+static void op_vddio(void) {
+	setvddio(1);
+}
+
+static void op_testcs1(void) {
+	testcs1();
+}
+
+static const struct bench_op {
+	const char *name;
+	void (*run)(void);
+} ops[] = {
+	{ "-v",        op_version },
+	{ "-p",        op_port_read },
+	{ "-p_write",  op_port_write },
+	{ "-p_set",    op_port_set },
+	{ "-rp",       op_read_port },
+	{ "-da",       op_dac },
+	{ "-a",        op_adc },
+	{ "-oea",      op_oe },
+	{ "-hv",       op_vddio },
+	{ "-testcs1",  op_testcs1 },
+};
+
+#define NOPS (sizeof(ops) / sizeof(ops[0]))
+#define BENCH_ROUNDS 5
+
+struct bench_result {
+	double ns;                 // per iteration
+	double calls[CALL_COUNT];  // per iteration
+};
+
+static void bench_run(const struct bench_op *op, int n, struct bench_result *res) {
+	uint64_t start;
+	double ns;
+	int saved_stdout, devnull;
+	int round, i;
+
+	// some operations print; keep that out of the numbers and the report
+	fflush(stdout);
+	saved_stdout = dup(1);
+	devnull = __real_open("/dev/null", O_WRONLY);
+	dup2(devnull, 1);
+
+	op->run();  // warm up: first-use mappings and the like
+
+	// best of a few rounds, so one preemption doesn't read as a regression
+	res->ns = 0;
+	for (round = 0; round < BENCH_ROUNDS; round++) {
+		memset(calls, 0, sizeof(calls));
+		start = stats_now();
+		for (i = 0; i < n; i++)
+			op->run();
+		ns = (double)(stats_now() - start) / n;
+		if (!round || ns < res->ns)
+			res->ns = ns;
+	}
+	for (i = 0; i < CALL_COUNT; i++)
+		res->calls[i] = (double)calls[i] / n;
+
+	fflush(stdout);
+	dup2(saved_stdout, 1);
+	__real_close(saved_stdout);
+	__real_close(devnull);
+}
+
+static void bench_write(FILE *out, const char *backend, int n,
+			struct bench_result *res) {
+	unsigned int i;
+	int c;
+
+	fprintf(out, "{\n  \"backend\": \"%s\",\n  \"iterations\": %d,\n  \"ops\": [\n",
+		backend, n);
+	for (i = 0; i < NOPS; i++) {
+		fprintf(out, "    {\"op\": \"%s\", \"ns\": %.1f", ops[i].name, res[i].ns);
+		for (c = 0; c < CALL_COUNT; c++)
+			fprintf(out, ", \"%s\": %.2f", call_names[c], res[i].calls[c]);
+		fprintf(out, "}%s\n", i + 1 < NOPS ? "," : "");
+	}
+	fprintf(out, "  ]\n}\n");
+}
+
+// reads back what bench_write() wrote; one op per line
+static int bench_check(const char *path, const char *backend,
+		       struct bench_result *res, double tolerance) {
+	struct bench_result base;
+	char line[512], name[32], base_backend[16] = "";
+	unsigned int i;
+	int c, failed = 0, matched = 0;
+	FILE *in;
+
+	in = fopen(path, "r");
+	if (!in)
+		return -1;
+
+	while (fgets(line, sizeof(line), in)) {
+		if (sscanf(line, " \"backend\": \"%15[^\"]\"", base_backend) == 1)
+			continue;
+		if (sscanf(line, " {\"op\": \"%31[^\"]\", \"ns\": %lf, \"open\": %lf, "
+			   "\"close\": %lf, \"mmap\": %lf, \"munmap\": %lf, \"ioctl\": %lf",
+			   name, &base.ns, &base.calls[CALL_OPEN], &base.calls[CALL_CLOSE],
+			   &base.calls[CALL_MMAP], &base.calls[CALL_MUNMAP],
+			   &base.calls[CALL_IOCTL]) != 7)
+			continue;
+
+		for (i = 0; i < NOPS && strcmp(ops[i].name, name); i++)
+			;
+		if (i == NOPS)
+			continue;
+		matched++;
+
+		for (c = 0; c < CALL_COUNT; c++) {
+			if (res[i].calls[c] > base.calls[c] + 0.005) {
+				printf("REGRESSION %s: %s %.2f -> %.2f per op\n", name,
+				       call_names[c], base.calls[c], res[i].calls[c]);
+				failed = 1;
+			}
+		}
+		if (res[i].ns > base.ns * (1 + tolerance / 100)) {
+			printf("REGRESSION %s: %.1f -> %.1f ns per op (+%.0f%%, limit %.0f%%)\n",
+			       name, base.ns, res[i].ns,
+			       (res[i].ns / base.ns - 1) * 100, tolerance);
+			failed = 1;
+		}
+	}
+	fclose(in);
+
+	if (strcmp(base_backend, backend))
+		printf("Note: baseline is from the %s backend, this run used %s\n",
+		       base_backend, backend);
+	if (!matched) {
+		fprintf(stderr, "No operations found in baseline %s\n", path);
+		return 1;
+	}
+	return failed;
+}
+
+static void bench_usage(char *progname) {
+	printf("Usage:\n"
+	       "%s [-n <iterations>] [-sim] [-o <baseline.json>] [-check <baseline.json> [-tolerance <pct>]]\n"
+	       "\t-n <iterations> runs of each operation (default 1000)\n"
+	       "\t-sim use simulated devices even if /dev/mem is accessible\n"
+	       "\t-o <file> write the results as a JSON baseline\n"
+	       "\t-check <file> compare with a baseline: any extra syscall, or wall time\n"
+	       "\t\tmore than <pct> (default 50) percent slower, is a regression.\n"
+	       "\t\tA missing baseline is created from this run.\n",
+	       progname);
+}
+
+int main(int argc, char **argv) {
+	struct bench_result res[NOPS];
+	const char *out_path = NULL, *check_path = NULL;
+	const char *backend;
+	double tolerance = 50;
+	int n = 1000;
+	int force_sim = 0;
+	unsigned int i;
+	int c, fd, ret = 0;
+	FILE *out;
+
+	for (c = 1; c < argc; c++) {
+		if (!strcmp(argv[c], "-n") && c + 1 < argc)
+			n = strtoul(argv[++c], NULL, 0);
+		else if (!strcmp(argv[c], "-sim"))
+			force_sim = 1;
+		else if (!strcmp(argv[c], "-o") && c + 1 < argc)
+			out_path = argv[++c];
+		else if (!strcmp(argv[c], "-check") && c + 1 < argc)
+			check_path = argv[++c];
+		else if (!strcmp(argv[c], "-tolerance") && c + 1 < argc)
+			tolerance = strtod(argv[++c], NULL);
+		else {
+			bench_usage(argv[0]);
+			return 1;
+		}
+	}
+	if (n < 1)
+		n = 1;
+
+	fd = force_sim ? -1 : __real_open("/dev/mem", O_RDWR);
+	if (fd < 0) {
+		// only the device models are wanted; the backends keep their
+		// hardware path and meet the models through the wrappers above
+		sim_enable(NULL);
+		sim_enabled = 0;
+		fake_devices = 1;
+		backend = "sim";
+	}
+	else {
+		__real_close(fd);
+		backend = "hw";
+	}
+
+	setup_fpga();
+	setup_fpga_cs1();
+
+	for (i = 0; i < NOPS; i++)
+		bench_run(&ops[i], n, &res[i]);
+
+	printf("%-10s %12s", "op", "ns/op");
+	for (c = 0; c < CALL_COUNT; c++)
+		printf(" %7s", call_names[c]);
+	printf("   (%s, %d iterations)\n", backend, n);
+	for (i = 0; i < NOPS; i++) {
+		printf("%-10s %12.1f", ops[i].name, res[i].ns);
+		for (c = 0; c < CALL_COUNT; c++)
+			printf(" %7.2f", res[i].calls[c]);
+		printf("\n");
+	}
+
+	if (check_path) {
+		ret = bench_check(check_path, backend, res, tolerance);
+		if (ret < 0) {
+			printf("No baseline at %s; writing one\n", check_path);
+			out_path = check_path;
+			ret = 0;
+		}
+		else if (ret == 0) {
+			printf("No regressions against %s\n", check_path);
+		}
+	}
+
+	if (out_path) {
+		out = fopen(out_path, "w");
+		if (!out) {
+			perror("Unable to write baseline");
+			return 1;
+		}
+		bench_write(out, backend, n, res);
+		fclose(out);
+	}
+
+	return ret;
+}
@@ -0,0 +1,567 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+# include <arm_neon.h>
+# define CAPTURE_NEON 1
+#elif defined(__SSE2__)
+# include <emmintrin.h>
+# define CAPTURE_SSE2 1
+#endif
+
+#include "capture.h"
+#include "stats.h"
+
+#define ALIGN8(n)   (((n) + 7) & ~(size_t)7)
+#define ALIGN16(n)  (((n) + 15) & ~(size_t)15)
+
+/*
+ * 10-bit planar packing, 16 samples at a time: 16 low bytes to lo[],
+ * 4 bytes of top bits to hi[].
+ */
+#if defined(CAPTURE_SSE2)
+static void pack16(const uint16_t *x, uint8_t *lo, uint8_t *hi) {
+	const __m128i lomask = _mm_set1_epi16(0xff), three = _mm_set1_epi16(3);
+	const __m128i nib = _mm_set1_epi32(0xf), byte = _mm_set_epi32(0, 0xff, 0, 0xff);
+	__m128i x0 = _mm_loadu_si128((const __m128i *)x);
+	__m128i x1 = _mm_loadu_si128((const __m128i *)(x + 8));
+	__m128i h0, h1;
+	int32_t packed;
+
+	_mm_storeu_si128((__m128i *)lo, _mm_packus_epi16(_mm_and_si128(x0, lomask),
+							  _mm_and_si128(x1, lomask)));
+
+	// fold four 2-bit fields per 64-bit lane into its low byte
+	h0 = _mm_and_si128(_mm_srli_epi16(x0, 8), three);
+	h1 = _mm_and_si128(_mm_srli_epi16(x1, 8), three);
+	h0 = _mm_and_si128(_mm_or_si128(h0, _mm_srli_epi32(h0, 14)), nib);
+	h1 = _mm_and_si128(_mm_or_si128(h1, _mm_srli_epi32(h1, 14)), nib);
+	h0 = _mm_and_si128(_mm_or_si128(h0, _mm_srli_epi64(h0, 28)), byte);
+	h1 = _mm_and_si128(_mm_or_si128(h1, _mm_srli_epi64(h1, 28)), byte);
+	h0 = _mm_shuffle_epi32(h0, _MM_SHUFFLE(3, 1, 2, 0));
+	h1 = _mm_shuffle_epi32(h1, _MM_SHUFFLE(3, 1, 2, 0));
+	h0 = _mm_unpacklo_epi64(h0, h1);
+	h0 = _mm_packs_epi32(h0, h0);
+	h0 = _mm_packus_epi16(h0, h0);
+	packed = _mm_cvtsi128_si32(h0);
+	memcpy(hi, &packed, 4);
+}
+
+static void unpack16(const uint8_t *lo, const uint8_t *hi, uint16_t *x) {
+	const __m128i zero = _mm_setzero_si128(), top = _mm_set1_epi16(0x300);
+	// shift field k of a byte up to bits 8..9
+	const __m128i mul = _mm_set_epi16(4, 16, 64, 256, 4, 16, 64, 256);
+	__m128i l = _mm_loadu_si128((const __m128i *)lo);
+	__m128i h;
+	int32_t packed;
+
+	memcpy(&packed, hi, 4);
+	h = _mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero);
+	h = _mm_unpacklo_epi16(h, h);
+	_mm_storeu_si128((__m128i *)x,
+			 _mm_or_si128(_mm_unpacklo_epi8(l, zero),
+				      _mm_and_si128(_mm_mullo_epi16(_mm_unpacklo_epi32(h, h), mul), top)));
+	_mm_storeu_si128((__m128i *)(x + 8),
+			 _mm_or_si128(_mm_unpackhi_epi8(l, zero),
+				      _mm_and_si128(_mm_mullo_epi16(_mm_unpackhi_epi32(h, h), mul), top)));
+}
+
+#elif defined(CAPTURE_NEON)
+static void pack16(const uint16_t *x, uint8_t *lo, uint8_t *hi) {
+	const int16_t shifts[8] = { 0, 2, 4, 6, 0, 2, 4, 6 };
+	const int16x8_t sh = vld1q_s16(shifts);
+	const uint16x8_t three = vdupq_n_u16(3);
+	uint16x8_t x0 = vld1q_u16(x), x1 = vld1q_u16(x + 8);
+	uint64x2_t h0, h1;
+
+	vst1q_u8(lo, vcombine_u8(vmovn_u16(x0), vmovn_u16(x1)));
+
+	// fields are disjoint, so summing the shifted lanes ORs them
+	h0 = vpaddlq_u32(vpaddlq_u16(vshlq_u16(vandq_u16(vshrq_n_u16(x0, 8), three), sh)));
+	h1 = vpaddlq_u32(vpaddlq_u16(vshlq_u16(vandq_u16(vshrq_n_u16(x1, 8), three), sh)));
+	hi[0] = vgetq_lane_u64(h0, 0);
+	hi[1] = vgetq_lane_u64(h0, 1);
+	hi[2] = vgetq_lane_u64(h1, 0);
+	hi[3] = vgetq_lane_u64(h1, 1);
+}
+
+static void unpack16(const uint8_t *lo, const uint8_t *hi, uint16_t *x) {
+	const uint8_t idx0[8] = { 0, 0, 0, 0, 1, 1, 1, 1 };
+	const uint8_t idx1[8] = { 2, 2, 2, 2, 3, 3, 3, 3 };
+	const int16_t shifts[8] = { 0, -2, -4, -6, 0, -2, -4, -6 };
+	const int16x8_t sh = vld1q_s16(shifts);
+	const uint16x8_t three = vdupq_n_u16(3);
+	uint8_t hb[8] = { hi[0], hi[1], hi[2], hi[3] };
+	uint8x8_t h = vld1_u8(hb);
+	uint8x16_t l = vld1q_u8(lo);
+	uint16x8_t t0, t1;
+
+	t0 = vandq_u16(vshlq_u16(vmovl_u8(vtbl1_u8(h, vld1_u8(idx0))), sh), three);
+	t1 = vandq_u16(vshlq_u16(vmovl_u8(vtbl1_u8(h, vld1_u8(idx1))), sh), three);
+	vst1q_u16(x, vorrq_u16(vmovl_u8(vget_low_u8(l)), vshlq_n_u16(t0, 8)));
+	vst1q_u16(x + 8, vorrq_u16(vmovl_u8(vget_high_u8(l)), vshlq_n_u16(t1, 8)));
+}
+
+#else
+static void pack16(const uint16_t *x, uint8_t *lo, uint8_t *hi) {
+	int i;
+
+	for (i = 0; i < 16; i++)
+		lo[i] = x[i] & 0xff;
+	for (i = 0; i < 4; i++)
+		hi[i] = ((x[4 * i] >> 8) & 3) | (((x[4 * i + 1] >> 8) & 3) << 2)
+			| (((x[4 * i + 2] >> 8) & 3) << 4) | (((x[4 * i + 3] >> 8) & 3) << 6);
+}
+
+static void unpack16(const uint8_t *lo, const uint8_t *hi, uint16_t *x) {
+	int i;
+
+	for (i = 0; i < 16; i++)
+		x[i] = lo[i] | (((hi[i / 4] >> (2 * (i % 4))) & 3) << 8);
+}
+#endif
+
+void capture_pack10(const uint16_t *x, size_t n, uint8_t *out) {
+	size_t i;
+
+	for (i = 0; i < n; i += 16)
+		pack16(x + i, out + i, out + n + i / 4);
+}
+
+void capture_unpack10(const uint8_t *packed, size_t n, uint16_t *out) {
+	size_t i;
+
+	for (i = 0; i < n; i += 16)
+		unpack16(packed + i, packed + n + i / 4, out + i);
+}
+
+
+/*
+ * Writer.  Each chunk is assembled in one scratch buffer and written with
+ * a single write(); the header is rewritten with the totals on close.
+ */
+static uint8_t *capture_scratch(struct capture_writer *w, size_t size) {
+	uint8_t *p;
+
+	if (size <= w->scratch_size)
+		return w->scratch;
+	p = realloc(w->scratch, size);
+	if (!p) {
+		perror("Unable to allocate capture chunk");
+		return NULL;
+	}
+	w->scratch = p;
+	w->scratch_size = size;
+	return p;
+}
+
+static int capture_emit(struct capture_writer *w, uint8_t *buf, size_t payload) {
+	size_t len = sizeof(struct capture_chunk) + payload;
+	ssize_t ret;
+
+	while (len) {
+		ret = write(w->fd, buf, len);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0) {
+			perror("Unable to write capture chunk");
+			return -1;
+		}
+		buf += ret;
+		len -= ret;
+	}
+	w->header.chunks++;
+	return 0;
+}
+
+struct capture_writer *capture_create(const char *path, const struct capture_channel *channels,
+				      int count, uint64_t period_ns,
+				      uint16_t fpga_major, uint16_t fpga_minor) {
+	static const uint8_t zero[CAPTURE_HEADER_SIZE];
+	struct capture_writer *w;
+
+	if (count < 1 || count > CAPTURE_MAX_CHANNELS) {
+		fprintf(stderr, "capture: 1 to %d channels\n", CAPTURE_MAX_CHANNELS);
+		return NULL;
+	}
+	w = calloc(1, sizeof(*w));
+	if (!w) {
+		perror("Unable to allocate capture writer");
+		return NULL;
+	}
+	w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (w->fd < 0) {
+		perror("Unable to create capture file");
+		free(w);
+		return NULL;
+	}
+
+	memcpy(w->header.magic, CAPTURE_MAGIC, 8);
+	w->header.header_size = CAPTURE_HEADER_SIZE;
+	w->header.chunk_align = 8;
+	w->header.fpga_major = fpga_major;
+	w->header.fpga_minor = fpga_minor;
+	w->header.channel_count = count;
+	w->header.start_ns = stats_clock(CLOCK_REALTIME);
+	w->header.period_ns = period_ns;
+	memcpy(w->header.channels, channels, count * sizeof(*channels));
+
+	// header space now, contents on close
+	if (write(w->fd, zero, sizeof(zero)) != sizeof(zero)) {
+		perror("Unable to write capture header");
+		close(w->fd);
+		free(w);
+		return NULL;
+	}
+	return w;
+}
+
+int capture_write_adc(struct capture_writer *w, int channel, uint64_t first,
+		      const uint16_t *x, size_t n) {
+	size_t padded = ALIGN16(n), packed = CAPTURE_PACKED_BYTES(n);
+	size_t payload = ALIGN8(packed);
+	struct capture_chunk *c;
+	uint16_t tail[16];
+	uint8_t *buf, *lo, *hi;
+	size_t i;
+
+	if (!n)
+		return 0;
+	buf = capture_scratch(w, sizeof(*c) + payload);
+	if (!buf)
+		return -1;
+	c = (struct capture_chunk *)buf;
+	c->channel = channel;
+	c->count = n;
+	c->first = first;
+	c->bytes = payload;
+
+	lo = buf + sizeof(*c);
+	hi = lo + padded;
+	for (i = 0; i + 16 <= n; i += 16)
+		pack16(x + i, lo + i, hi + i / 4);
+	if (i < n) {
+		// the last partial vector, zero padded
+		memset(tail, 0, sizeof(tail));
+		memcpy(tail, x + i, (n - i) * sizeof(*x));
+		pack16(tail, lo + i, hi + i / 4);
+	}
+	memset(buf + sizeof(*c) + packed, 0, payload - packed);
+
+	return capture_emit(w, buf, payload);
+}
+
+int capture_write_digital(struct capture_writer *w, int channel, uint64_t first,
+			  const uint8_t *x, size_t n) {
+	struct capture_transition *t;
+	struct capture_chunk *c;
+	size_t i, count = 0;
+	uint8_t *buf;
+
+	if (!n)
+		return 0;
+	// worst case every sample changes
+	buf = capture_scratch(w, sizeof(*c) + ALIGN8(n * sizeof(*t)));
+	if (!buf)
+		return -1;
+	c = (struct capture_chunk *)buf;
+	t = (struct capture_transition *)(c + 1);
+
+	if (n > CAPTURE_DIGITAL_MAX) {
+		fprintf(stderr, "capture: digital chunks hold at most %d samples\n",
+			CAPTURE_DIGITAL_MAX);
+		return -1;
+	}
+	for (i = 0; i < n; i++) {
+		// each chunk opens with its value at offset 0, so it stands alone
+		if (i && x[i] == x[i - 1])
+			continue;
+		t[count].offset = i;
+		t[count].value = x[i];
+		t[count].changed = i ? x[i] ^ x[i - 1] : 0xff;
+		count++;
+	}
+	memset(&t[count], 0, ALIGN8(count * sizeof(*t)) - count * sizeof(*t));
+
+	c->channel = channel;
+	c->count = count;
+	c->first = first;
+	c->bytes = ALIGN8(count * sizeof(*t));
+	return capture_emit(w, buf, c->bytes);
+}
+
+int capture_close(struct capture_writer *w, uint64_t samples) {
+	int ret = 0;
+
+	w->header.samples = samples;
+	if (pwrite(w->fd, &w->header, sizeof(w->header), 0) != sizeof(w->header)) {
+		perror("Unable to write capture header");
+		ret = -1;
+	}
+	if (close(w->fd) < 0)
+		ret = -1;
+	free(w->scratch);
+	free(w);
+	return ret;
+}
+
+
+/*
+ * Reader.
+ */
+int capture_map(const char *path, struct capture_file *f) {
+	struct stat st;
+	int fd;
+
+	memset(f, 0, sizeof(*f));
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		perror("Unable to open capture file");
+		return -1;
+	}
+	if (fstat(fd, &st) < 0 || st.st_size < CAPTURE_HEADER_SIZE) {
+		fprintf(stderr, "%s: not a capture file\n", path);
+		close(fd);
+		return -1;
+	}
+	f->map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (f->map == MAP_FAILED) {
+		perror("Unable to map capture file");
+		f->map = NULL;
+		return -1;
+	}
+	f->size = st.st_size;
+	f->header = (const struct capture_header *)f->map;
+	if (memcmp(f->header->magic, CAPTURE_MAGIC, 8)
+	    || f->header->header_size < sizeof(struct capture_header)
+	    || f->header->header_size > f->size
+	    || f->header->channel_count > CAPTURE_MAX_CHANNELS) {
+		fprintf(stderr, "%s: not a capture file\n", path);
+		capture_unmap(f);
+		return -1;
+	}
+	return 0;
+}
+
+void capture_unmap(struct capture_file *f) {
+	if (f->map)
+		munmap((void *)f->map, f->size);
+	memset(f, 0, sizeof(*f));
+}
+
+static const struct capture_chunk *capture_at(const struct capture_file *f, size_t off) {
+	const struct capture_chunk *c = (const struct capture_chunk *)(f->map + off);
+
+	if (off + sizeof(*c) > f->size || c->bytes > f->size - off - sizeof(*c)
+	    || c->channel >= f->header->channel_count)
+		return NULL;
+	return c;
+}
+
+const struct capture_chunk *capture_first(const struct capture_file *f) {
+	return capture_at(f, f->header->header_size);
+}
+
+const struct capture_chunk *capture_next(const struct capture_file *f,
+					 const struct capture_chunk *c) {
+	return capture_at(f, (const uint8_t *)capture_payload(c) + c->bytes - f->map);
+}
+
+
+void capture_info(const struct capture_file *f, FILE *out) {
+	const struct capture_header *h = f->header;
+	const struct capture_chunk *c;
+	uint64_t bytes[CAPTURE_MAX_CHANNELS] = { 0 }, counts[CAPTURE_MAX_CHANNELS] = { 0 };
+	unsigned int i;
+
+	for (c = capture_first(f); c; c = capture_next(f, c)) {
+		bytes[c->channel] += sizeof(*c) + c->bytes;
+		counts[c->channel] += c->count;
+	}
+
+	fprintf(out, "FPGA version %04x.%04x, %llu samples per channel every %llu ns, "
+		"%llu chunks, %zu bytes\n", h->fpga_minor, h->fpga_major,
+		(unsigned long long)h->samples, (unsigned long long)h->period_ns,
+		(unsigned long long)h->chunks, f->size);
+	for (i = 0; i < h->channel_count; i++) {
+		fprintf(out, "  %2d %-12s %s %d, %d bits: %llu %s, %.2f bits/sample", i,
+			h->channels[i].name,
+			h->channels[i].kind == CAPTURE_ADC10 ? "ADC channel" : "port",
+			h->channels[i].source, h->channels[i].width,
+			(unsigned long long)counts[i],
+			h->channels[i].kind == CAPTURE_ADC10 ? "samples" : "transitions",
+			h->samples ? bytes[i] * 8.0 / h->samples : 0);
+		if (h->channels[i].failed)
+			fprintf(out, ", %u failed conversions (stored as 0)",
+				h->channels[i].failed);
+		fprintf(out, "\n");
+	}
+}
+
+
+/*
+ * Exporters merge the channels into sample order.  Each channel has a
+ * cursor over its own chunks; ADC chunks are unpacked as they are reached.
+ */
+struct capture_cursor {
+	const struct capture_chunk *chunk;
+	size_t index;
+	uint16_t *samples;
+	size_t samples_size;
+};
+
+static int capture_cursor_load(const struct capture_file *f, struct capture_cursor *cur,
+			       unsigned int channel, const struct capture_chunk *from) {
+	const struct capture_chunk *c;
+	uint16_t *p;
+
+	for (c = from; c && c->channel != channel; c = capture_next(f, c))
+		;
+	cur->chunk = c;
+	cur->index = 0;
+	if (!c || f->header->channels[channel].kind != CAPTURE_ADC10)
+		return 0;
+
+	if (c->bytes < CAPTURE_PACKED_BYTES(c->count)) {
+		fprintf(stderr, "capture: short ADC chunk\n");
+		cur->chunk = NULL;
+		return -1;
+	}
+	if (ALIGN16(c->count) > cur->samples_size) {
+		p = realloc(cur->samples, ALIGN16(c->count) * sizeof(*p));
+		if (!p) {
+			perror("Unable to allocate capture samples");
+			cur->chunk = NULL;
+			return -1;
+		}
+		cur->samples = p;
+		cur->samples_size = ALIGN16(c->count);
+	}
+	capture_unpack10(capture_payload(c), ALIGN16(c->count), cur->samples);
+	return 0;
+}
+
+static uint64_t capture_cursor_sample(const struct capture_file *f, struct capture_cursor *cur,
+				      unsigned int *value) {
+	const struct capture_transition *t;
+
+	if (f->header->channels[cur->chunk->channel].kind == CAPTURE_ADC10) {
+		*value = cur->samples[cur->index];
+		return cur->chunk->first + cur->index;
+	}
+	t = (const struct capture_transition *)capture_payload(cur->chunk) + cur->index;
+	*value = t->value;
+	return cur->chunk->first + t->offset;
+}
+
+typedef void (*capture_emit_fn)(void *ctx, uint64_t sample, unsigned int channel,
+				unsigned int value);
+
+static int capture_merge(const struct capture_file *f, capture_emit_fn emit, void *ctx) {
+	struct capture_cursor cur[CAPTURE_MAX_CHANNELS];
+	unsigned int n = f->header->channel_count;
+	unsigned int i, best, value, best_value = 0;
+	uint64_t sample, best_sample;
+	int ret = 0;
+
+	memset(cur, 0, sizeof(cur));
+	for (i = 0; i < n; i++)
+		if (capture_cursor_load(f, &cur[i], i, capture_first(f)))
+			ret = -1;
+
+	for (;;) {
+		best = n;
+		best_sample = UINT64_MAX;
+		for (i = 0; i < n; i++) {
+			if (!cur[i].chunk)
+				continue;
+			sample = capture_cursor_sample(f, &cur[i], &value);
+			if (sample < best_sample) {
+				best = i;
+				best_sample = sample;
+				best_value = value;
+			}
+		}
+		if (best == n)
+			break;
+		emit(ctx, best_sample, best, best_value);
+		if (++cur[best].index >= cur[best].chunk->count
+		    && capture_cursor_load(f, &cur[best], best, capture_next(f, cur[best].chunk)))
+			ret = -1;
+	}
+
+	for (i = 0; i < n; i++)
+		free(cur[i].samples);
+	return ret;
+}
+
+struct capture_export {
+	const struct capture_file *f;
+	FILE *out;
+	uint64_t time;
+	int last[CAPTURE_MAX_CHANNELS];
+};
+
+static void capture_csv_row(void *ctx, uint64_t sample, unsigned int channel,
+			    unsigned int value) {
+	struct capture_export *e = ctx;
+	const struct capture_header *h = e->f->header;
+
+	fprintf(e->out, "%llu,%llu,%s,%u\n", (unsigned long long)sample,
+		(unsigned long long)(sample * h->period_ns), h->channels[channel].name, value);
+}
+
+int capture_export_csv(const struct capture_file *f, FILE *out) {
+	struct capture_export e = { f, out };
+
+	fprintf(out, "sample,time_ns,channel,value\n");
+	return capture_merge(f, capture_csv_row, &e);
+}
+
+static void capture_vcd_change(void *ctx, uint64_t sample, unsigned int channel,
+			       unsigned int value) {
+	struct capture_export *e = ctx;
+	const struct capture_channel *ch = &e->f->header->channels[channel];
+	uint64_t time = sample * e->f->header->period_ns;
+	int bit;
+
+	if (e->last[channel] == (int)value)
+		return;
+	e->last[channel] = value;
+	if (time != e->time) {
+		fprintf(e->out, "#%llu\n", (unsigned long long)time);
+		e->time = time;
+	}
+	fputc('b', e->out);
+	for (bit = ch->width - 1; bit >= 0; bit--)
+		fputc(value & (1 << bit) ? '1' : '0', e->out);
+	fprintf(e->out, " %c\n", '!' + channel);
+}
+
+int capture_export_vcd(const struct capture_file *f, FILE *out) {
+	const struct capture_header *h = f->header;
+	struct capture_export e = { f, out, UINT64_MAX };
+	time_t start = h->start_ns / 1000000000ULL;
+	unsigned int i;
+
+	fprintf(out, "$date %s$end\n", ctime(&start));
+	fprintf(out, "$version novena-gpbb capture, FPGA %04x.%04x $end\n",
+		h->fpga_minor, h->fpga_major);
+	fprintf(out, "$timescale 1ns $end\n$scope module gpbb $end\n");
+	for (i = 0; i < h->channel_count; i++) {
+		fprintf(out, "$var wire %d %c %s $end\n", h->channels[i].width, '!' + i,
+			h->channels[i].name);
+		e.last[i] = -1;
+	}
+	fprintf(out, "$upscope $end\n$enddefinitions $end\n");
+	return capture_merge(f, capture_vcd_change, &e);
+}
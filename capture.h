@@ -0,0 +1,122 @@
+#ifndef __CAPTURE_H__
+#define __CAPTURE_H__
+
+///
+// Binary capture files.
+//
+// A capture is a 4096-byte header followed by chunks, each an 8-byte
+// aligned struct capture_chunk and its payload.  Everything is stored in
+// the CPU's (little-endian) byte order with fixed-width fields, so a
+// reader mmap()s the file and walks it with pointer arithmetic; nothing is
+// parsed or copied.
+//
+// ADC chunks hold 10-bit samples in a planar packing: the low bytes of
+// all samples, then their top two bits four to a byte (sample i in bits
+// 2*(i%4) of byte i/4).  Sample counts are padded to a multiple of 16 so
+// both halves pack and unpack with whole vectors; count gives the real
+// number.  Digital chunks hold the port value at each change, the first
+// one at offset 0.
+///
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#define CAPTURE_MAGIC         "GPBBCAP1"
+#define CAPTURE_HEADER_SIZE   4096
+#define CAPTURE_MAX_CHANNELS  16
+
+enum capture_kind {
+	CAPTURE_ADC10   = 1,  // ADC108S022 channel, packed 10-bit samples
+	CAPTURE_DIGITAL = 2,  // 8-bit port, stored as transitions
+};
+
+struct capture_channel {
+	uint8_t kind;         // enum capture_kind
+	uint8_t source;       // ADC channel, or 0 for the input port
+	uint8_t width;        // bits per sample
+	uint8_t pad;
+	uint32_t failed;      // ADC: conversions that failed, stored as code 0
+	char name[24];
+};
+
+struct capture_header {
+	char magic[8];
+	uint32_t header_size;
+	uint32_t chunk_align;
+	uint16_t fpga_major;  // FPGA_R_V_MAJOR / FPGA_R_V_MINOR at capture time,
+	                      // printed minor.major as -v does
+	uint16_t fpga_minor;
+	uint32_t channel_count;
+	uint64_t start_ns;    // CLOCK_REALTIME of sample 0
+	uint64_t period_ns;   // one sample per channel per period
+	uint64_t samples;     // per channel, filled in when the capture closes
+	uint64_t chunks;
+	struct capture_channel channels[CAPTURE_MAX_CHANNELS];
+};
+
+struct capture_chunk {
+	uint32_t channel;     // index into the header's channels
+	uint32_t count;       // ADC: samples; digital: transitions
+	uint64_t first;       // sample index of the first sample / offset base
+	uint64_t bytes;       // payload size, a multiple of 8
+};
+
+struct capture_transition {
+	uint16_t offset;      // samples after the chunk's first
+	uint8_t value;
+	uint8_t changed;      // bits that differ from the previous value
+};
+
+#define CAPTURE_DIGITAL_MAX  65536  // samples per digital chunk
+
+#define CAPTURE_PACKED_BYTES(n)  ((((n) + 15) & ~(size_t)15) * 10 / 8)
+
+// 10-bit planar pack/unpack of n samples (n a multiple of 16)
+void capture_pack10(const uint16_t *x, size_t n, uint8_t *out);
+void capture_unpack10(const uint8_t *packed, size_t n, uint16_t *out);
+
+
+struct capture_writer {
+	int fd;
+	struct capture_header header;
+	uint8_t *scratch;
+	size_t scratch_size;
+};
+
+struct capture_writer *capture_create(const char *path, const struct capture_channel *channels,
+				      int count, uint64_t period_ns,
+				      uint16_t fpga_major, uint16_t fpga_minor);
+int capture_write_adc(struct capture_writer *w, int channel, uint64_t first,
+		      const uint16_t *x, size_t n);
+int capture_write_digital(struct capture_writer *w, int channel, uint64_t first,
+			  const uint8_t *x, size_t n);
+int capture_close(struct capture_writer *w, uint64_t samples);
+
+static inline void capture_failed(struct capture_writer *w, int channel) {
+	w->header.channels[channel].failed++;
+}
+
+
+struct capture_file {
+	const struct capture_header *header;
+	const uint8_t *map;
+	size_t size;
+};
+
+int capture_map(const char *path, struct capture_file *f);
+void capture_unmap(struct capture_file *f);
+// NULL at the end of the file or at a truncated chunk
+const struct capture_chunk *capture_first(const struct capture_file *f);
+const struct capture_chunk *capture_next(const struct capture_file *f,
+					 const struct capture_chunk *c);
+
+static inline const void *capture_payload(const struct capture_chunk *c) {
+	return c + 1;
+}
+
+void capture_info(const struct capture_file *f, FILE *out);
+int capture_export_csv(const struct capture_file *f, FILE *out);
+int capture_export_vcd(const struct capture_file *f, FILE *out);
+
+#endif /* __CAPTURE_H__ */
@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "control.h"
+#include "adc108s022.h"
+#include "dac101c085.h"
+#include "rt.h"
+#include "stats.h"
+
+double control_ema_filter(void *ctx, double sample) {
+	struct control_ema *ema = ctx;
+
+	if (!ema->primed) {
+		ema->state = sample;
+		ema->primed = 1;
+	}
+	else {
+		ema->state += ema->alpha * (sample - ema->state);
+	}
+	return ema->state;
+}
+
+static int control_write_trace(struct control_config *cfg,
+			       struct control_record *recs, int n) {
+	struct {
+		char magic[8];
+		uint32_t record_size;
+		uint32_t period_us;
+	} hdr;
+	int fd;
+
+	fd = open(cfg->trace_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror("Unable to open control trace");
+		return -1;
+	}
+	memcpy(hdr.magic, CONTROL_TRACE_MAGIC, 8);
+	hdr.record_size = sizeof(struct control_record);
+	hdr.period_us = cfg->period_us;
+	if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr)
+	    || write(fd, recs, n * sizeof(*recs)) != (ssize_t)(n * sizeof(*recs))) {
+		perror("Unable to write control trace");
+		close(fd);
+		return -1;
+	}
+	close(fd);
+	return 0;
+}
+
+int control_run(struct control_config *cfg) {
+	struct control_record *recs, *rec;
+	struct rt_hist lateness, latency, interval;
+	struct rt_period period;
+	double dt = cfg->period_us / 1e6;
+	double integral = 0, prev_meas = 0;
+	double meas, error, deriv, out, unclamped;
+	unsigned int code, pending = 0;
+	uint64_t start, prev_start = 0;
+	int have_pending = 0, have_meas = 0;
+	int gap = 1;            // periods since prev_meas
+	int failed = 0;
+	int chan, sample, i;
+
+	recs = calloc(cfg->iterations, sizeof(*recs));
+	if (!recs) {
+		perror("Unable to allocate control trace");
+		return -1;
+	}
+	rt_prefault(recs, cfg->iterations * sizeof(*recs));
+	rt_hist_init(&lateness);
+	rt_hist_init(&latency);
+	rt_hist_init(&interval);
+
+	adc_chan(cfg->adc_channel);
+	rt_period_start(&period, cfg->period_us * 1000);
+
+	for (i = 0; i < cfg->iterations; i++) {
+		rec = &recs[i];
+		rec->lateness = rt_period_wait(&period);
+		start = stats_now();
+		rec->timestamp = start;
+
+		// previous output on I2C1 while this conversion runs behind I2C2
+		chan = adc_start();
+		if (have_pending)
+			dac_set(cfg->dac, pending);
+		sample = adc_finish(chan);
+
+		// no measurement, no update: the output holds and the PID state
+		// waits for the next good sample
+		if (sample < 0) {
+			failed++;
+			gap++;
+			rec->latency = stats_now() - start;
+			rec->adc = CONTROL_ADC_FAILED;
+			rec->dac = pending;
+			rec->filtered = prev_meas;
+			rec->error = i ? recs[i - 1].error : 0;
+			rec->integral = integral;
+			goto account;
+		}
+		rec->adc = sample;
+
+		meas = cfg->filter ? cfg->filter(cfg->filter_ctx, rec->adc) : rec->adc;
+		error = cfg->setpoint - meas;
+		// derivative on measurement: no kick when the setpoint moves
+		deriv = have_meas ? -(meas - prev_meas) / (dt * gap) : 0;
+		prev_meas = meas;
+		have_meas = 1;
+		gap = 1;
+
+		unclamped = cfg->kp * error + cfg->ki * (integral + error * dt) + cfg->kd * deriv;
+		out = unclamped;
+		if (out > cfg->out_max)
+			out = cfg->out_max;
+		if (out < cfg->out_min)
+			out = cfg->out_min;
+		// anti-windup: stop integrating while saturated, unless the error
+		// would pull the output back into range
+		if (out == unclamped || (unclamped > cfg->out_max && error < 0)
+		    || (unclamped < cfg->out_min && error > 0))
+			integral += error * dt;
+
+		code = (unsigned int)(out + 0.5);
+		pending = code;
+		have_pending = 1;
+
+		rec->latency = stats_now() - start;
+		rec->dac = code;
+		rec->filtered = meas;
+		rec->error = error;
+		rec->integral = integral;
+
+	account:
+		rt_hist_add(&lateness, rec->lateness);
+		rt_hist_add(&latency, rec->latency);
+		if (i)
+			rt_hist_add(&interval, start - prev_start);
+		prev_start = start;
+	}
+	if (have_pending)
+		dac_set(cfg->dac, pending);
+
+	rec = &recs[cfg->iterations - 1];
+	printf("PID: ADC channel %d -> DAC %c, %d iterations every %ld us (%s)\n",
+	       cfg->adc_channel, cfg->dac == DAC_A ? 'A' : 'B', cfg->iterations,
+	       cfg->period_us, rt_enabled ? "RT" : "normal");
+	printf("final: adc %d, filtered %.1f, error %.1f, dac %d\n",
+	       rec->adc, rec->filtered, rec->error, rec->dac);
+	if (failed)
+		printf("%d iterations skipped on a failed ADC read\n", failed);
+	rt_hist_print("wakeup lateness", &lateness);
+	rt_hist_print("loop latency", &latency);
+	rt_hist_print("period", &interval);
+
+	if (cfg->trace_path)
+		control_write_trace(cfg, recs, cfg->iterations);
+	free(recs);
+	return 0;
+}
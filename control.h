@@ -0,0 +1,64 @@
+#ifndef __CONTROL_H__
+#define __CONTROL_H__
+
+///
+// Closed-loop ADC -> DAC control.
+//
+// Every period the loop samples one ADC channel, passes the sample through
+// an optional filter, runs a PID on the filtered value and drives DAC A or
+// B with the clamped result.  The DAC write of one iteration is issued on
+// I2C1 while the next ADC conversion runs on I2C2, so each output goes out
+// at the start of the following period: a fixed one-period delay in
+// exchange for overlapping the two buses.
+///
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "dac101c085.h"
+
+// measurement filter: returns the value the PID sees
+typedef double (*control_filter)(void *ctx, double sample);
+
+struct control_config {
+	unsigned int adc_channel;
+	dacType dac;
+	double setpoint;        // ADC codes
+	double kp, ki, kd;      // per ADC code of error, ki/kd per second
+	double out_min;         // DAC codes
+	double out_max;
+	long period_us;
+	int iterations;
+	control_filter filter;  // NULL: raw samples
+	void *filter_ctx;
+	const char *trace_path; // NULL: no per-iteration trace
+};
+
+#define CONTROL_TRACE_MAGIC "GPBBPID1"
+#define CONTROL_ADC_FAILED  0xffff  // control_record.adc when the read failed
+
+// one per iteration in the trace file, after a 16-byte header
+// (magic, uint32 record size, uint32 period_us)
+struct control_record {
+	uint64_t timestamp;     // CLOCK_MONOTONIC ns at the start of the iteration
+	uint32_t lateness;      // ns past the deadline
+	uint32_t latency;       // ns from iteration start to output computed
+	uint16_t adc;           // CONTROL_ADC_FAILED: nothing below was updated
+	uint16_t dac;           // code computed this iteration, written at the next
+	float filtered;
+	float error;
+	float integral;
+};
+
+// first-order low pass; alpha 1 passes samples through
+struct control_ema {
+	double alpha;
+	double state;
+	int primed;
+};
+
+double control_ema_filter(void *ctx, double sample);
+
+int control_run(struct control_config *cfg);
+
+#endif /* __CONTROL_H__ */
@@ -6,12 +6,12 @@
 #include <string.h>
 
 #include <linux/i2c-dev.h>
-#include <sys/ioctl.h>
 
 #include "dac101c085.h"
-
-#define DAC101C085_A_I2C_ADR  (0x14 >> 1)
-#define DAC101C085_B_I2C_ADR  (0x12 >> 1)
+#include "i2c.h"
+#include "stats.h"
+#include "trace.h"
+#include "state.h"
 
 //#define DEBUG
 //#define DEBUG_STANDALONE   // add a main routine for stand-alone debug
@@ -33,37 +33,22 @@ void dump(void *buf, int count) {
 }
 #endif
 
+static int dac101c085_address( dacType dac ) {
+  if( dac == DAC_A )
+    return DAC101C085_A_I2C_ADR;
+  else if( dac == DAC_B )
+    return DAC101C085_B_I2C_ADR;
+  else
+    return -1;
+}
+
 int dac101c085_write_byte( unsigned short data, dacType dac ) {
-  int i2cfd;
   char i2cbuf[2]; 
-  int slave_address = -1;
+  int slave_address = dac101c085_address( dac );
 
   struct i2c_msg msg[2];
 		
-  struct i2c_ioctl_rdwr_data {
-    struct i2c_msg *msgs;  /* ptr to array of simple messages */              
-    int nmsgs;             /* number of messages to exchange */ 
-  } msgst;
-  
-  if( dac == DAC_A )
-    slave_address = DAC101C085_A_I2C_ADR;
-  else if( dac == DAC_B )
-    slave_address = DAC101C085_B_I2C_ADR;
-  else
-    slave_address = -1;
-  
-  i2cfd = open("/dev/i2c-1", O_RDWR);
-  if( i2cfd < 0 ) {
-    perror("Unable to open /dev/i2c-1\n");
-    i2cfd = 0;
-    return 1;
-  }
-  if( ioctl( i2cfd, I2C_SLAVE, slave_address) < 0 ) {
-    perror("Unable to set I2C slave device\n" );
-    printf( "Address: %02x\n", slave_address );
-    close( i2cfd );
-    return 1;
-  }
+  STATS_SCOPE(STATS_DAC_I2C_WRITE);
 
   i2cbuf[0] = ((data & 0xFF00) >> 8); i2cbuf[1] = (data & 0xFF);
   // set address for read
@@ -76,52 +61,73 @@ int dac101c085_write_byte( unsigned short data, dacType dac ) {
   dump(i2cbuf, 2);
 #endif
 
-  msgst.msgs = msg;	
-  msgst.nmsgs = 1;
-
-  if (ioctl(i2cfd, I2C_RDWR, &msgst) < 0){
-    perror("Transaction failed\n" );
-    close( i2cfd );
+  if( i2c_transfer(I2C_BUS_DAC, slave_address, msg, 1) < 0 )
     return -1;
-  }
 
-  close( i2cfd );
+  TRACE(TRACE_BUS_I2C1, TRACE_WRITE, 2, TRACE_I2C_ADDR(slave_address, 0), data);
   
   return 0;
 }
 
 
+// one transaction per burst words: the part takes consecutive data words
+// after its address and updates the output on each, so every code but the
+// first in a burst costs only its two data bytes on the bus.  The bytes
+// go out of one heap buffer sized for the burst, not a stack array: a
+// maximum burst is 8 KB, too much for the stack of a program that links
+// the library.
+int dac101c085_write_burst( const unsigned short *data, int count, int burst, dacType dac ) {
+  int slave_address = dac101c085_address( dac );
+  struct i2c_msg msg;
+  __u8 *i2cbuf;
+  int done, n, i;
+
+  if( burst <= 0 )
+    burst = DAC101C085_BURST_WORDS;
+  if( burst > DAC101C085_BURST_MAX )
+    burst = DAC101C085_BURST_MAX;
+  if( burst > count )
+    burst = count;
+  if( count <= 0 )
+    return 0;
+
+  i2cbuf = malloc(burst * 2);
+  if( !i2cbuf )
+    return -1;
+
+  for( done = 0; done < count; done += n ) {
+    STATS_SCOPE(STATS_DAC_I2C_BURST);
+
+    n = count - done < burst ? count - done : burst;
+    for( i = 0; i < n; i++ ) {
+      i2cbuf[i * 2] = data[done + i] >> 8;
+      i2cbuf[i * 2 + 1] = data[done + i] & 0xFF;
+    }
+    msg.addr = slave_address;
+    msg.flags = 0;
+    msg.len = n * 2;
+    msg.buf = i2cbuf;
+
+    if( i2c_transfer(I2C_BUS_DAC, slave_address, &msg, 1) < 0 )
+      break;
+
+    for( i = 0; i < n; i++ )
+      TRACE(TRACE_BUS_I2C1, TRACE_WRITE, 2, TRACE_I2C_ADDR(slave_address, 0), data[done + i]);
+  }
+  free(i2cbuf);
+  // the last code that reached the DAC, also when a burst failed
+  if( done > 0 )
+    STATE(state_set_dac(dac, data[done - 1]));
+  return done ? done : -1;
+}
+
+
 int dac101c085_read_byte( unsigned short *data, dacType dac ) {
-  int i2cfd;
-  int slave_address = -1;
-  unsigned char buff[2];
+  int slave_address = dac101c085_address( dac );
 
   struct i2c_msg msg[2];
 		
-  struct i2c_ioctl_rdwr_data {
-    struct i2c_msg *msgs;  /* ptr to array of simple messages */              
-    int nmsgs;             /* number of messages to exchange */ 
-  } msgst;
-  
-  if( dac == DAC_A )
-    slave_address = DAC101C085_A_I2C_ADR;
-  else if( dac == DAC_B )
-    slave_address = DAC101C085_B_I2C_ADR;
-  else
-    slave_address = -1;
-  
-  i2cfd = open("/dev/i2c-1", O_RDWR);
-  if( i2cfd < 0 ) {
-    perror("Unable to open /dev/i2c-1\n");
-    i2cfd = 0;
-    return -1;
-  }
-  if( ioctl( i2cfd, I2C_SLAVE, slave_address) < 0 ) {
-    perror("Unable to set I2C slave device\n" );
-    printf( "Address: %02x\n", slave_address );
-    close( i2cfd );
-    return -1;
-  }
+  STATS_SCOPE(STATS_DAC_I2C_READ);
 
   // set readback buffer
   msg[0].addr = slave_address;
@@ -130,16 +136,10 @@ int dac101c085_read_byte( unsigned short *data, dacType dac ) {
   msg[0].len = 2;
   msg[0].buf = (char *) data;
 
-  msgst.msgs = msg;	
-  msgst.nmsgs = 1;
-
-  if (ioctl(i2cfd, I2C_RDWR, &msgst) < 0){
-    perror("Transaction failed\n" );
-    close( i2cfd );
+  if( i2c_transfer(I2C_BUS_DAC, slave_address, msg, 1) < 0 )
     return -1;
-  }
 
-  close( i2cfd );
+  TRACE(TRACE_BUS_I2C1, TRACE_READ, 2, TRACE_I2C_ADDR(slave_address, 0), *data);
   
   return 0;
 }
@@ -150,7 +150,8 @@ void dac_a_set(unsigned int code) {
     code = 0xFFF;
   }
   
-  dac101c085_write_byte( (unsigned short) (code & 0xFFFF), DAC_A );
+  if( dac101c085_write_byte( (unsigned short) (code & 0xFFFF), DAC_A ) == 0 )
+    STATE(state_set_dac(DAC_A, code));
 
 #ifdef DEBUG
   unsigned short data;
@@ -166,7 +167,8 @@ void dac_b_set(unsigned int code) {
     code = 0xFFF;
   }
   
-  dac101c085_write_byte( (unsigned short) (code & 0xFFFF), DAC_B );
+  if( dac101c085_write_byte( (unsigned short) (code & 0xFFFF), DAC_B ) == 0 )
+    STATE(state_set_dac(DAC_B, code));
 
 #ifdef DEBUG
   unsigned short data;
@@ -176,6 +178,14 @@ void dac_b_set(unsigned int code) {
 
 }
 
+// 10-bit code to DAC A or B; the implementation sends 2 dummy bits, as for -da/-db
+void dac_set(dacType dac, unsigned int code) {
+  if( dac == DAC_A )
+    dac_a_set(code << 2);
+  else
+    dac_b_set(code << 2);
+}
+
 
 #ifdef DEBUG_STANDALONE
 int main() {
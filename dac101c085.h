@@ -1,5 +1,28 @@
+#ifndef __DAC101C085_H__
+#define __DAC101C085_H__
+
 void dac_a_set(unsigned int code);
 void dac_b_set(unsigned int code);
 
 enum DACenum { DAC_B = 1, DAC_A = 0 };
 typedef enum DACenum dacType;
+
+// code 0-1023, shifted past the two dummy LSBs
+void dac_set(dacType dac, unsigned int code);
+
+#define DAC101C085_A_I2C_ADR  (0x14 >> 1)
+#define DAC101C085_B_I2C_ADR  (0x12 >> 1)
+
+int dac101c085_write_byte( unsigned short data, dacType dac );
+int dac101c085_read_byte( unsigned short *data, dacType dac );
+
+// words per burst transaction by default, and at most: i2c-dev refuses
+// messages over 8192 bytes
+#define DAC101C085_BURST_WORDS  256
+#define DAC101C085_BURST_MAX    4096
+
+// count words, burst (0 for the default) to an I2C write; returns the
+// number written, or -1 if the first transaction failed
+int dac101c085_write_burst( const unsigned short *data, int count, int burst, dacType dac );
+
+#endif /* __DAC101C085_H__ */
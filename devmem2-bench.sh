@@ -0,0 +1,26 @@
+#!/bin/sh
+# time N register reads as N devmem2 invocations vs. one devmem2 -b batch
+addr=${1:-0x08041FFE}   # FPGA_R_V_MAJOR
+count=${2:-1000}
+
+echo "$count reads of $addr, one devmem2 process each"
+start=$(date +%s%N)
+i=0
+while [ $i -lt $count ]
+do
+        ./devmem2 $addr h > /dev/null
+        i=$((i+1))
+done
+end=$(date +%s%N)
+echo "  $(( (end - start) / count )) ns/op"
+
+echo "$count reads of $addr, devmem2 -b"
+start=$(date +%s%N)
+i=0
+while [ $i -lt $count ]
+do
+        echo "r $addr h"
+        i=$((i+1))
+done | ./devmem2 -b > /dev/null
+end=$(date +%s%N)
+echo "  $(( (end - start) / count )) ns/op"
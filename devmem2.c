@@ -55,6 +55,144 @@
 #define MAP_SIZE 4096UL
 #define MAP_MASK (MAP_SIZE - 1)
 
+/*
+ * Batch mode: many operations through one /dev/mem descriptor, with the
+ * pages they touch kept mapped between operations.
+ */
+#define BATCH_MAPS 16
+
+struct batch_map {
+	off_t page;
+	void *base;
+};
+
+static struct batch_map batch_maps[BATCH_MAPS];
+static int batch_nmaps;
+static int batch_next;
+
+static void *batch_addr(int fd, off_t target) {
+	off_t page = target & ~MAP_MASK;
+	struct batch_map *m;
+	int i;
+
+	for(i = 0; i < batch_nmaps; i++)
+		if(batch_maps[i].page == page)
+			return batch_maps[i].base + (target & MAP_MASK);
+
+	/* cache full: evict round-robin */
+	if(batch_nmaps < BATCH_MAPS)
+		m = &batch_maps[batch_nmaps++];
+	else {
+		m = &batch_maps[batch_next];
+		batch_next = (batch_next + 1) % BATCH_MAPS;
+		if(munmap(m->base, MAP_SIZE) == -1) FATAL;
+	}
+
+	m->base = mmap(0, MAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, page);
+	if(m->base == (void *) -1) FATAL;
+	m->page = page;
+	return m->base + (target & MAP_MASK);
+}
+
+static unsigned long batch_read(void *addr, int type) {
+	switch(type) {
+		case 'b': return *((volatile unsigned char *) addr);
+		case 'h': return *((volatile unsigned short *) addr);
+		default:  return *((volatile unsigned int *) addr);
+	}
+}
+
+static void batch_write(void *addr, int type, unsigned long value) {
+	switch(type) {
+		case 'b': *((volatile unsigned char *) addr) = value; break;
+		case 'h': *((volatile unsigned short *) addr) = value; break;
+		default:  *((volatile unsigned int *) addr) = value; break;
+	}
+}
+
+/*
+ * One operation, fields separated by blanks or ':'
+ *	r address [type]
+ *	w address value [type]
+ *	m address value mask [type]	(read-modify-write of the bits in mask)
+ * Prints one line: address, type, value read, and value written if any.
+ */
+static int batch_op(int fd, char *line) {
+	char *field[5];
+	int nfields = 0;
+	char *tok;
+	int op, type = 'w';
+	int nargs;
+	off_t target;
+	void *addr;
+	unsigned long old, value = 0, mask = ~0UL;
+
+	for(tok = strtok(line, " \t:\r\n"); tok && nfields < 5;
+	    tok = strtok(NULL, " \t:\r\n"))
+		field[nfields++] = tok;
+	if(nfields == 0 || field[0][0] == '#')
+		return 0;
+
+	op = tolower(field[0][0]);
+	nargs = (op == 'r') ? 2 : (op == 'w') ? 3 : (op == 'm') ? 4 : 0;
+	if(!nargs || nfields < nargs) {
+		fprintf(stderr, "Bad operation '%s'\n", field[0]);
+		return -1;
+	}
+	if(nfields > nargs)
+		type = tolower(field[nargs][0]);
+	if(type != 'b' && type != 'h' && type != 'w') {
+		fprintf(stderr, "Illegal data type '%c'.\n", type);
+		return -1;
+	}
+
+	target = strtoul(field[1], 0, 0);
+	addr = batch_addr(fd, target);
+	old = batch_read(addr, type);
+
+	if(op == 'r') {
+		printf("0x%08lX %c 0x%lX\n", (unsigned long) target, type, old);
+		return 0;
+	}
+
+	value = strtoul(field[2], 0, 0);
+	if(op == 'm') {
+		mask = strtoul(field[3], 0, 0);
+		value = (old & ~mask) | (value & mask);
+	}
+	batch_write(addr, type, value);
+	printf("0x%08lX %c 0x%lX -> 0x%lX\n", (unsigned long) target, type, old, value);
+	return 0;
+}
+
+static int batch_main(int argc, char **argv) {
+	char line[256];
+	int fd;
+	int ret = 0;
+	int i;
+
+	if((fd = open("/dev/mem", O_RDWR | O_SYNC)) == -1) FATAL;
+
+	if(argc > 0) {
+		for(i = 0; i < argc; i++) {
+			strncpy(line, argv[i], sizeof(line) - 1);
+			line[sizeof(line) - 1] = '\0';
+			if(batch_op(fd, line))
+				ret = 2;
+		}
+	}
+	else {
+		while(fgets(line, sizeof(line), stdin))
+			if(batch_op(fd, line))
+				ret = 2;
+	}
+
+	for(i = 0; i < batch_nmaps; i++)
+		munmap(batch_maps[i].base, MAP_SIZE);
+	close(fd);
+	return ret;
+}
+
 int main(int argc, char **argv) {
     int fd;
     void *map_base, *virt_addr; 
@@ -66,10 +204,19 @@ int main(int argc, char **argv) {
 		fprintf(stderr, "\nUsage:\t%s { address } [ type [ data ] ]\n"
 			"\taddress : memory address to act upon\n"
 			"\ttype    : access operation type : [b]yte, [h]alfword, [w]ord\n"
-			"\tdata    : data to be written\n\n",
-			argv[0]);
+			"\tdata    : data to be written\n\n"
+			"\t%s -b [ op ... ]\n"
+			"\tbatch mode, ops from the arguments or one per line on stdin:\n"
+			"\t  r address [type]\n"
+			"\t  w address data [type]\n"
+			"\t  m address data mask [type]  (read-modify-write)\n"
+			"\tfields may also be separated by ':', e.g. w:0x20c8160:0xd2b\n\n",
+			argv[0], argv[0]);
 		exit(1);
 	}
+
+	if(!strcmp(argv[1], "-b"))
+		return batch_main(argc - 2, argv + 2);
 	target = strtoul(argv[1], 0, 0);
 
 	if(argc > 2)
@@ -11,6 +11,11 @@
 
 #include "gpio.h"
 #include "eim.h"
+#include "stats.h"
+#include "trace.h"
+#include "sim.h"
+#include "state.h"
+#include "uio.h"
 
 #define EIM_BASE (0x08040000)
 #define EIM_DOUT (0x0010)
@@ -22,15 +27,16 @@ static short *mem_16 = 0;
 static char  *mem_8  = 0;
 static int   *prev_mem_range = 0;
 
-uint8_t cached_dout = 0;
-uint8_t cached_dir = 0;
+uint16_t cached_dout = 0;
+uint16_t cached_dir = 0;
 
 static int read_kernel_memory(long offset, int virtualized, int size) {
 	int result;
 	static int mem_fd;
+	STATS_SCOPE(STATS_KMEM_READ);
 
 	int *mem_range = (int *)(offset & ~0xFFFF);
-	if( mem_range != prev_mem_range ) {
+	if( !sim_enabled && mem_range != prev_mem_range ) {
 		prev_mem_range = mem_range;
 
 		if(mem_32)
@@ -70,25 +76,37 @@ static int read_kernel_memory(long offset, int virtualized, int size) {
 	}
 
 	int scaled_offset = (offset-(offset&~0xFFFF));
-	if(size==1)
+	if( sim_enabled ) {
+		result = sim_mem_read(offset, size);
+		if(size==1)
+			result = (char) result;
+		else if(size==2)
+			result = (short) result;
+	}
+	else if(size==1)
 		result = mem_8[scaled_offset/sizeof(char)];
 	else if(size==2)
 		result = mem_16[scaled_offset/sizeof(short)];
 	else
 		result = mem_32[scaled_offset/sizeof(long)];
 
+	TRACE(TRACE_BUS_MEM, TRACE_READ, size, offset, result);
 	return result;
 }
 
 static int write_kernel_memory(long offset, long value, int virtualized, int size) {
+	STATS_SCOPE(STATS_KMEM_WRITE);
 	int old_value = read_kernel_memory(offset, virtualized, size);
 	int scaled_offset = (offset-(offset&~0xFFFF));
-	if(size==1)
+	if( sim_enabled )
+		sim_mem_write(offset, size, value);
+	else if(size==1)
 		mem_8[scaled_offset/sizeof(char)]   = value;
 	else if(size==2)
 		mem_16[scaled_offset/sizeof(short)] = value;
 	else
 		mem_32[scaled_offset/sizeof(long)]  = value;
+	TRACE(TRACE_BUS_MEM, TRACE_WRITE, size, offset, value);
 	return old_value;
 }
 
@@ -229,8 +247,25 @@ uint16_t *eim_get(enum eim_type type) {
 	if (mem)
 		return ((uint16_t *) (((uint8_t *)mem)+type));
 
+	if (uio_active) {
+		// the UIO driver has already set the EIM up
+		mem = (uint16_t *)uio_reg(EIM_BASE, 2);
+		if (!mem) {
+			fprintf(stderr, "UIO device has no map covering the EIM\n");
+			return NULL;
+		}
+		return eim_get(type);
+	}
+
 	prep_eim();
 
+	if (sim_enabled) {
+		// only ever handed to eim_load()/eim_store(), which go to the model
+		static uint16_t sim_window[0x1000];
+		mem = sim_window;
+		return eim_get(type);
+	}
+
 	fd = open("/dev/mem", O_RDWR);
 	if (fd == -1) {
 		perror("Couldn't open /dev/mem");
@@ -246,7 +281,27 @@ uint16_t *eim_get(enum eim_type type) {
 	return eim_get(type);
 }
 
+static uint16_t eim_load(uint16_t *mem, enum eim_type type) {
+	if (sim_enabled)
+		return sim_mem_read(EIM_BASE + type, 2);
+	return *mem;
+}
+
+static void eim_store(uint16_t *mem, enum eim_type type, uint16_t value) {
+	if (sim_enabled)
+		sim_mem_write(EIM_BASE + type, 2, value);
+	else
+		*mem = value;
+
+	// EIM_DOUT/EIM_DIR are the GPBB port and control registers
+	if (type == fpga_w_gpioa_dout)
+		STATE(state_set_port(value));
+	else if (type == fpga_w_gpioa_dir)
+		STATE(state_set_ctl(value));
+}
+
 int eim_set_direction(int gpio, int is_output) {
+	STATS_SCOPE(STATS_EIM_WRITE);
 	uint16_t *mem = eim_get(fpga_w_gpioa_dir);
 	if (!mem)
 		return -1;
@@ -257,12 +312,14 @@ int eim_set_direction(int gpio, int is_output) {
 		// Clear direction
 		cached_dir &= ~(1<<gpio);
 
-	*mem = cached_dir;
+	eim_store(mem, fpga_w_gpioa_dir, cached_dir);
+	TRACE(TRACE_BUS_MEM, TRACE_WRITE, 2, EIM_BASE + EIM_DIR, cached_dir);
 	return 0;
 }
 
 
 int eim_set_value(int gpio, int value) {
+	STATS_SCOPE(STATS_EIM_WRITE);
 	uint16_t *mem = eim_get(fpga_w_gpioa_dout);
 	if (!mem)
 		return -1;
@@ -271,15 +328,56 @@ int eim_set_value(int gpio, int value) {
 		cached_dout |= (1<<gpio);
 	else
 		cached_dout &= ~(1<<gpio);
-	*mem = cached_dout;
+	eim_store(mem, fpga_w_gpioa_dout, cached_dout);
+	TRACE(TRACE_BUS_MEM, TRACE_WRITE, 2, EIM_BASE + EIM_DOUT, cached_dout);
 	return 0;
 }
 
 int eim_get_value(int gpio) {
+	STATS_SCOPE(STATS_EIM_READ);
 	uint16_t *mem = eim_get(fpga_r_gpioa_din);
+	uint16_t din;
 	if (!mem)
 		return -1;
 	gpio &= ~GPIO_IS_EIM;
-	return (*mem >> gpio)&1;
+	din = eim_load(mem, fpga_r_gpioa_din);
+	TRACE(TRACE_BUS_MEM, TRACE_READ, 2, EIM_BASE + EIM_DIN, din);
+	return (din >> gpio)&1;
+}
+
+
+/*
+ * Whole-bank variants: every bit in mask is updated with a single 16-bit
+ * store, rather than one store per pin.
+ */
+int eim_set_direction_bits(uint16_t mask, uint16_t is_output) {
+	STATS_SCOPE(STATS_EIM_WRITE);
+	uint16_t *mem = eim_get(fpga_w_gpioa_dir);
+	if (!mem)
+		return -1;
+	cached_dir = (cached_dir & ~mask) | (is_output & mask);
+	eim_store(mem, fpga_w_gpioa_dir, cached_dir);
+	TRACE(TRACE_BUS_MEM, TRACE_WRITE, 2, EIM_BASE + EIM_DIR, cached_dir);
+	return 0;
 }
 
+int eim_set_bits(uint16_t mask, uint16_t values) {
+	STATS_SCOPE(STATS_EIM_WRITE);
+	uint16_t *mem = eim_get(fpga_w_gpioa_dout);
+	if (!mem)
+		return -1;
+	cached_dout = (cached_dout & ~mask) | (values & mask);
+	eim_store(mem, fpga_w_gpioa_dout, cached_dout);
+	TRACE(TRACE_BUS_MEM, TRACE_WRITE, 2, EIM_BASE + EIM_DOUT, cached_dout);
+	return 0;
+}
+
+int eim_get_bits(uint16_t *values) {
+	STATS_SCOPE(STATS_EIM_READ);
+	uint16_t *mem = eim_get(fpga_r_gpioa_din);
+	if (!mem)
+		return -1;
+	*values = eim_load(mem, fpga_r_gpioa_din);
+	TRACE(TRACE_BUS_MEM, TRACE_READ, 2, EIM_BASE + EIM_DIN, *values);
+	return 0;
+}
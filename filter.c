@@ -0,0 +1,626 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+# include <immintrin.h>
+# if defined(__x86_64__) || defined(__SSE2__)
+#  define FILTER_X86 1
+# endif
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+# include <arm_neon.h>
+# define FILTER_NEON 1
+#endif
+
+#include "filter.h"
+#include "stats.h"
+
+#define ADC108S022_MAX_SPS  200000  // the converter's rating, 50-200 ksps
+
+/*
+ * Kernels.  All implementations compute exactly the same integers; the
+ * dot product works on samples biased by -32768 so that the SIMD versions
+ * can use signed 16-bit multiplies, and the caller adds the bias back.
+ */
+struct filter_kernels {
+	const char *name;
+	void (*stats)(const uint16_t *x, size_t n, uint16_t *min, uint16_t *max,
+		      uint64_t *sum, uint64_t *sumsq);
+	uint64_t (*sum)(const uint16_t *x, size_t n);
+	int64_t (*dot_biased)(const uint16_t *x, const int16_t *h, size_t n);
+};
+
+static void stats_scalar(const uint16_t *x, size_t n, uint16_t *min, uint16_t *max,
+			 uint64_t *sum, uint64_t *sumsq) {
+	uint16_t lo = 0xffff, hi = 0;
+	uint64_t s = 0, sq = 0;
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		if (x[i] < lo)
+			lo = x[i];
+		if (x[i] > hi)
+			hi = x[i];
+		s += x[i];
+		sq += (uint32_t)x[i] * x[i];
+	}
+	*min = lo;
+	*max = hi;
+	*sum = s;
+	*sumsq = sq;
+}
+
+static uint64_t sum_scalar(const uint16_t *x, size_t n) {
+	uint64_t s = 0;
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		s += x[i];
+	return s;
+}
+
+static int64_t dot_biased_scalar(const uint16_t *x, const int16_t *h, size_t n) {
+	int64_t s = 0;
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		s += (int32_t)h[i] * ((int32_t)x[i] - 32768);
+	return s;
+}
+
+static const struct filter_kernels kernels_scalar = {
+	"scalar", stats_scalar, sum_scalar, dot_biased_scalar,
+};
+
+// merge a vector part's results with the scalar tail
+static void stats_tail(const uint16_t *x, size_t n, size_t done, uint16_t *min,
+		       uint16_t *max, uint64_t *sum, uint64_t *sumsq) {
+	uint16_t lo, hi;
+	uint64_t s, sq;
+
+	if (done == n)
+		return;
+	stats_scalar(x + done, n - done, &lo, &hi, &s, &sq);
+	if (!done || lo < *min)
+		*min = lo;
+	if (!done || hi > *max)
+		*max = hi;
+	*sum = (done ? *sum : 0) + s;
+	*sumsq = (done ? *sumsq : 0) + sq;
+}
+
+
+#ifdef FILTER_X86
+/*
+ * SSE2 has no unsigned 16-bit min/max or multiply-add, so samples are
+ * biased into signed range: y = x - 32768.  Then
+ *   sum(x^2) = sum(y^2) + 65536 sum(x) - n 2^30
+ * and madd(y, y) cannot overflow an unsigned 32-bit lane.
+ */
+#define CHUNK 4096  // vectors per 32-bit partial sum
+
+static void stats_sse2(const uint16_t *x, size_t n, uint16_t *min, uint16_t *max,
+		       uint64_t *sum, uint64_t *sumsq) {
+	const __m128i bias = _mm_set1_epi16(-32768), zero = _mm_setzero_si128();
+	__m128i vmin = _mm_set1_epi16(32767), vmax = _mm_set1_epi16(-32768);
+	__m128i sq64 = zero, sum64 = zero;
+	uint64_t lanes[2];
+	int16_t m[8];
+	size_t nv = n & ~(size_t)7, i = 0, end;
+	int k;
+
+	while (i < nv) {
+		__m128i acc = zero;
+
+		end = i + CHUNK * 8 < nv ? i + CHUNK * 8 : nv;
+		for (; i < end; i += 8) {
+			__m128i v = _mm_loadu_si128((const __m128i *)(x + i));
+			__m128i y = _mm_xor_si128(v, bias);
+			__m128i sq = _mm_madd_epi16(y, y);
+
+			vmin = _mm_min_epi16(vmin, y);
+			vmax = _mm_max_epi16(vmax, y);
+			sq64 = _mm_add_epi64(sq64, _mm_unpacklo_epi32(sq, zero));
+			sq64 = _mm_add_epi64(sq64, _mm_unpackhi_epi32(sq, zero));
+			acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(v, zero));
+			acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(v, zero));
+		}
+		sum64 = _mm_add_epi64(sum64, _mm_unpacklo_epi32(acc, zero));
+		sum64 = _mm_add_epi64(sum64, _mm_unpackhi_epi32(acc, zero));
+	}
+
+	if (nv) {
+		_mm_storeu_si128((__m128i *)lanes, sum64);
+		*sum = lanes[0] + lanes[1];
+		_mm_storeu_si128((__m128i *)lanes, sq64);
+		*sumsq = lanes[0] + lanes[1] + (*sum << 16) - ((uint64_t)nv << 30);
+		_mm_storeu_si128((__m128i *)m, vmin);
+		*min = 0xffff;
+		for (k = 0; k < 8; k++)
+			if ((uint16_t)(m[k] ^ 0x8000) < *min)
+				*min = m[k] ^ 0x8000;
+		_mm_storeu_si128((__m128i *)m, vmax);
+		*max = 0;
+		for (k = 0; k < 8; k++)
+			if ((uint16_t)(m[k] ^ 0x8000) > *max)
+				*max = m[k] ^ 0x8000;
+	}
+	stats_tail(x, n, nv, min, max, sum, sumsq);
+}
+
+// sum of 16-bit words as low bytes + 256 * high bytes, via psadbw
+static uint64_t sum_sse2(const uint16_t *x, size_t n) {
+	const __m128i lomask = _mm_set1_epi16(0x00ff), zero = _mm_setzero_si128();
+	__m128i lo = zero, hi = zero;
+	uint64_t l[2], h[2];
+	size_t nv = n & ~(size_t)7, i;
+
+	for (i = 0; i < nv; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(x + i));
+
+		lo = _mm_add_epi64(lo, _mm_sad_epu8(_mm_and_si128(v, lomask), zero));
+		hi = _mm_add_epi64(hi, _mm_sad_epu8(_mm_srli_epi16(v, 8), zero));
+	}
+	_mm_storeu_si128((__m128i *)l, lo);
+	_mm_storeu_si128((__m128i *)h, hi);
+	return l[0] + l[1] + ((h[0] + h[1]) << 8) + sum_scalar(x + nv, n - nv);
+}
+
+static int64_t dot_biased_sse2(const uint16_t *x, const int16_t *h, size_t n) {
+	const __m128i bias = _mm_set1_epi16(-32768);
+	__m128i acc = _mm_setzero_si128();
+	int64_t lanes[2];
+	size_t nv = n & ~(size_t)7, i;
+
+	for (i = 0; i < nv; i += 8) {
+		__m128i y = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(x + i)), bias);
+		__m128i p = _mm_madd_epi16(y, _mm_loadu_si128((const __m128i *)(h + i)));
+		__m128i sign = _mm_srai_epi32(p, 31);
+
+		acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(p, sign));
+		acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(p, sign));
+	}
+	_mm_storeu_si128((__m128i *)lanes, acc);
+	return lanes[0] + lanes[1] + dot_biased_scalar(x + nv, h + nv, n - nv);
+}
+
+static const struct filter_kernels kernels_sse2 = {
+	"sse2", stats_sse2, sum_sse2, dot_biased_sse2,
+};
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static void stats_avx2(const uint16_t *x, size_t n, uint16_t *min, uint16_t *max,
+			    uint64_t *sum, uint64_t *sumsq) {
+	const __m256i bias = _mm256_set1_epi16(-32768), zero = _mm256_setzero_si256();
+	__m256i vmin = _mm256_set1_epi16(-1), vmax = zero;
+	__m256i sq64 = zero, sum64 = zero;
+	uint64_t lanes[4];
+	uint16_t m[16];
+	size_t nv = n & ~(size_t)15, i = 0, end;
+	int k;
+
+	while (i < nv) {
+		__m256i acc = zero;
+
+		end = i + CHUNK * 16 < nv ? i + CHUNK * 16 : nv;
+		for (; i < end; i += 16) {
+			__m256i v = _mm256_loadu_si256((const __m256i *)(x + i));
+			__m256i y = _mm256_xor_si256(v, bias);
+			__m256i sq = _mm256_madd_epi16(y, y);
+
+			vmin = _mm256_min_epu16(vmin, v);
+			vmax = _mm256_max_epu16(vmax, v);
+			sq64 = _mm256_add_epi64(sq64, _mm256_unpacklo_epi32(sq, zero));
+			sq64 = _mm256_add_epi64(sq64, _mm256_unpackhi_epi32(sq, zero));
+			acc = _mm256_add_epi32(acc, _mm256_unpacklo_epi16(v, zero));
+			acc = _mm256_add_epi32(acc, _mm256_unpackhi_epi16(v, zero));
+		}
+		sum64 = _mm256_add_epi64(sum64, _mm256_unpacklo_epi32(acc, zero));
+		sum64 = _mm256_add_epi64(sum64, _mm256_unpackhi_epi32(acc, zero));
+	}
+
+	if (nv) {
+		_mm256_storeu_si256((__m256i *)lanes, sum64);
+		*sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+		_mm256_storeu_si256((__m256i *)lanes, sq64);
+		*sumsq = lanes[0] + lanes[1] + lanes[2] + lanes[3]
+			+ (*sum << 16) - ((uint64_t)nv << 30);
+		_mm256_storeu_si256((__m256i *)m, vmin);
+		*min = 0xffff;
+		for (k = 0; k < 16; k++)
+			if (m[k] < *min)
+				*min = m[k];
+		_mm256_storeu_si256((__m256i *)m, vmax);
+		*max = 0;
+		for (k = 0; k < 16; k++)
+			if (m[k] > *max)
+				*max = m[k];
+	}
+	stats_tail(x, n, nv, min, max, sum, sumsq);
+}
+
+AVX2 static uint64_t sum_avx2(const uint16_t *x, size_t n) {
+	const __m256i lomask = _mm256_set1_epi16(0x00ff), zero = _mm256_setzero_si256();
+	__m256i lo = zero, hi = zero;
+	uint64_t l[4], h[4];
+	size_t nv = n & ~(size_t)15, i;
+
+	for (i = 0; i < nv; i += 16) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(x + i));
+
+		lo = _mm256_add_epi64(lo, _mm256_sad_epu8(_mm256_and_si256(v, lomask), zero));
+		hi = _mm256_add_epi64(hi, _mm256_sad_epu8(_mm256_srli_epi16(v, 8), zero));
+	}
+	_mm256_storeu_si256((__m256i *)l, lo);
+	_mm256_storeu_si256((__m256i *)h, hi);
+	return l[0] + l[1] + l[2] + l[3] + ((h[0] + h[1] + h[2] + h[3]) << 8)
+		+ sum_scalar(x + nv, n - nv);
+}
+
+AVX2 static int64_t dot_biased_avx2(const uint16_t *x, const int16_t *h, size_t n) {
+	const __m256i bias = _mm256_set1_epi16(-32768);
+	__m256i acc = _mm256_setzero_si256();
+	int64_t lanes[4];
+	size_t nv = n & ~(size_t)15, i;
+
+	for (i = 0; i < nv; i += 16) {
+		__m256i y = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(x + i)), bias);
+		__m256i p = _mm256_madd_epi16(y, _mm256_loadu_si256((const __m256i *)(h + i)));
+		__m256i sign = _mm256_srai_epi32(p, 31);
+
+		acc = _mm256_add_epi64(acc, _mm256_unpacklo_epi32(p, sign));
+		acc = _mm256_add_epi64(acc, _mm256_unpackhi_epi32(p, sign));
+	}
+	_mm256_storeu_si256((__m256i *)lanes, acc);
+	return lanes[0] + lanes[1] + lanes[2] + lanes[3]
+		+ dot_biased_scalar(x + nv, h + nv, n - nv);
+}
+
+static const struct filter_kernels kernels_avx2 = {
+	"avx2", stats_avx2, sum_avx2, dot_biased_avx2,
+};
+#endif /* FILTER_X86 */
+
+
+#ifdef FILTER_NEON
+#define CHUNK 4096  // vectors per 32-bit partial sum
+
+static void stats_neon(const uint16_t *x, size_t n, uint16_t *min, uint16_t *max,
+		       uint64_t *sum, uint64_t *sumsq) {
+	uint16x8_t vmin = vdupq_n_u16(0xffff), vmax = vdupq_n_u16(0);
+	uint64x2_t sq64 = vdupq_n_u64(0), sum64 = vdupq_n_u64(0);
+	uint16x4_t m;
+	size_t nv = n & ~(size_t)7, i = 0, end;
+
+	while (i < nv) {
+		uint32x4_t acc = vdupq_n_u32(0);
+
+		end = i + CHUNK * 8 < nv ? i + CHUNK * 8 : nv;
+		for (; i < end; i += 8) {
+			uint16x8_t v = vld1q_u16(x + i);
+			uint16x4_t lo = vget_low_u16(v), hi = vget_high_u16(v);
+
+			vmin = vminq_u16(vmin, v);
+			vmax = vmaxq_u16(vmax, v);
+			sq64 = vpadalq_u32(sq64, vmull_u16(lo, lo));
+			sq64 = vpadalq_u32(sq64, vmull_u16(hi, hi));
+			acc = vpadalq_u16(acc, v);
+		}
+		sum64 = vpadalq_u32(sum64, acc);
+	}
+
+	if (nv) {
+		*sum = vgetq_lane_u64(sum64, 0) + vgetq_lane_u64(sum64, 1);
+		*sumsq = vgetq_lane_u64(sq64, 0) + vgetq_lane_u64(sq64, 1);
+		m = vpmin_u16(vget_low_u16(vmin), vget_high_u16(vmin));
+		m = vpmin_u16(m, m);
+		m = vpmin_u16(m, m);
+		*min = vget_lane_u16(m, 0);
+		m = vpmax_u16(vget_low_u16(vmax), vget_high_u16(vmax));
+		m = vpmax_u16(m, m);
+		m = vpmax_u16(m, m);
+		*max = vget_lane_u16(m, 0);
+	}
+	stats_tail(x, n, nv, min, max, sum, sumsq);
+}
+
+static uint64_t sum_neon(const uint16_t *x, size_t n) {
+	uint64x2_t sum64 = vdupq_n_u64(0);
+	size_t nv = n & ~(size_t)7, i = 0, end;
+
+	while (i < nv) {
+		uint32x4_t acc = vdupq_n_u32(0);
+
+		end = i + CHUNK * 8 < nv ? i + CHUNK * 8 : nv;
+		for (; i < end; i += 8)
+			acc = vpadalq_u16(acc, vld1q_u16(x + i));
+		sum64 = vpadalq_u32(sum64, acc);
+	}
+	return vgetq_lane_u64(sum64, 0) + vgetq_lane_u64(sum64, 1)
+		+ sum_scalar(x + nv, n - nv);
+}
+
+static int64_t dot_biased_neon(const uint16_t *x, const int16_t *h, size_t n) {
+	const uint16x8_t bias = vdupq_n_u16(0x8000);
+	int64x2_t acc = vdupq_n_s64(0);
+	size_t nv = n & ~(size_t)7, i;
+
+	for (i = 0; i < nv; i += 8) {
+		int16x8_t y = vreinterpretq_s16_u16(veorq_u16(vld1q_u16(x + i), bias));
+		int16x8_t c = vld1q_s16(h + i);
+
+		acc = vpadalq_s32(acc, vmull_s16(vget_low_s16(y), vget_low_s16(c)));
+		acc = vpadalq_s32(acc, vmull_s16(vget_high_s16(y), vget_high_s16(c)));
+	}
+	return vgetq_lane_s64(acc, 0) + vgetq_lane_s64(acc, 1)
+		+ dot_biased_scalar(x + nv, h + nv, n - nv);
+}
+
+static const struct filter_kernels kernels_neon = {
+	"neon", stats_neon, sum_neon, dot_biased_neon,
+};
+#endif /* FILTER_NEON */
+
+
+static const struct filter_kernels *kernels = NULL;
+
+static const struct filter_kernels *filter_kernels(void) {
+	if (kernels)
+		return kernels;
+#if defined(FILTER_NEON)
+	kernels = &kernels_neon;
+#elif defined(FILTER_X86)
+	__builtin_cpu_init();
+	kernels = __builtin_cpu_supports("avx2") ? &kernels_avx2 : &kernels_sse2;
+#else
+	kernels = &kernels_scalar;
+#endif
+	return kernels;
+}
+
+int filter_use(const char *impl) {
+	if (!strcmp(impl, "scalar")) {
+		kernels = &kernels_scalar;
+		return 0;
+	}
+#ifdef FILTER_X86
+	if (!strcmp(impl, "sse2")) {
+		kernels = &kernels_sse2;
+		return 0;
+	}
+	if (!strcmp(impl, "avx2") && (__builtin_cpu_init(), __builtin_cpu_supports("avx2"))) {
+		kernels = &kernels_avx2;
+		return 0;
+	}
+#endif
+#ifdef FILTER_NEON
+	if (!strcmp(impl, "neon")) {
+		kernels = &kernels_neon;
+		return 0;
+	}
+#endif
+	return -1;
+}
+
+const char *filter_impl(void) {
+	return filter_kernels()->name;
+}
+
+
+void filter_stats(const uint16_t *x, size_t n, struct filter_stats *s) {
+	double var;
+
+	memset(s, 0, sizeof(*s));
+	if (!n)
+		return;
+	filter_kernels()->stats(x, n, &s->min, &s->max, &s->sum, &s->sumsq);
+	s->mean = (double)s->sum / n;
+	s->rms = sqrt((double)s->sumsq / n);
+	var = (double)s->sumsq / n - s->mean * s->mean;
+	s->stddev = var > 0 ? sqrt(var) : 0;
+}
+
+// two-pass radix select on the high then the low byte
+uint16_t filter_median(const uint16_t *x, size_t n) {
+	size_t hist[256];
+	size_t want, seen;
+	unsigned int hi, lo;
+	size_t i;
+
+	if (!n)
+		return 0;
+	want = (n - 1) / 2;  // lower median
+
+	memset(hist, 0, sizeof(hist));
+	for (i = 0; i < n; i++)
+		hist[x[i] >> 8]++;
+	for (hi = 0, seen = 0; seen + hist[hi] <= want; hi++)
+		seen += hist[hi];
+	want -= seen;
+
+	memset(hist, 0, sizeof(hist));
+	for (i = 0; i < n; i++)
+		if ((x[i] >> 8) == hi)
+			hist[x[i] & 0xff]++;
+	for (lo = 0, seen = 0; seen + hist[lo] <= want; lo++)
+		seen += hist[lo];
+
+	return (hi << 8) | lo;
+}
+
+// a running sum: O(n) whatever the width, which beats a vector O(n * width)
+size_t filter_boxcar(const uint16_t *x, size_t n, unsigned width, uint16_t *out) {
+	uint64_t sum;
+	size_t i;
+
+	if (!width || n < width)
+		return 0;
+	sum = filter_kernels()->sum(x, width);
+	out[0] = (sum + width / 2) / width;
+	for (i = width; i < n; i++) {
+		sum += x[i] - x[i - width];
+		out[i - width + 1] = (sum + width / 2) / width;
+	}
+	return n - width + 1;
+}
+
+size_t filter_cic_decimate(const uint16_t *x, size_t n, unsigned r, unsigned order,
+			   uint16_t *out) {
+	const struct filter_kernels *k = filter_kernels();
+	uint64_t integ[5], comb[5], gain = 1, v, d;
+	size_t i, nout = 0;
+	unsigned s;
+
+	if (!r || order < 1 || order > 5)
+		return 0;
+	for (s = 0; s < order; s++)
+		gain *= r;
+
+	// first order is a boxcar sum of each group of r
+	if (order == 1) {
+		for (i = 0; i + r <= n; i += r)
+			out[nout++] = (k->sum(x + i, r) + r / 2) / r;
+		return nout;
+	}
+
+	// integrators and combs wrap modulo 2^64, which is what makes a CIC work
+	memset(integ, 0, sizeof(integ));
+	memset(comb, 0, sizeof(comb));
+	for (i = 0; i < n; i++) {
+		integ[0] += x[i];
+		for (s = 1; s < order; s++)
+			integ[s] += integ[s - 1];
+		if ((i + 1) % r)
+			continue;
+		v = integ[order - 1];
+		for (s = 0; s < order; s++) {
+			d = v - comb[s];
+			comb[s] = v;
+			v = d;
+		}
+		// the first order-1 outputs are the filter filling up
+		if ((i + 1) / r >= order)
+			out[nout++] = (v + gain / 2) / gain;
+	}
+	return nout;
+}
+
+size_t filter_fir_decimate(const uint16_t *x, size_t n, const int16_t *h,
+			   unsigned taps, unsigned r, uint16_t *out) {
+	const struct filter_kernels *k = filter_kernels();
+	int64_t hsum = 0, acc;
+	size_t i, nout = 0;
+	unsigned j;
+
+	if (!r || !taps || n < taps)
+		return 0;
+	for (j = 0; j < taps; j++)
+		hsum += h[j];
+
+	for (i = 0; i + taps <= n; i += r) {
+		acc = k->dot_biased(x + i, h, taps) + hsum * 32768;
+		acc = (acc + (1 << 14)) >> 15;
+		out[nout++] = acc < 0 ? 0 : acc > 0xffff ? 0xffff : acc;
+	}
+	return nout;
+}
+
+
+/*
+ * Microbenchmark: every operation through each available implementation,
+ * checked against the scalar result.
+ */
+void filter_bench(size_t n, int iterations, double acq_sps) {
+	static const char *impls[] = { "scalar", "sse2", "avx2", "neon" };
+	static const char *ops[] = { "stats", "boxcar16", "cic16", "fir32/8", "median" };
+	const struct filter_kernels *saved = filter_kernels();
+	struct filter_stats st, ref_st;
+	uint16_t *x, *out, *ref;
+	int16_t h[32];
+	size_t nout, ref_n = 0;
+	double t, rate;
+	uint64_t t0;
+	unsigned int seed = 1;
+	unsigned i, op;
+	int it;
+
+	x = malloc(n * sizeof(*x));
+	out = malloc(n * sizeof(*out));
+	ref = malloc(n * sizeof(*ref));
+	if (!x || !out || !ref) {
+		perror("Unable to allocate sample blocks");
+		goto done;
+	}
+	// 10-bit ADC codes around mid-scale, with noise
+	for (i = 0; i < n; i++)
+		x[i] = 512 + (rand_r(&seed) % 64) - 32;
+	// 32-tap windowed-sinc low pass at fs/16, Q15, unity DC gain
+	{
+		double w[32], sum = 0;
+		int acc = 0;
+
+		for (i = 0; i < 32; i++) {
+			double m = i - 15.5;
+			w[i] = sin(M_PI * m / 8) / (M_PI * m) * (0.54 - 0.46 * cos(2 * M_PI * i / 31));
+			sum += w[i];
+		}
+		for (i = 0; i < 32; i++) {
+			h[i] = lrint(w[i] / sum * 32768);
+			acc += h[i];
+		}
+		h[15] += 32768 - acc;
+	}
+
+	printf("%zu-sample blocks, %d iterations; ADC108S022 maximum is %d samples/s\n",
+	       n, iterations, ADC108S022_MAX_SPS);
+	if (acq_sps)
+		printf("I2C-polled acquisition measured at %.0f samples/s\n", acq_sps);
+	printf("%-10s %-8s %14s %10s", "op", "impl", "Msamples/s", "x ADC max");
+	printf(acq_sps ? " %10s\n" : "\n", "x acq");
+
+	for (op = 0; op < 5; op++) {
+		for (i = 0; i < sizeof(impls) / sizeof(impls[0]); i++) {
+			if (filter_use(impls[i]))
+				continue;
+			nout = 0;
+			t0 = stats_now();
+			for (it = 0; it < iterations; it++) {
+				switch (op) {
+				case 0: filter_stats(x, n, &st); break;
+				case 1: nout = filter_boxcar(x, n, 16, out); break;
+				case 2: nout = filter_cic_decimate(x, n, 16, 1, out); break;
+				case 3: nout = filter_fir_decimate(x, n, h, 32, 8, out); break;
+				case 4: out[0] = filter_median(x, n); nout = 1; break;
+				}
+			}
+			t = (stats_now() - t0) / 1e9;
+			rate = (double)n * iterations / t;
+
+			// scalar runs first and is the reference
+			if (!i) {
+				ref_st = st;
+				ref_n = nout;
+				memcpy(ref, out, nout * sizeof(*out));
+			}
+			printf("%-10s %-8s %14.1f %10.0f",
+			       ops[op], impls[i], rate / 1e6, rate / ADC108S022_MAX_SPS);
+			if (acq_sps)
+				printf(" %10.0f", rate / acq_sps);
+			printf("%s\n",
+			       (op == 0 ? memcmp(&st, &ref_st, sizeof(st)) != 0
+				: nout != ref_n || memcmp(out, ref, nout * sizeof(*out)) != 0)
+			       ? "  MISMATCH" : "");
+		}
+	}
+
+done:
+	kernels = saved;
+	free(x);
+	free(out);
+	free(ref);
+}
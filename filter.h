@@ -0,0 +1,46 @@
+#ifndef __FILTER_H__
+#define __FILTER_H__
+
+///
+// Block processing for ADC sample streams.
+//
+// All functions take blocks of 16-bit samples.  The inner loops (min/max/
+// sum/sum of squares, group sums for decimation, FIR dot products) have
+// NEON, SSE2 and AVX2 versions next to the scalar one; the best one the CPU
+// supports is picked on first use, and filter_use() can force another for
+// comparison.
+///
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct filter_stats {
+	uint16_t min;
+	uint16_t max;
+	uint64_t sum;
+	uint64_t sumsq;
+	double mean;
+	double rms;     // of the samples
+	double stddev;  // RMS of the samples less their mean
+};
+
+void filter_stats(const uint16_t *x, size_t n, struct filter_stats *s);
+uint16_t filter_median(const uint16_t *x, size_t n);
+
+// moving average over width samples; writes n - width + 1 outputs
+size_t filter_boxcar(const uint16_t *x, size_t n, unsigned width, uint16_t *out);
+// CIC decimator, order 1..5, by r; output normalised back to sample scale
+size_t filter_cic_decimate(const uint16_t *x, size_t n, unsigned r, unsigned order,
+			   uint16_t *out);
+// FIR decimator: out[k] = sum h[j] x[k*r + j], h in Q15 (-32767..32767)
+size_t filter_fir_decimate(const uint16_t *x, size_t n, const int16_t *h,
+			   unsigned taps, unsigned r, uint16_t *out);
+
+// "scalar", "sse2", "avx2" or "neon"; -1 if not available here
+int filter_use(const char *impl);
+const char *filter_impl(void);
+
+// acq_sps, when not 0, is the rate samples actually arrive at, for comparison
+void filter_bench(size_t n, int iterations, double acq_sps);
+
+#endif /* __FILTER_H__ */
@@ -0,0 +1,176 @@
+///
+// FPGA loader tests without an FPGA.
+//
+// Under the sim, fpga_load() takes a regular file or a FIFO in place of the
+// spidev node.  The cases build a small .bit file with a known payload,
+// check that fpga_bit_parse() reads its header back, load it into a file
+// (twice, the second time over a longer one, which must be truncated) and
+// into a FIFO drained by a child process, and compare the bytes that
+// arrive with the file.  Outside the sim a regular file must be refused.
+// Exit status is the number of failed checks.
+///
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "fpga-load.h"
+#include "sim.h"
+
+#define TEST_PAYLOAD  (200 * 1024)  // more than one FPGA_WRITE_CHUNK
+
+static int failures;
+
+#define CHECK(cond, ...) \
+	do { \
+		if (!(cond)) { \
+			failures++; \
+			printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+			printf(__VA_ARGS__); \
+			printf("\n"); \
+		} \
+	} while (0)
+
+static char dir[] = "/tmp/gpbb-fpga-test.XXXXXX";
+static char bit_path[64], out_path[64], fifo_path[64];
+static unsigned char *bit;
+static size_t bit_len;
+
+static size_t test_field(unsigned char *p, char key, const char *s) {
+	size_t n = strlen(s) + 1;
+
+	p[0] = key;
+	p[1] = n >> 8;
+	p[2] = n;
+	memcpy(p + 3, s, n);
+	return 3 + n;
+}
+
+// a .bit header around payload bytes that are a function of their offset
+static int test_bitfile(void) {
+	static const unsigned char preamble[] = {
+		0x00, 0x09, 0x0f, 0xf0, 0x0f, 0xf0, 0x0f, 0xf0, 0x0f, 0xf0, 0x00, 0x00, 0x01,
+	};
+	size_t pos = 0, i;
+	FILE *f;
+
+	bit = malloc(sizeof(preamble) + 256 + 5 + TEST_PAYLOAD);
+	if (!bit)
+		return -1;
+	memcpy(bit, preamble, sizeof(preamble));
+	pos = sizeof(preamble);
+	pos += test_field(bit + pos, 'a', "novena_gpbb_test.ncd;UserID=0xFFFFFFFF");
+	pos += test_field(bit + pos, 'b', "6slx45csg324");
+	pos += test_field(bit + pos, 'c', "2026/10/19");
+	pos += test_field(bit + pos, 'd', "12:00:00");
+	bit[pos++] = 'e';
+	bit[pos++] = (TEST_PAYLOAD >> 24) & 0xff;
+	bit[pos++] = (TEST_PAYLOAD >> 16) & 0xff;
+	bit[pos++] = (TEST_PAYLOAD >> 8) & 0xff;
+	bit[pos++] = TEST_PAYLOAD & 0xff;
+	for (i = 0; i < TEST_PAYLOAD; i++)
+		bit[pos + i] = (i * 7 + (i >> 8)) & 0xff;
+	bit_len = pos + TEST_PAYLOAD;
+
+	f = fopen(bit_path, "w");
+	if (!f || fwrite(bit, 1, bit_len, f) != bit_len || fclose(f))
+		return -1;
+	return 0;
+}
+
+// 0 if fd holds exactly the .bit file
+static int test_compare_fd(int fd) {
+	unsigned char buf[8192];
+	size_t seen = 0;
+	ssize_t n;
+
+	while ((n = read(fd, buf, sizeof(buf))) > 0) {
+		if (seen + n > bit_len || memcmp(buf, bit + seen, n))
+			return -1;
+		seen += n;
+	}
+	return n < 0 || seen != bit_len ? -1 : 0;
+}
+
+static void test_parse(void) {
+	struct fpga_bitinfo info;
+
+	CHECK(fpga_bit_parse(bit, bit_len, &info) == 0, "parse the test header");
+	CHECK(!strcmp(info.part, "6slx45csg324"), "part %s", info.part);
+	CHECK(!strcmp(info.date, "2026/10/19") && !strcmp(info.time, "12:00:00"),
+	      "date %s time %s", info.date, info.time);
+	CHECK(info.length == TEST_PAYLOAD, "payload length %u", info.length);
+	CHECK(fpga_bit_parse(bit, bit_len - 1, &info) < 0, "a short payload is refused");
+}
+
+static void test_file(void) {
+	int fd;
+
+	// a longer file already there must not leave its tail behind
+	fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	CHECK(fd >= 0 && ftruncate(fd, bit_len + 4096) == 0, "pre-existing file");
+	close(fd);
+
+	CHECK(fpga_load(bit_path, out_path) == 0, "load into a file");
+	fd = open(out_path, O_RDONLY);
+	CHECK(fd >= 0 && test_compare_fd(fd) == 0, "file holds the bitstream");
+	close(fd);
+}
+
+static void test_fifo(void) {
+	int status, fd;
+	pid_t pid;
+
+	CHECK(mkfifo(fifo_path, 0600) == 0, "mkfifo: %s", strerror(errno));
+	pid = fork();
+	if (!pid) {
+		fd = open(fifo_path, O_RDONLY);
+		_exit(fd < 0 || test_compare_fd(fd) ? 1 : 0);
+	}
+	CHECK(fpga_load(bit_path, fifo_path) == 0, "load into a FIFO");
+	waitpid(pid, &status, 0);
+	CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0,
+	      "the FIFO reader saw the bitstream");
+}
+
+static void test_refused(void) {
+	sim_enabled = 0;
+	CHECK(fpga_load(bit_path, out_path) < 0, "a regular file without -sim is refused");
+	sim_enabled = 1;
+}
+
+int main(int argc, char **argv) {
+	if (!mkdtemp(dir)) {
+		perror("mkdtemp");
+		return 1;
+	}
+	snprintf(bit_path, sizeof(bit_path), "%s/test.bit", dir);
+	snprintf(out_path, sizeof(out_path), "%s/spidev", dir);
+	snprintf(fifo_path, sizeof(fifo_path), "%s/fifo", dir);
+	if (test_bitfile()) {
+		perror("Unable to write the test bitstream");
+		return 1;
+	}
+	sim_enable(NULL);
+
+	test_parse();
+	test_file();
+	test_fifo();
+	test_refused();
+
+	unlink(bit_path);
+	unlink(out_path);
+	unlink(fifo_path);
+	rmdir(dir);
+	free(bit);
+
+	printf("fpga-load-test: %s (%d failed)\n", failures ? "FAIL" : "ok", failures);
+	return failures;
+}
@@ -0,0 +1,390 @@
+///
+// FPGA configuration, formerly configure.sh:
+//   pulse the PROG reset line (GPIO 135), stream the bitstream into the
+//   FPGA's slave-serial port over /dev/spidev2.0, then turn on the clock
+//   the CPU feeds the FPGA.
+//
+// configure.sh did this with `dd bs=128`, which is one write() and one
+// 128-byte SPI transfer per block (~11,600 for the 1.4MB bitstream).  Here
+// the file is mmap'd and handed to spidev in transfers as large as the
+// spidev driver will take (its bufsiz module parameter, 4096 by default).
+//
+// The target has to be a character device, so a missing spidev node can't
+// turn into a regular file that "loads" fine.  Only under -sim may a file or
+// FIFO stand in for it (created, or truncated, if need be); the bitstream
+// is then copied with plain large write()s, with no reset pulse, and the
+// load isn't recorded.  fpga-load-test checks the bytes that arrive.
+//
+// Every successful load records the bitstream's header fields, a payload
+// fingerprint and the version the FPGA then reports in FPGA_STATE_FILE.
+// fpga_load_if_needed() skips the load when the file matches that record
+// and the FPGA still answers on CS0 with the same version.  The state file
+// lives on tmpfs, so it doesn't outlive the power cycle that clears the FPGA.
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <linux/spi/spidev.h>
+
+#include "gpio.h"
+#include "novena-gpbb.h"
+#include "fpga-load.h"
+#include "sim.h"
+#include "stats.h"
+
+#define SPIDEV_BUFSIZ_PATH "/sys/module/spidev/parameters/bufsiz"
+#define SPIDEV_BUFSIZ_DEFAULT 4096
+#define FPGA_WRITE_CHUNK (64 * 1024)
+
+static double ms_since(uint64_t start) {
+  return (stats_now() - start) / 1e6;
+}
+
+static size_t spidev_bufsiz(void) {
+  char buf[32];
+  int fd;
+  int bytes;
+  long size;
+
+  fd = open(SPIDEV_BUFSIZ_PATH, O_RDONLY);
+  if( fd < 0 )
+    return SPIDEV_BUFSIZ_DEFAULT;
+  bytes = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if( bytes <= 0 )
+    return SPIDEV_BUFSIZ_DEFAULT;
+  buf[bytes] = '\0';
+  size = strtol(buf, NULL, 10);
+  return size > 0 ? size : SPIDEV_BUFSIZ_DEFAULT;
+}
+
+// returns the number of syscalls it took, or -1
+static int fpga_send_spi(int spifd, const unsigned char *data, size_t len) {
+  struct spi_ioc_transfer xfer;
+  size_t chunk = spidev_bufsiz();
+  size_t done = 0;
+  int calls = 0;
+
+  while( done < len ) {
+    size_t n = len - done < chunk ? len - done : chunk;
+
+    memset(&xfer, 0, sizeof(xfer));
+    xfer.tx_buf = (unsigned long) (data + done);
+    xfer.len = n;
+
+    calls++;
+    if( ioctl(spifd, SPI_IOC_MESSAGE(1), &xfer) < 0 ) {
+      if( errno == EMSGSIZE && chunk > 128 ) {
+	chunk /= 2; // driver buffer smaller than advertised, back off
+	continue;
+      }
+      perror("SPI transfer failed");
+      return -1;
+    }
+    done += n;
+  }
+
+  return calls;
+}
+
+static int fpga_send_write(int spifd, const unsigned char *data, size_t len) {
+  size_t done = 0;
+  int calls = 0;
+  ssize_t ret;
+
+  while( done < len ) {
+    size_t n = len - done < FPGA_WRITE_CHUNK ? len - done : FPGA_WRITE_CHUNK;
+
+    calls++;
+    ret = write(spifd, data + done, n);
+    if( ret < 0 ) {
+      if( errno == EINTR )
+	continue;
+      perror("Bitstream write failed");
+      return -1;
+    }
+    done += ret;
+  }
+
+  return calls;
+}
+
+/*
+ * Xilinx .bit header: a 2-byte-length preamble and a 0x0001 key count,
+ * then 'a' design, 'b' part, 'c' date, 'd' time (each a 2-byte length and
+ * a NUL-terminated string) and 'e' with a 4-byte payload length.
+ */
+static int fpga_bit_string(const unsigned char *data, size_t len, size_t *pos,
+			   char key, char *out, size_t outlen) {
+  size_t n;
+
+  if( *pos + 3 > len || data[*pos] != key )
+    return -1;
+  n = (data[*pos + 1] << 8) | data[*pos + 2];
+  *pos += 3;
+  if( *pos + n > len )
+    return -1;
+  snprintf(out, outlen, "%.*s", (int) n, (const char *) data + *pos);
+  *pos += n;
+  return 0;
+}
+
+int fpga_bit_parse(const unsigned char *data, size_t len, struct fpga_bitinfo *info) {
+  size_t pos;
+  uint64_t hash = 0xcbf29ce484222325ULL; // FNV-1a
+  size_t i;
+
+  memset(info, 0, sizeof(*info));
+  if( len < 13 )
+    return -1;
+  pos = 2 + ((data[0] << 8) | data[1]) + 2;
+
+  if( fpga_bit_string(data, len, &pos, 'a', info->design, sizeof(info->design)) ||
+      fpga_bit_string(data, len, &pos, 'b', info->part, sizeof(info->part)) ||
+      fpga_bit_string(data, len, &pos, 'c', info->date, sizeof(info->date)) ||
+      fpga_bit_string(data, len, &pos, 'd', info->time, sizeof(info->time)) )
+    return -1;
+
+  if( pos + 5 > len || data[pos] != 'e' )
+    return -1;
+  info->length = ((uint32_t) data[pos + 1] << 24) | (data[pos + 2] << 16) |
+    (data[pos + 3] << 8) | data[pos + 4];
+  pos += 5;
+  if( pos + info->length > len )
+    return -1;
+
+  for( i = 0; i < info->length; i++ ) {
+    hash ^= data[pos + i];
+    hash *= 0x100000001b3ULL;
+  }
+  info->fingerprint = hash;
+  return 0;
+}
+
+static int fpga_state_read(struct fpga_bitinfo *info, unsigned int *major,
+			   unsigned int *minor) {
+  FILE *f;
+  unsigned long long fp;
+  int n;
+
+  memset(info, 0, sizeof(*info));
+  f = fopen(FPGA_STATE_FILE, "r");
+  if( !f )
+    return -1;
+  n = fscanf(f, "design=%127[^\n]\npart=%31[^\n]\ndate=%15[^\n]\ntime=%15[^\n]\n"
+	     "length=%u\nfingerprint=%llx\nversion=%x.%x\n",
+	     info->design, info->part, info->date, info->time,
+	     &info->length, &fp, minor, major);
+  fclose(f);
+  info->fingerprint = fp;
+  return n == 8 ? 0 : -1;
+}
+
+static void fpga_state_write(const struct fpga_bitinfo *info, unsigned int major,
+			     unsigned int minor) {
+  FILE *f;
+
+  f = fopen(FPGA_STATE_FILE, "w");
+  if( !f ) {
+    perror("Unable to record FPGA state");
+    return;
+  }
+  fprintf(f, "design=%s\npart=%s\ndate=%s\ntime=%s\n"
+	  "length=%u\nfingerprint=%016llx\nversion=%04x.%04x\n",
+	  info->design, info->part, info->date, info->time,
+	  info->length, (unsigned long long) info->fingerprint, minor, major);
+  fclose(f);
+}
+
+// a configured, clocked FPGA loops the CS0 test register back
+static int fpga_answers(void) {
+  static const unsigned short patterns[] = { 0xa55a, 0x5aa5 };
+  unsigned short saved;
+  int ok = 1;
+  int i;
+
+  saved = read_kernel_memory(FPGA_R_TEST0, 0, 2);
+  for( i = 0; i < 2; i++ ) {
+    write_kernel_memory(FPGA_W_TEST0, patterns[i], 0, 2);
+    if( (unsigned short) read_kernel_memory(FPGA_R_TEST0, 0, 2) != patterns[i] )
+      ok = 0;
+  }
+  write_kernel_memory(FPGA_W_TEST0, saved, 0, 2);
+  return ok;
+}
+
+static void fpga_version(unsigned int *major, unsigned int *minor) {
+  *major = (unsigned short) read_kernel_memory(FPGA_R_V_MAJOR, 0, 2);
+  *minor = (unsigned short) read_kernel_memory(FPGA_R_V_MINOR, 0, 2);
+}
+
+static unsigned char *fpga_map(const char *bitfile, size_t *len) {
+  unsigned char *data;
+  struct stat st;
+  int bitfd;
+
+  bitfd = open(bitfile, O_RDONLY);
+  if( bitfd < 0 ) {
+    perror("Unable to open bitstream");
+    return NULL;
+  }
+  if( fstat(bitfd, &st) < 0 || st.st_size == 0 ) {
+    fprintf(stderr, "Unable to read bitstream %s\n", bitfile);
+    close(bitfd);
+    return NULL;
+  }
+  *len = st.st_size;
+  data = mmap(NULL, *len, PROT_READ, MAP_PRIVATE, bitfd, 0);
+  close(bitfd);
+  if( data == MAP_FAILED ) {
+    perror("Unable to mmap bitstream");
+    return NULL;
+  }
+  madvise(data, *len, MADV_SEQUENTIAL);
+  return data;
+}
+
+static void fpga_reset(void) {
+  // like configure.sh, a missing GPIO is reported but isn't fatal
+  if( gpio_export(FPGA_RESET_GPIO) ||
+      gpio_set_direction(FPGA_RESET_GPIO, GPIO_OUT) ||
+      gpio_set_value(FPGA_RESET_GPIO, 0) ||
+      gpio_set_value(FPGA_RESET_GPIO, 1) )
+    fprintf(stderr, "Warning: couldn't pulse FPGA reset (gpio %d)\n",
+	    FPGA_RESET_GPIO);
+}
+
+static int fpga_load_mapped(const char *bitfile, const unsigned char *data,
+			    size_t len, const char *spidev) {
+  uint64_t start, phase;
+  double t_reset, t_config, t_clock;
+  struct fpga_bitinfo info;
+  unsigned int major, minor;
+  struct stat st;
+  int is_spidev;
+  int spifd;
+  int calls;
+
+  if( !spidev )
+    spidev = FPGA_SPIDEV;
+
+  start = stats_now();
+
+  spifd = open(spidev, O_WRONLY | (sim_enabled ? O_CREAT | O_TRUNC : 0), 0644);
+  if( spifd < 0 ) {
+    fprintf(stderr, "Unable to open spidev %s: %s\n", spidev, strerror(errno));
+    return -1;
+  }
+  if( fstat(spifd, &st) ) {
+    perror("Unable to stat spidev");
+    close(spifd);
+    return -1;
+  }
+  is_spidev = S_ISCHR(st.st_mode);
+  if( !is_spidev && !sim_enabled ) {
+    fprintf(stderr, "%s is not a character device (use -sim to load into a file)\n",
+	    spidev);
+    close(spifd);
+    return -1;
+  }
+
+  phase = stats_now();
+  if( is_spidev )
+    fpga_reset();
+  t_reset = ms_since(phase);
+
+  phase = stats_now();
+  if( is_spidev )
+    calls = fpga_send_spi(spifd, data, len);
+  else
+    calls = fpga_send_write(spifd, data, len);
+  t_config = ms_since(phase);
+
+  close(spifd);
+  if( calls < 0 )
+    return -1;
+
+  phase = stats_now();
+  write_kernel_memory( FPGA_CLK_REG, FPGA_CLK_ON, 0, 4 ); // turn on clock to FPGA
+  t_clock = ms_since(phase);
+
+  // a stand-in file says nothing about what the FPGA is running
+  if( is_spidev ) {
+    if( fpga_bit_parse(data, len, &info) == 0 ) {
+      fpga_version(&major, &minor);
+      fpga_state_write(&info, major, minor);
+    }
+    else {
+      unlink(FPGA_STATE_FILE);
+    }
+  }
+
+  printf( "configured FPGA from %s: %zu bytes in %d transfers\n",
+	  bitfile, len, calls );
+  printf( "reset %.1f ms, config %.1f ms (%.2f MB/s), clock %.1f ms, total %.1f ms\n",
+	  t_reset, t_config, t_config > 0 ? len / (t_config * 1e3) : 0.0,
+	  t_clock, ms_since(start) );
+  return 0;
+}
+
+int fpga_load(const char *bitfile, const char *spidev) {
+  unsigned char *data;
+  size_t len;
+  int ret;
+
+  data = fpga_map(bitfile, &len);
+  if( !data )
+    return -1;
+  ret = fpga_load_mapped(bitfile, data, len, spidev);
+  munmap(data, len);
+  return ret;
+}
+
+int fpga_load_if_needed(const char *bitfile, const char *spidev) {
+  struct fpga_bitinfo want, have;
+  unsigned int major, minor, cur_major, cur_minor;
+  uint64_t start;
+  unsigned char *data;
+  size_t len;
+  int ret;
+
+  start = stats_now();
+
+  data = fpga_map(bitfile, &len);
+  if( !data )
+    return -1;
+
+  if( fpga_bit_parse(data, len, &want) ) {
+    fprintf(stderr, "%s has no readable .bit header, loading unconditionally\n",
+	    bitfile);
+  }
+  else if( fpga_state_read(&have, &major, &minor) == 0 &&
+	   !strcmp(want.design, have.design) &&
+	   !strcmp(want.date, have.date) &&
+	   !strcmp(want.time, have.time) &&
+	   want.length == have.length &&
+	   want.fingerprint == have.fingerprint ) {
+    fpga_version(&cur_major, &cur_minor);
+    if( cur_major == major && cur_minor == minor && fpga_answers() ) {
+      munmap(data, len);
+      printf( "FPGA already running %s (%s %s, version %04x.%04x), load skipped in %.1f ms\n",
+	      want.design, want.date, want.time, minor, major, ms_since(start) );
+      return 0;
+    }
+  }
+
+  ret = fpga_load_mapped(bitfile, data, len, spidev);
+  munmap(data, len);
+  printf( "bring-up with load %.1f ms\n", ms_since(start) );
+  return ret;
+}
@@ -0,0 +1,26 @@
+#ifndef __FPGA_LOAD_H__
+#define __FPGA_LOAD_H__
+
+#define FPGA_RESET_GPIO  135
+#define FPGA_SPIDEV      "/dev/spidev2.0"
+#define FPGA_CLK_REG     0x020c8160  // CCM_CCOSR, clock out to the FPGA
+#define FPGA_CLK_ON      0x00000D2B
+#define FPGA_STATE_FILE  "/var/run/novena-gpbb.fpga"
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct fpga_bitinfo {
+  char design[128];
+  char part[32];
+  char date[16];
+  char time[16];
+  uint32_t length;       // configuration payload bytes
+  uint64_t fingerprint;  // FNV-1a over the payload
+};
+
+int fpga_bit_parse(const unsigned char *data, size_t len, struct fpga_bitinfo *info);
+int fpga_load(const char *bitfile, const char *spidev);
+int fpga_load_if_needed(const char *bitfile, const char *spidev);
+
+#endif /* __FPGA_LOAD_H__ */
@@ -0,0 +1,414 @@
+///
+// Board bring-up: the /dev/mem accessors for SoC and FPGA registers, and
+// the IOMUXC, clock and EIM timing setup that makes the FPGA's CS0 and
+// CS1 windows usable.  Part of libgpbb; gpbb_open() runs the setup.
+///
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "novena-gpbb.h"
+#include "stats.h"
+#include "trace.h"
+#include "sim.h"
+#include "uio.h"
+
+static int fd = 0;
+static int   *mem_32 = 0;
+static short *mem_16 = 0;
+static char  *mem_8  = 0;
+static int *prev_mem_range = 0;
+
+int read_kernel_memory(long offset, int virtualized, int size) {
+  int result;
+  volatile void *reg;
+  STATS_SCOPE(STATS_KMEM_READ);
+
+  // the FPGA windows through UIO; anything else still needs /dev/mem
+  if( uio_active && (reg = uio_reg(offset, size)) ) {
+    if(size==1)
+      result = *(volatile char *)reg;
+    else if(size==2)
+      result = *(volatile short *)reg;
+    else
+      result = *(volatile int *)reg;
+    TRACE(TRACE_BUS_MEM, TRACE_READ, size, offset, result);
+    return result;
+  }
+
+  int *mem_range = (int *)(offset & ~0xFFFF);
+  if( !sim_enabled && mem_range != prev_mem_range ) {
+    //        fprintf(stderr, "New range detected.  Reopening at memory range %p\n", mem_range);
+    prev_mem_range = mem_range;
+
+    if(mem_32)
+      munmap(mem_32, 0xFFFF);
+    if(fd)
+      close(fd);
+
+    if(virtualized) {
+      fd = open("/dev/kmem", O_RDWR);
+      if( fd < 0 ) {
+	perror("Unable to open /dev/kmem");
+	fd = 0;
+	return -1;
+      }
+    }
+    else {
+      fd = open("/dev/mem", O_RDWR);
+      if( fd < 0 ) {
+	perror("Unable to open /dev/mem. Must be run with root permissions.");
+	fd = 0;
+	return -1;
+      }
+    }
+
+    mem_32 = mmap(0, 0xffff, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset&~0xFFFF);
+    if( -1 == (int)mem_32 ) {
+      perror("Unable to mmap file");
+
+      if( -1 == close(fd) )
+	perror("Also couldn't close file");
+
+      fd=0;
+      return -1;
+    }
+    mem_16 = (short *)mem_32;
+    mem_8  = (char  *)mem_32;
+  }
+
+  int scaled_offset = (offset-(offset&~0xFFFF));
+  //    fprintf(stderr, "Returning offset 0x%08x\n", scaled_offset);
+  if( sim_enabled ) {
+    result = sim_mem_read(offset, size);
+    if(size==1)
+      result = (char) result;
+    else if(size==2)
+      result = (short) result;
+  }
+  else if(size==1)
+    result = mem_8[scaled_offset/sizeof(char)];
+  else if(size==2)
+    result = mem_16[scaled_offset/sizeof(short)];
+  else
+    result = mem_32[scaled_offset/sizeof(long)];
+
+  TRACE(TRACE_BUS_MEM, TRACE_READ, size, offset, result);
+  return result;
+}
+
+
+int write_kernel_memory(long offset, long value, int virtualized, int size) {
+  STATS_SCOPE(STATS_KMEM_WRITE);
+  int old_value = read_kernel_memory(offset, virtualized, size);
+  int scaled_offset = (offset-(offset&~0xFFFF));
+  volatile void *reg = uio_active ? uio_reg(offset, size) : NULL;
+  if( reg ) {
+    if(size==1)
+      *(volatile char *)reg = value;
+    else if(size==2)
+      *(volatile short *)reg = value;
+    else
+      *(volatile int *)reg = value;
+  }
+  else if( sim_enabled )
+    sim_mem_write(offset, size, value);
+  else if(size==1)
+    mem_8[scaled_offset/sizeof(char)]   = value;
+  else if(size==2)
+    mem_16[scaled_offset/sizeof(short)] = value;
+  else
+    mem_32[scaled_offset/sizeof(long)]  = value;
+  TRACE(TRACE_BUS_MEM, TRACE_WRITE, size, offset, value);
+  return old_value;
+}
+
+// unmap the page read_kernel_memory() keeps and close its fd
+void release_kernel_memory(void) {
+  if(mem_32)
+    munmap(mem_32, 0xFFFF);
+  if(fd)
+    close(fd);
+  mem_32 = 0;
+  mem_16 = 0;
+  mem_8  = 0;
+  fd = 0;
+  prev_mem_range = 0;
+}
+
+void setup_fpga() {
+  int i;
+
+  if( uio_active )  // the UIO device's driver owns EIM pads and timing
+    return;
+  //  printf( "setting up EIM CS0 (register interface) pads and configuring timing\n" );
+  // set up pads to be mapped to EIM
+  for( i = 0; i < 16; i++ ) {
+    write_kernel_memory( 0x20e0114 + i*4, 0x0, 0, 4 );  // mux mapping
+    write_kernel_memory( 0x20e0428 + i*4, 0xb0b1, 0, 4 ); // pad strength config'd for a 100MHz rate 
+  }
+
+  // mux mapping
+  write_kernel_memory( 0x20e046c - 0x314, 0x0, 0, 4 ); // BCLK
+  write_kernel_memory( 0x20e040c - 0x314, 0x0, 0, 4 ); // CS0
+  write_kernel_memory( 0x20e0410 - 0x314, 0x0, 0, 4 ); // CS1
+  write_kernel_memory( 0x20e0414 - 0x314, 0x0, 0, 4 ); // OE
+  write_kernel_memory( 0x20e0418 - 0x314, 0x0, 0, 4 ); // RW
+  write_kernel_memory( 0x20e041c - 0x314, 0x0, 0, 4 ); // LBA
+  write_kernel_memory( 0x20e0468 - 0x314, 0x0, 0, 4 ); // WAIT
+  write_kernel_memory( 0x20e0408 - 0x314, 0x0, 0, 4 ); // A16
+  write_kernel_memory( 0x20e0404 - 0x314, 0x0, 0, 4 ); // A17
+  write_kernel_memory( 0x20e0400 - 0x314, 0x0, 0, 4 ); // A18
+
+  // pad strength
+  write_kernel_memory( 0x20e046c, 0xb0b1, 0, 4 ); // BCLK
+  write_kernel_memory( 0x20e040c, 0xb0b1, 0, 4 ); // CS0
+  write_kernel_memory( 0x20e0410, 0xb0b1, 0, 4 ); // CS1
+  write_kernel_memory( 0x20e0414, 0xb0b1, 0, 4 ); // OE
+  write_kernel_memory( 0x20e0418, 0xb0b1, 0, 4 ); // RW
+  write_kernel_memory( 0x20e041c, 0xb0b1, 0, 4 ); // LBA
+  write_kernel_memory( 0x20e0468, 0xb0b1, 0, 4 ); // WAIT
+  write_kernel_memory( 0x20e0408, 0xb0b1, 0, 4 ); // A16
+  write_kernel_memory( 0x20e0404, 0xb0b1, 0, 4 ); // A17
+  write_kernel_memory( 0x20e0400, 0xb0b1, 0, 4 ); // A18
+
+  write_kernel_memory( 0x020c4080, 0xcf3, 0, 4 ); // ungate eim slow clocks
+
+  // rework timing for sync use
+  // 0011 0  001 1   001    0   001 00  00  1  011  1    0   1   1   1   1   1   1
+  // PSZ  WP GBC AUS CSREC  SP  DSZ BCS BCD WC BL   CREP CRE RFL WFL MUM SRD SWR CSEN
+  //
+  // PSZ = 0011  64 words page size
+  // WP = 0      (not protected)
+  // GBC = 001   min 1 cycles between chip select changes
+  // AUS = 0     address shifted according to port size
+  // CSREC = 001 min 1 cycles between CS, OE, WE signals
+  // SP = 0      no supervisor protect (user mode access allowed)
+  // DSZ = 001   16-bit port resides on DATA[15:0]
+  // BCS = 00    0 clock delay for burst generation
+  // BCD = 00    divide EIM clock by 0 for burst clock
+  // WC = 1      write accesses are continuous burst length
+  // BL = 011    32 word memory wrap length
+  // CREP = 1    non-PSRAM, set to 1
+  // CRE = 0     CRE is disabled
+  // RFL = 1     fixed latency reads
+  // WFL = 1     fixed latency writes
+  // MUM = 1     multiplexed mode enabled
+  // SRD = 1     synch reads
+  // SWR = 1     synch writes
+  // CSEN = 1    chip select is enabled
+
+  //  write_kernel_memory( 0x21b8000, 0x5191C0B9, 0, 4 );
+  write_kernel_memory( 0x21b8000, 0x31910BBF, 0, 4 );
+
+  // EIM_CS0GCR2   
+  //  MUX16_BYP_GRANT = 1
+  //  ADH = 1 (1 cycles)
+  //  0x1001
+  write_kernel_memory( 0x21b8004, 0x1000, 0, 4 );
+
+
+  // EIM_CS0RCR1   
+  // 00 000101 0 000   0   000   0 000 0 000 0 000 0 000
+  //    RWSC     RADVA RAL RADVN   OEA   OEN   RCSA  RCSN
+  // RWSC 000101    5 cycles for reads to happen
+  //
+  // 0000 0111 0000   0011   0000 0000 0000 0000
+  //  0    7     0     3      0  0    0    0
+  // 0000 0101 0000   0000   0 000 0 000 0 000 0 000
+//  write_kernel_memory( 0x21b8008, 0x05000000, 0, 4 );
+//  write_kernel_memory( 0x21b8008, 0x0A024000, 0, 4 );
+  write_kernel_memory( 0x21b8008, 0x09014000, 0, 4 );
+  // EIM_CS0RCR2  
+  // 0000 0000 0   000 00 00 0 010  0 001 
+  //           APR PAT    RL   RBEA   RBEN
+  // APR = 0   mandatory because MUM = 1
+  // PAT = XXX because APR = 0
+  // RL = 00   because async mode
+  // RBEA = 000  these match RCSA/RCSN from previous field
+  // RBEN = 000
+  // 0000 0000 0000 0000 0000  0000
+  write_kernel_memory( 0x21b800c, 0x00000000, 0, 4 );
+
+  // EIM_CS0WCR1
+  // 0   0    000100 000   000   000  000  010 000 000  000
+  // WAL WBED WWSC   WADVA WADVN WBEA WBEN WEA WEN WCSA WCSN
+  // WAL = 0       use WADVN
+  // WBED = 0      allow BE during write
+  // WWSC = 000100 4 write wait states
+  // WADVA = 000   same as RADVA
+  // WADVN = 000   this sets WE length to 1 (this value +1)
+  // WBEA = 000    same as RBEA
+  // WBEN = 000    same as RBEN
+  // WEA = 010     2 cycles between beginning of access and WE assertion
+  // WEN = 000     1 cycles to end of WE assertion
+  // WCSA = 000    cycles to CS assertion
+  // WCSN = 000    cycles to CS negation
+  // 1000 0111 1110 0001 0001  0100 0101 0001
+  // 8     7    E    1    1     4    5    1
+  // 0000 0111 0000 0100 0000  1000 0000 0000
+  // 0      7    0   4    0     8    0     0
+  // 0000 0100 0000 0000 0000  0100 0000 0000
+  //  0    4    0    0     0    4     0    0
+
+  write_kernel_memory( 0x21b8010, 0x09080800, 0, 4 );
+  //  write_kernel_memory( 0x21b8010, 0x02040400, 0, 4 );
+
+  // EIM_WCR
+  // BCM = 1   free-run BCLK
+  // GBCD = 0  don't divide the burst clock
+  write_kernel_memory( 0x21b8090, 0x701, 0, 4 );
+
+  // EIM_WIAR 
+  // ACLK_EN = 1
+  write_kernel_memory( 0x21b8094, 0x10, 0, 4 );
+
+  //  printf( "done.\n" );
+}
+
+void setup_fpga_cs1() { 
+  int i;
+
+  if( uio_active )
+    return;
+  //  printf( "setting up EIM CS1 (burst interface) pads and configuring timing\n" );
+  // ASSUME: setup_fpga() is already called to configure gpio mux setting.
+  // this just gets the pads set to high-speed mode
+
+  // set up pads to be mapped to EIM
+  for( i = 0; i < 16; i++ ) {
+    write_kernel_memory( 0x20e0428 + i*4, 0xb0f1, 0, 4 ); // pad strength config'd for a 200MHz rate 
+  }
+
+  // pad strength
+  write_kernel_memory( 0x20e046c, 0xb0f1, 0, 4 ); // BCLK
+  //  write_kernel_memory( 0x20e040c, 0xb0b1, 0, 4 ); // CS0
+  write_kernel_memory( 0x20e0410, 0xb0f1, 0, 4 ); // CS1
+  write_kernel_memory( 0x20e0414, 0xb0f1, 0, 4 ); // OE
+  write_kernel_memory( 0x20e0418, 0xb0f1, 0, 4 ); // RW
+  write_kernel_memory( 0x20e041c, 0xb0f1, 0, 4 ); // LBA
+  write_kernel_memory( 0x20e0468, 0xb0f1, 0, 4 ); // WAIT
+  write_kernel_memory( 0x20e0408, 0xb0f1, 0, 4 ); // A16
+  write_kernel_memory( 0x20e0404, 0xb0f1, 0, 4 ); // A17
+  write_kernel_memory( 0x20e0400, 0xb0f1, 0, 4 ); // A18
+
+  // EIM_CS1GCR1   
+  // 0011 0  001 1   001    0   001 00  00  1  011  1    0   1   1   1   1   1   1
+  // PSZ  WP GBC AUS CSREC  SP  DSZ BCS BCD WC BL   CREP CRE RFL WFL MUM SRD SWR CSEN
+  //
+  // PSZ = 0011  64 words page size
+  // WP = 0      (not protected)
+  // GBC = 001   min 1 cycles between chip select changes
+  // AUS = 0     address shifted according to port size
+  // CSREC = 001 min 1 cycles between CS, OE, WE signals
+  // SP = 0      no supervisor protect (user mode access allowed)
+  // DSZ = 001   16-bit port resides on DATA[15:0]
+  // BCS = 00    0 clock delay for burst generation
+  // BCD = 00    divide EIM clock by 0 for burst clock
+  // WC = 1      write accesses are continuous burst length
+  // BL = 011    32 word memory wrap length
+  // CREP = 1    non-PSRAM, set to 1
+  // CRE = 0     CRE is disabled
+  // RFL = 1     fixed latency reads
+  // WFL = 1     fixed latency writes
+  // MUM = 1     multiplexed mode enabled
+  // SRD = 1     synch reads
+  // SWR = 1     synch writes
+  // CSEN = 1    chip select is enabled
+
+  // 0101 0111 1111    0001 1100  0000  1011   1   0   0   1
+  // 0x5  7    F        1   C     0     B    9
+
+  // 0101 0001 1001    0001 1100  0000  1011   1001
+  // 5     1    9       1    c     0     B      9
+
+  // 0011 0001 1001    0001 0000  1011  1011   1111
+
+  write_kernel_memory( 0x21b8000 + 0x18, 0x31910BBF, 0, 4 );
+
+  // EIM_CS1GCR2   
+  //  MUX16_BYP_GRANT = 1
+  //  ADH = 0 (0 cycles)
+  //  0x1000
+  write_kernel_memory( 0x21b8004 + 0x18, 0x1000, 0, 4 );
+
+
+  // 9 cycles is total length of read
+  // 2 cycles for address
+  // +4 more cycles for first data to show up
+
+  // EIM_CS1RCR1   
+  // 00 000100 0 000   0   001   0 010 0 000 0 000 0 000
+  //    RWSC     RADVA RAL RADVN   OEA   OEN   RCSA  RCSN
+  //
+  // 00 001001 0 000   0   001   0 110 0 000 0 000 0 000
+  //    RWSC     RADVA RAL RADVN   OEA   OEN   RCSA  RCSN
+  //
+  // 0000 0111 0000   0011   0000 0000 0000 0000
+  //  0    7     0     3      0  0    0    0
+  // 0000 0101 0000   0000   0 000 0 000 0 000 0 000
+//  write_kernel_memory( 0x21b8008, 0x05000000, 0, 4 );
+  // 0000 0011 0000   0001   0001 0000 0000 0000
+
+  // 0000 1001 0000   0001   0110 0000 0000 0000
+  // 
+  write_kernel_memory( 0x21b8008 + 0x18, 0x09014000, 0, 4 );
+
+  // EIM_CS1RCR2  
+  // 0000 0000 0   000 00 00 0 010  0 001 
+  //           APR PAT    RL   RBEA   RBEN
+  // APR = 0   mandatory because MUM = 1
+  // PAT = XXX because APR = 0
+  // RL = 00   because async mode
+  // RBEA = 000  these match RCSA/RCSN from previous field
+  // RBEN = 000
+  // 0000 0000 0000 0000 0000  0000
+  write_kernel_memory( 0x21b800c + 0x18, 0x00000200, 0, 4 );
+
+  // EIM_CS1WCR1
+  // 0   0    000010 000   001   000  000  010 000 000  000
+  // WAL WBED WWSC   WADVA WADVN WBEA WBEN WEA WEN WCSA WCSN
+  // WAL = 0       use WADVN
+  // WBED = 0      allow BE during write
+  // WWSC = 000100 4 write wait states
+  // WADVA = 000   same as RADVA
+  // WADVN = 000   this sets WE length to 1 (this value +1)
+  // WBEA = 000    same as RBEA
+  // WBEN = 000    same as RBEN
+  // WEA = 010     2 cycles between beginning of access and WE assertion
+  // WEN = 000     1 cycles to end of WE assertion
+  // WCSA = 000    cycles to CS assertion
+  // WCSN = 000    cycles to CS negation
+  // 1000 0111 1110 0001 0001  0100 0101 0001
+  // 8     7    E    1    1     4    5    1
+  // 0000 0111 0000 0100 0000  1000 0000 0000
+  // 0      7    0   4    0     8    0     0
+  // 0000 0100 0000 0000 0000  0100 0000 0000
+  //  0    4    0    0     0    4     0    0
+
+  // 0000 0010 0000 0000 0000  0010 0000 0000
+  // 0000 0010 0000 0100 0000  0100 0000 0000
+
+  write_kernel_memory( 0x21b8010 + 0x18, 0x02040400, 0, 4 );
+
+  // EIM_WCR
+  // BCM = 1   free-run BCLK
+  // GBCD = 0  divide the burst clock by 1
+  // add timeout watchdog after 1024 bclk cycles
+  write_kernel_memory( 0x21b8090, 0x701, 0, 4 );
+
+  // EIM_WIAR 
+  // ACLK_EN = 1
+  write_kernel_memory( 0x21b8094, 0x10, 0, 4 );
+
+  //  printf( "resetting CS0 space to 64M and enabling 64M CS1 space.\n" );
+  write_kernel_memory( 0x20e0004, 
+		       (read_kernel_memory(0x20e0004, 0, 4) & 0xFFFFFFC0) |
+		       0x1B, 0, 4);
+
+  //  printf( "done.\n" );
+}
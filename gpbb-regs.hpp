@@ -0,0 +1,341 @@
+#ifndef __GPBB_REGS_HPP__
+#define __GPBB_REGS_HPP__
+
+///
+// Typed register map (C++14, header only).
+//
+// Each register is a type carrying its physical address; each field is a
+// type carrying its bit position and the register it belongs to.  Register
+// words are assembled at compile time:
+//
+//   constexpr uint32_t gcr1 = eim_gcr1<0>::value(
+//       eim_gcr1<0>::psz(3), eim_gcr1<0>::dsz(1), eim_gcr1<0>::csen(1));
+//
+// A value that doesn't fit its field, or a field of another register, fails
+// to compile.  FPGA registers resolve their F()/F1() index at compile time,
+// so read()/write() are a single load or store into the mapped window.
+//
+// The static_asserts at the end rebuild the words that setup_fpga(),
+// setup_fpga_cs1() and prep_eim() write as hex, field by field.
+///
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "novena-gpbb.h"
+
+namespace gpbb {
+
+template <unsigned Msb, unsigned Lsb, typename Reg>
+struct field {
+	static_assert(Msb >= Lsb && Msb < 32, "field outside a 32-bit register");
+
+	static constexpr unsigned width = Msb - Lsb + 1;
+	static constexpr uint32_t max = width == 32 ? 0xffffffffu : (1u << width) - 1;
+	static constexpr uint32_t mask = max << Lsb;
+
+	uint32_t bits;
+
+	// in a constant expression, an out-of-range value is a compile error
+	constexpr explicit field(uint32_t v)
+		: bits(v <= max ? v << Lsb : throw "value does not fit the field") {}
+
+	static constexpr uint32_t get(uint32_t word) { return (word >> Lsb) & max; }
+};
+
+// 32-bit SoC register; page is the 64K window read_kernel_memory() maps
+template <typename Reg, uint32_t Addr>
+struct reg32 {
+	static_assert((Addr & 3) == 0, "unaligned 32-bit register");
+
+	static constexpr uint32_t address = Addr;
+	static constexpr size_t index = (Addr & 0xffff) >> 2;
+
+	static constexpr uint32_t value() { return 0; }
+
+	template <unsigned Msb, unsigned Lsb, typename... Rest>
+	static constexpr uint32_t value(field<Msb, Lsb, Reg> f, Rest... rest) {
+		return (value(rest...) & field<Msb, Lsb, Reg>::mask)
+			? throw "field given twice"
+			: f.bits | value(rest...);
+	}
+
+	static uint32_t read(volatile uint32_t *page) { return page[index]; }
+	static void write(volatile uint32_t *page, uint32_t v) { page[index] = v; }
+};
+
+
+/*
+ * EIM chip-select timing, i.MX6 RM ch. 22.  CS1's block is CS0's + 0x18.
+ */
+#define EIM_REGS_BASE  0x021b8000u
+#define EIM_CS_STRIDE  0x18u
+
+template <unsigned CS>
+struct eim_gcr1 : reg32<eim_gcr1<CS>, EIM_REGS_BASE + CS * EIM_CS_STRIDE + 0x00> {
+	using psz   = field<31, 28, eim_gcr1>;  // page size
+	using wp    = field<27, 27, eim_gcr1>;  // write protect
+	using gbc   = field<26, 24, eim_gcr1>;  // gap between chip selects
+	using aus   = field<23, 23, eim_gcr1>;  // address unshifted
+	using csrec = field<22, 20, eim_gcr1>;  // CS recovery
+	using sp    = field<19, 19, eim_gcr1>;  // supervisor protect
+	using dsz   = field<18, 16, eim_gcr1>;  // data port size
+	using bcs   = field<15, 14, eim_gcr1>;  // burst clock start
+	using bcd   = field<13, 12, eim_gcr1>;  // burst clock divisor
+	using wc    = field<11, 11, eim_gcr1>;  // write continuous burst
+	using bl    = field<10,  8, eim_gcr1>;  // burst length
+	using crep  = field< 7,  7, eim_gcr1>;
+	using cre   = field< 6,  6, eim_gcr1>;
+	using rfl   = field< 5,  5, eim_gcr1>;  // fixed read latency
+	using wfl   = field< 4,  4, eim_gcr1>;  // fixed write latency
+	using mum   = field< 3,  3, eim_gcr1>;  // multiplexed address/data
+	using srd   = field< 2,  2, eim_gcr1>;  // synchronous reads
+	using swr   = field< 1,  1, eim_gcr1>;  // synchronous writes
+	using csen  = field< 0,  0, eim_gcr1>;
+};
+
+template <unsigned CS>
+struct eim_gcr2 : reg32<eim_gcr2<CS>, EIM_REGS_BASE + CS * EIM_CS_STRIDE + 0x04> {
+	using mux16_byp_grant = field<12, 12, eim_gcr2>;
+	using dap  = field<9, 9, eim_gcr2>;
+	using dae  = field<8, 8, eim_gcr2>;
+	using daps = field<7, 4, eim_gcr2>;
+	using adh  = field<1, 0, eim_gcr2>;  // address hold cycles
+};
+
+template <unsigned CS>
+struct eim_rcr1 : reg32<eim_rcr1<CS>, EIM_REGS_BASE + CS * EIM_CS_STRIDE + 0x08> {
+	using rwsc  = field<29, 24, eim_rcr1>;  // read wait states
+	using radva = field<22, 20, eim_rcr1>;
+	using ral   = field<19, 19, eim_rcr1>;
+	using radvn = field<18, 16, eim_rcr1>;
+	using oea   = field<14, 12, eim_rcr1>;
+	using oen   = field<10,  8, eim_rcr1>;
+	using rcsa  = field< 6,  4, eim_rcr1>;
+	using rcsn  = field< 2,  0, eim_rcr1>;
+};
+
+template <unsigned CS>
+struct eim_rcr2 : reg32<eim_rcr2<CS>, EIM_REGS_BASE + CS * EIM_CS_STRIDE + 0x0c> {
+	using apr  = field<15, 15, eim_rcr2>;
+	using pat  = field<14, 12, eim_rcr2>;
+	using rl   = field< 9,  8, eim_rcr2>;  // read latency
+	using rbea = field< 6,  4, eim_rcr2>;
+	using rbe  = field< 3,  3, eim_rcr2>;
+	using rben = field< 2,  0, eim_rcr2>;
+};
+
+template <unsigned CS>
+struct eim_wcr1 : reg32<eim_wcr1<CS>, EIM_REGS_BASE + CS * EIM_CS_STRIDE + 0x10> {
+	using wal   = field<31, 31, eim_wcr1>;
+	using wbed  = field<30, 30, eim_wcr1>;
+	using wwsc  = field<29, 24, eim_wcr1>;  // write wait states
+	using wadva = field<23, 21, eim_wcr1>;
+	using wadvn = field<20, 18, eim_wcr1>;
+	using wbea  = field<17, 15, eim_wcr1>;
+	using wben  = field<14, 12, eim_wcr1>;
+	using wea   = field<11,  9, eim_wcr1>;
+	using wen   = field< 8,  6, eim_wcr1>;
+	using wcsa  = field< 5,  3, eim_wcr1>;
+	using wcsn  = field< 2,  0, eim_wcr1>;
+};
+
+struct eim_wcr : reg32<eim_wcr, EIM_REGS_BASE + 0x90> {
+	using wdog_limit = field<10, 9, eim_wcr>;
+	using wdog_en    = field< 8, 8, eim_wcr>;
+	using intpol     = field< 5, 5, eim_wcr>;
+	using inten      = field< 4, 4, eim_wcr>;
+	using gbcd       = field< 2, 1, eim_wcr>;  // burst clock divisor
+	using bcm        = field< 0, 0, eim_wcr>;  // free-running BCLK
+};
+
+struct eim_wiar : reg32<eim_wiar, EIM_REGS_BASE + 0x94> {
+	using aclk_en = field<4, 4, eim_wiar>;
+	using errst   = field<3, 3, eim_wiar>;
+	using intr    = field<2, 2, eim_wiar>;
+	using ips_ack = field<1, 1, eim_wiar>;
+	using ips_req = field<0, 0, eim_wiar>;
+};
+
+
+/*
+ * IOMUXC.  Each EIM pad has a mux register and, 0x314 above it, a pad
+ * control register.
+ */
+#define IOMUXC_BASE      0x020e0000u
+#define IOMUXC_MUX_TO_PAD  0x314u
+
+struct iomuxc_gpr1 : reg32<iomuxc_gpr1, IOMUXC_BASE + 0x04> {
+	using addrs1  = field<5, 4, iomuxc_gpr1>;  // CS1 size, 1 = 64M
+	using act_cs1 = field<3, 3, iomuxc_gpr1>;
+	using addrs0  = field<2, 1, iomuxc_gpr1>;
+	using act_cs0 = field<0, 0, iomuxc_gpr1>;
+};
+
+template <uint32_t PadAddr>
+struct iomuxc_pad : reg32<iomuxc_pad<PadAddr>, PadAddr> {
+	using hys   = field<16, 16, iomuxc_pad>;
+	using pus   = field<15, 14, iomuxc_pad>;  // 2 = 100K pull-up
+	using pue   = field<13, 13, iomuxc_pad>;
+	using pke   = field<12, 12, iomuxc_pad>;
+	using ode   = field<11, 11, iomuxc_pad>;
+	using speed = field< 7,  6, iomuxc_pad>;  // 2 = 100MHz, 3 = 200MHz
+	using dse   = field< 5,  3, iomuxc_pad>;  // 6 = 40 ohm
+	using sre   = field< 0,  0, iomuxc_pad>;  // fast slew
+};
+
+template <uint32_t PadAddr>
+struct iomuxc_mux : reg32<iomuxc_mux<PadAddr>, PadAddr - IOMUXC_MUX_TO_PAD> {
+	using sion     = field<4, 4, iomuxc_mux>;
+	using mux_mode = field<2, 0, iomuxc_mux>;  // 0 = EIM
+};
+
+#define IOMUXC_PAD_EIM_DA(n)  (0x020e0428u + (n) * 4)
+#define IOMUXC_PAD_EIM_A18    0x020e0400u
+#define IOMUXC_PAD_EIM_A17    0x020e0404u
+#define IOMUXC_PAD_EIM_A16    0x020e0408u
+#define IOMUXC_PAD_EIM_CS0    0x020e040cu
+#define IOMUXC_PAD_EIM_CS1    0x020e0410u
+#define IOMUXC_PAD_EIM_OE     0x020e0414u
+#define IOMUXC_PAD_EIM_RW     0x020e0418u
+#define IOMUXC_PAD_EIM_LBA    0x020e041cu
+#define IOMUXC_PAD_EIM_WAIT   0x020e0468u
+#define IOMUXC_PAD_EIM_BCLK   0x020e046cu
+
+
+/*
+ * FPGA registers behind CS0 (16 bits) and CS1 (64 bits), indexed into the
+ * window mapped at FPGA_REG_OFFSET / FPGA_CS1_REG_OFFSET.
+ */
+template <uint32_t Addr>
+struct cs0_reg {
+	static_assert(Addr >= FPGA_REG_OFFSET && Addr < FPGA_REG_OFFSET + 0x2000,
+		      "not a CS0 register");
+	static_assert((Addr & 1) == 0, "unaligned CS0 register");
+
+	static constexpr uint32_t address = Addr;
+	static constexpr size_t index = (Addr - FPGA_REG_OFFSET) >> 1;
+	static constexpr bool readonly = Addr >= FPGA_REG_OFFSET + 0x1000;
+
+	static uint16_t read(volatile uint16_t *cs0) { return cs0[index]; }
+	static void write(volatile uint16_t *cs0, uint16_t v) {
+		static_assert(!readonly, "CS0 read-only register");
+		cs0[index] = v;
+	}
+};
+
+template <uint32_t Addr>
+struct cs1_reg {
+	static_assert(Addr >= FPGA_CS1_REG_OFFSET && Addr < FPGA_CS1_REG_OFFSET + 0x2000,
+		      "not a CS1 register");
+	static_assert((Addr & 7) == 0, "unaligned CS1 register");
+
+	static constexpr uint32_t address = Addr;
+	static constexpr size_t index = (Addr - FPGA_CS1_REG_OFFSET) >> 3;
+
+	static uint64_t read(volatile uint64_t *cs1) { return cs1[index]; }
+	static void write(volatile uint64_t *cs1, uint64_t v) { cs1[index] = v; }
+};
+
+using fpga_w_test0      = cs0_reg<FPGA_W_TEST0>;
+using fpga_w_test1      = cs0_reg<FPGA_W_TEST1>;
+using fpga_w_cpu_to_dut = cs0_reg<FPGA_W_CPU_TO_DUT>;
+using fpga_r_test0      = cs0_reg<FPGA_R_TEST0>;
+using fpga_r_test1      = cs0_reg<FPGA_R_TEST1>;
+using fpga_r_dut_to_cpu = cs0_reg<FPGA_R_DUT_TO_CPU>;
+using fpga_r_gpbb_stat  = cs0_reg<FPGA_R_GPBB_STAT>;
+using fpga_r_v_minor    = cs0_reg<FPGA_R_V_MINOR>;
+using fpga_r_v_major    = cs0_reg<FPGA_R_V_MAJOR>;
+
+struct fpga_w_gpbb_ctl : cs0_reg<FPGA_W_GPBB_CTL> {
+	static constexpr uint16_t oe_a  = 0x0001;
+	static constexpr uint16_t oe_b  = 0x0002;
+	static constexpr uint16_t vddio_5v = 0x8000;
+};
+
+using fpga_wb_loop0 = cs1_reg<FPGA_WB_LOOP0>;
+using fpga_wb_loop1 = cs1_reg<FPGA_WB_LOOP1>;
+using fpga_rb_loop0 = cs1_reg<FPGA_RB_LOOP0>;
+using fpga_rb_loop1 = cs1_reg<FPGA_RB_LOOP1>;
+
+
+/*
+ * Today's magic numbers, rebuilt from their fields.
+ */
+namespace check {
+
+// setup_fpga()/setup_fpga_cs1(): synchronous, 64-word pages, 32-word bursts
+template <unsigned CS>
+constexpr uint32_t sync_gcr1() {
+	using r = eim_gcr1<CS>;
+	return r::value(typename r::psz(3), typename r::gbc(1), typename r::aus(1),
+			typename r::csrec(1), typename r::dsz(1), typename r::wc(1),
+			typename r::bl(3), typename r::crep(1), typename r::rfl(1),
+			typename r::wfl(1), typename r::mum(1), typename r::srd(1),
+			typename r::swr(1), typename r::csen(1));
+}
+static_assert(sync_gcr1<0>() == 0x31910BBF, "EIM_CS0GCR1");
+static_assert(sync_gcr1<1>() == 0x31910BBF, "EIM_CS1GCR1");
+
+// prep_eim(): asynchronous, 256-word pages
+static_assert(eim_gcr1<0>::value(eim_gcr1<0>::psz(5), eim_gcr1<0>::gbc(1),
+				 eim_gcr1<0>::aus(1), eim_gcr1<0>::csrec(1),
+				 eim_gcr1<0>::dsz(1), eim_gcr1<0>::bcs(3),
+				 eim_gcr1<0>::crep(1), eim_gcr1<0>::rfl(1),
+				 eim_gcr1<0>::wfl(1), eim_gcr1<0>::mum(1),
+				 eim_gcr1<0>::csen(1)) == 0x5191C0B9, "prep_eim EIM_CS0GCR1");
+
+static_assert(eim_gcr2<0>::value(eim_gcr2<0>::mux16_byp_grant(1)) == 0x1000, "EIM_CS0GCR2");
+static_assert(eim_gcr2<1>::value(eim_gcr2<1>::mux16_byp_grant(1)) == 0x1000, "EIM_CS1GCR2");
+static_assert(eim_gcr2<0>::value(eim_gcr2<0>::mux16_byp_grant(1),
+				 eim_gcr2<0>::adh(1)) == 0x1001, "prep_eim EIM_CS0GCR2");
+
+static_assert(eim_rcr1<0>::value(eim_rcr1<0>::rwsc(9), eim_rcr1<0>::radvn(1),
+				 eim_rcr1<0>::oea(4)) == 0x09014000, "EIM_CS0RCR1");
+static_assert(eim_rcr1<1>::value(eim_rcr1<1>::rwsc(9), eim_rcr1<1>::radvn(1),
+				 eim_rcr1<1>::oea(4)) == 0x09014000, "EIM_CS1RCR1");
+static_assert(eim_rcr1<0>::value(eim_rcr1<0>::rwsc(10), eim_rcr1<0>::radvn(2),
+				 eim_rcr1<0>::oea(4)) == 0x0A024000, "prep_eim EIM_CS0RCR1");
+
+static_assert(eim_rcr2<0>::value() == 0x00000000, "EIM_CS0RCR2");
+static_assert(eim_rcr2<1>::value(eim_rcr2<1>::rl(2)) == 0x00000200, "EIM_CS1RCR2");
+
+static_assert(eim_wcr1<0>::value(eim_wcr1<0>::wwsc(9), eim_wcr1<0>::wadvn(2),
+				 eim_wcr1<0>::wea(4)) == 0x09080800, "EIM_CS0WCR1");
+static_assert(eim_wcr1<1>::value(eim_wcr1<1>::wwsc(2), eim_wcr1<1>::wadvn(1),
+				 eim_wcr1<1>::wea(2)) == 0x02040400, "EIM_CS1WCR1");
+
+static_assert(eim_wcr::value(eim_wcr::bcm(1), eim_wcr::wdog_en(1),
+			     eim_wcr::wdog_limit(3)) == 0x701, "EIM_WCR");
+static_assert(eim_wcr::value(eim_wcr::bcm(1)) == 0x1, "prep_eim EIM_WCR");
+static_assert(eim_wiar::value(eim_wiar::aclk_en(1)) == 0x10, "EIM_WIAR");
+
+static_assert(iomuxc_gpr1::value(iomuxc_gpr1::act_cs0(1), iomuxc_gpr1::addrs0(1),
+				 iomuxc_gpr1::act_cs1(1), iomuxc_gpr1::addrs1(1)) == 0x1B,
+	      "IOMUXC_GPR1 CS0/CS1 64M each");
+
+// pad settings for CS0 (100MHz) and CS1 (200MHz)
+template <unsigned Speed>
+constexpr uint32_t eim_pad() {
+	using r = iomuxc_pad<IOMUXC_PAD_EIM_BCLK>;
+	return r::value(r::pus(2), r::pue(1), r::pke(1), r::speed(Speed), r::dse(6), r::sre(1));
+}
+static_assert(eim_pad<2>() == 0xb0b1, "EIM pad, 100MHz");
+static_assert(eim_pad<3>() == 0xb0f1, "EIM pad, 200MHz");
+
+static_assert(eim_gcr1<1>::address == 0x21b8000 + 0x18, "EIM_CS1GCR1 address");
+static_assert(eim_wcr1<1>::address == 0x21b8010 + 0x18, "EIM_CS1WCR1 address");
+static_assert(iomuxc_mux<IOMUXC_PAD_EIM_BCLK>::address == 0x20e046c - 0x314, "BCLK mux");
+static_assert(iomuxc_mux<IOMUXC_PAD_EIM_DA(0)>::address == 0x20e0114, "DA0 mux");
+
+static_assert(fpga_w_gpbb_ctl::index == F(FPGA_W_GPBB_CTL), "F()");
+static_assert(fpga_r_dut_to_cpu::index == F(FPGA_R_DUT_TO_CPU), "F()");
+static_assert(fpga_r_v_major::index == F(FPGA_R_V_MAJOR), "F()");
+static_assert(fpga_wb_loop1::index == F1(FPGA_WB_LOOP1), "F1()");
+static_assert(fpga_rb_loop1::index == F1(FPGA_RB_LOOP1), "F1()");
+
+} // namespace check
+
+} // namespace gpbb
+
+#endif /* __GPBB_REGS_HPP__ */
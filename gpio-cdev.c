@@ -0,0 +1,509 @@
+///
+// GPIO character-device backend.
+//
+// The sysfs interface in gpio.c costs an open/write/close per pin per
+// access.  The character device (/dev/gpiochipN) hands out a line handle
+// covering up to GPIOHANDLES_MAX lines of one chip, and a single ioctl on
+// that handle reads or writes every line in it.  A gpio_lines group holds
+// one such handle per chip touched, so a mixed set of pins costs one ioctl
+// per chip instead of three syscalls per pin.
+//
+// The ABI v1 handle interface is used because it is present on every kernel
+// that has the character device at all (4.8 onwards).
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
+#include "gpio.h"
+#include "stats.h"
+
+#define GPIO_PATH "/sys/class/gpio"
+#define GPIO_CONSUMER "novena-gpbb"
+#define GPIO_BANK_SIZE 32 // i.MX6 banks, used when sysfs can't tell us
+
+struct gpio_chip_handle {
+	char chip[32];
+	int fd;
+	int nlines;
+	int offset[GPIO_LINES_MAX];
+	int index[GPIO_LINES_MAX];  // bit position in the caller's value word
+};
+
+struct gpio_lines {
+	int count;
+	int is_output;
+	int gpios[GPIO_LINES_MAX];
+	int nchips;
+	struct gpio_chip_handle chips[GPIO_LINES_MAX];
+	int sysfs_fd[GPIO_LINES_MAX]; // only used by the sysfs fallback
+};
+
+// per-gpio handles used to back the single-pin gpio_* calls
+struct gpio_cdev_pin {
+	int gpio;
+	struct gpio_lines *lines;
+	struct gpio_cdev_pin *next;
+};
+
+static struct gpio_cdev_pin *cdev_pins = NULL;
+
+static int read_sysfs_int(const char *path, int *value) {
+	char buf[32];
+	int fd;
+	int bytes;
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1)
+		return -errno;
+	bytes = read(fd, buf, sizeof(buf)-1);
+	close(fd);
+	if (bytes <= 0)
+		return -EIO;
+	buf[bytes] = '\0';
+	*value = strtol(buf, NULL, 10);
+	return 0;
+}
+
+static int gpio_cdev_chip_name(const char *sysfs_chip, char *chip, int len) {
+	char path[512];
+	struct dirent *de;
+	DIR *dir;
+	int ret = -ENOENT;
+
+	snprintf(path, sizeof(path)-1, GPIO_PATH "/%s/device", sysfs_chip);
+	dir = opendir(path);
+	if (!dir)
+		return -errno;
+
+	while ((de = readdir(dir))) {
+		if (!strncmp(de->d_name, "gpiochip", 8)) {
+			snprintf(chip, len, "/dev/%s", de->d_name);
+			ret = 0;
+			break;
+		}
+	}
+	closedir(dir);
+	return ret;
+}
+
+/*
+ * Map a global (sysfs-style) GPIO number onto a chip node and line offset.
+ */
+static int gpio_cdev_lookup(int gpio, char *chip, int len, int *offset) {
+	char path[512];
+	struct dirent *de;
+	DIR *dir;
+	int base, ngpio;
+
+	dir = opendir(GPIO_PATH);
+	if (dir) {
+		while ((de = readdir(dir))) {
+			if (strncmp(de->d_name, "gpiochip", 8))
+				continue;
+
+			snprintf(path, sizeof(path)-1, GPIO_PATH "/%s/base", de->d_name);
+			if (read_sysfs_int(path, &base))
+				continue;
+			snprintf(path, sizeof(path)-1, GPIO_PATH "/%s/ngpio", de->d_name);
+			if (read_sysfs_int(path, &ngpio))
+				continue;
+			if (gpio < base || gpio >= base + ngpio)
+				continue;
+
+			if (gpio_cdev_chip_name(de->d_name, chip, len))
+				break;
+			closedir(dir);
+			*offset = gpio - base;
+			return 0;
+		}
+		closedir(dir);
+	}
+
+	snprintf(chip, len, "/dev/gpiochip%d", gpio / GPIO_BANK_SIZE);
+	*offset = gpio % GPIO_BANK_SIZE;
+	return 0;
+}
+
+int gpio_cdev_available(void) {
+	char chip[64];
+	int offset;
+	int fd;
+
+	gpio_cdev_lookup(0, chip, sizeof(chip), &offset);
+	fd = open(chip, O_RDWR);
+	if (fd == -1)
+		return 0;
+	close(fd);
+	return 1;
+}
+
+static int gpio_cdev_request_chip(struct gpio_chip_handle *h,
+				  int is_output, uint32_t values) {
+	struct gpiohandle_request req;
+	int chipfd;
+	int i;
+
+	chipfd = open(h->chip, O_RDWR);
+	if (chipfd == -1)
+		return -errno;
+
+	memset(&req, 0, sizeof(req));
+	for (i = 0; i < h->nlines; i++) {
+		req.lineoffsets[i] = h->offset[i];
+		req.default_values[i] = (values >> h->index[i]) & 1;
+	}
+	req.lines = h->nlines;
+	req.flags = is_output ? GPIOHANDLE_REQUEST_OUTPUT : GPIOHANDLE_REQUEST_INPUT;
+	strncpy(req.consumer_label, GPIO_CONSUMER, sizeof(req.consumer_label)-1);
+
+	if (ioctl(chipfd, GPIO_GET_LINEHANDLE_IOCTL, &req) == -1) {
+		int err = -errno;
+		fprintf(stderr, "Couldn't request lines on %s: %s\n",
+			h->chip, strerror(errno));
+		close(chipfd);
+		return err;
+	}
+
+	close(chipfd);
+	h->fd = req.fd;
+	return 0;
+}
+
+static int gpio_sysfs_lines_open(struct gpio_lines *lines, uint32_t values) {
+	char gpio_path[256];
+	int i;
+
+	for (i = 0; i < lines->count; i++) {
+		int gpio = lines->gpios[i];
+
+		if (gpio_export(gpio))
+			return -EIO;
+		if (gpio_set_direction(gpio, lines->is_output))
+			return -EIO;
+
+		snprintf(gpio_path, sizeof(gpio_path)-1,
+			 GPIO_PATH "/gpio%d/value", gpio);
+		lines->sysfs_fd[i] = open(gpio_path,
+				lines->is_output ? O_RDWR : O_RDONLY);
+		if (lines->sysfs_fd[i] == -1) {
+			perror("Couldn't open value file for gpio");
+			return -errno;
+		}
+	}
+
+	if (lines->is_output)
+		return gpio_lines_set(lines, values);
+	return 0;
+}
+
+struct gpio_lines *gpio_lines_request(const int *gpios, int count,
+				      int is_output, uint32_t values) {
+	struct gpio_lines *lines;
+	char chip[32];
+	int offset;
+	int i, c;
+
+	if (count <= 0 || count > GPIO_LINES_MAX) {
+		fprintf(stderr, "gpio_lines_request: %d lines requested, max %d\n",
+			count, GPIO_LINES_MAX);
+		return NULL;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (gpios[i] & GPIO_IS_EIM) {
+			fprintf(stderr, "gpio_lines_request: EIM pin %d can't be a line\n",
+				gpios[i] & ~GPIO_IS_EIM);
+			return NULL;
+		}
+	}
+
+	lines = calloc(1, sizeof(*lines));
+	if (!lines)
+		return NULL;
+	lines->count = count;
+	lines->is_output = is_output;
+	for (i = 0; i < count; i++) {
+		lines->gpios[i] = gpios[i];
+		lines->sysfs_fd[i] = -1;
+	}
+
+	if (gpio_get_backend() != GPIO_BACKEND_CHARDEV) {
+		if (gpio_sysfs_lines_open(lines, values)) {
+			gpio_lines_release(lines);
+			return NULL;
+		}
+		return lines;
+	}
+
+	// bucket the lines by chip, so each chip is one request and one ioctl
+	for (i = 0; i < count; i++) {
+		gpio_cdev_lookup(gpios[i], chip, sizeof(chip), &offset);
+		for (c = 0; c < lines->nchips; c++)
+			if (!strcmp(lines->chips[c].chip, chip))
+				break;
+		if (c == lines->nchips) {
+			strcpy(lines->chips[c].chip, chip);
+			lines->chips[c].fd = -1;
+			lines->nchips++;
+		}
+		lines->chips[c].offset[lines->chips[c].nlines] = offset;
+		lines->chips[c].index[lines->chips[c].nlines] = i;
+		lines->chips[c].nlines++;
+	}
+
+	for (c = 0; c < lines->nchips; c++) {
+		if (gpio_cdev_request_chip(&lines->chips[c], is_output, values)) {
+			gpio_lines_release(lines);
+			return NULL;
+		}
+	}
+
+	return lines;
+}
+
+void gpio_lines_release(struct gpio_lines *lines) {
+	int i;
+
+	if (!lines)
+		return;
+	for (i = 0; i < lines->nchips; i++)
+		if (lines->chips[i].fd != -1)
+			close(lines->chips[i].fd);
+	for (i = 0; i < lines->count; i++)
+		if (lines->sysfs_fd[i] != -1)
+			close(lines->sysfs_fd[i]);
+	free(lines);
+}
+
+int gpio_lines_count(struct gpio_lines *lines) {
+	return lines->count;
+}
+
+int gpio_lines_get(struct gpio_lines *lines, uint32_t *values) {
+	struct gpiohandle_data data;
+	uint32_t result = 0;
+	char c;
+	int i, j;
+	STATS_SCOPE(STATS_GPIO_LINES_GET);
+
+	if (!lines->nchips) {
+		for (i = 0; i < lines->count; i++) {
+			if (pread(lines->sysfs_fd[i], &c, 1, 0) != 1) {
+				perror("Couldn't get input value");
+				return -errno;
+			}
+			if (c != '0')
+				result |= (1u << i);
+		}
+		*values = result;
+		return 0;
+	}
+
+	for (i = 0; i < lines->nchips; i++) {
+		struct gpio_chip_handle *h = &lines->chips[i];
+
+		if (ioctl(h->fd, GPIOHANDLE_GET_LINE_VALUES_IOCTL, &data) == -1) {
+			perror("Couldn't get line values");
+			return -errno;
+		}
+		for (j = 0; j < h->nlines; j++)
+			if (data.values[j])
+				result |= (1u << h->index[j]);
+	}
+
+	*values = result;
+	return 0;
+}
+
+int gpio_lines_set(struct gpio_lines *lines, uint32_t values) {
+	struct gpiohandle_data data;
+	int i, j;
+	STATS_SCOPE(STATS_GPIO_LINES_SET);
+
+	if (!lines->nchips) {
+		for (i = 0; i < lines->count; i++) {
+			if (pwrite(lines->sysfs_fd[i],
+				   (values >> i) & 1 ? "1" : "0", 1, 0) != 1) {
+				fprintf(stderr, "Couldn't set GPIO %d output value: %s\n",
+					lines->gpios[i], strerror(errno));
+				return -errno;
+			}
+		}
+		return 0;
+	}
+
+	for (i = 0; i < lines->nchips; i++) {
+		struct gpio_chip_handle *h = &lines->chips[i];
+
+		memset(&data, 0, sizeof(data));
+		for (j = 0; j < h->nlines; j++)
+			data.values[j] = (values >> h->index[j]) & 1;
+		if (ioctl(h->fd, GPIOHANDLE_SET_LINE_VALUES_IOCTL, &data) == -1) {
+			perror("Couldn't set line values");
+			return -errno;
+		}
+	}
+	return 0;
+}
+
+
+static struct gpio_cdev_pin *gpio_cdev_find(int gpio) {
+	struct gpio_cdev_pin *pin;
+
+	for (pin = cdev_pins; pin; pin = pin->next)
+		if (pin->gpio == gpio)
+			return pin;
+	return NULL;
+}
+
+static struct gpio_lines *gpio_cdev_pin_lines(int gpio, int is_output,
+					      int value) {
+	struct gpio_cdev_pin *pin = gpio_cdev_find(gpio);
+
+	if (pin && pin->lines->is_output == is_output)
+		return pin->lines;
+
+	if (!pin) {
+		pin = calloc(1, sizeof(*pin));
+		if (!pin)
+			return NULL;
+		pin->gpio = gpio;
+		pin->next = cdev_pins;
+		cdev_pins = pin;
+	}
+	else {
+		gpio_lines_release(pin->lines);
+	}
+
+	pin->lines = gpio_lines_request(&gpio, 1, is_output, value ? 1 : 0);
+	if (!pin->lines) {
+		gpio_cdev_release(gpio);
+		return NULL;
+	}
+	return pin->lines;
+}
+
+int gpio_cdev_release(int gpio) {
+	struct gpio_cdev_pin **p;
+
+	for (p = &cdev_pins; *p; p = &(*p)->next) {
+		if ((*p)->gpio == gpio) {
+			struct gpio_cdev_pin *pin = *p;
+			*p = pin->next;
+			gpio_lines_release(pin->lines);
+			free(pin);
+			break;
+		}
+	}
+	return 0;
+}
+
+int gpio_cdev_set_direction(int gpio, int is_output) {
+	struct gpio_cdev_pin *pin = gpio_cdev_find(gpio);
+	uint32_t value = 0;
+
+	// keep the currently driven level when flipping an output around
+	if (pin && pin->lines->is_output)
+		gpio_lines_get(pin->lines, &value);
+
+	if (!gpio_cdev_pin_lines(gpio, is_output, value))
+		return -EIO;
+	return 0;
+}
+
+int gpio_cdev_set_value(int gpio, int value) {
+	struct gpio_lines *lines = gpio_cdev_pin_lines(gpio, 1, value);
+
+	if (!lines)
+		return -EIO;
+	return gpio_lines_set(lines, value ? 1 : 0);
+}
+
+int gpio_cdev_get_value(int gpio) {
+	struct gpio_cdev_pin *pin = gpio_cdev_find(gpio);
+	struct gpio_lines *lines;
+	uint32_t value;
+	int ret;
+
+	// reading back an output is allowed, don't turn it into an input
+	lines = pin ? pin->lines : gpio_cdev_pin_lines(gpio, 0, 0);
+	if (!lines)
+		return -EIO;
+
+	ret = gpio_lines_get(lines, &value);
+	if (ret)
+		return ret;
+	return value & 1;
+}
+
+/*
+ * Line events.  The line is handed to an event request, so any handle the
+ * single-pin calls were holding on it gets dropped first.
+ */
+int gpio_cdev_request_events(int gpio, enum gpio_edge edge) {
+	struct gpioevent_request req;
+	char chip[32];
+	int offset;
+	int chipfd;
+
+	gpio_cdev_release(gpio);
+	gpio_cdev_lookup(gpio, chip, sizeof(chip), &offset);
+
+	chipfd = open(chip, O_RDWR);
+	if (chipfd == -1)
+		return -errno;
+
+	memset(&req, 0, sizeof(req));
+	req.lineoffset = offset;
+	req.handleflags = GPIOHANDLE_REQUEST_INPUT;
+	if (edge & GPIO_EDGE_RISING)
+		req.eventflags |= GPIOEVENT_REQUEST_RISING_EDGE;
+	if (edge & GPIO_EDGE_FALLING)
+		req.eventflags |= GPIOEVENT_REQUEST_FALLING_EDGE;
+	strncpy(req.consumer_label, GPIO_CONSUMER, sizeof(req.consumer_label)-1);
+
+	if (ioctl(chipfd, GPIO_GET_LINEEVENT_IOCTL, &req) == -1) {
+		int err = -errno;
+		fprintf(stderr, "Couldn't request events for gpio %d: %s\n",
+			gpio, strerror(errno));
+		close(chipfd);
+		return err;
+	}
+
+	close(chipfd);
+	return req.fd;
+}
+
+int gpio_cdev_read_event(int fd, struct gpio_event *event) {
+	struct gpioevent_data data;
+	uint64_t mono, real;
+
+	if (read(fd, &data, sizeof(data)) != sizeof(data)) {
+		perror("Couldn't read gpio event");
+		return -errno;
+	}
+
+	mono = stats_now();
+	real = stats_clock(CLOCK_REALTIME);
+	event->wakeup = mono;
+	event->value = (data.id == GPIOEVENT_EVENT_RISING_EDGE);
+
+	// kernels before 5.7 stamp events with CLOCK_REALTIME
+	if (data.timestamp <= mono)
+		event->timestamp = data.timestamp;
+	else if (data.timestamp <= real)
+		event->timestamp = mono - (real - data.timestamp);
+	else
+		event->timestamp = mono;
+	return 0;
+}
@@ -0,0 +1,194 @@
+///
+// Mixed pin groups.
+//
+// gpio.c decides per call whether a pin is an EIM-bank pin or a native
+// GPIO, and the EIM path rewrites the whole output word for every bit.  A
+// gpio_pins group does that sorting once at open: EIM pins collapse into a
+// mask over the 16-bit fpga_w_gpioa_dout/fpga_r_gpioa_din registers, and
+// native pins go into one gpio_lines group (one ioctl per chip, or held-open
+// sysfs fds).  Setting or reading the group then costs at most one EIM
+// access plus one native batch.
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <stdint.h>
+
+#include "gpio.h"
+
+struct gpio_pins {
+	int count;
+	int is_output;
+	uint32_t out;          // last value written, in caller bit order
+
+	uint32_t eim_pins;     // caller bits that live on the EIM bank
+	uint16_t eim_mask;
+	int eim_bit[GPIO_LINES_MAX];
+
+	uint32_t line_pins;    // caller bits that are native GPIOs
+	struct gpio_lines *lines;
+	int line_bit[GPIO_LINES_MAX];
+};
+
+static uint16_t gpio_pins_to_eim(struct gpio_pins *pins, uint32_t values) {
+	uint16_t eim = 0;
+	int i;
+
+	for (i = 0; i < pins->count; i++)
+		if ((pins->eim_pins & values) & (1u << i))
+			eim |= 1u << pins->eim_bit[i];
+	return eim;
+}
+
+static uint32_t gpio_pins_to_lines(struct gpio_pins *pins, uint32_t values) {
+	uint32_t lines = 0;
+	int i;
+
+	for (i = 0; i < pins->count; i++)
+		if ((pins->line_pins & values) & (1u << i))
+			lines |= 1u << pins->line_bit[i];
+	return lines;
+}
+
+struct gpio_pins *gpio_pins_open(const int *gpios, int count,
+				 int is_output, uint32_t values) {
+	struct gpio_pins *pins;
+	int native[GPIO_LINES_MAX];
+	int nnative = 0;
+	int i;
+
+	if (count <= 0 || count > GPIO_LINES_MAX) {
+		fprintf(stderr, "gpio_pins_open: %d pins requested, max %d\n",
+			count, GPIO_LINES_MAX);
+		errno = EINVAL;
+		return NULL;
+	}
+
+	pins = calloc(1, sizeof(*pins));
+	if (!pins)
+		return NULL;
+	pins->count = count;
+	pins->is_output = is_output;
+
+	for (i = 0; i < count; i++) {
+		if (gpios[i] & GPIO_IS_EIM) {
+			int bit = gpios[i] & ~GPIO_IS_EIM;
+
+			// the EIM bank is one 16-bit register
+			if (bit > 15) {
+				fprintf(stderr, "gpio_pins_open: EIM pin %d out of range\n", bit);
+				free(pins);
+				errno = EINVAL;
+				return NULL;
+			}
+			pins->eim_bit[i] = bit;
+			pins->eim_pins |= 1u << i;
+			pins->eim_mask |= 1u << pins->eim_bit[i];
+		}
+		else {
+			pins->line_bit[i] = nnative;
+			pins->line_pins |= 1u << i;
+			native[nnative++] = gpios[i];
+		}
+	}
+
+	if (nnative) {
+		pins->lines = gpio_lines_request(native, nnative, is_output,
+						 gpio_pins_to_lines(pins, values));
+		if (!pins->lines) {
+			free(pins);
+			return NULL;
+		}
+	}
+
+	if (pins->eim_mask) {
+		if (is_output)
+			eim_set_bits(pins->eim_mask, gpio_pins_to_eim(pins, values));
+		if (eim_set_direction_bits(pins->eim_mask,
+					   is_output ? pins->eim_mask : 0)) {
+			gpio_pins_close(pins);
+			return NULL;
+		}
+	}
+
+	pins->out = values;
+	return pins;
+}
+
+void gpio_pins_close(struct gpio_pins *pins) {
+	if (!pins)
+		return;
+	gpio_lines_release(pins->lines);
+	free(pins);
+}
+
+int gpio_pins_set(struct gpio_pins *pins, uint32_t values) {
+	int ret;
+
+	if (pins->eim_mask) {
+		ret = eim_set_bits(pins->eim_mask, gpio_pins_to_eim(pins, values));
+		if (ret)
+			return ret;
+	}
+	if (pins->lines) {
+		ret = gpio_lines_set(pins->lines, gpio_pins_to_lines(pins, values));
+		if (ret)
+			return ret;
+	}
+
+	pins->out = values;
+	return 0;
+}
+
+/*
+ * Only touch the backends that own a bit which actually changes.
+ */
+int gpio_pins_update(struct gpio_pins *pins, uint32_t values, uint32_t mask) {
+	uint32_t next = (pins->out & ~mask) | (values & mask);
+	uint32_t changed = next ^ pins->out;
+	int ret;
+
+	if (changed & pins->eim_pins) {
+		ret = eim_set_bits(gpio_pins_to_eim(pins, changed),
+				   gpio_pins_to_eim(pins, next));
+		if (ret)
+			return ret;
+	}
+	if (changed & pins->line_pins) {
+		ret = gpio_lines_set(pins->lines, gpio_pins_to_lines(pins, next));
+		if (ret)
+			return ret;
+	}
+
+	pins->out = next;
+	return 0;
+}
+
+int gpio_pins_get(struct gpio_pins *pins, uint32_t *values) {
+	uint32_t result = 0;
+	uint32_t lines;
+	uint16_t eim;
+	int ret;
+	int i;
+
+	if (pins->eim_mask) {
+		ret = eim_get_bits(&eim);
+		if (ret)
+			return ret;
+		for (i = 0; i < pins->count; i++)
+			if ((pins->eim_pins & (1u << i)) && (eim & (1u << pins->eim_bit[i])))
+				result |= 1u << i;
+	}
+	if (pins->lines) {
+		ret = gpio_lines_get(pins->lines, &lines);
+		if (ret)
+			return ret;
+		for (i = 0; i < pins->count; i++)
+			if ((pins->line_pins & (1u << i)) && (lines & (1u << pins->line_bit[i])))
+				result |= 1u << i;
+	}
+
+	*values = result;
+	return 0;
+}
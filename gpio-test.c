@@ -0,0 +1,616 @@
+///
+// GPIO backend tests against an in-process fake chip.
+//
+// Like gpbb-bench, this is linked with -Wl,--wrap shims, so gpio.c and
+// gpio-cdev.c run unmodified.  /sys/class/gpio is redirected to a scratch
+// directory laid out the way the kernel lays it out (two gpiochips, export
+// and unexport files that create and remove gpioN/), and /dev/gpiochipN
+// opens and ioctls are served by a fake chip holding 64 line levels.  As in
+// the kernel, a line that sysfs exports can't be requested through the
+// chardev, and a line can be held by one handle at a time.  A line event
+// request gets the read end of a pipe, which fake_edge() feeds.
+//
+// Each case drives a backend through the gpio_* calls and checks the
+// levels the fake chip ends up with, and the values read back.  Exit status
+// is the number of failed checks.
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/gpio.h>
+
+#include "gpio.h"
+#include "novena-gpbb.h"
+#include "sim.h"
+
+#define SYSFS_GPIO   "/sys/class/gpio"
+#define FAKE_LINES   64   // gpiochip0 at base 0, gpiochip1 at base 32
+#define FAKE_FDS     256
+
+enum fake_kind {
+	FAKE_NONE = 0,
+	FAKE_EXPORT,
+	FAKE_UNEXPORT,
+	FAKE_CHIP,
+	FAKE_HANDLE,
+	FAKE_EVENT,
+};
+
+static struct {
+	int kind;
+	int chip;
+	int is_output;
+	int nlines;
+	int line[GPIOHANDLES_MAX];  // global line numbers
+	int feed;                   // FAKE_EVENT: the pipe's write end
+} fake_fd[FAKE_FDS];
+
+static char fake_root[64];
+static int fake_level[FAKE_LINES];  // levels of lines sysfs doesn't export
+static int fake_owner[FAKE_LINES];  // fd of the handle holding a line, or 0
+static int failures;
+
+#define CHECK(cond, ...) \
+	do { \
+		if (!(cond)) { \
+			failures++; \
+			printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+			printf(__VA_ARGS__); \
+			printf("\n"); \
+		} \
+	} while (0)
+
+int __real_open(const char *path, int flags, ...);
+int __real_close(int fd);
+ssize_t __real_write(int fd, const void *buf, size_t count);
+int __real_ioctl(int fd, unsigned long request, ...);
+int __real_stat(const char *path, struct stat *st);
+DIR *__real_opendir(const char *path);
+
+static const char *fake_path(const char *path, char *buf, size_t len) {
+	if (strncmp(path, SYSFS_GPIO, strlen(SYSFS_GPIO)))
+		return path;
+	snprintf(buf, len, "%s%s", fake_root, path + strlen(SYSFS_GPIO));
+	return buf;
+}
+
+static int fake_new_fd(int kind) {
+	int fd = __real_open("/dev/null", O_RDWR);
+
+	if (fd < 0 || fd >= FAKE_FDS) {
+		if (fd >= 0)
+			__real_close(fd);
+		errno = EMFILE;
+		return -1;
+	}
+	memset(&fake_fd[fd], 0, sizeof(fake_fd[fd]));
+	fake_fd[fd].kind = kind;
+	return fd;
+}
+
+static void fake_file(int gpio, const char *name, const char *fmt, ...) {
+	char path[256];
+	va_list ap;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/gpio%d/%s", fake_root, gpio, name);
+	f = fopen(path, "w");
+	if (!f)
+		return;
+	va_start(ap, fmt);
+	vfprintf(f, fmt, ap);
+	va_end(ap);
+	fclose(f);
+}
+
+static int fake_exported(int gpio) {
+	char path[256];
+	struct stat st;
+
+	snprintf(path, sizeof(path), "%s/gpio%d", fake_root, gpio);
+	return __real_stat(path, &st) == 0;
+}
+
+// the level of a line, wherever it currently lives
+static int fake_get(int gpio) {
+	char path[256];
+	char c = '0';
+	FILE *f;
+
+	if (!fake_exported(gpio))
+		return fake_level[gpio];
+	snprintf(path, sizeof(path), "%s/gpio%d/value", fake_root, gpio);
+	f = fopen(path, "r");
+	if (f) {
+		if (fread(&c, 1, 1, f) != 1)
+			c = '0';
+		fclose(f);
+	}
+	return c != '0';
+}
+
+// something outside driving a line
+static void fake_set(int gpio, int level) {
+	if (fake_exported(gpio))
+		fake_file(gpio, "value", "%d\n", level);
+	else
+		fake_level[gpio] = level;
+}
+
+static int fake_export(int gpio, int export) {
+	static const char *files[] = { "direction", "value", "edge" };
+	char path[256];
+	int i;
+
+	if (gpio < 0 || gpio >= FAKE_LINES)
+		return -EINVAL;
+	if (export) {
+		if (fake_exported(gpio) || fake_owner[gpio])
+			return -EBUSY;
+		snprintf(path, sizeof(path), "%s/gpio%d", fake_root, gpio);
+		mkdir(path, 0755);
+		fake_file(gpio, "direction", "in\n");
+		fake_file(gpio, "value", "%d\n", fake_level[gpio]);
+		fake_file(gpio, "edge", "none\n");
+		return 0;
+	}
+
+	if (!fake_exported(gpio))
+		return -EINVAL;
+	fake_level[gpio] = fake_get(gpio);
+	for (i = 0; i < 3; i++) {
+		snprintf(path, sizeof(path), "%s/gpio%d/%s", fake_root, gpio, files[i]);
+		unlink(path);
+	}
+	snprintf(path, sizeof(path), "%s/gpio%d", fake_root, gpio);
+	rmdir(path);
+	return 0;
+}
+
+int __wrap_open(const char *path, int flags, ...) {
+	char buf[512];
+	mode_t mode = 0;
+	va_list ap;
+	int fd;
+
+	if (flags & O_CREAT) {
+		va_start(ap, flags);
+		mode = va_arg(ap, int);
+		va_end(ap);
+	}
+
+	if (!strncmp(path, "/dev/gpiochip", 13)) {
+		int chip = atoi(path + 13);
+
+		if (chip < 0 || chip >= FAKE_LINES / 32) {
+			errno = ENOENT;
+			return -1;
+		}
+		fd = fake_new_fd(FAKE_CHIP);
+		if (fd >= 0)
+			fake_fd[fd].chip = chip;
+		return fd;
+	}
+	if (!strcmp(path, SYSFS_GPIO "/export"))
+		return fake_new_fd(FAKE_EXPORT);
+	if (!strcmp(path, SYSFS_GPIO "/unexport"))
+		return fake_new_fd(FAKE_UNEXPORT);
+	return __real_open(fake_path(path, buf, sizeof(buf)), flags, mode);
+}
+
+int __wrap_close(int fd) {
+	int i;
+
+	if (fd >= 0 && fd < FAKE_FDS && fake_fd[fd].kind) {
+		for (i = 0; i < fake_fd[fd].nlines; i++)
+			if (fake_owner[fake_fd[fd].line[i]] == fd)
+				fake_owner[fake_fd[fd].line[i]] = 0;
+		if (fake_fd[fd].kind == FAKE_EVENT)
+			__real_close(fake_fd[fd].feed);
+		fake_fd[fd].kind = FAKE_NONE;
+	}
+	return __real_close(fd);
+}
+
+ssize_t __wrap_write(int fd, const void *buf, size_t count) {
+	char str[16];
+	int kind = fd >= 0 && fd < FAKE_FDS ? fake_fd[fd].kind : FAKE_NONE;
+	int ret;
+
+	if (kind != FAKE_EXPORT && kind != FAKE_UNEXPORT)
+		return __real_write(fd, buf, count);
+	snprintf(str, sizeof(str), "%.*s", (int)(count < sizeof(str) ? count : sizeof(str) - 1),
+		 (const char *)buf);
+	ret = fake_export(atoi(str), kind == FAKE_EXPORT);
+	if (ret) {
+		errno = -ret;
+		return -1;
+	}
+	return count;
+}
+
+static int fake_linehandle(int chipfd, struct gpiohandle_request *req) {
+	int base = fake_fd[chipfd].chip * 32;
+	int i, fd, gpio;
+
+	if (req->lines < 1 || req->lines > GPIOHANDLES_MAX)
+		return -EINVAL;
+	for (i = 0; i < (int)req->lines; i++) {
+		if (req->lineoffsets[i] >= 32)
+			return -EINVAL;
+		gpio = base + req->lineoffsets[i];
+		if (fake_exported(gpio) || fake_owner[gpio])
+			return -EBUSY;
+	}
+
+	fd = fake_new_fd(FAKE_HANDLE);
+	if (fd < 0)
+		return -errno;
+	fake_fd[fd].is_output = !!(req->flags & GPIOHANDLE_REQUEST_OUTPUT);
+	fake_fd[fd].nlines = req->lines;
+	for (i = 0; i < (int)req->lines; i++) {
+		gpio = base + req->lineoffsets[i];
+		fake_fd[fd].line[i] = gpio;
+		fake_owner[gpio] = fd;
+		if (fake_fd[fd].is_output)
+			fake_level[gpio] = req->default_values[i] != 0;
+	}
+	req->fd = fd;
+	return 0;
+}
+
+static int fake_lineevent(int chipfd, struct gpioevent_request *req) {
+	int gpio = fake_fd[chipfd].chip * 32 + req->lineoffset;
+	int p[2];
+
+	if (req->lineoffset >= 32)
+		return -EINVAL;
+	if (fake_exported(gpio) || fake_owner[gpio])
+		return -EBUSY;
+	if (pipe(p) < 0)
+		return -errno;
+	if (p[0] >= FAKE_FDS) {
+		__real_close(p[0]);
+		__real_close(p[1]);
+		return -EMFILE;
+	}
+	memset(&fake_fd[p[0]], 0, sizeof(fake_fd[p[0]]));
+	fake_fd[p[0]].kind = FAKE_EVENT;
+	fake_fd[p[0]].nlines = 1;
+	fake_fd[p[0]].line[0] = gpio;
+	fake_fd[p[0]].feed = p[1];
+	fake_owner[gpio] = p[0];
+	req->fd = p[0];
+	return 0;
+}
+
+// an edge on a line someone is waiting on
+static int fake_edge(int gpio, int level) {
+	struct gpioevent_data ev;
+	int fd = fake_owner[gpio];
+
+	fake_level[gpio] = level;
+	if (!fd || fake_fd[fd].kind != FAKE_EVENT)
+		return -1;
+	memset(&ev, 0, sizeof(ev));
+	ev.timestamp = 1;
+	ev.id = level ? GPIOEVENT_EVENT_RISING_EDGE : GPIOEVENT_EVENT_FALLING_EDGE;
+	return __real_write(fake_fd[fd].feed, &ev, sizeof(ev)) == sizeof(ev) ? 0 : -1;
+}
+
+int __wrap_ioctl(int fd, unsigned long request, ...) {
+	struct gpiohandle_data *data;
+	va_list ap;
+	void *arg;
+	int kind = fd >= 0 && fd < FAKE_FDS ? fake_fd[fd].kind : FAKE_NONE;
+	int i, ret = 0;
+
+	va_start(ap, request);
+	arg = va_arg(ap, void *);
+	va_end(ap);
+
+	if (kind == FAKE_NONE)
+		return __real_ioctl(fd, request, arg);
+
+	if (kind == FAKE_CHIP && request == GPIO_GET_LINEHANDLE_IOCTL)
+		ret = fake_linehandle(fd, arg);
+	else if (kind == FAKE_CHIP && request == GPIO_GET_LINEEVENT_IOCTL)
+		ret = fake_lineevent(fd, arg);
+	else if (kind == FAKE_HANDLE && request == GPIOHANDLE_GET_LINE_VALUES_IOCTL) {
+		data = arg;
+		memset(data, 0, sizeof(*data));
+		for (i = 0; i < fake_fd[fd].nlines; i++)
+			data->values[i] = fake_level[fake_fd[fd].line[i]];
+	}
+	else if (kind == FAKE_HANDLE && request == GPIOHANDLE_SET_LINE_VALUES_IOCTL) {
+		data = arg;
+		if (!fake_fd[fd].is_output)
+			ret = -EPERM;
+		for (i = 0; !ret && i < fake_fd[fd].nlines; i++)
+			fake_level[fake_fd[fd].line[i]] = data->values[i] != 0;
+	}
+	else
+		ret = -ENOTTY;
+
+	if (ret) {
+		errno = -ret;
+		return -1;
+	}
+	return 0;
+}
+
+int __wrap_stat(const char *path, struct stat *st) {
+	char buf[512];
+
+	return __real_stat(fake_path(path, buf, sizeof(buf)), st);
+}
+
+DIR *__wrap_opendir(const char *path) {
+	char buf[512];
+
+	return __real_opendir(fake_path(path, buf, sizeof(buf)));
+}
+
+static void fake_sysfs_file(const char *name, const char *value) {
+	char path[256];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s/%s", fake_root, name);
+	f = fopen(path, "w");
+	if (f) {
+		fputs(value, f);
+		fclose(f);
+	}
+}
+
+static int fake_setup(void) {
+	char path[256], num[16];
+	int chip;
+
+	strcpy(fake_root, "/tmp/gpio-test.XXXXXX");
+	if (!mkdtemp(fake_root)) {
+		perror("Unable to create the fake sysfs tree");
+		return -1;
+	}
+	fake_sysfs_file("export", "");
+	fake_sysfs_file("unexport", "");
+	for (chip = 0; chip < FAKE_LINES / 32; chip++) {
+		// sysfs names a chip by its base, the chardev by its index
+		snprintf(path, sizeof(path), "%s/gpiochip%d", fake_root, chip * 32);
+		mkdir(path, 0755);
+		snprintf(path, sizeof(path), "%s/gpiochip%d/device", fake_root, chip * 32);
+		mkdir(path, 0755);
+		snprintf(path, sizeof(path), "%s/gpiochip%d/device/gpiochip%d",
+			 fake_root, chip * 32, chip);
+		mkdir(path, 0755);
+		snprintf(path, sizeof(path), "gpiochip%d/base", chip * 32);
+		snprintf(num, sizeof(num), "%d\n", chip * 32);
+		fake_sysfs_file(path, num);
+		snprintf(path, sizeof(path), "gpiochip%d/ngpio", chip * 32);
+		fake_sysfs_file(path, "32\n");
+	}
+	return 0;
+}
+
+static void fake_teardown(void) {
+	char cmd[128];
+
+	snprintf(cmd, sizeof(cmd), "rm -rf %s", fake_root);
+	if (system(cmd))
+		fprintf(stderr, "Unable to remove %s\n", fake_root);
+}
+
+static int fake_fds(int kind) {
+	int fd, n = 0;
+
+	for (fd = 0; fd < FAKE_FDS; fd++)
+		n += fake_fd[fd].kind == kind;
+	return n;
+}
+
+
+static void test_sysfs(void) {
+	static const int group[] = { 5, 6, 40 };
+	struct gpio_lines *lines;
+	uint32_t values;
+	int i;
+
+	CHECK(gpio_set_backend(GPIO_BACKEND_SYSFS) == GPIO_BACKEND_SYSFS, "sysfs backend");
+
+	// an output, and its level back through sysfs and the chip
+	CHECK(gpio_export(3) == 0, "export 3");
+	CHECK(fake_exported(3), "gpio3/ exists after export");
+	CHECK(gpio_set_direction(3, GPIO_OUT) == 0, "direction 3");
+	CHECK(gpio_set_value(3, 1) == 0, "set 3");
+	CHECK(gpio_get_value(3) == 1, "get 3 after set 1");
+	CHECK(gpio_set_value(3, 0) == 0 && gpio_get_value(3) == 0, "get 3 after set 0");
+	CHECK(gpio_set_value(3, 1) == 0, "set 3 again");
+	CHECK(gpio_unexport(3) == 0, "unexport 3");
+	CHECK(!fake_exported(3) && fake_level[3] == 1, "chip keeps 3 high after unexport");
+
+	// an input driven from outside
+	fake_level[4] = 1;
+	CHECK(gpio_export(4) == 0 && gpio_set_direction(4, GPIO_IN) == 0, "export 4 as input");
+	CHECK(gpio_get_value(4) == 1, "input 4 reads 1");
+	fake_set(4, 0);
+	CHECK(gpio_get_value(4) == 0, "input 4 follows the chip to 0");
+	gpio_unexport(4);
+
+	// a group across both chips, on held-open value files
+	lines = gpio_lines_request(group, 3, GPIO_OUT, 0x5);
+	CHECK(lines != NULL, "sysfs group request");
+	if (lines) {
+		CHECK(gpio_lines_get(lines, &values) == 0 && values == 0x5,
+		      "group reads back 0x5, got 0x%x", values);
+		CHECK(gpio_lines_set(lines, 0x2) == 0, "group set 0x2");
+		CHECK(fake_get(5) == 0 && fake_get(6) == 1 && fake_get(40) == 0,
+		      "chip has 0,1,0 after group set 0x2");
+		fake_set(40, 1);
+		CHECK(gpio_lines_get(lines, &values) == 0 && values == 0x6,
+		      "group sees the chip's 40 go high, got 0x%x", values);
+		gpio_lines_release(lines);
+	}
+	for (i = 0; i < 3; i++)
+		gpio_unexport(group[i]);
+	CHECK(!fake_exported(5) && !fake_exported(40), "group unexported");
+}
+
+static void test_chardev(void) {
+	static const int group[] = { 1, 2, 33, 34 };
+	struct gpio_lines *lines;
+	uint32_t values;
+	int i;
+
+	CHECK(gpio_set_backend(GPIO_BACKEND_CHARDEV) == GPIO_BACKEND_CHARDEV, "chardev backend");
+
+	// single-pin calls through per-pin handles
+	CHECK(gpio_set_value(3, 0) == 0 && fake_level[3] == 0, "chardev set 3 to 0");
+	CHECK(gpio_get_value(3) == 0, "chardev reads 3 back as 0");
+	CHECK(gpio_set_value(3, 1) == 0 && fake_level[3] == 1, "chardev set 3 to 1");
+	CHECK(gpio_get_value(3) == 1, "chardev reads 3 back as 1");
+	fake_level[4] = 1;
+	CHECK(gpio_get_value(4) == 1, "chardev input 4 reads 1");
+	fake_level[4] = 0;
+	CHECK(gpio_get_value(4) == 0, "chardev input 4 reads 0");
+	CHECK(gpio_set_direction(3, GPIO_IN) == 0 && gpio_get_value(3) == 1,
+	      "3 turned around to an input still reads 1");
+
+	// the single-pin handle owns 3, so a group can't have it
+	lines = gpio_lines_request((int []){ 3 }, 1, GPIO_IN, 0);
+	CHECK(lines == NULL, "a held line can't be requested twice");
+	gpio_lines_release(lines);
+	CHECK(gpio_unexport(3) == 0 && gpio_unexport(4) == 0, "release 3 and 4");
+	CHECK(fake_owner[3] == 0 && fake_owner[4] == 0 && fake_fds(FAKE_HANDLE) == 0,
+	      "no handles left after release");
+
+	// one handle, and one ioctl, per chip
+	lines = gpio_lines_request(group, 4, GPIO_OUT, 0x9);
+	CHECK(lines != NULL, "chardev group request");
+	if (lines) {
+		CHECK(fake_fds(FAKE_HANDLE) == 2, "group spans two chips, %d handles", fake_fds(FAKE_HANDLE));
+		CHECK(fake_level[1] == 1 && fake_level[2] == 0 && fake_level[33] == 0 &&
+		      fake_level[34] == 1, "group defaults 0x9 on the chip");
+		CHECK(gpio_lines_get(lines, &values) == 0 && values == 0x9,
+		      "group reads back 0x9, got 0x%x", values);
+		CHECK(gpio_lines_set(lines, 0x6) == 0, "group set 0x6");
+		CHECK(gpio_lines_get(lines, &values) == 0 && values == 0x6,
+		      "group reads back 0x6, got 0x%x", values);
+		gpio_lines_release(lines);
+	}
+	CHECK(fake_fds(FAKE_HANDLE) == 0, "group released");
+
+	// a line sysfs still exports is busy for the chardev
+	gpio_set_backend(GPIO_BACKEND_SYSFS);
+	CHECK(gpio_export(8) == 0, "sysfs export 8");
+	gpio_set_backend(GPIO_BACKEND_CHARDEV);
+	CHECK(gpio_get_value(8) < 0, "chardev can't read exported 8");
+	gpio_set_backend(GPIO_BACKEND_SYSFS);
+	CHECK(gpio_unexport(8) == 0, "sysfs unexport 8");
+	gpio_set_backend(GPIO_BACKEND_CHARDEV);
+	CHECK(gpio_get_value(8) == 0, "chardev reads 8 once sysfs lets go");
+	gpio_unexport(8);
+
+	for (i = 0; i < FAKE_LINES; i++)
+		CHECK(!fake_owner[i], "line %d still held", i);
+	gpio_set_backend(GPIO_BACKEND_SYSFS);
+}
+
+static void test_chardev_edges(void) {
+	static const int pins[] = { 10, 35 };
+	struct gpio_event ev[4];
+	int n;
+
+	gpio_set_backend(GPIO_BACKEND_CHARDEV);
+	CHECK(gpio_set_edge(10, GPIO_EDGE_BOTH) == 0 && gpio_set_edge(35, GPIO_EDGE_RISING) == 0,
+	      "arm edges on 10 and 35");
+	CHECK(fake_fds(FAKE_EVENT) == 2, "two event fds, got %d", fake_fds(FAKE_EVENT));
+	CHECK(gpio_wait_edges(pins, 2, 0, ev, 4) == 0, "no edge yet");
+
+	fake_edge(35, 1);
+	n = gpio_wait_edges(pins, 2, 100, ev, 4);
+	CHECK(n == 1 && ev[0].gpio == 35 && ev[0].value == 1, "rising edge on 35");
+	fake_edge(10, 0);
+	n = gpio_wait_edges(pins, 2, 100, ev, 4);
+	CHECK(n == 1 && ev[0].gpio == 10 && ev[0].value == 0, "falling edge on 10");
+
+	// unexport has to hand the line back, event fd and all
+	CHECK(gpio_unexport(10) == 0, "unexport 10");
+	CHECK(!fake_owner[10] && fake_fds(FAKE_EVENT) == 1, "10's event fd closed");
+	CHECK(gpio_wait_edges(pins, 1, 0, ev, 4) == -EINVAL, "10 no longer armed");
+	CHECK(gpio_set_value(10, 1) == 0 && fake_level[10] == 1, "10 usable as an output again");
+	gpio_unexport(10);
+	CHECK(gpio_set_edge(35, GPIO_EDGE_NONE) == 0 && !fake_owner[35] &&
+	      fake_fds(FAKE_EVENT) == 0, "disarming 35 closes its fd");
+	gpio_set_backend(GPIO_BACKEND_SYSFS);
+}
+
+static void test_pins(void) {
+	// EIM bits 0 and 3 between native lines on either chip
+	static const int group[] = { 5, GPIO_IS_EIM | 0, 33, GPIO_IS_EIM | 3 };
+	struct gpio_pins *pins;
+	uint32_t values;
+
+	// the EIM bank goes to the model, whose loopback reads the low byte of
+	// DOUT back while DIR bit 0 is set
+	CHECK(sim_enable(NULL) == 0, "sim for the EIM bank");
+	gpio_set_backend(GPIO_BACKEND_CHARDEV);
+
+	pins = gpio_pins_open(group, 4, GPIO_OUT, 0x3);
+	CHECK(pins != NULL, "mixed group open");
+	if (pins) {
+		CHECK(fake_level[5] == 1 && fake_level[33] == 0, "native pins default to 1,0");
+		CHECK((sim_mem_read(FPGA_W_CPU_TO_DUT, 2) & 0x9) == 0x1,
+		      "EIM pins default to 1,0");
+		CHECK(fake_fds(FAKE_HANDLE) == 2, "native pins in %d handles", fake_fds(FAKE_HANDLE));
+		CHECK(gpio_pins_get(pins, &values) == 0 && values == 0x3,
+		      "group reads back 0x3, got 0x%x", values);
+
+		CHECK(gpio_pins_set(pins, 0xc) == 0, "group set 0xc");
+		CHECK(fake_level[5] == 0 && fake_level[33] == 1 &&
+		      (sim_mem_read(FPGA_W_CPU_TO_DUT, 2) & 0x9) == 0x8,
+		      "0xc lands on 33 and EIM bit 3");
+		CHECK(gpio_pins_get(pins, &values) == 0 && values == 0xc,
+		      "group reads back 0xc, got 0x%x", values);
+
+		// only the bits under the mask move
+		CHECK(gpio_pins_update(pins, 0x1, 0x3) == 0, "update bits 0-1 to 1,0");
+		CHECK(fake_level[5] == 1 && fake_level[33] == 1, "5 set, 33 untouched");
+		CHECK(gpio_pins_get(pins, &values) == 0 && values == 0xd,
+		      "group reads back 0xd, got 0x%x", values);
+		gpio_pins_close(pins);
+	}
+	CHECK(fake_fds(FAKE_HANDLE) == 0, "group released");
+
+	// the EIM bank has 16 bits; bit 16 must not alias bit 0
+	errno = 0;
+	pins = gpio_pins_open((int []){ 5, GPIO_IS_EIM | 16 }, 2, GPIO_OUT, 0);
+	CHECK(pins == NULL && errno == EINVAL, "EIM bit 16 rejected");
+	gpio_pins_close(pins);
+	CHECK(fake_fds(FAKE_HANDLE) == 0, "nothing held after the rejected open");
+
+	gpio_set_backend(GPIO_BACKEND_SYSFS);
+	sim_enabled = 0;
+}
+
+int main(int argc, char **argv) {
+	if (fake_setup())
+		return 1;
+
+	test_sysfs();
+	test_chardev();
+	test_chardev_edges();
+	test_pins();
+
+	fake_teardown();
+	printf("gpio-test: %s (%d failed)\n", failures ? "FAIL" : "ok", failures);
+	return failures;
+}
@@ -8,13 +8,43 @@
 #include <sys/stat.h>
 #include <sys/mman.h>
 #include <stdint.h>
+#include <poll.h>
+#include <time.h>
 
 #include "gpio.h"
+#include "stats.h"
 
 #define GPIO_PATH "/sys/class/gpio"
 #define EXPORT_PATH GPIO_PATH "/export"
 #define UNEXPORT_PATH GPIO_PATH "/unexport"
 
+static enum gpio_backend gpio_backend = GPIO_BACKEND_SYSFS;
+
+// pins armed for edge waits, with the fd that poll() blocks on
+struct gpio_edge_pin {
+	int gpio;
+	int fd;
+	int cdev;  // fd is a chardev line event fd, not a sysfs value fd
+	struct gpio_edge_pin *next;
+};
+
+static struct gpio_edge_pin *edge_pins = NULL;
+
+static void gpio_edge_remove(int gpio);
+
+enum gpio_backend gpio_set_backend(enum gpio_backend backend) {
+	if (backend == GPIO_BACKEND_CHARDEV && !gpio_cdev_available()) {
+		fprintf(stderr, "GPIO character device unavailable, using sysfs\n");
+		backend = GPIO_BACKEND_SYSFS;
+	}
+	gpio_backend = backend;
+	return gpio_backend;
+}
+
+enum gpio_backend gpio_get_backend(void) {
+	return gpio_backend;
+}
+
 static int gpio_is_exported(int gpio) {
 	char gpio_path[256];
 	struct stat buf;
@@ -54,6 +84,8 @@ static int gpio_export_unexport(char *path, int gpio) {
 int gpio_export(int gpio) {
 	if (gpio&GPIO_IS_EIM)
 		return 0;
+	if (gpio_backend == GPIO_BACKEND_CHARDEV)
+		return 0;
 	if (gpio_is_exported(gpio))
 		return 0;
 	return gpio_export_unexport(EXPORT_PATH, gpio);
@@ -62,6 +94,10 @@ int gpio_export(int gpio) {
 int gpio_unexport(int gpio) {
 	if (gpio&GPIO_IS_EIM)
 		return 0;
+	// either backend's edge fd holds the line
+	gpio_edge_remove(gpio);
+	if (gpio_backend == GPIO_BACKEND_CHARDEV)
+		return gpio_cdev_release(gpio);
 	if (!gpio_is_exported(gpio))
 		return 0;
 	return gpio_export_unexport(UNEXPORT_PATH, gpio);
@@ -71,9 +107,12 @@ int gpio_set_direction(int gpio, int is_output) {
 	char gpio_path[256];
 	int fd;
 	int ret;
+	STATS_SCOPE(STATS_GPIO_DIRECTION);
 
 	if (gpio&GPIO_IS_EIM)
 		return eim_set_direction(gpio&(~GPIO_IS_EIM), is_output);
+	if (gpio_backend == GPIO_BACKEND_CHARDEV)
+		return gpio_cdev_set_direction(gpio, is_output);
 
 	snprintf(gpio_path, sizeof(gpio_path)-1, GPIO_PATH "/gpio%d/direction", gpio);
 
@@ -104,9 +143,12 @@ int gpio_set_value(int gpio, int value) {
 	char gpio_path[256];
 	int fd;
 	int ret;
+	STATS_SCOPE(STATS_GPIO_SET);
 
 	if (gpio&GPIO_IS_EIM)
 		return eim_set_value(gpio&(~GPIO_IS_EIM), value);
+	if (gpio_backend == GPIO_BACKEND_CHARDEV)
+		return gpio_cdev_set_value(gpio, value);
 
 	snprintf(gpio_path, sizeof(gpio_path)-1, GPIO_PATH "/gpio%d/value", gpio);
 
@@ -137,9 +179,12 @@ int gpio_set_value(int gpio, int value) {
 int gpio_get_value(int gpio) {
 	char gpio_path[256];
 	int fd;
+	STATS_SCOPE(STATS_GPIO_GET);
 
 	if (gpio&GPIO_IS_EIM)
 		return eim_get_value(gpio&(~GPIO_IS_EIM));
+	if (gpio_backend == GPIO_BACKEND_CHARDEV)
+		return gpio_cdev_get_value(gpio);
 
 	snprintf(gpio_path, sizeof(gpio_path)-1, GPIO_PATH "/gpio%d/value", gpio);
 
@@ -161,3 +206,168 @@ int gpio_get_value(int gpio) {
 }
 
 
+
+
+static struct gpio_edge_pin *gpio_edge_find(int gpio) {
+	struct gpio_edge_pin *pin;
+
+	for (pin = edge_pins; pin; pin = pin->next)
+		if (pin->gpio == gpio)
+			return pin;
+	return NULL;
+}
+
+static void gpio_edge_remove(int gpio) {
+	struct gpio_edge_pin **p;
+
+	for (p = &edge_pins; *p; p = &(*p)->next) {
+		if ((*p)->gpio == gpio) {
+			struct gpio_edge_pin *pin = *p;
+			*p = pin->next;
+			close(pin->fd);
+			free(pin);
+			return;
+		}
+	}
+}
+
+static int gpio_sysfs_set_edge(int gpio, enum gpio_edge edge) {
+	static const char *names[] = { "none", "rising", "falling", "both" };
+	char gpio_path[256];
+	int fd;
+
+	snprintf(gpio_path, sizeof(gpio_path)-1, GPIO_PATH "/gpio%d/edge", gpio);
+
+	fd = open(gpio_path, O_WRONLY);
+	if (fd == -1) {
+		fprintf(stderr, "Edge file: [%s]\n", gpio_path);
+		perror("Couldn't open edge file for gpio");
+		return -errno;
+	}
+
+	if (write(fd, names[edge], strlen(names[edge]) + 1) == -1) {
+		fprintf(stderr, "Couldn't set GPIO %d edge: %s\n",
+			gpio, strerror(errno));
+		close(fd);
+		return -errno;
+	}
+
+	close(fd);
+	return 0;
+}
+
+int gpio_set_edge(int gpio, enum gpio_edge edge) {
+	struct gpio_edge_pin *pin;
+	char gpio_path[256];
+	char c;
+	int fd;
+	int ret;
+
+	if (gpio&GPIO_IS_EIM) {
+		fprintf(stderr, "EIM pin %d can't generate edge events\n",
+			gpio&(~GPIO_IS_EIM));
+		return -EINVAL;
+	}
+
+	gpio_edge_remove(gpio);
+
+	if (gpio_backend == GPIO_BACKEND_CHARDEV) {
+		if (edge == GPIO_EDGE_NONE)
+			return 0;
+		fd = gpio_cdev_request_events(gpio, edge);
+		if (fd < 0)
+			return fd;
+	}
+	else {
+		ret = gpio_export(gpio);
+		if (!ret)
+			ret = gpio_set_direction(gpio, GPIO_IN);
+		if (!ret)
+			ret = gpio_sysfs_set_edge(gpio, edge);
+		if (ret || edge == GPIO_EDGE_NONE)
+			return ret;
+
+		snprintf(gpio_path, sizeof(gpio_path)-1, GPIO_PATH "/gpio%d/value", gpio);
+		fd = open(gpio_path, O_RDONLY);
+		if (fd == -1) {
+			perror("Couldn't open value file for gpio");
+			return -errno;
+		}
+		// sysfs reports POLLPRI until the value has been read once
+		if (read(fd, &c, 1) == -1) {
+			perror("Couldn't get input value");
+			close(fd);
+			return -errno;
+		}
+	}
+
+	pin = calloc(1, sizeof(*pin));
+	if (!pin) {
+		close(fd);
+		return -ENOMEM;
+	}
+	pin->gpio = gpio;
+	pin->fd = fd;
+	pin->cdev = (gpio_backend == GPIO_BACKEND_CHARDEV);
+	pin->next = edge_pins;
+	edge_pins = pin;
+	return 0;
+}
+
+int gpio_wait_edges(const int *gpios, int count, int timeout_ms,
+		    struct gpio_event *events, int max_events) {
+	struct gpio_edge_pin *pins[GPIO_WAIT_MAX];
+	struct pollfd fds[GPIO_WAIT_MAX];
+	char c;
+	int nevents = 0;
+	int ret;
+	int i;
+	STATS_SCOPE(STATS_GPIO_WAIT);
+
+	if (count <= 0 || count > GPIO_WAIT_MAX)
+		return -EINVAL;
+
+	for (i = 0; i < count; i++) {
+		pins[i] = gpio_edge_find(gpios[i]);
+		if (!pins[i]) {
+			fprintf(stderr, "gpio %d has no edge configured\n", gpios[i]);
+			return -EINVAL;
+		}
+		fds[i].fd = pins[i]->fd;
+		fds[i].events = pins[i]->cdev ? POLLIN : (POLLPRI | POLLERR);
+		fds[i].revents = 0;
+	}
+
+	ret = poll(fds, count, timeout_ms);
+	if (ret == -1) {
+		perror("Couldn't wait for gpio edge");
+		return -errno;
+	}
+
+	for (i = 0; i < count && nevents < max_events; i++) {
+		struct gpio_event *ev = &events[nevents];
+
+		if (!fds[i].revents)
+			continue;
+
+		ev->gpio = pins[i]->gpio;
+		if (pins[i]->cdev) {
+			ret = gpio_cdev_read_event(pins[i]->fd, ev);
+			if (ret)
+				return ret;
+		}
+		else {
+			// sysfs has no event timestamp, the wakeup is the best we have
+			ev->wakeup = stats_now();
+			ev->timestamp = ev->wakeup;
+			if (pread(pins[i]->fd, &c, 1, 0) != 1) {
+				perror("Couldn't get input value");
+				return -errno;
+			}
+			ev->value = (c != '0');
+		}
+		nevents++;
+	}
+
+	return nevents;
+}
@@ -1,6 +1,8 @@
 #ifndef __GPIO_H__
 #define __GPIO_H__
 
+#include <stdint.h>
+
 #define GPIO_IS_EIM (0x80000000)
 
 enum gpio_dir {
@@ -8,14 +10,76 @@ enum gpio_dir {
 	GPIO_OUT = 1,
 };
 
+enum gpio_backend {
+	GPIO_BACKEND_SYSFS = 0,
+	GPIO_BACKEND_CHARDEV = 1,
+};
+
+enum gpio_edge {
+	GPIO_EDGE_NONE = 0,
+	GPIO_EDGE_RISING = 1,
+	GPIO_EDGE_FALLING = 2,
+	GPIO_EDGE_BOTH = 3,
+};
+
+struct gpio_event {
+	int gpio;
+	int value;           // level after the edge: 1 rising, 0 falling
+	uint64_t timestamp;  // CLOCK_MONOTONIC ns of the edge, as best known
+	uint64_t wakeup;     // CLOCK_MONOTONIC ns when the waiter woke up
+};
+
 int gpio_export(int gpio);
 int gpio_unexport(int gpio);
 int gpio_set_direction(int gpio, int is_output);
 int gpio_set_value(int gpio, int value);
 int gpio_get_value(int gpio);
 
+// arm edge detection, then block until one of gpios[] sees an edge.
+// returns the number of events stored, 0 on timeout, -errno on failure
+#define GPIO_WAIT_MAX 64
+int gpio_set_edge(int gpio, enum gpio_edge edge);
+int gpio_wait_edges(const int *gpios, int count, int timeout_ms,
+		    struct gpio_event *events, int max_events);
+
+// select sysfs or /dev/gpiochipN; returns the backend actually in use
+enum gpio_backend gpio_set_backend(enum gpio_backend backend);
+enum gpio_backend gpio_get_backend(void);
+
+// line groups: bit i of a value word is gpios[i]
+#define GPIO_LINES_MAX 32
+struct gpio_lines;
+struct gpio_lines *gpio_lines_request(const int *gpios, int count,
+				      int is_output, uint32_t values);
+void gpio_lines_release(struct gpio_lines *lines);
+int gpio_lines_count(struct gpio_lines *lines);
+int gpio_lines_get(struct gpio_lines *lines, uint32_t *values);
+int gpio_lines_set(struct gpio_lines *lines, uint32_t values);
+
+// pin groups: any mix of native and EIM pins, each backend resolved once
+// at open and touched with as few accesses as possible; open fails with
+// EINVAL for an EIM pin past bit 15
+struct gpio_pins;
+struct gpio_pins *gpio_pins_open(const int *gpios, int count,
+				 int is_output, uint32_t values);
+void gpio_pins_close(struct gpio_pins *pins);
+int gpio_pins_set(struct gpio_pins *pins, uint32_t values);
+int gpio_pins_update(struct gpio_pins *pins, uint32_t values, uint32_t mask);
+int gpio_pins_get(struct gpio_pins *pins, uint32_t *values);
+
+int gpio_cdev_available(void);
+int gpio_cdev_release(int gpio);
+int gpio_cdev_set_direction(int gpio, int is_output);
+int gpio_cdev_set_value(int gpio, int value);
+int gpio_cdev_get_value(int gpio);
+int gpio_cdev_request_events(int gpio, enum gpio_edge edge);
+int gpio_cdev_read_event(int fd, struct gpio_event *event);
+
 
 int eim_set_direction(int gpio, int is_output);
 int eim_set_value(int gpio, int value);
 int eim_get_value(int gpio);
+int eim_set_direction_bits(uint16_t mask, uint16_t is_output);
+int eim_set_bits(uint16_t mask, uint16_t values);
+int eim_get_bits(uint16_t *values);
 #endif /* __GPIO_H__ */
@@ -0,0 +1,95 @@
+///
+// The one place the I2C drivers reach the bus.  adc108s022.c and
+// dac101c085.c build their messages and hand them here; this opens the
+// adapter, selects the slave and runs the exchange -- or passes it to the
+// simulated devices when the sim backend is selected.
+///
+
+#include <stdio.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+
+#include <linux/i2c-dev.h>
+#include <sys/ioctl.h>
+
+#include "i2c.h"
+#include "sim.h"
+#include "rt.h"
+
+#define I2C_BUSES 4
+
+static int i2c_bus_fd[I2C_BUSES];  // adapters kept open in RT mode or held
+
+int i2c_hold(int bus) {
+  char dev[32];
+  int i2cfd;
+
+  if( bus < 0 || bus >= I2C_BUSES )
+    return -EINVAL;
+  if( sim_enabled || i2c_bus_fd[bus] > 0 )
+    return 0;
+  snprintf(dev, sizeof(dev), "/dev/i2c-%d", bus);
+  i2cfd = open(dev, O_RDWR);
+  if( i2cfd < 0 )
+    return -errno;
+  i2c_bus_fd[bus] = i2cfd;
+  return 0;
+}
+
+void i2c_release(int bus) {
+  if( bus < 0 || bus >= I2C_BUSES || i2c_bus_fd[bus] <= 0 )
+    return;
+  close(i2c_bus_fd[bus]);
+  i2c_bus_fd[bus] = 0;
+}
+
+int i2c_transfer(int bus, int slave, struct i2c_msg *msgs, int nmsgs) {
+  char dev[32];
+  int i2cfd;
+  int keep;
+  int ret = 0;
+
+  struct i2c_ioctl_rdwr_data {
+    struct i2c_msg *msgs;  /* ptr to array of simple messages */              
+    int nmsgs;             /* number of messages to exchange */ 
+  } msgst;
+
+  if( sim_enabled )
+    return sim_i2c_transfer(bus, msgs, nmsgs);
+
+  keep = bus >= 0 && bus < I2C_BUSES && (rt_enabled || i2c_bus_fd[bus] > 0);
+  if( keep && i2c_bus_fd[bus] > 0 ) {
+    i2cfd = i2c_bus_fd[bus];
+  }
+  else {
+    snprintf(dev, sizeof(dev), "/dev/i2c-%d", bus);
+    i2cfd = open(dev, O_RDWR);
+    if( i2cfd < 0 ) {
+      fprintf(stderr, "Unable to open %s: %s\n", dev, strerror(errno));
+      return -1;
+    }
+    if( keep )
+      i2c_bus_fd[bus] = i2cfd;
+  }
+  if( ioctl( i2cfd, I2C_SLAVE, slave) < 0 ) {
+    perror("Unable to set I2C slave device\n" );
+    printf( "Address: %02x\n", slave );
+    ret = -1;
+    goto out;
+  }
+
+  msgst.msgs = msgs;	
+  msgst.nmsgs = nmsgs;
+
+  if (ioctl(i2cfd, I2C_RDWR, &msgst) < 0){
+    perror("Transaction failed\n" );
+    ret = -1;
+  }
+
+out:
+  if( !keep )
+    close( i2cfd );
+  return ret;
+}
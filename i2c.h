@@ -0,0 +1,17 @@
+#ifndef __I2C_H__
+#define __I2C_H__
+
+#include <linux/i2c-dev.h>
+
+#define I2C_BUS_DAC   1  // /dev/i2c-1: DAC101C085 A and B
+#define I2C_BUS_FPGA  2  // /dev/i2c-2: FPGA register file, ADC108S022 behind it
+
+// one I2C_RDWR exchange with slave on /dev/i2c-<bus>; 0 or -1
+int i2c_transfer(int bus, int slave, struct i2c_msg *msgs, int nmsgs);
+
+// keep /dev/i2c-<bus> open for every transfer until i2c_release(), rather
+// than opening it per transfer; 0 or -errno
+int i2c_hold(int bus);
+void i2c_release(int bus);
+
+#endif /* __I2C_H__ */
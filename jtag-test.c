@@ -0,0 +1,119 @@
+///
+// SVF and XSVF player tests against the simulated TAP.
+//
+// jtag-test.svf and jtag-test.xsvf walk the sim-dut.h TAP through the same
+// sequence: reset and STATE moves, the IDCODE under a TDO mask, a write
+// and read-back of the USER register through Pause-DR, RUNTEST (XRUNTEST,
+// XWAIT) waits, and a scan through BYPASS.  Both must play without a TDO
+// mismatch.  The SVF file's FREQUENCY must stretch its RUNTEST TCK counts
+// into real waits.  A copy of the SVF file with one expected TDO value
+// changed must report exactly that mismatch, and one with an unknown
+// statement must be refused.  Exit status is the number of failed checks.
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include "jtag.h"
+#include "svf.h"
+#include "sim.h"
+#include "sim-dut.h"
+
+#define TEST_SVF   "jtag-test.svf"
+#define TEST_XSVF  "jtag-test.xsvf"
+
+static int failures;
+
+#define CHECK(cond, ...) \
+	do { \
+		if (!(cond)) { \
+			failures++; \
+			printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+			printf(__VA_ARGS__); \
+			printf("\n"); \
+		} \
+	} while (0)
+
+// play path with a fresh TAP on the default pins; returns svf_play()'s result
+static int test_play(const char *path, int xsvf, struct svf_stats *st) {
+	struct jtag j;
+	int ret;
+
+	sim_attach_dut(sim_dut_jtag(&jtag_default_pins));
+	if (jtag_open(&j, &jtag_default_pins, NULL, 0, 0, 1)) {
+		sim_attach_dut(NULL);
+		return -1;
+	}
+	ret = xsvf ? xsvf_play(&j, path, st) : svf_play(&j, path, st);
+	jtag_close(&j);
+	sim_attach_dut(NULL);
+	return ret;
+}
+
+// TEST_SVF with the first occurrence of from replaced by to
+static int test_edit(const char *path, const char *from, const char *to) {
+	char buf[4096], *at;
+	size_t n;
+	FILE *f;
+
+	f = fopen(TEST_SVF, "r");
+	if (!f)
+		return -1;
+	n = fread(buf, 1, sizeof(buf) - 1, f);
+	fclose(f);
+	buf[n] = '\0';
+	at = strstr(buf, from);
+	f = fopen(path, "w");
+	if (!at || !f) {
+		if (f)
+			fclose(f);
+		return -1;
+	}
+	fwrite(buf, 1, at - buf, f);
+	fputs(to, f);
+	fputs(at + strlen(from), f);
+	return fclose(f);
+}
+
+int main(int argc, char **argv) {
+	char path[] = "/tmp/gpbb-jtag-test.XXXXXX";
+	struct svf_stats st;
+	int fd, ret;
+
+	sim_enable(NULL);
+
+	ret = test_play(TEST_SVF, 0, &st);
+	CHECK(ret == 0, "%s plays: %d, %d mismatches", TEST_SVF, ret, st.mismatches);
+	CHECK(st.frequency == 1e6, "FREQUENCY read as %g", st.frequency);
+	// RUNTEST 100 TCK and RUNTEST 10 TCK at 1 MHz
+	CHECK(st.wait_ns >= 110000, "RUNTEST waited %llu ns at the file's TCK rate",
+	      (unsigned long long)st.wait_ns);
+
+	ret = test_play(TEST_XSVF, 1, &st);
+	CHECK(ret == 0, "%s plays: %d, %d mismatches", TEST_XSVF, ret, st.mismatches);
+	// XRUNTEST 100 us once, XWAIT 50 us
+	CHECK(st.wait_ns == 150000, "XSVF waited %llu ns", (unsigned long long)st.wait_ns);
+
+	fd = mkstemp(path);
+	if (fd < 0) {
+		perror("mkstemp");
+		return 1;
+	}
+	close(fd);
+
+	CHECK(test_edit(path, "TDO (cafef00d)", "TDO (cafef00e)") == 0, "edit %s", TEST_SVF);
+	ret = test_play(path, 0, &st);
+	CHECK(ret == 1 && st.mismatches == 1, "a wrong TDO value: %d, %d mismatches",
+	      ret, st.mismatches);
+
+	CHECK(test_edit(path, "STATE RESET;\nSTATE IDLE;", "PIOMAP (IN A);") == 0,
+	      "edit %s", TEST_SVF);
+	CHECK(test_play(path, 0, &st) < 0, "an unsupported statement is refused");
+
+	unlink(path);
+	printf("jtag-test: %s (%d failed)\n", failures ? "FAIL" : "ok", failures);
+	return failures;
+}
@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+
+#include "jtag.h"
+#include "stats.h"
+
+#define JTAG_CHUNK_BITS  (1 << 15)  // TDO capture granularity of long scans
+#define JTAG_FLUSH_OPS   (1 << 20)  // run the stream once it holds this many
+
+#define PORT_OE(p) ((p) < 8 ? 0x1 : 0x2)
+
+const struct jtag_pins jtag_default_pins = { 5, 6, 7, 3 };
+
+static const char *state_names[JTAG_STATES] = {
+	"RESET", "IDLE",
+	"DRSELECT", "DRCAPTURE", "DRSHIFT", "DREXIT1", "DRPAUSE", "DREXIT2", "DRUPDATE",
+	"IRSELECT", "IRCAPTURE", "IRSHIFT", "IREXIT1", "IRPAUSE", "IREXIT2", "IRUPDATE",
+};
+
+// [state][tms]
+static const uint8_t next_state[JTAG_STATES][2] = {
+	[JTAG_RESET]     = { JTAG_IDLE,      JTAG_RESET },
+	[JTAG_IDLE]      = { JTAG_IDLE,      JTAG_DRSELECT },
+	[JTAG_DRSELECT]  = { JTAG_DRCAPTURE, JTAG_IRSELECT },
+	[JTAG_DRCAPTURE] = { JTAG_DRSHIFT,   JTAG_DREXIT1 },
+	[JTAG_DRSHIFT]   = { JTAG_DRSHIFT,   JTAG_DREXIT1 },
+	[JTAG_DREXIT1]   = { JTAG_DRPAUSE,   JTAG_DRUPDATE },
+	[JTAG_DRPAUSE]   = { JTAG_DRPAUSE,   JTAG_DREXIT2 },
+	[JTAG_DREXIT2]   = { JTAG_DRSHIFT,   JTAG_DRUPDATE },
+	[JTAG_DRUPDATE]  = { JTAG_IDLE,      JTAG_DRSELECT },
+	[JTAG_IRSELECT]  = { JTAG_IRCAPTURE, JTAG_RESET },
+	[JTAG_IRCAPTURE] = { JTAG_IRSHIFT,   JTAG_IREXIT1 },
+	[JTAG_IRSHIFT]   = { JTAG_IRSHIFT,   JTAG_IREXIT1 },
+	[JTAG_IREXIT1]   = { JTAG_IRPAUSE,   JTAG_IRUPDATE },
+	[JTAG_IRPAUSE]   = { JTAG_IRPAUSE,   JTAG_IREXIT2 },
+	[JTAG_IREXIT2]   = { JTAG_IRSHIFT,   JTAG_IRUPDATE },
+	[JTAG_IRUPDATE]  = { JTAG_IDLE,      JTAG_DRSELECT },
+};
+
+enum jtag_state jtag_next(enum jtag_state state, int tms) {
+	return next_state[state][!!tms];
+}
+
+enum jtag_state jtag_state_parse(const char *name) {
+	int i;
+
+	for (i = 0; i < JTAG_STATES; i++)
+		if (!strcasecmp(name, state_names[i]))
+			return i;
+	return JTAG_STATES;
+}
+
+const char *jtag_state_name(enum jtag_state state) {
+	return state < JTAG_STATES ? state_names[state] : "?";
+}
+
+// one TCK cycle: TMS/TDI (tdi < 0 leaves it) with TCK low, TDO sampled
+// there into rx bit rx_bit (if >= 0), then TCK high, where the TAP acts
+static void jtag_tck(struct jtag *j, int tms, int tdi, int rx_bit) {
+	struct vec_stream *s = &j->s;
+	int h;
+
+	vec_set(s, j->pins.tck, 0);
+	vec_set(s, j->pins.tms, tms);
+	if (tdi >= 0)
+		vec_set(s, j->pins.tdi, tdi);
+	for (h = 0; h < j->hold; h++)
+		vec_emit(s);
+	if (rx_bit >= 0)
+		vec_sample(s, rx_bit / 8, rx_bit % 8, j->pins.tdo);
+	vec_set(s, j->pins.tck, 1);
+	for (h = 0; h < j->hold; h++)
+		vec_emit(s);
+
+	j->state = next_state[j->state][!!tms];
+	s->tx_bits++;
+}
+
+int jtag_open(struct jtag *j, const struct jtag_pins *pins, volatile uint16_t *cs0,
+	      uint16_t port, uint8_t oe, int hold) {
+	memset(j, 0, sizeof(*j));
+	j->pins = *pins;
+	j->cs0 = cs0;
+	j->hold = hold > 0 ? hold : 1;
+	vec_init(&j->s, port, oe);
+
+	// TCK low and TMS high before the outputs come on
+	vec_set(&j->s, pins->tck, 0);
+	vec_set(&j->s, pins->tms, 1);
+	vec_emit(&j->s);
+	vec_oe(&j->s, oe | PORT_OE(pins->tck) | PORT_OE(pins->tms) | PORT_OE(pins->tdi));
+	jtag_goto(j, JTAG_RESET);
+	return j->s.error ? -1 : 0;
+}
+
+void jtag_close(struct jtag *j) {
+	vec_free(&j->s);
+	free(j->cap);
+	free(j->samples);
+	free(j->rx);
+	j->cap = NULL;
+	j->samples = j->rx = NULL;
+}
+
+void jtag_goto(struct jtag *j, enum jtag_state state) {
+	uint8_t prev[JTAG_STATES], tms[JTAG_STATES];
+	int queue[JTAG_STATES], head = 0, tail = 0;
+	int path[JTAG_STATES], n = 0;
+	int s, t, b;
+
+	if (state == JTAG_RESET) {
+		for (b = 0; b < 5; b++)
+			jtag_tck(j, 1, -1, -1);
+		return;
+	}
+
+	// breadth first from the current state gives the shortest TMS path
+	memset(prev, 0xff, sizeof(prev));
+	prev[j->state] = j->state;
+	queue[tail++] = j->state;
+	while (head < tail && prev[state] == 0xff) {
+		s = queue[head++];
+		for (b = 0; b < 2; b++) {
+			t = next_state[s][b];
+			if (prev[t] == 0xff) {
+				prev[t] = s;
+				tms[t] = b;
+				queue[tail++] = t;
+			}
+		}
+	}
+	for (s = state; s != (int)j->state; s = prev[s])
+		path[n++] = tms[s];
+	while (n--)
+		jtag_tck(j, path[n], -1, -1);
+}
+
+void jtag_clock(struct jtag *j, int count) {
+	int tms = j->state == JTAG_RESET;
+
+	while (count--) {
+		if (j->s.nops >= JTAG_FLUSH_OPS)
+			jtag_flush(j);
+		jtag_tck(j, tms, -1, -1);
+	}
+}
+
+static void jtag_capture(struct jtag *j, uint8_t *dest, int rx, int bytes) {
+	struct jtag_capture *cap;
+	int max;
+
+	if (j->ncap == j->max_cap) {
+		max = j->max_cap ? j->max_cap * 2 : 64;
+		cap = realloc(j->cap, max * sizeof(*cap));
+		if (!cap) {
+			j->s.error = 1;
+			return;
+		}
+		j->cap = cap;
+		j->max_cap = max;
+	}
+	j->cap[j->ncap].dest = dest;
+	j->cap[j->ncap].rx = rx;
+	j->cap[j->ncap].bytes = bytes;
+	j->ncap++;
+}
+
+void jtag_shift(struct jtag *j, int ir, const uint8_t *tdi, uint8_t *tdo, int nbits,
+		enum jtag_state end) {
+	enum jtag_state shift = ir ? JTAG_IRSHIFT : JTAG_DRSHIFT;
+	int i, b, k, n, rx, bit;
+
+	if (!nbits)
+		return;
+	if (j->state != shift)
+		jtag_goto(j, shift);
+
+	for (i = 0; i < nbits; i += n) {
+		if (j->s.nops >= JTAG_FLUSH_OPS)
+			jtag_flush(j);
+		n = nbits - i < JTAG_CHUNK_BITS ? nbits - i : JTAG_CHUNK_BITS;
+		rx = j->s.rx_len;
+		if (tdo) {
+			jtag_capture(j, tdo + i / 8, rx, (n + 7) / 8);
+			j->s.rx_len += (n + 7) / 8;
+		}
+		for (b = 0; b < n; b++) {
+			k = i + b;
+			bit = tdi ? (tdi[k / 8] >> (k % 8)) & 1 : 0;
+			// the last bit goes out on the way to Exit1
+			jtag_tck(j, k == nbits - 1 && end != shift, bit, tdo ? rx * 8 + b : -1);
+		}
+	}
+	if (end != shift)
+		jtag_goto(j, end);
+}
+
+static int jtag_grow(uint8_t **buf, int *max, int n) {
+	uint8_t *p;
+
+	if (n <= *max)
+		return 0;
+	p = realloc(*buf, n);
+	if (!p)
+		return -1;
+	*buf = p;
+	*max = n;
+	return 0;
+}
+
+int jtag_flush(struct jtag *j) {
+	struct vec_stream *s = &j->s;
+	uint64_t t0;
+	int i;
+
+	if (s->error || j->error) {
+		if (!j->error)
+			fprintf(stderr, "Unable to allocate JTAG vectors\n");
+		j->error = 1;
+		return -1;
+	}
+	if (!s->nops)
+		return 0;
+	if (jtag_grow(&j->samples, &j->max_samples, s->nbits + 1) ||
+	    jtag_grow(&j->rx, &j->max_rx, s->rx_len + 1)) {
+		fprintf(stderr, "Unable to allocate JTAG samples\n");
+		j->error = 1;
+		return -1;
+	}
+
+	t0 = stats_now();
+	vec_run(s, j->cs0, j->samples);
+	j->run_ns += stats_now() - t0;
+
+	vec_decode(s, j->samples, j->rx);
+	for (i = 0; i < j->ncap; i++)
+		memcpy(j->cap[i].dest, j->rx + j->cap[i].rx, j->cap[i].bytes);
+	j->ncap = 0;
+
+	j->tcks += s->tx_bits;
+	j->ops += s->nops;
+	// keep the allocation for the next batch
+	s->nops = s->nbits = s->rx_len = s->tx_bits = 0;
+	return 0;
+}
@@ -0,0 +1,83 @@
+#ifndef __JTAG_H__
+#define __JTAG_H__
+
+///
+// JTAG probe on the GPBB ports.
+//
+// TCK, TMS and TDI are output port bits and TDO an input port bit, wired
+// as struct jtag_pins says.  Nothing goes to the hardware as it is asked
+// for: every TCK cycle is appended to a vector stream (vector.h) as two
+// stores to FPGA_W_CPU_TO_DUT, TDO sampled on the first, and the stream
+// runs at jtag_flush() or when it grows large.  Scans that want TDO name
+// a buffer, which is only filled in by the flush that runs them.
+///
+
+#include <stdint.h>
+
+#include "vector.h"
+
+// TAP states, in the order XSVF numbers them
+enum jtag_state {
+	JTAG_RESET, JTAG_IDLE,
+	JTAG_DRSELECT, JTAG_DRCAPTURE, JTAG_DRSHIFT, JTAG_DREXIT1,
+	JTAG_DRPAUSE, JTAG_DREXIT2, JTAG_DRUPDATE,
+	JTAG_IRSELECT, JTAG_IRCAPTURE, JTAG_IRSHIFT, JTAG_IREXIT1,
+	JTAG_IRPAUSE, JTAG_IREXIT2, JTAG_IRUPDATE,
+	JTAG_STATES
+};
+
+struct jtag_pins {
+	int tck, tms, tdi;      // output pins
+	int tdo;                // input pin
+};
+
+extern const struct jtag_pins jtag_default_pins;  // A5, A6, A7; in3
+
+struct jtag_capture {
+	uint8_t *dest;
+	int rx;                 // first byte in the stream's rx
+	int bytes;
+};
+
+struct jtag {
+	struct jtag_pins pins;
+	volatile uint16_t *cs0;
+	struct vec_stream s;
+	enum jtag_state state;
+	int hold;               // writes per TCK half period
+
+	struct jtag_capture *cap;
+	int ncap, max_cap;
+	uint8_t *samples, *rx;
+	int max_samples, max_rx;
+
+	uint64_t tcks;          // over all flushes
+	uint64_t ops;
+	uint64_t run_ns;        // time spent running streams
+	int error;
+};
+
+// port and oe are the board's current CPU_TO_DUT and OE bits
+int jtag_open(struct jtag *j, const struct jtag_pins *pins, volatile uint16_t *cs0,
+	      uint16_t port, uint8_t oe, int hold);
+void jtag_close(struct jtag *j);
+
+// from any state (RESET takes five TMS=1 clocks whatever the state)
+void jtag_goto(struct jtag *j, enum jtag_state state);
+// count TCKs staying in the current state, which must be a stable one
+void jtag_clock(struct jtag *j, int count);
+// shift nbits through IR or DR, LSB of tdi[0] first, and leave the scan in
+// end; tdo (may be NULL) gets the bits shifted out at the next flush.
+// end == JTAG_DRSHIFT/IRSHIFT stays in Shift for another jtag_shift()
+void jtag_shift(struct jtag *j, int ir, const uint8_t *tdi, uint8_t *tdo, int nbits,
+		enum jtag_state end);
+// run everything queued and fill in the pending TDO buffers
+int jtag_flush(struct jtag *j);
+
+// the TAP state machine: where one TCK with tms leads from state
+enum jtag_state jtag_next(enum jtag_state state, int tms);
+// SVF names; JTAG_STATES if unknown
+enum jtag_state jtag_state_parse(const char *name);
+const char *jtag_state_name(enum jtag_state state);
+
+#endif /* __JTAG_H__ */
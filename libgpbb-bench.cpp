@@ -0,0 +1,168 @@
+///
+// libgpbb example and benchmark: what a board operation costs through a
+// library handle, against running novena-gpbb for it the way a script
+// that shells out would.
+//
+//   libgpbb-bench [-sim] [-n iterations] [-cli_n runs] [-cli path]
+//
+// The in-process column is the best of five rounds of n calls on one
+// gpbb::board.  The CLI column is the mean of cli_n fork/exec/wait runs of
+// the matching option, each with its own EIM setup, mappings and exit.
+// -sim runs both against the software model, so no board or root is needed.
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "libgpbb.hpp"
+
+extern char **environ;
+
+namespace {
+
+struct bench_op {
+	const char *name;
+	std::vector<std::string> args;  // the CLI's spelling of the same thing
+	std::function<void(gpbb::board &)> run;
+};
+
+const std::vector<bench_op> ops = {
+	{ "version",  { "-v" },            [](gpbb::board &b) { b.version(); } },
+	{ "port get", { "-p", "a" },       [](gpbb::board &b) { b.port(GPBB_PORT_A); } },
+	{ "port put", { "-p", "a", "55" }, [](gpbb::board &b) { b.port(GPBB_PORT_A, 0x55); } },
+	{ "pin set",  { "-p_set", "a", "3" },
+	  [](gpbb::board &b) { b.pin(GPBB_PORT_A, 3, true); } },
+	{ "input",    { "-rp" },           [](gpbb::board &b) { b.input(); } },
+	{ "oe",       { "-oea", "1" },     [](gpbb::board &b) { b.oe(GPBB_PORT_A, true); } },
+	{ "vddio",    { "-hv" },           [](gpbb::board &b) { b.vddio(true); } },
+	{ "dac",      { "-da", "512" },    [](gpbb::board &b) { b.dac(GPBB_DAC_A, 512); } },
+	{ "adc",      { "-a", "0" },       [](gpbb::board &b) { b.adc(0); } },
+	{ "cs1",      { "-testcs1" },
+	  [](gpbb::board &b) {
+		b.cs1(0, 0xdeadbeeffeedfaceULL);
+		b.cs1(1, 0x5555aaaa33339999ULL);
+		b.cs1(0);
+		b.cs1(1);
+	  } },
+};
+
+double ns_since(std::chrono::steady_clock::time_point t0) {
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+}
+
+double time_in_process(gpbb::board &b, const bench_op &op, int n) {
+	double best = 0;
+	int round, i;
+
+	op.run(b);  // warm up
+	for (round = 0; round < 5; round++) {
+		auto t0 = std::chrono::steady_clock::now();
+		for (i = 0; i < n; i++)
+			op.run(b);
+		double ns = ns_since(t0) / n;
+		if (!round || ns < best)
+			best = ns;
+	}
+	return best;
+}
+
+// mean ns per run, or -1 if the CLI could not be run or failed
+double time_cli(const std::string &cli, bool sim, const bench_op &op, int runs) {
+	posix_spawn_file_actions_t fa;
+	std::vector<char *> argv;
+	int i, status;
+	pid_t pid;
+
+	argv.push_back(const_cast<char *>(cli.c_str()));
+	if (sim)
+		argv.push_back(const_cast<char *>("-sim"));
+	for (auto &a : op.args)
+		argv.push_back(const_cast<char *>(a.c_str()));
+	argv.push_back(nullptr);
+
+	posix_spawn_file_actions_init(&fa);
+	posix_spawn_file_actions_addopen(&fa, 1, "/dev/null", O_WRONLY, 0);
+
+	auto t0 = std::chrono::steady_clock::now();
+	for (i = 0; i < runs; i++) {
+		if (posix_spawn(&pid, argv[0], &fa, nullptr, argv.data(), environ) ||
+		    waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status)) {
+			posix_spawn_file_actions_destroy(&fa);
+			return -1;
+		}
+	}
+	double ns = ns_since(t0) / runs;
+	posix_spawn_file_actions_destroy(&fa);
+	return ns;
+}
+
+void usage(const char *prog) {
+	printf("Usage:\n"
+	       "%s [-sim] [-n iterations] [-cli_n runs] [-cli path]\n"
+	       "\t-sim run in-process and CLI operations against the software model\n"
+	       "\t-n <iterations> in-process calls per round (default 10000)\n"
+	       "\t-cli_n <runs> CLI runs per operation (default 50)\n"
+	       "\t-cli <path> the novena-gpbb binary (default ./novena-gpbb)\n",
+	       prog);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+	std::string cli = "./novena-gpbb";
+	bool sim = false;
+	int n = 10000, cli_n = 50;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-sim"))
+			sim = true;
+		else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+			n = strtol(argv[++i], NULL, 0);
+		else if (!strcmp(argv[i], "-cli_n") && i + 1 < argc)
+			cli_n = strtol(argv[++i], NULL, 0);
+		else if (!strcmp(argv[i], "-cli") && i + 1 < argc)
+			cli = argv[++i];
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (n < 1)
+		n = 1;
+	if (cli_n < 1)
+		cli_n = 1;
+
+	try {
+		gpbb::board b(sim ? GPBB_OPEN_SIM : 0);
+		gpbb::fpga_version v = b.version();
+
+		printf("libgpbb API %u, FPGA %04x.%04x%s\n", gpbb_api_version(),
+		       v.minor, v.major, sim ? " (sim)" : "");
+		printf("%-10s %14s %14s %10s\n", "op", "in-process ns", "CLI us", "ratio");
+		for (auto &op : ops) {
+			double lib = time_in_process(b, op, n);
+			double run = time_cli(cli, sim, op, cli_n);
+
+			if (run < 0)
+				printf("%-10s %14.1f %14s %10s\n", op.name, lib, "failed", "-");
+			else
+				printf("%-10s %14.1f %14.1f %9.0fx\n", op.name, lib, run / 1e3, run / lib);
+		}
+	} catch (const std::system_error &e) {
+		fprintf(stderr, "%s: %s\n", e.what(), e.code().message().c_str());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,317 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "libgpbb.h"
+#include "novena-gpbb.h"
+#include "dac101c085.h"
+#include "adc108s022.h"
+#include "i2c.h"
+#include "stats.h"
+#include "trace.h"
+#include "sim.h"
+#include "state.h"
+#include "uio.h"
+
+#define GPBB_WINDOW  0xffff
+
+struct gpbb_board {
+	int mem_fd;             // 0 when the windows come from UIO or the sim
+	volatile uint16_t *cs0;
+	volatile uint64_t *cs1;
+	int i2c_held[2];        // I2C_BUS_DAC, I2C_BUS_FPGA
+	uint16_t *dac_words;    // one burst of shifted codes, on first stream
+};
+
+static const int gpbb_buses[2] = { I2C_BUS_DAC, I2C_BUS_FPGA };
+
+static int gpbb_open_count;
+
+// the DAC and ADC buses are held from their first use on, so a board
+// without them still answers everything on EIM; if the hold fails, the
+// transfer opens the adapter itself and reports why it can't
+static void gpbb_i2c(struct gpbb_board *g, int i) {
+	if (!g->i2c_held[i] && i2c_hold(gpbb_buses[i]) == 0)
+		g->i2c_held[i] = 1;
+}
+
+unsigned int gpbb_api_version(void) {
+	return GPBB_API_VERSION;
+}
+
+static uint16_t cs0_get(struct gpbb_board *g, unsigned long reg) {
+	uint16_t val;
+
+	if (sim_enabled)
+		val = sim_mem_read(reg, 2);
+	else
+		val = g->cs0[F(reg)];
+	TRACE(TRACE_BUS_MEM, TRACE_READ, 2, reg, val);
+	return val;
+}
+
+static void cs0_put(struct gpbb_board *g, unsigned long reg, uint16_t val) {
+	if (sim_enabled)
+		sim_mem_write(reg, 2, val);
+	else
+		g->cs0[F(reg)] = val;
+	TRACE(TRACE_BUS_MEM, TRACE_WRITE, 2, reg, val);
+
+	if (reg == FPGA_W_CPU_TO_DUT)
+		STATE(state_set_port(val));
+	else if (reg == FPGA_W_GPBB_CTL)
+		STATE(state_set_ctl(val));
+}
+
+static int gpbb_map(struct gpbb_board *g) {
+	void *mem;
+
+	if (sim_enabled)
+		return 0;
+	if (uio_active) {
+		// the device's maps must cover both windows, as cs0_map() wants
+		g->cs0 = uio_reg(FPGA_REG_OFFSET, 0x2000) ? uio_reg(FPGA_REG_OFFSET, 2) : NULL;
+		g->cs1 = uio_reg(FPGA_CS1_REG_OFFSET, 0x2000) ? uio_reg(FPGA_CS1_REG_OFFSET, 8) : NULL;
+		return g->cs0 ? 0 : -ENODEV;
+	}
+
+	g->mem_fd = open("/dev/mem", O_RDWR);
+	if (g->mem_fd < 0) {
+		g->mem_fd = 0;
+		return -errno;
+	}
+	mem = mmap(0, GPBB_WINDOW, PROT_READ | PROT_WRITE, MAP_SHARED, g->mem_fd, FPGA_REG_OFFSET);
+	if (mem == MAP_FAILED)
+		return -errno;
+	g->cs0 = mem;
+	mem = mmap(0, GPBB_WINDOW, PROT_READ | PROT_WRITE, MAP_SHARED, g->mem_fd, FPGA_CS1_REG_OFFSET);
+	if (mem == MAP_FAILED)
+		return -errno;
+	g->cs1 = mem;
+	return 0;
+}
+
+struct gpbb_board *gpbb_open(unsigned int flags) {
+	struct gpbb_board *g;
+	int ret;
+
+	if (gpbb_open_count) {
+		errno = EBUSY;
+		return NULL;
+	}
+	if ((flags & GPBB_OPEN_SIM) && !sim_enabled && sim_enable(NULL)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	g = calloc(1, sizeof(*g));
+	if (!g)
+		return NULL;
+	gpbb_open_count++;
+
+	ret = gpbb_map(g);
+	if (ret)
+		goto fail;
+	if (!(flags & GPBB_OPEN_NO_SETUP)) {
+		setup_fpga();
+		setup_fpga_cs1();
+		// its page only served the setup
+		release_kernel_memory();
+	}
+	return g;
+
+fail:
+	gpbb_close(g);
+	errno = -ret;
+	return NULL;
+}
+
+void gpbb_close(struct gpbb_board *g) {
+	int i;
+
+	if (!g)
+		return;
+	for (i = 0; i < 2; i++)
+		if (g->i2c_held[i])
+			i2c_release(gpbb_buses[i]);
+	if (g->mem_fd) {
+		if (g->cs0)
+			munmap((void *)g->cs0, GPBB_WINDOW);
+		if (g->cs1)
+			munmap((void *)g->cs1, GPBB_WINDOW);
+		close(g->mem_fd);
+	}
+	free(g->dac_words);
+	free(g);
+	gpbb_open_count--;
+}
+
+int gpbb_version(struct gpbb_board *g, uint16_t *major, uint16_t *minor) {
+	STATS_SCOPE(STATS_EIM_READ);
+
+	*major = cs0_get(g, FPGA_R_V_MAJOR);
+	*minor = cs0_get(g, FPGA_R_V_MINOR);
+	return 0;
+}
+
+int gpbb_port_get(struct gpbb_board *g, int port) {
+	STATS_SCOPE(STATS_EIM_READ);
+
+	if (port != GPBB_PORT_A && port != GPBB_PORT_B)
+		return -EINVAL;
+	return (cs0_get(g, FPGA_W_CPU_TO_DUT) >> (port * 8)) & 0xff;
+}
+
+int gpbb_port_put(struct gpbb_board *g, int port, uint8_t value) {
+	uint16_t cur;
+	STATS_SCOPE(STATS_EIM_WRITE);
+
+	if (port != GPBB_PORT_A && port != GPBB_PORT_B)
+		return -EINVAL;
+	cur = cs0_get(g, FPGA_W_CPU_TO_DUT);
+	if (port == GPBB_PORT_A)
+		cs0_put(g, FPGA_W_CPU_TO_DUT, value | (cur & 0xff00));
+	else
+		cs0_put(g, FPGA_W_CPU_TO_DUT, (value << 8) | (cur & 0x00ff));
+	return 0;
+}
+
+int gpbb_pin_put(struct gpbb_board *g, int port, int bit, int level) {
+	uint16_t cur, mask;
+	STATS_SCOPE(STATS_EIM_WRITE);
+
+	if ((port != GPBB_PORT_A && port != GPBB_PORT_B) || bit < 0 || bit > 7)
+		return -EINVAL;
+	mask = 1 << (port * 8 + bit);
+	cur = cs0_get(g, FPGA_W_CPU_TO_DUT);
+	cs0_put(g, FPGA_W_CPU_TO_DUT, level ? cur | mask : cur & ~mask);
+	return 0;
+}
+
+int gpbb_input(struct gpbb_board *g) {
+	STATS_SCOPE(STATS_EIM_READ);
+
+	return cs0_get(g, FPGA_R_DUT_TO_CPU) & 0xff;
+}
+
+int gpbb_oe(struct gpbb_board *g, int port, int drive) {
+	uint16_t cur, bit;
+	STATS_SCOPE(STATS_EIM_WRITE);
+
+	if (port != GPBB_PORT_A && port != GPBB_PORT_B)
+		return -EINVAL;
+	bit = port == GPBB_PORT_A ? 0x1 : 0x2;
+	cur = cs0_get(g, FPGA_W_GPBB_CTL);
+	cs0_put(g, FPGA_W_GPBB_CTL, drive ? cur | bit : cur & ~bit);
+	return 0;
+}
+
+int gpbb_vddio(struct gpbb_board *g, int high) {
+	uint16_t cur;
+	STATS_SCOPE(STATS_EIM_WRITE);
+
+	cur = cs0_get(g, FPGA_W_GPBB_CTL);
+	cs0_put(g, FPGA_W_GPBB_CTL, high ? cur | 0x8000 : cur & 0x7fff);
+	return 0;
+}
+
+int gpbb_dac(struct gpbb_board *g, int dac, unsigned int code) {
+	if ((dac != GPBB_DAC_A && dac != GPBB_DAC_B) || code > 0x3ff)
+		return -EINVAL;
+	gpbb_i2c(g, 0);
+	// the DAC101C085 takes 12-bit words with two dummy LSBs
+	if (dac101c085_write_byte(code << 2, dac == GPBB_DAC_A ? DAC_A : DAC_B) < 0)
+		return -EIO;
+	STATE(state_set_dac(dac == GPBB_DAC_A ? DAC_A : DAC_B, code << 2));
+	return 0;
+}
+
+int gpbb_dac_stream(struct gpbb_board *g, int dac, const uint16_t *codes, int n, int burst) {
+	int i, k, done, ret;
+
+	if ((dac != GPBB_DAC_A && dac != GPBB_DAC_B) || n < 0)
+		return -EINVAL;
+	for (i = 0; i < n; i++)
+		if (codes[i] > 0x3ff)
+			return -EINVAL;
+
+	// shifted into DAC words one burst at a time, in a buffer the handle
+	// keeps rather than on the caller's stack
+	if (!g->dac_words) {
+		g->dac_words = malloc(DAC101C085_BURST_MAX * sizeof(*g->dac_words));
+		if (!g->dac_words)
+			return -ENOMEM;
+	}
+	gpbb_i2c(g, 0);
+	if (burst <= 0)
+		burst = DAC101C085_BURST_WORDS;
+	if (burst > DAC101C085_BURST_MAX)
+		burst = DAC101C085_BURST_MAX;
+	for (done = 0; done < n; done += k) {
+		k = n - done < burst ? n - done : burst;
+		for (i = 0; i < k; i++)
+			g->dac_words[i] = codes[done + i] << 2;
+		ret = dac101c085_write_burst(g->dac_words, k, k,
+					     dac == GPBB_DAC_A ? DAC_A : DAC_B);
+		if (ret != k)
+			return -EIO;
+	}
+	return n;
+}
+
+int gpbb_adc(struct gpbb_board *g, int chan) {
+	int cur;
+
+	if (chan < 0 || chan > 7)
+		return -EINVAL;
+	gpbb_i2c(g, 1);
+	// no adc_chan(): its two transactions only matter on a channel change
+	cur = adc_start_chan(chan);
+	if (cur < 0)
+		return -EIO;
+	return adc_finish(cur);
+}
+
+int gpbb_cs1_read(struct gpbb_board *g, int word, uint64_t *value) {
+	unsigned long reg = FPGA_RB_LOOP0 + word * 8;
+	STATS_SCOPE(STATS_EIM_READ);
+
+	if (word < 0 || word > 1)
+		return -EINVAL;
+	if (sim_enabled)
+		*value = sim_mem_read(reg, 8);
+	else if (g->cs1)
+		memcpy(value, (void *)&g->cs1[F1(reg)], 8);
+	else
+		return -ENODEV;
+	TRACE(TRACE_BUS_MEM, TRACE_READ, 8, reg, *value);
+	return 0;
+}
+
+int gpbb_cs1_write(struct gpbb_board *g, int word, uint64_t value) {
+	unsigned long reg = FPGA_WB_LOOP0 + word * 8;
+	STATS_SCOPE(STATS_EIM_WRITE);
+
+	if (word < 0 || word > 1)
+		return -EINVAL;
+	if (sim_enabled)
+		sim_mem_write(reg, 8, value);
+	else if (g->cs1)
+		g->cs1[F1(reg)] = value;
+	else
+		return -ENODEV;
+	TRACE(TRACE_BUS_MEM, TRACE_WRITE, 8, reg, value);
+	return 0;
+}
+
+volatile uint16_t *gpbb_cs0(struct gpbb_board *g) {
+	return g->cs0;
+}
+
+volatile uint64_t *gpbb_cs1(struct gpbb_board *g) {
+	return g->cs1;
+}
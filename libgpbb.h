@@ -0,0 +1,86 @@
+#ifndef __LIBGPBB_H__
+#define __LIBGPBB_H__
+
+///
+// libgpbb: the GPBB board as a library, for programs that would otherwise
+// run novena-gpbb once per operation.
+//
+// gpbb_open() does the EIM setup once and returns a handle that owns the
+// /dev/mem descriptor, the CS0 and CS1 mappings and, from the first DAC or
+// ADC call on, the I2C adapters those sit on; every call after that is a
+// register access or an I2C exchange, with no open, mmap or setup of its
+// own.  A board without the I2C buses still opens, and only the DAC and
+// ADC calls fail.  The board is one
+// device, so a process should have one handle open at a time.
+//
+// Calls return 0 (or the value read) on success and -errno on failure.
+// This header is the stable interface: the API version only grows, and
+// the shared library exports nothing else.
+///
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GPBB_API_VERSION  2
+
+#define GPBB_API __attribute__((visibility("default")))
+
+#define GPBB_PORT_A  0
+#define GPBB_PORT_B  1
+
+#define GPBB_DAC_A   0
+#define GPBB_DAC_B   1
+
+#define GPBB_OPEN_SIM       0x1  // the in-process model instead of the board
+#define GPBB_OPEN_NO_SETUP  0x2  // leave EIM pads and timing as they are
+
+struct gpbb_board;
+
+// the GPBB_API_VERSION the library was built with
+GPBB_API unsigned int gpbb_api_version(void);
+
+// NULL with errno set on failure
+GPBB_API struct gpbb_board *gpbb_open(unsigned int flags);
+GPBB_API void gpbb_close(struct gpbb_board *g);
+
+GPBB_API int gpbb_version(struct gpbb_board *g, uint16_t *major, uint16_t *minor);
+
+// the output latch of a port, and writes to it
+GPBB_API int gpbb_port_get(struct gpbb_board *g, int port);
+GPBB_API int gpbb_port_put(struct gpbb_board *g, int port, uint8_t value);
+GPBB_API int gpbb_pin_put(struct gpbb_board *g, int port, int bit, int level);
+// the input port
+GPBB_API int gpbb_input(struct gpbb_board *g);
+
+GPBB_API int gpbb_oe(struct gpbb_board *g, int port, int drive);
+// 5 V if high, else 3.3 V
+GPBB_API int gpbb_vddio(struct gpbb_board *g, int high);
+
+// 10-bit DAC code; one ADC conversion of channel 0-7, as -a reports it
+// (-ETIMEDOUT if it never completes)
+GPBB_API int gpbb_dac(struct gpbb_board *g, int dac, unsigned int code);
+GPBB_API int gpbb_adc(struct gpbb_board *g, int chan);
+// n codes in I2C writes of up to burst codes each (0 for the driver's
+// default), the output stepping through them at the bus rate; returns n,
+// or -EIO when a burst fails, after the last code that reached the DAC.
+// Since API version 2
+GPBB_API int gpbb_dac_stream(struct gpbb_board *g, int dac, const uint16_t *codes, int n,
+			     int burst);
+
+// the two 64-bit CS1 loopback words
+GPBB_API int gpbb_cs1_read(struct gpbb_board *g, int word, uint64_t *value);
+GPBB_API int gpbb_cs1_write(struct gpbb_board *g, int word, uint64_t value);
+
+// raw CS0 (16-bit registers) and CS1 windows for code that streams through
+// them; NULL under GPBB_OPEN_SIM, where there is no window to map
+GPBB_API volatile uint16_t *gpbb_cs0(struct gpbb_board *g);
+GPBB_API volatile uint64_t *gpbb_cs1(struct gpbb_board *g);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __LIBGPBB_H__ */
@@ -0,0 +1,95 @@
+#ifndef __LIBGPBB_HPP__
+#define __LIBGPBB_HPP__
+
+///
+// C++ wrapper for libgpbb (C++14, header only).
+//
+// gpbb::board owns a handle: the constructor opens it, EIM setup included,
+// and the destructor closes it.  It moves but does not copy, so the
+// mappings and bus fds have exactly one owner.  A failing call throws
+// std::system_error carrying the errno the C call returned.
+//
+//   gpbb::board b;
+//   b.oe(GPBB_PORT_A, true);
+//   b.port(GPBB_PORT_A, 0x55);
+//   int code = b.adc(0);
+///
+
+#include <stdint.h>
+#include <errno.h>
+#include <system_error>
+#include <utility>
+
+#include "libgpbb.h"
+
+namespace gpbb {
+
+struct fpga_version {
+	uint16_t major;
+	uint16_t minor;
+};
+
+class board {
+public:
+	explicit board(unsigned int flags = 0) : g_(gpbb_open(flags)) {
+		if (!g_)
+			throw std::system_error(errno, std::generic_category(), "gpbb_open");
+	}
+	~board() {
+		if (g_)
+			gpbb_close(g_);
+	}
+
+	board(const board &) = delete;
+	board &operator=(const board &) = delete;
+	board(board &&other) noexcept : g_(other.g_) { other.g_ = nullptr; }
+	board &operator=(board &&other) noexcept {
+		std::swap(g_, other.g_);
+		return *this;
+	}
+
+	fpga_version version() {
+		fpga_version v;
+		check(gpbb_version(g_, &v.major, &v.minor), "gpbb_version");
+		return v;
+	}
+
+	uint8_t port(int port) { return check(gpbb_port_get(g_, port), "gpbb_port_get"); }
+	void port(int port, uint8_t value) { check(gpbb_port_put(g_, port, value), "gpbb_port_put"); }
+	void pin(int port, int bit, bool level) {
+		check(gpbb_pin_put(g_, port, bit, level), "gpbb_pin_put");
+	}
+	uint8_t input() { return check(gpbb_input(g_), "gpbb_input"); }
+
+	void oe(int port, bool drive) { check(gpbb_oe(g_, port, drive), "gpbb_oe"); }
+	void vddio(bool high) { check(gpbb_vddio(g_, high), "gpbb_vddio"); }
+
+	void dac(int dac, unsigned int code) { check(gpbb_dac(g_, dac, code), "gpbb_dac"); }
+	void dac_stream(int dac, const uint16_t *codes, int n, int burst = 0) {
+		check(gpbb_dac_stream(g_, dac, codes, n, burst), "gpbb_dac_stream");
+	}
+	int adc(int chan) { return check(gpbb_adc(g_, chan), "gpbb_adc"); }
+
+	uint64_t cs1(int word) {
+		uint64_t v;
+		check(gpbb_cs1_read(g_, word, &v), "gpbb_cs1_read");
+		return v;
+	}
+	void cs1(int word, uint64_t value) { check(gpbb_cs1_write(g_, word, value), "gpbb_cs1_write"); }
+
+	// for the calls this class does not wrap
+	struct gpbb_board *get() const { return g_; }
+
+private:
+	static int check(int ret, const char *what) {
+		if (ret < 0)
+			throw std::system_error(-ret, std::generic_category(), what);
+		return ret;
+	}
+
+	struct gpbb_board *g_;
+};
+
+} // namespace gpbb
+
+#endif /* __LIBGPBB_HPP__ */
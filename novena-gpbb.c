@@ -6,229 +6,847 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <time.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/resource.h>
 #include "gpio.h"
 
 #include "novena-gpbb.h"
 #include "dac101c085.h"
 #include "adc108s022.h"
-
-static int fd = 0;
-static int   *mem_32 = 0;
-static short *mem_16 = 0;
-static char  *mem_8  = 0;
-static int *prev_mem_range = 0;
-
-int read_kernel_memory(long offset, int virtualized, int size) {
-  int result;
-
-  int *mem_range = (int *)(offset & ~0xFFFF);
-  if( mem_range != prev_mem_range ) {
-    //        fprintf(stderr, "New range detected.  Reopening at memory range %p\n", mem_range);
-    prev_mem_range = mem_range;
-
-    if(mem_32)
-      munmap(mem_32, 0xFFFF);
-    if(fd)
-      close(fd);
-
-    if(virtualized) {
-      fd = open("/dev/kmem", O_RDWR);
-      if( fd < 0 ) {
-	perror("Unable to open /dev/kmem");
-	fd = 0;
-	return -1;
-      }
-    }
-    else {
-      fd = open("/dev/mem", O_RDWR);
-      if( fd < 0 ) {
-	perror("Unable to open /dev/mem. Must be run with root permissions.");
-	fd = 0;
-	return -1;
-      }
+#include "fpga-load.h"
+#include "stats.h"
+#include "trace.h"
+#include "sim.h"
+#include "state.h"
+#include "rt.h"
+#include "control.h"
+#include "filter.h"
+#include "sweep.h"
+#include "capture.h"
+#include "writer.h"
+#include "uio.h"
+#include "regwait.h"
+#include "vector.h"
+#include "sim-dut.h"
+#include "jtag.h"
+#include "svf.h"
+#include "libgpbb.h"
+#include "telemetry.h"
+
+// every board access goes through one libgpbb handle, which owns the
+// mappings and bus fds.  main() opens it with the EIM setup; anything that
+// gets here first (gpbb-bench runs the operations without main()) opens it
+// without.  A failed open is reported once and not retried.
+static struct gpbb_board *board;
+static int board_failed;
+
+static struct gpbb_board *board_open(unsigned int flags) {
+  if( !board && !board_failed ) {
+    board = gpbb_open(flags);
+    if( !board ) {
+      fprintf(stderr, "Unable to open the GPBB: %s\n", strerror(errno));
+      board_failed = 1;
     }
+  }
+  return board;
+}
 
-    mem_32 = mmap(0, 0xffff, PROT_READ | PROT_WRITE, MAP_SHARED, fd, offset&~0xFFFF);
-    if( -1 == (int)mem_32 ) {
-      perror("Unable to mmap file");
+struct gpbb_board *board_get(void) {
+  return board_open(GPBB_OPEN_NO_SETUP);
+}
 
-      if( -1 == close(fd) )
-	perror("Also couldn't close file");
+// the handle's CS0 register window
+static volatile unsigned short *cs0_map(void) {
+  static unsigned short sim_cs0;
 
-      fd=0;
-      return -1;
-    }
-    mem_16 = (short *)mem_32;
-    mem_8  = (char  *)mem_32;
-  }
+  if( !board_get() )
+    return NULL;
+  if( sim_enabled )  // cs0_read goes to the model; any non-NULL will do
+    return &sim_cs0;
+  return gpbb_cs0(board);
+}
 
-  int scaled_offset = (offset-(offset&~0xFFFF));
-  //    fprintf(stderr, "Returning offset 0x%08x\n", scaled_offset);
-  if(size==1)
-    result = mem_8[scaled_offset/sizeof(char)];
-  else if(size==2)
-    result = mem_16[scaled_offset/sizeof(short)];
+static unsigned short cs0_read(volatile unsigned short *cs0, unsigned long reg) {
+  unsigned short val;
+
+  if( sim_enabled )
+    val = sim_mem_read(reg, 2);
   else
-    result = mem_32[scaled_offset/sizeof(long)];
+    val = cs0[F(reg)];
 
-  return result;
+  TRACE(TRACE_BUS_MEM, TRACE_READ, 2, reg, val);
+  return val;
 }
 
+static int cs0_wait_read(void *ctx, unsigned int *value) {
+  unsigned long reg = *(unsigned long *)ctx;
+
+  *value = cs0_read(cs0_map(), reg);
+  return 0;
+}
 
-int write_kernel_memory(long offset, long value, int virtualized, int size) {
-  int old_value = read_kernel_memory(offset, virtualized, size);
-  int scaled_offset = (offset-(offset&~0xFFFF));
-  if(size==1)
-    mem_8[scaled_offset/sizeof(char)]   = value;
-  else if(size==2)
-    mem_16[scaled_offset/sizeof(short)] = value;
+// poll a CS0 register until (value & mask) == want; with -uio, sleep on
+// the device's interrupt between polls
+static int cs0_wait(unsigned long reg, unsigned int mask, unsigned int want,
+		    unsigned int timeout_ms) {
+  struct regwait_policy policy = { 16, 1000, 1000000, timeout_ms * 1000000ULL };
+  struct regwait_stats stats;
+  unsigned int value;
+  int ret;
+
+  if( !cs0_map() )
+    return -1;
+  if( uio_active ) {
+    policy.event = uio_event;
+    policy.spins = 1;
+  }
+  memset(&stats, 0, sizeof(stats));
+  ret = regwait(cs0_wait_read, &reg, mask, want, &policy, &stats, &value);
+  if( ret == 0 )
+    printf( "0x%08lx: 0x%04x\n", reg, value );
   else
-    mem_32[scaled_offset/sizeof(long)]  = value;
-  return old_value;
+    printf( "0x%08lx: %s, last 0x%04x\n", reg,
+	    ret == -ETIMEDOUT ? "timed out" : "read failed", value );
+  regwait_stats_print("waitreg", &stats, stdout);
+  return ret;
 }
 
 void setvddio(int high) {
-  volatile unsigned short *cs0;
+  if( board_get() )
+    gpbb_vddio(board, high);
+}
+
+void oe_state(int drive, int channel) {
+  if( board_get() )
+    gpbb_oe(board, channel == OE_A ? GPBB_PORT_A : GPBB_PORT_B, drive);
+}
+
+unsigned char gpbb_output_state(char port) {
+  if( !board_get() )
+    return 0;
+  return gpbb_port_get(board, port == PORT_A ? GPBB_PORT_A : GPBB_PORT_B);
+}
+
+unsigned char gpbb_read() {
+  if( !board_get() )
+    return 0;
+  return gpbb_input(board);
+}
 
-  if(mem_16)
-    munmap(mem_16, 0xFFFF);
-  if(fd)
-    close(fd);
+void gpbb_port_write(char port, char type, unsigned short val) {
+  int p = port == PORT_A ? GPBB_PORT_A : GPBB_PORT_B;
 
-  fd = open("/dev/mem", O_RDWR);
-  if( fd < 0 ) {
-    perror("Unable to open /dev/mem. Must be run with root permissions.");
-    fd = 0;
+  if( !board_get() )
     return;
+
+  switch( type ) {
+  case PORT_VAL:
+    printf( "writing %02x to port %c\n", val, port ? 'b' : 'a' );
+    gpbb_port_put(board, p, val & 0xFF);
+    break;
+  case PORT_SET:
+  case PORT_CLR:
+    if( gpbb_pin_put(board, p, val, type == PORT_SET) )
+      printf( "Invalid bit %d, must be 0-7\n", val );
+    break;
+  default:
+    printf( "gpbb_port_write() received improper operation type code\n" );
   }
+}
 
-  mem_16 = mmap(0, 0xffff, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0x08040000);
-  cs0 = (volatile unsigned short *)mem_16;
 
-  if( high )  // set to 5V
-    cs0[F(FPGA_W_GPBB_CTL)] |= 0x8000;
-  else
-    cs0[F(FPGA_W_GPBB_CTL)] &= 0x7FFF;
+// read every pin in gpios[] count times, per backend, and report the cost
+void gpio_bench(int *gpios, int ngpios, int count) {
+  enum gpio_backend saved = gpio_get_backend();
+  struct gpio_lines *lines;
+  uint64_t start, end;
+  uint32_t values;
+  int i, j, ret;
+
+  gpio_set_backend(GPIO_BACKEND_SYSFS);
+  for( j = 0; j < ngpios; j++ ) {
+    ret = gpio_export(gpios[j]);
+    if( !ret && (ret = gpio_get_value(gpios[j])) >= 0 )
+      continue;
+    printf( "sysfs: can't read gpio %d: %s\n", gpios[j], strerror(-ret) );
+    while( j >= 0 )
+      gpio_unexport(gpios[j--]);
+    gpio_set_backend(saved);
+    return;
+  }
+
+  start = stats_now();
+  for( i = 0; i < count; i++ )
+    for( j = 0; j < ngpios; j++ )
+      gpio_get_value(gpios[j]);
+  end = stats_now();
+  printf( "sysfs gpio_get_value:   %10.0f ns per %d-pin read\n",
+	  (double)(end - start) / count, ngpios );
+
+  lines = gpio_lines_request(gpios, ngpios, GPIO_IN, 0);
+  if( !lines || gpio_lines_get(lines, &values) )
+    printf( "sysfs gpio_lines_get:   request failed\n" );
+  else {
+    start = stats_now();
+    for( i = 0; i < count; i++ )
+      gpio_lines_get(lines, &values);
+    end = stats_now();
+    printf( "sysfs gpio_lines_get:   %10.0f ns per %d-pin read\n",
+	    (double)(end - start) / count, ngpios );
+  }
+  gpio_lines_release(lines);
+
+  // the kernel won't hand a line that sysfs still exports to the chardev
+  for( j = 0; j < ngpios; j++ )
+    gpio_unexport(gpios[j]);
+  if( gpio_set_backend(GPIO_BACKEND_CHARDEV) != GPIO_BACKEND_CHARDEV ) {
+    gpio_set_backend(saved);
+    return;
+  }
+
+  for( j = 0; j < ngpios; j++ ) {
+    ret = gpio_get_value(gpios[j]);
+    if( ret < 0 ) {
+      printf( "chardev: can't read gpio %d: %s\n", gpios[j], strerror(-ret) );
+      break;
+    }
+  }
+  if( j == ngpios ) {
+    start = stats_now();
+    for( i = 0; i < count; i++ )
+      for( j = 0; j < ngpios; j++ )
+	gpio_get_value(gpios[j]);
+    end = stats_now();
+    printf( "chardev gpio_get_value: %10.0f ns per %d-pin read\n",
+	    (double)(end - start) / count, ngpios );
+  }
+  // the single-pin handles hold the lines the group is about to request
+  for( j = 0; j < ngpios; j++ )
+    gpio_unexport(gpios[j]);
+
+  lines = gpio_lines_request(gpios, ngpios, GPIO_IN, 0);
+  if( !lines || gpio_lines_get(lines, &values) )
+    printf( "chardev gpio_lines_get: request failed\n" );
+  else {
+    start = stats_now();
+    for( i = 0; i < count; i++ )
+      gpio_lines_get(lines, &values);
+    end = stats_now();
+    printf( "chardev gpio_lines_get: %10.0f ns per %d-pin read\n",
+	    (double)(end - start) / count, ngpios );
+  }
+  gpio_lines_release(lines);
 
+  gpio_set_backend(saved);
 }
 
-void oe_state(int drive, int channel) {
-  volatile unsigned short *cs0;
+static double cpu_seconds(void) {
+  struct rusage ru;
 
-  if(mem_16)
-    munmap(mem_16, 0xFFFF);
-  if(fd)
-    close(fd);
+  getrusage(RUSAGE_SELF, &ru);
+  return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+    ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
 
-  fd = open("/dev/mem", O_RDWR);
-  if( fd < 0 ) {
-    perror("Unable to open /dev/mem. Must be run with root permissions.");
-    fd = 0;
+// block for count edges on gpios[], then report wakeup latency and CPU cost
+void gpio_wait_bench(int *gpios, int ngpios, enum gpio_edge edge, int count) {
+  struct gpio_event *events;
+  double cpu, lat, lat_max = 0, lat_sum = 0;
+  int seen = 0;
+  int i, n;
+
+  // a wait can return up to GPIO_WAIT_MAX events past count
+  events = malloc((count + GPIO_WAIT_MAX) * sizeof(*events));
+  if( !events ) {
+    perror("Unable to allocate event buffer");
     return;
   }
+  for( i = 0; i < ngpios; i++ )
+    if( gpio_set_edge(gpios[i], edge) ) {
+      free(events);
+      return;
+    }
 
-  mem_16 = mmap(0, 0xffff, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0x08040000);
-  cs0 = (volatile unsigned short *)mem_16;
-  
-  if( channel == OE_A ) {
-    if( drive ) 
-      cs0[F(FPGA_W_GPBB_CTL)] |= 0x1;
-    else
-      cs0[F(FPGA_W_GPBB_CTL)] &= 0xFFFE;
-  } else {
-    if( drive ) 
-      cs0[F(FPGA_W_GPBB_CTL)] |= 0x2;
-    else
-      cs0[F(FPGA_W_GPBB_CTL)] &= 0xFFFD;
+  // nothing is printed until the events are in, so the CPU is the wait's
+  cpu = cpu_seconds();
+  while( seen < count ) {
+    n = gpio_wait_edges(gpios, ngpios, -1, events + seen, GPIO_WAIT_MAX);
+    if( n < 0 )
+      break;
+    seen += n;
+  }
+  cpu = cpu_seconds() - cpu;
+
+  for( i = 0; i < ngpios; i++ )
+    gpio_set_edge(gpios[i], GPIO_EDGE_NONE);
+
+  for( i = 0; i < seen; i++ ) {
+    lat = events[i].wakeup - events[i].timestamp;
+    lat_sum += lat;
+    if( lat > lat_max )
+      lat_max = lat;
+    printf( "gpio %d: %d at %llu.%09llu\n", events[i].gpio, events[i].value,
+	    (unsigned long long) events[i].timestamp / 1000000000ULL,
+	    (unsigned long long) events[i].timestamp % 1000000000ULL );
+  }
+  free(events);
+
+  if( !seen )
+    return;
+  printf( "%d events, wakeup latency avg %.0f ns max %.0f ns, %.1f us CPU per event\n",
+	  seen, lat_sum / seen, lat_max, cpu * 1e6 / seen );
+  if( gpio_get_backend() == GPIO_BACKEND_SYSFS )
+    printf( "(sysfs events carry no kernel timestamp, latency not measurable)\n" );
+}
+
+// the same measurement done by spinning on gpio_get_value()
+void gpio_poll_bench(int gpio, int count) {
+  uint64_t start;
+  double cpu, wall;
+  int last, value;
+  int seen = 0;
+
+  gpio_export(gpio);
+  gpio_set_direction(gpio, GPIO_IN);
+  last = gpio_get_value(gpio);
+
+  start = stats_now();
+  cpu = cpu_seconds();
+  while( seen < count ) {
+    value = gpio_get_value(gpio);
+    if( value < 0 )
+      break;
+    if( value != last ) {
+      printf( "gpio %d: %d\n", gpio, value );
+      last = value;
+      seen++;
+    }
   }
+  cpu = cpu_seconds() - cpu;
+  wall = (stats_now() - start) / 1e9;
+
+  if( !seen )
+    return;
+  printf( "%d changes, %.1f us CPU per event, %.0f%% of one core\n",
+	  seen, cpu * 1e6 / seen, 100 * cpu / wall );
 }
 
-unsigned char gpbb_output_state(char port) {
-  volatile unsigned short *cs0;
+// sample <chan> every <period_us>; nothing is printed until the loop is done
+void adc_stream(unsigned int chan, int count, long period_us) {
+  struct rt_period period;
+  struct rt_hist wakeup, work;
+  struct filter_stats st;
+  uint16_t *samples;
+  uint64_t t0;
+  int i;
+
+  samples = malloc(count * sizeof(*samples));
+  if( !samples ) {
+    perror("Unable to allocate sample buffer");
+    return;
+  }
+  rt_prefault(samples, count * sizeof(*samples));
+  rt_hist_init(&wakeup);
+  rt_hist_init(&work);
+
+  adc_chan(chan);
+  rt_period_start(&period, period_us * 1000);
+  for( i = 0; i < count; i++ ) {
+    rt_hist_add(&wakeup, rt_period_wait(&period));
+    t0 = stats_now();
+    samples[i] = adc_read();
+    rt_hist_add(&work, stats_now() - t0);
+  }
+
+  filter_stats(samples, count, &st);
+  printf( "ADC channel %d: %d samples every %ld us (%s), min %d, mean %.1f, max %d\n",
+	  chan, count, period_us, rt_enabled ? "RT" : "normal", st.min, st.mean, st.max );
+  printf( "median %d, rms %.2f, noise %.2f codes rms\n",
+	  filter_median(samples, count), st.rms, st.stddev );
+  rt_hist_print("wakeup latency", &wakeup);
+  rt_hist_print("adc_read time", &work);
+  regwait_stats_print("VALID polls per conversion", &adc_valid_wait, stdout);
+  free(samples);
+}
 
-  if(mem_16)
-    munmap(mem_16, 0xFFFF);
-  if(fd)
-    close(fd);
+// back-to-back gpbb_adc() conversions per second: the real ceiling on the
+// sample rate here, since every one is polled over I2C; 0 without a board
+static double adc_poll_rate(void) {
+  uint64_t t0;
+  int i;
 
-  fd = open("/dev/mem", O_RDWR);
-  if( fd < 0 ) {
-    perror("Unable to open /dev/mem. Must be run with root permissions.");
-    fd = 0;
+  if( !board_get() )
     return 0;
+  t0 = stats_now();
+  for( i = 0; i < 100; i++ )
+    if( gpbb_adc(board, 0) < 0 )
+      return 0;
+  return 100 / ((stats_now() - t0) / 1e9);
+}
+
+#define CAPTURE_BLOCK 4096  // samples per channel per chunk
+
+// periodic samples of the listed ADC channels and the input port into a
+// capture file; a failed conversion is stored as 0 and counted in the
+// channel's header entry
+int port_capture(const char *path, int *chans, int nchans, int count, long period_us) {
+  struct capture_channel ch[CAPTURE_MAX_CHANNELS];
+  struct capture_writer *w;
+  struct rt_period period;
+  uint16_t *adc;
+  uint8_t *port;
+  uint64_t failed = 0;
+  int i, c, n, code, first = 0, ret = 0;
+
+  if( !board_get() )
+    return -1;
+
+  memset(ch, 0, sizeof(ch));
+  for( c = 0; c < nchans; c++ ) {
+    if( chans[c] < 0 || chans[c] > 7 ) {
+      fprintf(stderr, "ADC channel %d out of range (0-7)\n", chans[c]);
+      return -1;
+    }
+    ch[c].kind = CAPTURE_ADC10;
+    ch[c].source = chans[c];
+    ch[c].width = 10;
+    snprintf(ch[c].name, sizeof(ch[c].name), "adc%d", chans[c]);
+  }
+  ch[nchans].kind = CAPTURE_DIGITAL;
+  ch[nchans].width = 8;
+  strcpy(ch[nchans].name, "port");
+
+  adc = malloc(nchans * CAPTURE_BLOCK * sizeof(*adc));
+  port = malloc(CAPTURE_BLOCK);
+  if( !adc || !port ) {
+    perror("Unable to allocate capture buffers");
+    free(adc);
+    free(port);
+    return -1;
+  }
+  rt_prefault(adc, nchans * CAPTURE_BLOCK * sizeof(*adc));
+  rt_prefault(port, CAPTURE_BLOCK);
+
+  w = capture_create(path, ch, nchans + 1, period_us * 1000,
+		     read_kernel_memory(FPGA_R_V_MAJOR, 0, 2),
+		     read_kernel_memory(FPGA_R_V_MINOR, 0, 2));
+  if( !w ) {
+    free(adc);
+    free(port);
+    return -1;
   }
 
-  mem_16 = mmap(0, 0xffff, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0x08040000);
-  cs0 = (volatile unsigned short *)mem_16;
-  
-  if( port == PORT_A ) {
-    return cs0[F(FPGA_W_CPU_TO_DUT)] & 0xFF;
-  } else {
-    return (cs0[F(FPGA_W_CPU_TO_DUT)] >> 8) & 0xFF;
+  rt_period_start(&period, period_us * 1000);
+  for( i = 0; i < count; i += n ) {
+    n = count - i < CAPTURE_BLOCK ? count - i : CAPTURE_BLOCK;
+    for( first = 0; first < n; first++ ) {
+      rt_period_wait(&period);
+      for( c = 0; c < nchans; c++ ) {
+	code = gpbb_adc(board, chans[c]);
+	if( code < 0 ) {
+	  capture_failed(w, c);
+	  failed++;
+	  code = 0;
+	}
+	adc[c * CAPTURE_BLOCK + first] = code;
+      }
+      port[first] = gpbb_read();
+    }
+    for( c = 0; c < nchans && !ret; c++ )
+      ret = capture_write_adc(w, c, i, adc + c * CAPTURE_BLOCK, n);
+    if( !ret )
+      ret = capture_write_digital(w, nchans, i, port, n);
+    if( ret )
+      break;
   }
+
+  if( capture_close(w, ret ? i : count) )
+    ret = -1;
+  if( failed )
+    fprintf(stderr, "%llu ADC conversions failed; see -capinfo\n",
+	    (unsigned long long)failed);
+  free(adc);
+  free(port);
+  return ret;
 }
 
-unsigned char gpbb_read() {
+// hex digits, two per byte; "-" is no bytes
+static int parse_hex_bytes(const char *arg, uint8_t *buf, int max) {
+  char byte[3] = { 0 };
+  int n = 0;
+
+  if( !strcmp(arg, "-") )
+    return 0;
+  if( strlen(arg) % 2 || strlen(arg) / 2 > max ) {
+    printf( "%s: need an even number of hex digits, %d bytes at most\n", arg, max );
+    return -1;
+  }
+  for( ; *arg; arg += 2 ) {
+    byte[0] = arg[0];
+    byte[1] = arg[1];
+    buf[n++] = strtoul(byte, NULL, 16);
+  }
+  return n;
+}
+
+static void print_hex_bytes(const char *label, const uint8_t *buf, int n) {
+  int i;
+
+  printf( "%s", label );
+  for( i = 0; i < n; i++ )
+    printf( " %02x", buf[i] );
+  printf( "\n" );
+}
+
+// start a vector stream from the port and OE state the board is in now
+static volatile unsigned short *vec_begin(struct vec_stream *s) {
+  volatile unsigned short *cs0 = cs0_map();
+
+  if( cs0 )
+    vec_init(s, cs0_read(cs0, FPGA_W_CPU_TO_DUT), cs0_read(cs0, FPGA_W_GPBB_CTL) & 0x3);
+  return cs0;
+}
+
+// run a compiled stream repeat times through one mapping and report the
+// rate; samples (nbits bytes) is left holding the last run's
+static uint8_t *vec_exec(volatile unsigned short *cs0, struct vec_stream *s, int repeat) {
+  uint8_t *samples;
+  unsigned short ctl;
+  uint64_t t0, t;
+  int i;
+
+  if( s->error ) {
+    printf( "Unable to allocate vector stream\n" );
+    return NULL;
+  }
+  samples = malloc(s->nbits + 1);
+  if( !samples ) {
+    perror("Unable to allocate vector samples");
+    return NULL;
+  }
+  if( repeat < 1 )
+    repeat = 1;
+
+  t0 = stats_now();
+  for( i = 0; i < repeat; i++ )
+    vec_run(s, (volatile uint16_t *)cs0, samples);
+  t = (stats_now() - t0) / repeat;
+
+  ctl = cs0_read(cs0, FPGA_W_GPBB_CTL);
+  STATE(state_set_port(s->port));
+  STATE(state_set_ctl(ctl));
+  printf( "%d bits in %d ops (%d sampled), %.1f us: %.1f kbit/s, %.3f Mops/s\n",
+	  s->tx_bits, s->nops, s->nbits, t / 1e3, s->tx_bits * 1e6 / t, s->nops * 1e3 / t );
+  return samples;
+}
+
+static int port_spi(int mode, const char *hex, int repeat) {
+  struct vec_spi cfg = vec_spi_pins;
+  struct vec_stream s;
+  volatile unsigned short *cs0;
+  uint8_t tx[256], rx[256], *samples;
+  int n;
+
+  n = parse_hex_bytes(hex, tx, sizeof(tx));
+  if( n < 0 || !(cs0 = vec_begin(&s)) )
+    return -1;
+  cfg.mode = mode & 3;
+  vec_spi(&s, &cfg, tx, n);
+  samples = vec_exec(cs0, &s, repeat);
+  if( samples ) {
+    vec_decode(&s, samples, rx);
+    print_hex_bytes("tx", tx, n);
+    print_hex_bytes("rx", rx, n);
+  }
+  free(samples);
+  vec_free(&s);
+  return samples ? 0 : -1;
+}
+
+static int port_i2c(int addr, const char *hex, int rlen, int repeat) {
+  struct vec_stream s;
+  volatile unsigned short *cs0;
+  uint8_t wr[256], rx[2 * 256 + 2], *samples;
+  int n, i;
+
+  n = parse_hex_bytes(hex, wr, sizeof(wr));
+  if( n < 0 || rlen < 0 || rlen > 256 || !(cs0 = vec_begin(&s)) )
+    return -1;
+  vec_i2c(&s, &vec_i2c_pins, addr, wr, n, rlen);
+  samples = vec_exec(cs0, &s, repeat);
+  if( samples ) {
+    vec_decode(&s, samples, rx);
+    // rx: the bytes read, then a 0 for each ACK
+    printf( "acks:" );
+    for( i = rlen; i < s.rx_len; i++ )
+      printf( " %s", rx[i] ? "NACK" : "ACK" );
+    printf( "\n" );
+    if( rlen )
+      print_hex_bytes("read", rx, rlen);
+  }
+  free(samples);
+  vec_free(&s);
+  return samples ? 0 : -1;
+}
+
+static int port_uart(const char *hex, int bit_vectors, int repeat) {
+  struct vec_uart cfg = vec_uart_pins;
+  struct vec_stream s;
   volatile unsigned short *cs0;
+  uint8_t tx[256], rx[512], *samples;
+  int n, nrx, errors;
+
+  n = parse_hex_bytes(hex, tx, sizeof(tx));
+  if( n < 0 || !(cs0 = vec_begin(&s)) )
+    return -1;
+  if( bit_vectors > 0 )
+    cfg.bit_vectors = bit_vectors;
+  // two frame times of idle for the far end to answer the last frame
+  vec_uart(&s, &cfg, tx, n, 2);
+  samples = vec_exec(cs0, &s, repeat);
+  if( samples ) {
+    nrx = vec_uart_decode(&cfg, samples, s.nbits, rx, sizeof(rx), &errors);
+    print_hex_bytes("tx", tx, n);
+    print_hex_bytes("rx", rx, nrx);
+    if( errors )
+      printf( "%d framing/parity errors\n", errors );
+  }
+  free(samples);
+  vec_free(&s);
+  return samples ? 0 : -1;
+}
 
-  if(mem_16)
-    munmap(mem_16, 0xFFFF);
-  if(fd)
-    close(fd);
+static struct jtag_pins jtag_pins;
+static const struct jtag_pins *jtag_wiring = &jtag_default_pins;
 
-  fd = open("/dev/mem", O_RDWR);
-  if( fd < 0 ) {
-    perror("Unable to open /dev/mem. Must be run with root permissions.");
-    fd = 0;
-    return 0;
+// aN/bN for an output pin, a bare number for an output or input bit
+static int parse_pin(const char *arg) {
+  if( arg[0] == 'a' || arg[0] == 'A' )
+    return strtol(arg + 1, NULL, 0);
+  if( arg[0] == 'b' || arg[0] == 'B' )
+    return 8 + strtol(arg + 1, NULL, 0);
+  return strtol(arg, NULL, 0);
+}
+
+static volatile unsigned short *jtag_begin(struct jtag *j, int hold) {
+  volatile unsigned short *cs0 = cs0_map();
+
+  if( cs0 && jtag_open(j, jtag_wiring, (volatile uint16_t *)cs0, cs0_read(cs0, FPGA_W_CPU_TO_DUT),
+		       cs0_read(cs0, FPGA_W_GPBB_CTL) & 0x3, hold) ) {
+    printf( "Unable to allocate JTAG vectors\n" );
+    jtag_close(j);
+    return NULL;
   }
+  return cs0;
+}
 
-  mem_16 = mmap(0, 0xffff, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0x08040000);
-  cs0 = (volatile unsigned short *)mem_16;
-  
-  return cs0[F(FPGA_R_DUT_TO_CPU)] & 0xFF;
+static void jtag_end(volatile unsigned short *cs0, struct jtag *j) {
+  STATE(state_set_port(j->s.port));
+  STATE(state_set_ctl(cs0_read(cs0, FPGA_W_GPBB_CTL)));
+  jtag_close(j);
 }
 
-void gpbb_port_write(char port, char type, unsigned short val) {
+// IDCODE is what DR holds after Test-Logic-Reset on any TAP that has one
+static int port_jtagid(void) {
   volatile unsigned short *cs0;
+  struct jtag j;
+  uint8_t id[4];
+  uint32_t idcode;
+  int ret;
+
+  if( !(cs0 = jtag_begin(&j, 1)) )
+    return -1;
+  jtag_shift(&j, 0, NULL, id, 32, JTAG_IDLE);
+  ret = jtag_flush(&j);
+  jtag_end(cs0, &j);
+  if( ret )
+    return -1;
+  idcode = id[0] | id[1] << 8 | id[2] << 16 | (uint32_t)id[3] << 24;
+  if( !(idcode & 1) )
+    printf( "IDCODE %08x: no IDCODE (BYPASS after reset?)\n", idcode );
+  else
+    printf( "IDCODE %08x: manufacturer %03x, part %04x, version %x\n", idcode,
+	    (idcode >> 1) & 0x7ff, (idcode >> 12) & 0xffff, idcode >> 28 );
+  return 0;
+}
+
+static int port_svf(const char *path, int xsvf, int hold) {
+  volatile unsigned short *cs0;
+  struct svf_stats st;
+  struct jtag j;
+  int ret;
+
+  if( !(cs0 = jtag_begin(&j, hold)) )
+    return -1;
+  ret = xsvf ? xsvf_play(&j, path, &st) : svf_play(&j, path, &st);
+  if( ret >= 0 )
+    svf_report(&j, &st);
+  jtag_end(cs0, &j);
+  return ret;
+}
 
-  if(mem_16)
-    munmap(mem_16, 0xFFFF);
-  if(fd)
-    close(fd);
+// codes 0-1023 (as -da takes them) from a file, whitespace separated, sent
+// once code by code and once in bursts; the DAC ends on the last code
+static int dac_stream(int dac, const char *path, int burst) {
+  uint16_t *codes = NULL, *p;
+  int n = 0, max = 0, ret;
+  uint64_t t0, single, bursts;
+  long code;
+  FILE *f;
+  int i;
 
-  fd = open("/dev/mem", O_RDWR);
-  if( fd < 0 ) {
-    perror("Unable to open /dev/mem. Must be run with root permissions.");
-    fd = 0;
-    return;
+  f = fopen(path, "r");
+  if( !f ) {
+    perror("Unable to open DAC code file");
+    return -1;
+  }
+  while( fscanf(f, "%li", &code) == 1 ) {
+    if( code < 0 || code > 1023 ) {
+      printf( "%s: code %ld out of range 0-1023\n", path, code );
+      fclose(f);
+      free(codes);
+      return -1;
+    }
+    if( n == max ) {
+      max = max ? max * 2 : 1024;
+      p = realloc(codes, max * sizeof(*codes));
+      if( !p ) {
+	perror("Unable to allocate DAC codes");
+	fclose(f);
+	free(codes);
+	return -1;
+      }
+      codes = p;
+    }
+    codes[n++] = code;
+  }
+  fclose(f);
+  if( !n || !board_get() ) {
+    if( !n )
+      printf( "%s: no codes\n", path );
+    free(codes);
+    return -1;
+  }
+  if( burst <= 0 )
+    burst = DAC101C085_BURST_WORDS;
+  if( burst > DAC101C085_BURST_MAX )
+    burst = DAC101C085_BURST_MAX;
+
+  t0 = stats_now();
+  for( i = 0; i < n; i++ )
+    if( gpbb_dac(board, dac, codes[i]) < 0 )
+      break;
+  single = stats_now() - t0;
+  if( i < n ) {
+    free(codes);
+    return -1;
   }
 
-  mem_16 = mmap(0, 0xffff, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0x08040000);
-  cs0 = (volatile unsigned short *)mem_16;
+  t0 = stats_now();
+  ret = gpbb_dac_stream(board, dac, codes, n, burst);
+  bursts = stats_now() - t0;
+  free(codes);
+  if( ret < 0 )
+    return -1;
+
+  printf( "single writes: %d updates in %d transactions, %.1f ms, %.0f updates/s\n",
+	  n, n, single / 1e6, n * 1e9 / single );
+  printf( "bursts of %d: %d updates in %d transactions, %.1f ms, %.0f updates/s (%.2fx)\n",
+	  burst, n, (n + burst - 1) / burst, bursts / 1e6, n * 1e9 / bursts,
+	  (double)single / bursts );
+  return 0;
+}
 
-  switch( type ) {
-  case PORT_VAL:
-    printf( "writing %02x to port %c\n", val, port ? 'b' : 'a' );
-    if( port == PORT_A ) {
-      cs0[F(FPGA_W_CPU_TO_DUT)] = (val & 0xFF) | (cs0[F(FPGA_W_CPU_TO_DUT)] & 0xFF00);
-    } else {
-      cs0[F(FPGA_W_CPU_TO_DUT)] = ((val & 0xFF) << 8) | (cs0[F(FPGA_W_CPU_TO_DUT)] & 0x00FF);
+// parse a comma-separated gpio list, returns the number of entries
+int parse_gpio_list(char *arg, int *gpios, int max) {
+  int n = 0;
+  char *tok;
+
+  for( tok = strtok(arg, ","); tok && n < max; tok = strtok(NULL, ",") )
+    gpios[n++] = strtoul(tok, NULL, 0);
+  return n;
+}
+
+// "0,2,5" as a telem_config ADC mask; "-" is no channels, -1 a bad one
+static int telem_adc_mask(char *arg) {
+  int chans[TELEM_ADC_CHANNELS];
+  int mask = 0;
+  int i, n;
+
+  if( !strcmp(arg, "-") )
+    return 0;
+  n = parse_gpio_list(arg, chans, TELEM_ADC_CHANNELS);
+  for( i = 0; i < n; i++ ) {
+    if( chans[i] < 0 || chans[i] >= TELEM_ADC_CHANNELS ) {
+      printf( "ADC channel %d out of range (0-%d)\n", chans[i], TELEM_ADC_CHANNELS - 1 );
+      return -1;
     }
-    break;
-  case PORT_SET:
-    if( port == PORT_B )
-      val += 8;
-    cs0[F(FPGA_W_CPU_TO_DUT)] |= 1 << val;
-    break;
-  case PORT_CLR:
-    if( port == PORT_B )
-      val += 8;
-    cs0[F(FPGA_W_CPU_TO_DUT)] &= ~(1 << val);
-    break;
-  default:
-    printf( "gpbb_port_write() received improper operation type code\n" );
+    mask |= 1 << chans[i];
+  }
+  return mask;
+}
+
+// poll count times (0: until interrupted) and report what it cost
+static int port_telemetry(struct telem_config *cfg, uint64_t count, int verbose) {
+  volatile unsigned short *cs0 = cs0_map();
+  struct telem_stats st;
+  struct telem *t;
+  int ret;
+
+  if( !cs0 )
+    return -1;
+  t = telem_open(cfg, (volatile uint16_t *)cs0);
+  if( !t )
+    return -1;
+  ret = telem_run(t, count, &st);
+  telem_close(t);
+
+  if( !verbose ) {
+    printf( "%10.1f %10.1f %14.6f %10.1f %8llu %8llu %8.2f %8llu\n",
+	    cfg->period_ns ? 1e9 / cfg->period_ns : 0.0, telem_rate(&st),
+	    st.wall_ns ? (double)st.cpu_ns / st.wall_ns : 0.0,
+	    st.cycles ? st.read.sum / st.cycles / 1e3 : 0.0,
+	    (unsigned long long)(st.cycles ? st.ring_ns / st.cycles : 0),
+	    (unsigned long long)(st.text_writes ? st.text_ns / st.text_writes / 1000 : 0),
+	    st.cycles ? (double)st.i2c_transfers / st.cycles : 0.0,
+	    (unsigned long long)st.overruns );
+    return ret;
+  }
+  telem_report(cfg, &st, stdout);
+  if( cfg->period_ns )
+    rt_hist_print("wakeup latency", &st.wakeup);
+  rt_hist_print("snapshot read time", &st.read);
+  return ret;
+}
+
+// the poller's share of one core from 1 Hz up to free-running
+static int telem_bench(uint32_t adc_mask, double seconds) {
+  static const long rates[] = { 1, 10, 100, 1000, 0 };
+  struct telem_config cfg;
+  unsigned int i;
+  int ret = 0;
+
+  memset(&cfg, 0, sizeof(cfg));
+  cfg.adc_mask = adc_mask;
+  cfg.eim = 1;
+  cfg.ring_path = "/tmp/gpbb-telembench.ring";
+  cfg.ring_capacity = 4096;
+  cfg.text_path = "/tmp/gpbb-telembench.prom";
+  cfg.text_interval_ns = 1000000000L;
+
+  printf( "%10s %10s %14s %10s %8s %8s %8s %8s\n", "rate Hz", "got /s", "core fraction",
+	  "reads us", "ring ns", "text us", "xfers", "overruns" );
+  for( i = 0; i < sizeof(rates) / sizeof(rates[0]) && !ret; i++ ) {
+    cfg.period_ns = rates[i] ? 1000000000L / rates[i] : 0;
+    // one more snapshot than periods, so the run spans the whole time
+    ret = port_telemetry(&cfg, rates[i] ? rates[i] * seconds + 1 : 1000, 0);
   }
+  unlink(cfg.ring_path);
+  unlink(cfg.text_path);
+  if( sim_enabled )
+    printf( "(sim: -sim_latency bus time is busy-waited, so it counts as CPU)\n" );
+  return ret;
 }
 
 
@@ -239,6 +857,8 @@ void print_usage(char *progname) {
 	"\t-v  Read out the version code of the FPGA\n"
 	"\t-da <value> set DAC A to value (0-1024 decimal)\n"
 	"\t-db <value> set DAC B to value (0-1024 decimal)\n"
+	"\t-dstream <a|b> <codefile> [burst] send the codes (0-1023) in a file to DAC A or B,\n"
+	"\t\tone write each and then burst codes per I2C write (default %d), and compare updates/s\n"
 	"\t-a  <chan> set and read channel <chan> from ADC\n"
 	"\t-hv set VDD-IO to high (5V) voltage\n"
 	"\t-lv set VDD-IO to low (nom 3.3V unless you trimmed it) voltage\n"
@@ -252,275 +872,105 @@ void print_usage(char *progname) {
 	"\t-rp return the value of the 8-bit input port\n"
 	"\t* CS1 isn't useful in the design, but loopback code provided as a template\n"
 	"\t-testcs1 Check that burst-access area (CS1) works\n"
-	 "", progname);
+	"\t-load <bitfile> [spidev] reset and configure the FPGA (default %s);\n"
+	"\t\tspidev must be a character device unless -sim comes first\n"
+	"\t-load_if_needed <bitfile> [spidev] as -load, unless that bitstream is already running\n"
+	"\t-stats print call counts and latency histograms of hardware operations at exit\n"
+	"\t-stats_file <path> write the same statistics as JSON to <path> at exit\n"
+	"\t-trace <file> [records] record register and I2C accesses of the following commands to a ring file\n"
+	"\t-replay <file> [timed] replay a trace as fast as possible, or with its original timing\n"
+	"\t-tracesum <file> per-address access counts, redundant reads and writes of a trace\n"
+	"\t-state_publish keep the shared state page up to date with the following commands\n"
+	"\t-state print the published port, OE/VDDIO, DAC and ADC state without touching the hardware\n"
+	"\t* -sim options apply to the whole command line, wherever they appear\n"
+	"\t-sim [loopback|counter|<hex>] run against a software model of the board instead of the hardware;\n"
+	"\t\tthe input port reads back port A (loopback), a counter, or a constant\n"
+	"\t-sim_latency charge each simulated access the EIM/I2C bus time it would take on the board\n"
+	"\t-uio <N|/dev/uioN> map the CS0/CS1 windows through a UIO device instead of /dev/mem\n"
+	"\t\t(applies to the whole command line); waits block on its interrupt when it has one\n"
+	"\t-waitreg <addr> <mask> <value> [timeout_ms] wait for (CS0 register & mask) == value (default 1000 ms)\n"
+	"\t-rt [cpu] [priority] run the following commands SCHED_FIFO (default priority %d), pinned\n"
+	"\t\tto <cpu>, with memory locked and register windows pre-faulted\n"
+	"\t-astream <chan> <count> [period_us] sample an ADC channel periodically (default 1000 us)\n"
+	"\t\tand report wakeup-latency and read-time histograms; compare with and without -rt\n"
+	"\t-pid <chan> <a|b> <setpoint> <kp> <ki> <kd> <count> [period_us] [alpha] [tracefile]\n"
+	"\t\tclose a loop from ADC <chan> to DAC A or B every period_us (default 1000); alpha < 1\n"
+	"\t\tlow-pass filters the samples; tracefile records every iteration (control.h)\n"
+	"\t-sweep <a|b> <chan> [first] [last] [settle_us] [curvefile] step DAC A or B through codes\n"
+	"\t\tfirst..last (default 0..1023), reading ADC <chan> settle_us (default 100) after each\n"
+	"\t\twrite; prints the transfer curve (or writes curvefile), INL/DNL and points/s\n"
+	"\t-capture <file> <chan[,chan...]|-> <count> [period_us] record ADC channels and the input\n"
+	"\t\tport every period_us (default 1000) into a binary capture file (capture.h)\n"
+	"\t-capinfo <file> summarise a capture file\n"
+	"\t-capexport <file> <csv|vcd> [outfile] convert a capture file to CSV or VCD\n"
+	"\t-stream <adc0-7|port|cs1|nand> <count> <file> [period_us] [direct] write raw samples to a\n"
+	"\t\tfile through a writer thread (writer.h), every period_us or free-running if 0 (default)\n"
+	"\t-writebench [diskfile] [direct] writer throughput on tmpfs and a disk file at rising input rates\n"
+	"\t-telemetry <period_ms> <ringfile|-> <textfile|-> [chan,chan...|-] [count] [text_ms] poll the\n"
+	"\t\tstatus, input port, version and EIM registers and ADC channels (default none) every\n"
+	"\t\tperiod_ms into a ring file, and every text_ms (default 1000) into a text exposition file\n"
+	"\t\tfor a scraper (telemetry.h); until interrupted if count is 0 (default)\n"
+	"\t-telembench [chan,chan...|-] [seconds] the poller's CPU use as a fraction of one core at\n"
+	"\t\t1 Hz to 1 kHz and free-running, seconds (default 2) at each rate\n"
+	"\t* -vspi, -vi2c and -vuart bit-bang a bus on the ports from a precompiled vector stream (vector.h):\n"
+	"\t\tSPI SCK/MOSI//CS on A0/A1/A2, MISO on in0; I2C SCL on A4, SDA on B0 (open drain\n"
+	"\t\tthrough OE B) read back on in1; UART TX on A3, RX on in2.  repeat runs the stream again\n"
+	"\t-vspi <mode> <hexbytes> [repeat] SPI transfer in mode 0-3, prints the bytes clocked in\n"
+	"\t-vi2c <addr> <hexbytes|-> [readlen] [repeat] I2C write and/or read (repeated START)\n"
+	"\t-vuart <hexbytes> [bit_vectors] [repeat] UART 8N1 frames, each bit held for bit_vectors\n"
+	"\t\twrites (default 4); prints frames received meanwhile\n"
+	"\t-vecbench [bytes] [iterations] raw EIM write rate and each protocol's rate against it\n"
+	"\t\t(default 64, 100)\n"
+	"\t* JTAG probe (jtag.h) with TCK/TMS/TDI on A5/A6/A7 and TDO on in3 unless -jtag_pins says otherwise:\n"
+	"\t-jtag_pins <tck> <tms> <tdi> <tdo> outputs as aN/bN, TDO as an input bit number\n"
+	"\t-jtagid read the IDCODE a single TAP loads after Test-Logic-Reset\n"
+	"\t-svf <file> [hold] play an SVF file, TCK held for hold writes per half period (default 1)\n"
+	"\t-xsvf <file> [hold] play an XSVF file; both report TDO mismatches and the TCK rate\n"
+	"\t-simdut <spi[0-3]|i2c|uart|jtag> with -sim, attach a simulated device on the wiring above\n"
+	"\t\t(sim-dut.h); the UART one expects the default bit_vectors\n"
+	"\t-filterbench [n] [iterations] time the sample-block filters (filter.h) on n-sample blocks\n"
+	"\t\t(default 65536, 200) with every SIMD version this CPU has, against the scalar ones\n"
+	"\t\tand against the converter's rating and the measured I2C-polled ADC rate\n"
+	"\t* GPIO access defaults to sysfs\n"
+	"\t-gpiocdev use the GPIO character device (/dev/gpiochipN) for GPIO access\n"
+	"\t-gpiobench <gpio[,gpio...]> <count> compare sysfs and chardev read latency\n"
+	"\t-gpiowait <gpio[,gpio...]> <rising|falling|both> <count> wait for edges, report latency and CPU\n"
+	"\t-gpiopoll <gpio> <count> spin on <gpio> for <count> changes, report CPU\n"
+	"\t-pins <gpio[,gpio...]> [value] read a pin group, or drive it to value (bit n is the nth pin);\n"
+	"\t\tEIM bank pins are 0x80000000 + bit (0-15), any mix with native ones\n"
+	 "", progname, DAC101C085_BURST_WORDS, FPGA_SPIDEV, RT_DEFAULT_PRIORITY);
 }
 
 
-void setup_fpga() {
-  int i;
-  //  printf( "setting up EIM CS0 (register interface) pads and configuring timing\n" );
-  // set up pads to be mapped to EIM
-  for( i = 0; i < 16; i++ ) {
-    write_kernel_memory( 0x20e0114 + i*4, 0x0, 0, 4 );  // mux mapping
-    write_kernel_memory( 0x20e0428 + i*4, 0xb0b1, 0, 4 ); // pad strength config'd for a 100MHz rate 
-  }
-
-  // mux mapping
-  write_kernel_memory( 0x20e046c - 0x314, 0x0, 0, 4 ); // BCLK
-  write_kernel_memory( 0x20e040c - 0x314, 0x0, 0, 4 ); // CS0
-  write_kernel_memory( 0x20e0410 - 0x314, 0x0, 0, 4 ); // CS1
-  write_kernel_memory( 0x20e0414 - 0x314, 0x0, 0, 4 ); // OE
-  write_kernel_memory( 0x20e0418 - 0x314, 0x0, 0, 4 ); // RW
-  write_kernel_memory( 0x20e041c - 0x314, 0x0, 0, 4 ); // LBA
-  write_kernel_memory( 0x20e0468 - 0x314, 0x0, 0, 4 ); // WAIT
-  write_kernel_memory( 0x20e0408 - 0x314, 0x0, 0, 4 ); // A16
-  write_kernel_memory( 0x20e0404 - 0x314, 0x0, 0, 4 ); // A17
-  write_kernel_memory( 0x20e0400 - 0x314, 0x0, 0, 4 ); // A18
-
-  // pad strength
-  write_kernel_memory( 0x20e046c, 0xb0b1, 0, 4 ); // BCLK
-  write_kernel_memory( 0x20e040c, 0xb0b1, 0, 4 ); // CS0
-  write_kernel_memory( 0x20e0410, 0xb0b1, 0, 4 ); // CS1
-  write_kernel_memory( 0x20e0414, 0xb0b1, 0, 4 ); // OE
-  write_kernel_memory( 0x20e0418, 0xb0b1, 0, 4 ); // RW
-  write_kernel_memory( 0x20e041c, 0xb0b1, 0, 4 ); // LBA
-  write_kernel_memory( 0x20e0468, 0xb0b1, 0, 4 ); // WAIT
-  write_kernel_memory( 0x20e0408, 0xb0b1, 0, 4 ); // A16
-  write_kernel_memory( 0x20e0404, 0xb0b1, 0, 4 ); // A17
-  write_kernel_memory( 0x20e0400, 0xb0b1, 0, 4 ); // A18
-
-  write_kernel_memory( 0x020c4080, 0xcf3, 0, 4 ); // ungate eim slow clocks
-
-  // rework timing for sync use
-  // 0011 0  001 1   001    0   001 00  00  1  011  1    0   1   1   1   1   1   1
-  // PSZ  WP GBC AUS CSREC  SP  DSZ BCS BCD WC BL   CREP CRE RFL WFL MUM SRD SWR CSEN
-  //
-  // PSZ = 0011  64 words page size
-  // WP = 0      (not protected)
-  // GBC = 001   min 1 cycles between chip select changes
-  // AUS = 0     address shifted according to port size
-  // CSREC = 001 min 1 cycles between CS, OE, WE signals
-  // SP = 0      no supervisor protect (user mode access allowed)
-  // DSZ = 001   16-bit port resides on DATA[15:0]
-  // BCS = 00    0 clock delay for burst generation
-  // BCD = 00    divide EIM clock by 0 for burst clock
-  // WC = 1      write accesses are continuous burst length
-  // BL = 011    32 word memory wrap length
-  // CREP = 1    non-PSRAM, set to 1
-  // CRE = 0     CRE is disabled
-  // RFL = 1     fixed latency reads
-  // WFL = 1     fixed latency writes
-  // MUM = 1     multiplexed mode enabled
-  // SRD = 1     synch reads
-  // SWR = 1     synch writes
-  // CSEN = 1    chip select is enabled
-
-  //  write_kernel_memory( 0x21b8000, 0x5191C0B9, 0, 4 );
-  write_kernel_memory( 0x21b8000, 0x31910BBF, 0, 4 );
-
-  // EIM_CS0GCR2   
-  //  MUX16_BYP_GRANT = 1
-  //  ADH = 1 (1 cycles)
-  //  0x1001
-  write_kernel_memory( 0x21b8004, 0x1000, 0, 4 );
-
-
-  // EIM_CS0RCR1   
-  // 00 000101 0 000   0   000   0 000 0 000 0 000 0 000
-  //    RWSC     RADVA RAL RADVN   OEA   OEN   RCSA  RCSN
-  // RWSC 000101    5 cycles for reads to happen
-  //
-  // 0000 0111 0000   0011   0000 0000 0000 0000
-  //  0    7     0     3      0  0    0    0
-  // 0000 0101 0000   0000   0 000 0 000 0 000 0 000
-//  write_kernel_memory( 0x21b8008, 0x05000000, 0, 4 );
-//  write_kernel_memory( 0x21b8008, 0x0A024000, 0, 4 );
-  write_kernel_memory( 0x21b8008, 0x09014000, 0, 4 );
-  // EIM_CS0RCR2  
-  // 0000 0000 0   000 00 00 0 010  0 001 
-  //           APR PAT    RL   RBEA   RBEN
-  // APR = 0   mandatory because MUM = 1
-  // PAT = XXX because APR = 0
-  // RL = 00   because async mode
-  // RBEA = 000  these match RCSA/RCSN from previous field
-  // RBEN = 000
-  // 0000 0000 0000 0000 0000  0000
-  write_kernel_memory( 0x21b800c, 0x00000000, 0, 4 );
-
-  // EIM_CS0WCR1
-  // 0   0    000100 000   000   000  000  010 000 000  000
-  // WAL WBED WWSC   WADVA WADVN WBEA WBEN WEA WEN WCSA WCSN
-  // WAL = 0       use WADVN
-  // WBED = 0      allow BE during write
-  // WWSC = 000100 4 write wait states
-  // WADVA = 000   same as RADVA
-  // WADVN = 000   this sets WE length to 1 (this value +1)
-  // WBEA = 000    same as RBEA
-  // WBEN = 000    same as RBEN
-  // WEA = 010     2 cycles between beginning of access and WE assertion
-  // WEN = 000     1 cycles to end of WE assertion
-  // WCSA = 000    cycles to CS assertion
-  // WCSN = 000    cycles to CS negation
-  // 1000 0111 1110 0001 0001  0100 0101 0001
-  // 8     7    E    1    1     4    5    1
-  // 0000 0111 0000 0100 0000  1000 0000 0000
-  // 0      7    0   4    0     8    0     0
-  // 0000 0100 0000 0000 0000  0100 0000 0000
-  //  0    4    0    0     0    4     0    0
-
-  write_kernel_memory( 0x21b8010, 0x09080800, 0, 4 );
-  //  write_kernel_memory( 0x21b8010, 0x02040400, 0, 4 );
-
-  // EIM_WCR
-  // BCM = 1   free-run BCLK
-  // GBCD = 0  don't divide the burst clock
-  write_kernel_memory( 0x21b8090, 0x701, 0, 4 );
-
-  // EIM_WIAR 
-  // ACLK_EN = 1
-  write_kernel_memory( 0x21b8094, 0x10, 0, 4 );
-
-  //  printf( "done.\n" );
-}
-
-void setup_fpga_cs1() { 
-  int i;
-  //  printf( "setting up EIM CS1 (burst interface) pads and configuring timing\n" );
-  // ASSUME: setup_fpga() is already called to configure gpio mux setting.
-  // this just gets the pads set to high-speed mode
-
-  // set up pads to be mapped to EIM
-  for( i = 0; i < 16; i++ ) {
-    write_kernel_memory( 0x20e0428 + i*4, 0xb0f1, 0, 4 ); // pad strength config'd for a 200MHz rate 
-  }
-
-  // pad strength
-  write_kernel_memory( 0x20e046c, 0xb0f1, 0, 4 ); // BCLK
-  //  write_kernel_memory( 0x20e040c, 0xb0b1, 0, 4 ); // CS0
-  write_kernel_memory( 0x20e0410, 0xb0f1, 0, 4 ); // CS1
-  write_kernel_memory( 0x20e0414, 0xb0f1, 0, 4 ); // OE
-  write_kernel_memory( 0x20e0418, 0xb0f1, 0, 4 ); // RW
-  write_kernel_memory( 0x20e041c, 0xb0f1, 0, 4 ); // LBA
-  write_kernel_memory( 0x20e0468, 0xb0f1, 0, 4 ); // WAIT
-  write_kernel_memory( 0x20e0408, 0xb0f1, 0, 4 ); // A16
-  write_kernel_memory( 0x20e0404, 0xb0f1, 0, 4 ); // A17
-  write_kernel_memory( 0x20e0400, 0xb0f1, 0, 4 ); // A18
-
-  // EIM_CS1GCR1   
-  // 0011 0  001 1   001    0   001 00  00  1  011  1    0   1   1   1   1   1   1
-  // PSZ  WP GBC AUS CSREC  SP  DSZ BCS BCD WC BL   CREP CRE RFL WFL MUM SRD SWR CSEN
-  //
-  // PSZ = 0011  64 words page size
-  // WP = 0      (not protected)
-  // GBC = 001   min 1 cycles between chip select changes
-  // AUS = 0     address shifted according to port size
-  // CSREC = 001 min 1 cycles between CS, OE, WE signals
-  // SP = 0      no supervisor protect (user mode access allowed)
-  // DSZ = 001   16-bit port resides on DATA[15:0]
-  // BCS = 00    0 clock delay for burst generation
-  // BCD = 00    divide EIM clock by 0 for burst clock
-  // WC = 1      write accesses are continuous burst length
-  // BL = 011    32 word memory wrap length
-  // CREP = 1    non-PSRAM, set to 1
-  // CRE = 0     CRE is disabled
-  // RFL = 1     fixed latency reads
-  // WFL = 1     fixed latency writes
-  // MUM = 1     multiplexed mode enabled
-  // SRD = 1     synch reads
-  // SWR = 1     synch writes
-  // CSEN = 1    chip select is enabled
-
-  // 0101 0111 1111    0001 1100  0000  1011   1   0   0   1
-  // 0x5  7    F        1   C     0     B    9
-
-  // 0101 0001 1001    0001 1100  0000  1011   1001
-  // 5     1    9       1    c     0     B      9
-
-  // 0011 0001 1001    0001 0000  1011  1011   1111
-
-  write_kernel_memory( 0x21b8000 + 0x18, 0x31910BBF, 0, 4 );
-
-  // EIM_CS1GCR2   
-  //  MUX16_BYP_GRANT = 1
-  //  ADH = 0 (0 cycles)
-  //  0x1000
-  write_kernel_memory( 0x21b8004 + 0x18, 0x1000, 0, 4 );
-
-
-  // 9 cycles is total length of read
-  // 2 cycles for address
-  // +4 more cycles for first data to show up
-
-  // EIM_CS1RCR1   
-  // 00 000100 0 000   0   001   0 010 0 000 0 000 0 000
-  //    RWSC     RADVA RAL RADVN   OEA   OEN   RCSA  RCSN
-  //
-  // 00 001001 0 000   0   001   0 110 0 000 0 000 0 000
-  //    RWSC     RADVA RAL RADVN   OEA   OEN   RCSA  RCSN
-  //
-  // 0000 0111 0000   0011   0000 0000 0000 0000
-  //  0    7     0     3      0  0    0    0
-  // 0000 0101 0000   0000   0 000 0 000 0 000 0 000
-//  write_kernel_memory( 0x21b8008, 0x05000000, 0, 4 );
-  // 0000 0011 0000   0001   0001 0000 0000 0000
-
-  // 0000 1001 0000   0001   0110 0000 0000 0000
-  // 
-  write_kernel_memory( 0x21b8008 + 0x18, 0x09014000, 0, 4 );
-
-  // EIM_CS1RCR2  
-  // 0000 0000 0   000 00 00 0 010  0 001 
-  //           APR PAT    RL   RBEA   RBEN
-  // APR = 0   mandatory because MUM = 1
-  // PAT = XXX because APR = 0
-  // RL = 00   because async mode
-  // RBEA = 000  these match RCSA/RCSN from previous field
-  // RBEN = 000
-  // 0000 0000 0000 0000 0000  0000
-  write_kernel_memory( 0x21b800c + 0x18, 0x00000200, 0, 4 );
-
-  // EIM_CS1WCR1
-  // 0   0    000010 000   001   000  000  010 000 000  000
-  // WAL WBED WWSC   WADVA WADVN WBEA WBEN WEA WEN WCSA WCSN
-  // WAL = 0       use WADVN
-  // WBED = 0      allow BE during write
-  // WWSC = 000100 4 write wait states
-  // WADVA = 000   same as RADVA
-  // WADVN = 000   this sets WE length to 1 (this value +1)
-  // WBEA = 000    same as RBEA
-  // WBEN = 000    same as RBEN
-  // WEA = 010     2 cycles between beginning of access and WE assertion
-  // WEN = 000     1 cycles to end of WE assertion
-  // WCSA = 000    cycles to CS assertion
-  // WCSN = 000    cycles to CS negation
-  // 1000 0111 1110 0001 0001  0100 0101 0001
-  // 8     7    E    1    1     4    5    1
-  // 0000 0111 0000 0100 0000  1000 0000 0000
-  // 0      7    0   4    0     8    0     0
-  // 0000 0100 0000 0000 0000  0100 0000 0000
-  //  0    4    0    0     0    4     0    0
-
-  // 0000 0010 0000 0000 0000  0010 0000 0000
-  // 0000 0010 0000 0100 0000  0100 0000 0000
-
-  write_kernel_memory( 0x21b8010 + 0x18, 0x02040400, 0, 4 );
-
-  // EIM_WCR
-  // BCM = 1   free-run BCLK
-  // GBCD = 0  divide the burst clock by 1
-  // add timeout watchdog after 1024 bclk cycles
-  write_kernel_memory( 0x21b8090, 0x701, 0, 4 );
-
-  // EIM_WIAR 
-  // ACLK_EN = 1
-  write_kernel_memory( 0x21b8094, 0x10, 0, 4 );
-
-  //  printf( "resetting CS0 space to 64M and enabling 64M CS1 space.\n" );
-  write_kernel_memory( 0x20e0004, 
-		       (read_kernel_memory(0x20e0004, 0, 4) & 0xFFFFFFC0) |
-		       0x1B, 0, 4);
-
-  //  printf( "done.\n" );
+static volatile unsigned long long *cs1_map(void) {
+  static unsigned long long sim_cs1;
+
+  if( !board_get() )
+    return NULL;
+  if( sim_enabled )
+    return &sim_cs1;
+  if( !gpbb_cs1(board) )
+    fprintf(stderr, "UIO device has no map covering CS1\n");
+  return (volatile unsigned long long *)gpbb_cs1(board);
+}
+
+static unsigned long long cs1_read(volatile unsigned long long *cs1, unsigned long reg) {
+  unsigned long long val;
+
+  if( sim_enabled )
+    val = sim_mem_read(reg, 8);
+  else
+    memcpy(&val, (void *) &cs1[F1(reg)], 8);
+  TRACE(TRACE_BUS_MEM, TRACE_READ, 8, reg, val);
+  return val;
+}
+
+static void cs1_write(volatile unsigned long long *cs1, unsigned long reg, unsigned long long val) {
+  if( sim_enabled )
+    sim_mem_write(reg, 8, val);
+  else
+    cs1[F1(reg)] = val;
+  TRACE(TRACE_BUS_MEM, TRACE_WRITE, 8, reg, val);
 }
 
 
@@ -531,20 +981,9 @@ int testcs1() {
   unsigned long long testbuf[16];
   unsigned long long origbuf[16];
 
-  if(mem_32)
-    munmap(mem_32, 0xFFFF);
-  if(fd)
-    close(fd);
-
-  fd = open("/dev/mem", O_RDWR);
-  if( fd < 0 ) {
-    perror("Unable to open /dev/mem. Must be run with root permissions.");
-    fd = 0;
+  cs1 = cs1_map();
+  if( !cs1 )
     return 0;
-  }
-
-  mem_32 = mmap(0, 0xffff, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0x0C040000);
-  cs1 = (unsigned long long *)mem_32;
 
   for( i = 0; i < 2; i++ ) {
     testbuf[i] = i | (i + 64) << 16 | (i + 8) << 32 | (i + 16) << 48 ;
@@ -559,15 +998,15 @@ int testcs1() {
   //  memcpy( (void *) cs1, testbuf, 2*8);
   origbuf[0] = testbuf[0];
   origbuf[1] = testbuf[1];
-  cs1[0] = testbuf[0];
-  cs1[1] = testbuf[1];
+  cs1_write(cs1, FPGA_WB_LOOP0, testbuf[0]);
+  cs1_write(cs1, FPGA_WB_LOOP1, testbuf[1]);
 
   for( i = 0; i < 2; i++ ) {
     testbuf[i] = 0;
   }
 
-  memcpy(testbuf,(void *) cs1, 8);
-  memcpy(&(testbuf[1]),(void *)cs1 + 8, 8);
+  testbuf[0] = cs1_read(cs1, FPGA_WB_LOOP0);
+  testbuf[1] = cs1_read(cs1, FPGA_WB_LOOP1);
   
   for( i = 0; i < 2; i++ ) {
     printf( "%lld: %016llx\n", i, origbuf[i] );
@@ -582,17 +1021,216 @@ int testcs1() {
   return retval;
 }
 
+// raw samples of one source straight into writer buffers; period_us 0
+// free-runs.  A failed ADC conversion is written as 0 and counted in the
+// writer stats.
+int port_stream(const char *src, int count, const char *path, long period_us, int direct) {
+  struct writer_config cfg = {
+    WRITER_DEFAULT_BUFFER_SIZE, WRITER_DEFAULT_BUFFERS, direct, 0,
+  };
+  volatile unsigned short *cs0 = NULL;
+  volatile unsigned long long *cs1 = NULL;
+  struct writer_stats st;
+  struct rt_period period;
+  struct writer *w;
+  uint8_t *buf;
+  size_t size, per_buf;
+  uint64_t t0;
+  int i, j, n, code, failed, adc = -1;
+
+  if( !strncmp(src, "adc", 3) && src[3] >= '0' && src[3] <= '7' && !src[4] ) {
+    if( !board_get() )
+      return -1;
+    adc = src[3] - '0';
+    size = 2;
+  }
+  else if( !strcmp(src, "port") )
+    size = 1;
+  else if( !strcmp(src, "nand") ) {
+    if( !(cs0 = cs0_map()) )
+      return -1;
+    size = 2;
+  }
+  else if( !strcmp(src, "cs1") ) {
+    if( !(cs1 = cs1_map()) )
+      return -1;
+    size = 8;
+  }
+  else {
+    printf( "stream source must be adc0..adc7, port, cs1 or nand\n" );
+    return -1;
+  }
+
+  w = writer_open(path, &cfg);
+  if( !w )
+    return -1;
+  per_buf = cfg.buffer_size / size;
+
+  t0 = stats_now();
+  if( period_us )
+    rt_period_start(&period, period_us * 1000);
+  for( i = 0; i < count; i += n ) {
+    n = count - i < (int)per_buf ? count - i : (int)per_buf;
+    buf = writer_get(w);
+    failed = 0;
+    for( j = 0; j < n; j++ ) {
+      if( period_us )
+	rt_period_wait(&period);
+      if( adc >= 0 ) {
+	code = gpbb_adc(board, adc);
+	if( code < 0 ) {
+	  failed++;
+	  code = 0;
+	}
+	((uint16_t *)buf)[j] = code;
+      }
+      else if( size == 1 )
+	buf[j] = gpbb_read();
+      else if( cs0 )
+	((uint16_t *)buf)[j] = cs0_read(cs0, FPGA_R_NAND_UK_DATA);
+      else
+	((uint64_t *)buf)[j] = cs1_read(cs1, FPGA_RB_LOOP0);
+    }
+    writer_put(w, buf, n * size);
+    if( failed )
+      writer_failed(w, failed);
+  }
+  t0 = stats_now() - t0;
+
+  if( writer_close(w, &st) )
+    return -1;
+  printf( "%s: %d samples in %.3f s, %.0f samples/s\n", src, count, t0 / 1e9, count / (t0 / 1e9) );
+  writer_stats_print(&st);
+  return 0;
+}
+
+
+static const char *state_name(void) {
+  return sim_enabled ? STATE_SHM_NAME_SIM : STATE_SHM_NAME;
+}
+
+// a new state page starts from what the FPGA registers hold now
+static void state_seed(void) {
+  volatile unsigned short *cs0;
+
+  cs0 = cs0_map();
+  if( !cs0 )
+    return;
+  state_set_port(cs0_read(cs0, FPGA_W_CPU_TO_DUT));
+  state_set_ctl(cs0_read(cs0, FPGA_W_GPBB_CTL));
+}
+
+static int state_show(void) {
+  const struct gpbb_state_page *page;
+  struct gpbb_state s;
+
+  page = state_attach(state_name());
+  if( !page )
+    return 1;
+  state_snapshot(page, &s);
+  printf( "owner pid %d\n", page->owner );
+  state_print(&s);
+  state_detach(page);
+  return 0;
+}
+
+// -capinfo/-capexport <file> ...: offline, so handled before setup_fpga()
+static int capture_tool(int argc, char **argv) {
+  struct capture_file cf;
+  FILE *out = stdout;
+  int export = !strcmp(argv[0], "-capexport");
+  int ret;
+
+  argc--;
+  argv++;
+  if( export ? (argc < 2 || argc > 3 || (strcmp(argv[1], "csv") && strcmp(argv[1], "vcd")))
+      : argc != 1 ) {
+    printf( "usage -capinfo <file>, -capexport <file> <csv|vcd> [outfile]\n" );
+    return 1;
+  }
+  if( capture_map(argv[0], &cf) )
+    return 1;
+  if( export && argc > 2 && !(out = fopen(argv[2], "w")) ) {
+    perror("Unable to open export file");
+    capture_unmap(&cf);
+    return 1;
+  }
+  if( !export ) {
+    capture_info(&cf, out);
+    ret = 0;
+  }
+  else if( !strcmp(argv[1], "csv") )
+    ret = capture_export_csv(&cf, out);
+  else
+    ret = capture_export_vcd(&cf, out);
+  if( out != stdout )
+    fclose(out);
+  capture_unmap(&cf);
+  return ret ? 1 : 0;
+}
+
+// -sim and -uio have to be in effect before setup_fpga() touches the hardware
+static int sim_args(int argc, char **argv) {
+  int i;
+
+  for( i = 0; i < argc; i++ ) {
+    if( !strcmp(argv[i], "-sim") ) {
+      if( sim_enable((i + 1 < argc && argv[i + 1][0] != '-') ? argv[i + 1] : NULL) )
+	return -1;
+    }
+    else if( !strcmp(argv[i], "-sim_latency") )
+      sim_set_latency(1);
+    else if( !strcmp(argv[i], "-uio") ) {
+      if( i + 1 >= argc ) {
+	printf( "usage -uio <N|/dev/uioN>\n" );
+	return -1;
+      }
+      if( uio_enable(argv[i + 1]) )
+	return -1;
+    }
+  }
+  if( sim_enabled && uio_active ) {
+    printf( "-sim and -uio are alternatives\n" );
+    return -1;
+  }
+  for( i = 0; i < argc; i++ ) {
+    if( !strcmp(argv[i], "-simdut") ) {
+      struct sim_dut *dut;
+
+      if( i + 1 >= argc || !sim_enabled ) {
+	printf( "usage -sim -simdut <spi[0-3]|i2c|uart|jtag>\n" );
+	return -1;
+      }
+      dut = sim_dut_named(argv[i + 1]);
+      if( !dut )
+	return -1;
+      sim_attach_dut(dut);
+    }
+  }
+  return 0;
+}
 
 int main(int argc, char **argv) {
   char *prog = argv[0];
   unsigned int a1;
   char port;
+  int ret;
   
   argv++;
   argc--;
 
-  setup_fpga();
-  setup_fpga_cs1();
+  if( sim_args(argc, argv) )
+    return 1;
+
+  // reading the published state needs neither the hardware nor its setup
+  for( a1 = 0; a1 < argc; a1++ ) {
+    if( !strcmp(argv[a1], "-state") )
+      return state_show();
+  }
+  if( argc && (!strcmp(argv[0], "-capinfo") || !strcmp(argv[0], "-capexport")) )
+    return capture_tool(argc, argv);
+
+  board_open(0);
 
   if(!argc) {
     print_usage(prog);
@@ -606,11 +1244,12 @@ int main(int argc, char **argv) {
       print_usage(prog);
     } 
     else if(!strcmp(*argv, "-v")) {
+      uint16_t major, minor;
+
       argc--;
       argv++;
-      printf( "FPGA version code: %04hx.%04hx\n", 
-	      read_kernel_memory(FPGA_R_V_MINOR, 0, 2),
-	      read_kernel_memory(FPGA_R_V_MAJOR, 0, 2) );
+      if( board_get() && !gpbb_version(board, &major, &minor) )
+	printf( "FPGA version code: %04hx.%04hx\n", minor, major );
     }
 
     else if(!strcmp(*argv, "-da")) {
@@ -624,7 +1263,8 @@ int main(int argc, char **argv) {
       a1 = strtoul(*argv, NULL, 10);
       argc--;
       argv++;
-      dac_a_set(a1 * 4); // implementation sends 2 dummy bits
+      if( board_get() && gpbb_dac(board, GPBB_DAC_A, a1) == -EINVAL )
+	printf( "DAC code must be 0-1023\n" );
     }
 
     else if(!strcmp(*argv, "-db")) {
@@ -638,7 +1278,22 @@ int main(int argc, char **argv) {
       a1 = strtoul(*argv, NULL, 10);
       argc--;
       argv++;
-      dac_b_set(a1 * 4);
+      if( board_get() && gpbb_dac(board, GPBB_DAC_B, a1) == -EINVAL )
+	printf( "DAC code must be 0-1023\n" );
+    }
+
+    else if(!strcmp(*argv, "-dstream")) {
+      argc--;
+      argv++;
+      if( argc < 2 || argc > 3 || (argv[0][0] != 'a' && argv[0][0] != 'b') ) {
+	printf( "usage -dstream <a|b> <codefile> [burst]\n" );
+	return 1;
+      }
+      if( dac_stream(argv[0][0] == 'a' ? GPBB_DAC_A : GPBB_DAC_B, argv[1],
+		     argc > 2 ? strtol(argv[2], NULL, 0) : 0) )
+	return 1;
+      argv += argc;
+      argc = 0;
     }
 
     else if(!strcmp(*argv, "-a")) {
@@ -652,9 +1307,15 @@ int main(int argc, char **argv) {
       a1 = strtoul(*argv, NULL, 10);
       argc--;
       argv++;
-      adc_chan(a1);
-      
-      printf( "ADC channel %d: %d\n", a1, adc_read() );;
+      if( board_get() ) {
+	ret = gpbb_adc(board, a1);
+	if( ret == -EINVAL )
+	  printf( "ADC channel must be 0-7\n" );
+	else if( ret >= 0 )
+	  printf( "ADC channel %d: %d\n", a1, ret );
+	else
+	  printf( "ADC channel %d: %s\n", a1, strerror(-ret) );
+      }
     }
 
     else if(!strcmp(*argv, "-hv")) {
@@ -785,11 +1446,580 @@ int main(int argc, char **argv) {
       testcs1();
     }
 
+    else if(!strcmp(*argv, "-load")) {
+      char *spidev = NULL;
+
+      argc--;
+      argv++;
+      if( argc < 1 ) {
+	printf( "usage -load <bitfile> [spidev]\n" );
+	return 1;
+      }
+
+      if( argc > 1 && argv[1][0] != '-' )
+	spidev = argv[1];
+      if( fpga_load(argv[0], spidev) )
+	return 1;
+      argc -= spidev ? 2 : 1;
+      argv += spidev ? 2 : 1;
+    }
+
+    else if(!strcmp(*argv, "-load_if_needed")) {
+      char *spidev = NULL;
+
+      argc--;
+      argv++;
+      if( argc < 1 ) {
+	printf( "usage -load_if_needed <bitfile> [spidev]\n" );
+	return 1;
+      }
+
+      if( argc > 1 && argv[1][0] != '-' )
+	spidev = argv[1];
+      if( fpga_load_if_needed(argv[0], spidev) )
+	return 1;
+      argc -= spidev ? 2 : 1;
+      argv += spidev ? 2 : 1;
+    }
+
+    else if(!strcmp(*argv, "-sim")) {
+      argc--;
+      argv++;
+      if( argc > 0 && argv[0][0] != '-' ) {
+	argc--;
+	argv++;
+      }
+    }
+
+    else if(!strcmp(*argv, "-sim_latency")) {
+      argc--;
+      argv++;
+    }
+
+    else if(!strcmp(*argv, "-uio") || !strcmp(*argv, "-simdut")) {
+      argc -= 2;
+      argv += 2;
+    }
+
+    else if(!strcmp(*argv, "-state_publish")) {
+      int created;
+
+      argc--;
+      argv++;
+      created = state_publish(state_name());
+      if( created < 0 )
+	return 1;
+      if( created )
+	state_seed();
+    }
+
+    else if(!strcmp(*argv, "-stats")) {
+      argc--;
+      argv++;
+      stats_dump_at_exit(1, NULL);
+    }
+
+    else if(!strcmp(*argv, "-stats_file")) {
+      argc--;
+      argv++;
+      if( argc < 1 ) {
+	printf( "usage -stats_file <path>\n" );
+	return 1;
+      }
+      stats_dump_at_exit(0, argv[0]);
+      argc--;
+      argv++;
+    }
+
+    else if(!strcmp(*argv, "-trace")) {
+      int nargs = 1;
+
+      argc--;
+      argv++;
+      if( argc < 1 ) {
+	printf( "usage -trace <file> [records]\n" );
+	return 1;
+      }
+      a1 = 0;
+      if( argc > 1 && argv[1][0] != '-' ) {
+	a1 = strtoul(argv[1], NULL, 0);
+	nargs = 2;
+      }
+      if( trace_start(argv[0], a1) )
+	return 1;
+      argc -= nargs;
+      argv += nargs;
+    }
+
+    else if(!strcmp(*argv, "-replay")) {
+      int timed = 0;
+      int nargs = 1;
+
+      argc--;
+      argv++;
+      if( argc < 1 ) {
+	printf( "usage -replay <file> [timed]\n" );
+	return 1;
+      }
+      if( argc > 1 && !strcmp(argv[1], "timed") ) {
+	timed = 1;
+	nargs = 2;
+      }
+      if( trace_replay(argv[0], timed, (volatile uint64_t *)cs1_map()) )
+	return 1;
+      argc -= nargs;
+      argv += nargs;
+    }
+
+    else if(!strcmp(*argv, "-tracesum")) {
+      argc--;
+      argv++;
+      if( argc < 1 ) {
+	printf( "usage -tracesum <file>\n" );
+	return 1;
+      }
+      if( trace_summarize(argv[0]) )
+	return 1;
+      argc--;
+      argv++;
+    }
+
+    else if(!strcmp(*argv, "-gpiocdev")) {
+      argc--;
+      argv++;
+      gpio_set_backend(GPIO_BACKEND_CHARDEV);
+    }
+
+    else if(!strcmp(*argv, "-gpiobench")) {
+      int gpios[GPIO_LINES_MAX];
+      int ngpios;
+
+      argc--;
+      argv++;
+      if( argc != 2 ) {
+	printf( "usage -gpiobench <gpio[,gpio...]> <count>\n" );
+	return 1;
+      }
+
+      ngpios = parse_gpio_list(argv[0], gpios, GPIO_LINES_MAX);
+      a1 = strtoul(argv[1], NULL, 10);
+      argc -= 2;
+      argv += 2;
+      if( !ngpios || !a1 ) {
+	printf( "usage -gpiobench <gpio[,gpio...]> <count>\n" );
+	return 1;
+      }
+      gpio_bench(gpios, ngpios, a1);
+    }
+
+    else if(!strcmp(*argv, "-gpiowait")) {
+      int gpios[GPIO_WAIT_MAX];
+      int ngpios;
+      enum gpio_edge edge;
+
+      argc--;
+      argv++;
+      if( argc != 3 ) {
+	printf( "usage -gpiowait <gpio[,gpio...]> <rising|falling|both> <count>\n" );
+	return 1;
+      }
+
+      ngpios = parse_gpio_list(argv[0], gpios, GPIO_WAIT_MAX);
+      if( !strcmp(argv[1], "rising") )
+	edge = GPIO_EDGE_RISING;
+      else if( !strcmp(argv[1], "falling") )
+	edge = GPIO_EDGE_FALLING;
+      else if( !strcmp(argv[1], "both") )
+	edge = GPIO_EDGE_BOTH;
+      else {
+	printf( "Invalid edge, must be one of rising,falling,both\n" );
+	return 1;
+      }
+      a1 = strtoul(argv[2], NULL, 10);
+      argc -= 3;
+      argv += 3;
+      gpio_wait_bench(gpios, ngpios, edge, a1);
+    }
+
+    else if(!strcmp(*argv, "-rt")) {
+      int cpu = -1;
+      int prio = RT_DEFAULT_PRIORITY;
+      volatile unsigned short *cs0;
+
+      argc--;
+      argv++;
+      if( argc > 0 && argv[0][0] != '-' ) {
+	cpu = strtol(argv[0], NULL, 0);
+	argc--;
+	argv++;
+	if( argc > 0 && argv[0][0] != '-' ) {
+	  prio = strtol(argv[0], NULL, 0);
+	  argc--;
+	  argv++;
+	}
+      }
+      rt_enable(cpu, prio);  // carries on unprivileged, without the guarantees
+
+      // map and touch the register windows now, not in the first iteration
+      cs0 = cs0_map();
+      if( cs0 && !sim_enabled )
+	rt_prefault(cs0, 0x2000);
+      if( board && gpbb_cs1(board) && !sim_enabled )
+	rt_prefault(gpbb_cs1(board), 0x2000);
+    }
+
+    else if(!strcmp(*argv, "-astream")) {
+      argc--;
+      argv++;
+      if( argc < 2 || argc > 3 ) {
+	printf( "usage -astream <chan> <count> [period_us]\n" );
+	return 1;
+      }
+      a1 = strtoul(argv[0], NULL, 0);
+      if( a1 > 7 ) {
+	printf( "usage -astream <chan> <count> [period_us]\n" );
+	return 1;
+      }
+      adc_stream(a1, strtoul(argv[1], NULL, 10),
+		 argc > 2 ? strtol(argv[2], NULL, 10) : 1000);
+      argv += argc;
+      argc = 0;
+    }
+
+    else if(!strcmp(*argv, "-filterbench")) {
+      argc--;
+      argv++;
+      printf( "Filters: %s\n", filter_impl() );
+      filter_bench(argc > 0 ? strtoul(argv[0], NULL, 10) : 65536,
+		   argc > 1 ? strtoul(argv[1], NULL, 10) : 200, adc_poll_rate());
+      argv += argc;
+      argc = 0;
+    }
+
+    else if(!strcmp(*argv, "-pid")) {
+      struct control_config cfg;
+      struct control_ema ema;
+
+      argc--;
+      argv++;
+      if( argc < 7 || argc > 10 || (argv[1][0] != 'a' && argv[1][0] != 'b') ) {
+	printf( "usage -pid <chan> <a|b> <setpoint> <kp> <ki> <kd> <count> [period_us] [alpha] [tracefile]\n" );
+	return 1;
+      }
+      memset(&cfg, 0, sizeof(cfg));
+      cfg.adc_channel = strtoul(argv[0], NULL, 0);
+      cfg.dac = argv[1][0] == 'a' ? DAC_A : DAC_B;
+      cfg.setpoint = strtod(argv[2], NULL);
+      cfg.kp = strtod(argv[3], NULL);
+      cfg.ki = strtod(argv[4], NULL);
+      cfg.kd = strtod(argv[5], NULL);
+      cfg.iterations = strtoul(argv[6], NULL, 10);
+      cfg.period_us = argc > 7 ? strtol(argv[7], NULL, 10) : 1000;
+      cfg.out_min = 0;
+      cfg.out_max = 1023;
+      if( argc > 8 ) {
+	memset(&ema, 0, sizeof(ema));
+	ema.alpha = strtod(argv[8], NULL);
+	cfg.filter = control_ema_filter;
+	cfg.filter_ctx = &ema;
+      }
+      if( argc > 9 )
+	cfg.trace_path = argv[9];
+      if( cfg.adc_channel > 7 || cfg.iterations < 1 || cfg.period_us < 1 ) {
+	printf( "usage -pid <chan> <a|b> <setpoint> <kp> <ki> <kd> <count> [period_us] [alpha] [tracefile]\n" );
+	return 1;
+      }
+      if( control_run(&cfg) )
+	return 1;
+      argv += argc;
+      argc = 0;
+    }
+
+    else if(!strcmp(*argv, "-capture")) {
+      int chans[CAPTURE_MAX_CHANNELS - 1];
+      int nchans = 0;
+
+      argc--;
+      argv++;
+      if( argc < 3 || argc > 4 ) {
+	printf( "usage -capture <file> <chan[,chan...]|-> <count> [period_us]\n" );
+	return 1;
+      }
+      if( strcmp(argv[1], "-") )
+	nchans = parse_gpio_list(argv[1], chans, CAPTURE_MAX_CHANNELS - 1);
+      if( port_capture(argv[0], chans, nchans, strtoul(argv[2], NULL, 10),
+		       argc > 3 ? strtol(argv[3], NULL, 10) : 1000) )
+	return 1;
+      argv += argc;
+      argc = 0;
+    }
+
+    else if(!strcmp(*argv, "-stream")) {
+      int direct = 0;
+
+      argc--;
+      argv++;
+      if( argc > 3 && !strcmp(argv[argc - 1], "direct") ) {
+	direct = 1;
+	argc--;
+      }
+      if( argc < 3 || argc > 4 ) {
+	printf( "usage -stream <adc0-7|port|cs1|nand> <count> <file> [period_us] [direct]\n" );
+	return 1;
+      }
+      if( port_stream(argv[0], strtoul(argv[1], NULL, 10), argv[2],
+		      argc > 3 ? strtol(argv[3], NULL, 10) : 0, direct) )
+	return 1;
+      argv += argc + direct;
+      argc = 0;
+    }
+
+    else if(!strcmp(*argv, "-waitreg")) {
+      argc--;
+      argv++;
+      if( argc < 3 ) {
+	printf( "usage -waitreg <addr> <mask> <value> [timeout_ms]\n" );
+	return 1;
+      }
+      if( cs0_wait(strtoul(argv[0], NULL, 0), strtoul(argv[1], NULL, 0),
+		   strtoul(argv[2], NULL, 0), argc > 3 ? strtoul(argv[3], NULL, 0) : 1000) )
+	return 1;
+      argv += argc > 3 ? 4 : 3;
+      argc -= argc > 3 ? 4 : 3;
+    }
+
+    else if(!strcmp(*argv, "-vspi")) {
+      argc--;
+      argv++;
+      if( argc < 2 ) {
+	printf( "usage -vspi <mode> <hexbytes> [repeat]\n" );
+	return 1;
+      }
+      if( port_spi(strtol(argv[0], NULL, 0), argv[1],
+		   argc > 2 ? strtol(argv[2], NULL, 0) : 1) )
+	return 1;
+      argv += argc;
+      argc = 0;
+    }
+
+    else if(!strcmp(*argv, "-vi2c")) {
+      argc--;
+      argv++;
+      if( argc < 2 ) {
+	printf( "usage -vi2c <addr> <hexbytes|-> [readlen] [repeat]\n" );
+	return 1;
+      }
+      if( port_i2c(strtol(argv[0], NULL, 0), argv[1],
+		   argc > 2 ? strtol(argv[2], NULL, 0) : 0,
+		   argc > 3 ? strtol(argv[3], NULL, 0) : 1) )
+	return 1;
+      argv += argc;
+      argc = 0;
+    }
+
+    else if(!strcmp(*argv, "-vuart")) {
+      argc--;
+      argv++;
+      if( argc < 1 ) {
+	printf( "usage -vuart <hexbytes> [bit_vectors] [repeat]\n" );
+	return 1;
+      }
+      if( port_uart(argv[0], argc > 1 ? strtol(argv[1], NULL, 0) : 0,
+		    argc > 2 ? strtol(argv[2], NULL, 0) : 1) )
+	return 1;
+      argv += argc;
+      argc = 0;
+    }
+
+    else if(!strcmp(*argv, "-jtag_pins")) {
+      argc--;
+      argv++;
+      if( argc < 4 ) {
+	printf( "usage -jtag_pins <tck> <tms> <tdi> <tdo>\n" );
+	return 1;
+      }
+      jtag_pins.tck = parse_pin(argv[0]);
+      jtag_pins.tms = parse_pin(argv[1]);
+      jtag_pins.tdi = parse_pin(argv[2]);
+      jtag_pins.tdo = parse_pin(argv[3]);
+      if( jtag_pins.tck > 15 || jtag_pins.tms > 15 || jtag_pins.tdi > 15 || jtag_pins.tdo > 7 ) {
+	printf( "JTAG outputs are a0-b7, TDO 0-7\n" );
+	return 1;
+      }
+      jtag_wiring = &jtag_pins;
+      argc -= 4;
+      argv += 4;
+    }
+
+    else if(!strcmp(*argv, "-jtagid")) {
+      argc--;
+      argv++;
+      if( port_jtagid() )
+	return 1;
+    }
+
+    else if(!strcmp(*argv, "-svf") || !strcmp(*argv, "-xsvf")) {
+      int xsvf = !strcmp(*argv, "-xsvf");
+
+      argc--;
+      argv++;
+      if( argc < 1 ) {
+	printf( "usage %s <file> [hold]\n", xsvf ? "-xsvf" : "-svf" );
+	return 1;
+      }
+      if( port_svf(argv[0], xsvf, argc > 1 ? strtol(argv[1], NULL, 0) : 1) )
+	return 1;
+      argv += argc;
+      argc = 0;
+    }
+
+    else if(!strcmp(*argv, "-vecbench")) {
+      volatile unsigned short *cs0;
+
+      argc--;
+      argv++;
+      cs0 = cs0_map();
+      if( !cs0 )
+	return 1;
+      vec_bench((volatile uint16_t *)cs0, argc > 0 ? strtol(argv[0], NULL, 0) : 64,
+		argc > 1 ? strtol(argv[1], NULL, 0) : 100);
+      argv += argc;
+      argc = 0;
+    }
+
+    else if(!strcmp(*argv, "-telemetry")) {
+      struct telem_config cfg;
+      int mask;
+
+      argc--;
+      argv++;
+      if( argc < 3 || argc > 6 || strtod(argv[0], NULL) < 0 ) {
+	printf( "usage -telemetry <period_ms> <ringfile|-> <textfile|-> [chan,chan...|-] [count] [text_ms]\n" );
+	return 1;
+      }
+      memset(&cfg, 0, sizeof(cfg));
+      cfg.period_ns = strtod(argv[0], NULL) * 1e6;
+      cfg.ring_path = strcmp(argv[1], "-") ? argv[1] : NULL;
+      cfg.text_path = strcmp(argv[2], "-") ? argv[2] : NULL;
+      mask = argc > 3 ? telem_adc_mask(argv[3]) : 0;
+      if( mask < 0 )
+	return 1;
+      cfg.adc_mask = mask;
+      cfg.text_interval_ns = (argc > 5 ? strtod(argv[5], NULL) : 1000) * 1e6;
+      cfg.eim = 1;
+      if( port_telemetry(&cfg, argc > 4 ? strtoull(argv[4], NULL, 10) : 0, 1) )
+	return 1;
+      argv += argc;
+      argc = 0;
+    }
+
+    else if(!strcmp(*argv, "-telembench")) {
+      int mask;
+
+      argc--;
+      argv++;
+      mask = argc > 0 ? telem_adc_mask(argv[0]) : 0;
+      if( mask < 0 || telem_bench(mask, argc > 1 ? strtod(argv[1], NULL) : 2) )
+	return 1;
+      argv += argc;
+      argc = 0;
+    }
+
+    else if(!strcmp(*argv, "-writebench")) {
+      argc--;
+      argv++;
+      writer_bench(argc > 0 ? argv[0] : "gpbb-writebench.dat",
+		   argc > 1 && !strcmp(argv[1], "direct"));
+      argv += argc;
+      argc = 0;
+    }
+
+    else if(!strcmp(*argv, "-sweep")) {
+      struct sweep_config cfg;
+
+      argc--;
+      argv++;
+      if( argc < 2 || argc > 6 || (argv[0][0] != 'a' && argv[0][0] != 'b') ) {
+	printf( "usage -sweep <a|b> <chan> [first] [last] [settle_us] [curvefile]\n" );
+	return 1;
+      }
+      memset(&cfg, 0, sizeof(cfg));
+      cfg.dac = argv[0][0] == 'a' ? DAC_A : DAC_B;
+      cfg.adc_channel = strtoul(argv[1], NULL, 0);
+      cfg.first = argc > 2 ? strtoul(argv[2], NULL, 0) : 0;
+      cfg.last = argc > 3 ? strtoul(argv[3], NULL, 0) : 1023;
+      cfg.settle_us = argc > 4 ? strtol(argv[4], NULL, 10) : 100;
+      cfg.curve_path = argc > 5 ? argv[5] : NULL;
+      if( cfg.adc_channel > 7 || cfg.last > 1023 || cfg.first > cfg.last || cfg.settle_us < 0 ) {
+	printf( "usage -sweep <a|b> <chan> [first] [last] [settle_us] [curvefile]\n" );
+	return 1;
+      }
+      if( sweep_run(&cfg) )
+	return 1;
+      argv += argc;
+      argc = 0;
+    }
+
+    else if(!strcmp(*argv, "-gpiopoll")) {
+      argc--;
+      argv++;
+      if( argc != 2 ) {
+	printf( "usage -gpiopoll <gpio> <count>\n" );
+	return 1;
+      }
+
+      a1 = strtoul(argv[0], NULL, 0);
+      gpio_poll_bench(a1, strtoul(argv[1], NULL, 10));
+      argc -= 2;
+      argv += 2;
+    }
+
+    else if(!strcmp(*argv, "-pins")) {
+      int gpios[GPIO_LINES_MAX];
+      int ngpios;
+      int is_output;
+      uint32_t value = 0;
+      struct gpio_pins *pins;
+
+      argc--;
+      argv++;
+      if( argc < 1 ) {
+	printf( "usage -pins <gpio[,gpio...]> [value]\n" );
+	return 1;
+      }
+
+      ngpios = parse_gpio_list(argv[0], gpios, GPIO_LINES_MAX);
+      argc--;
+      argv++;
+      is_output = (argc > 0 && argv[0][0] != '-');
+      if( is_output ) {
+	value = strtoul(argv[0], NULL, 0);
+	argc--;
+	argv++;
+      }
+
+      pins = gpio_pins_open(gpios, ngpios, is_output, value);
+      if( !pins ) {
+	perror("Unable to open pin group");
+	return 1;
+      }
+      if( !is_output ) {
+	if( gpio_pins_get(pins, &value) ) {
+	  perror("Unable to read pin group");
+	  gpio_pins_close(pins);
+	  return 1;
+	}
+	printf( "0x%x\n", value );
+      }
+      gpio_pins_close(pins);
+    }
+
     else {
       print_usage(prog);
       return 1;
     }
   }
 
+  gpbb_close(board);
   return 0;
 }
@@ -35,6 +35,9 @@
 #define FPGA_R_DUT_TO_CPU   0x08041010
 #define FPGA_R_GPBB_STAT    0x08041012
 
+#define FPGA_R_NAND_UK_DATA 0x08041100  // auto-advances the queue
+#define FPGA_R_NAND_UK_STAT 0x08041102
+
 #define FPGA_R_V_MINOR      0x08041FFC
 #define FPGA_R_V_MAJOR      0x08041FFE
 
@@ -53,3 +56,20 @@
 #define PORT_VAL 0
 #define PORT_SET 1
 #define PORT_CLR 2
+
+
+int read_kernel_memory(long offset, int virtualized, int size);
+int write_kernel_memory(long offset, long value, int virtualized, int size);
+void release_kernel_memory(void);
+
+void setup_fpga();
+void setup_fpga_cs1();
+void setvddio(int high);
+void oe_state(int drive, int channel);
+unsigned char gpbb_output_state(char port);
+unsigned char gpbb_read();
+void gpbb_port_write(char port, char type, unsigned short val);
+int testcs1();
+
+struct gpbb_board;
+struct gpbb_board *board_get(void);
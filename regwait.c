@@ -0,0 +1,136 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+
+#include "regwait.h"
+#include "stats.h"
+
+#define REGWAIT_CALIBRATE_ROUNDS  8
+
+// what a 1 us sleep costs beyond its 1 us; 0 until measured
+static uint64_t sleep_overhead_ns;
+
+static void regwait_calibrate(void) {
+	struct timespec ts = { 0, 1000 };
+	uint64_t t0, t, best = UINT64_MAX;
+	int i;
+
+	for (i = 0; i < REGWAIT_CALIBRATE_ROUNDS; i++) {
+		t0 = stats_now();
+		nanosleep(&ts, NULL);
+		t = stats_now() - t0;
+		if (t < best)
+			best = t;
+	}
+	sleep_overhead_ns = best > 1000 ? best - 1000 : 1;
+}
+
+static void regwait_delay(uint64_t ns) {
+	struct timespec ts;
+	uint64_t end;
+
+	if (!sleep_overhead_ns)
+		regwait_calibrate();
+
+	// a sleep this short would oversleep by more than it asks for
+	if (ns < 2 * sleep_overhead_ns) {
+		end = stats_now() + ns;
+		while (stats_now() < end)
+			;
+		return;
+	}
+	ns -= sleep_overhead_ns;
+	ts.tv_sec = ns / 1000000000ULL;
+	ts.tv_nsec = ns % 1000000000ULL;
+	while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+		;
+}
+
+static void regwait_record(struct regwait_stats *s, uint32_t polls) {
+	int b = 0;
+
+	if (!s)
+		return;
+	s->waits++;
+	s->polls += polls;
+	if (polls > s->max_polls)
+		s->max_polls = polls;
+	while ((1U << b) < polls && b < REGWAIT_HIST_BUCKETS - 1)
+		b++;
+	s->hist[b]++;
+}
+
+int regwait(regwait_read read, void *ctx, unsigned int mask, unsigned int want,
+	    const struct regwait_policy *policy, struct regwait_stats *stats,
+	    unsigned int *value) {
+	uint64_t deadline = stats_now() + policy->timeout_ns;
+	uint64_t delay = policy->min_delay_ns;
+	int use_event = policy->event != NULL;
+	unsigned int v = 0;
+	uint32_t polls = 0;
+	uint64_t now;
+	int ret;
+
+	for (;;) {
+		polls++;
+		if (read(ctx, &v) < 0) {
+			if (stats)
+				stats->errors++;
+			regwait_record(stats, polls);
+			return -EIO;
+		}
+		if ((v & mask) == want)
+			break;
+		now = stats_now();
+		if (now >= deadline) {
+			if (stats)
+				stats->timeouts++;
+			regwait_record(stats, polls);
+			if (value)
+				*value = v;
+			return -ETIMEDOUT;
+		}
+		if (polls < policy->spins)
+			continue;
+		if (use_event) {
+			// an event or its timeout both mean: poll again
+			ret = policy->event(policy->event_ctx, deadline - now);
+			if (ret == 0 || ret == -ETIMEDOUT)
+				continue;
+			use_event = 0;
+		}
+		// the last sleep ends at the deadline, for one final poll
+		regwait_delay(delay < deadline - now ? delay : deadline - now);
+		delay *= 2;
+		if (delay > policy->max_delay_ns)
+			delay = policy->max_delay_ns;
+	}
+
+	regwait_record(stats, polls);
+	if (value)
+		*value = v;
+	return 0;
+}
+
+void regwait_stats_print(const char *name, const struct regwait_stats *s, FILE *out) {
+	int b, last = 0;
+
+	if (!s->waits)
+		return;
+	fprintf(out, "%s: %llu waits, %.2f polls avg, %u max, %llu timeouts, %llu errors\n",
+		name, (unsigned long long)s->waits, (double)s->polls / s->waits, s->max_polls,
+		(unsigned long long)s->timeouts, (unsigned long long)s->errors);
+	for (b = 0; b < REGWAIT_HIST_BUCKETS; b++)
+		if (s->hist[b])
+			last = b;
+	for (b = 0; b <= last; b++) {
+		if (b < 2)
+			fprintf(out, "  %5d polls %10llu\n", b + 1, (unsigned long long)s->hist[b]);
+		else
+			fprintf(out, "  %5d-%-5d %10llu\n", (1 << (b - 1)) + 1, 1 << b,
+				(unsigned long long)s->hist[b]);
+	}
+}
@@ -0,0 +1,55 @@
+#ifndef __REGWAIT_H__
+#define __REGWAIT_H__
+
+///
+// Bounded waits on FPGA status registers.
+//
+// regwait() polls a register through any read function until
+// (value & mask) == want.  It spins for the first few polls, then sleeps
+// between polls with a delay that doubles from min_delay_ns up to
+// max_delay_ns, and gives up at timeout_ns.  Delays shorter than what a
+// sleep actually costs on this machine (measured once, on first use) are
+// busy-waited instead, so short delays are not stretched by timer slack.
+// A policy with an event function blocks in it between polls instead,
+// e.g. on an interrupt, and backs off as usual if it returns -ENOSYS.
+//
+// Each call site keeps a struct regwait_stats recording how many polls
+// its waits took.
+///
+
+#include <stdint.h>
+#include <stdio.h>
+
+// 0 and the register value, or < 0 if the read failed
+typedef int (*regwait_read)(void *ctx, unsigned int *value);
+
+struct regwait_policy {
+	unsigned int spins;     // polls before the first delay
+	uint64_t min_delay_ns;
+	uint64_t max_delay_ns;
+	uint64_t timeout_ns;
+	// optional: 0 on an event, -ETIMEDOUT, -ENOSYS if there is none to wait for
+	int (*event)(void *ctx, uint64_t timeout_ns);
+	void *event_ctx;
+};
+
+#define REGWAIT_HIST_BUCKETS  16  // polls per wait: 1, 2, 3-4, 5-8, ...
+
+struct regwait_stats {
+	uint64_t waits;
+	uint64_t polls;
+	uint64_t timeouts;
+	uint64_t errors;
+	uint32_t max_polls;
+	uint64_t hist[REGWAIT_HIST_BUCKETS];
+};
+
+// 0 once the condition holds, -ETIMEDOUT, or -EIO if a read failed;
+// value (may be NULL) gets the last value read
+int regwait(regwait_read read, void *ctx, unsigned int mask, unsigned int want,
+	    const struct regwait_policy *policy, struct regwait_stats *stats,
+	    unsigned int *value);
+
+void regwait_stats_print(const char *name, const struct regwait_stats *s, FILE *out);
+
+#endif /* __REGWAIT_H__ */
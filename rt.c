@@ -0,0 +1,167 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+
+#include "rt.h"
+#include "stats.h"
+
+#define RT_STACK_PREFAULT  (256 * 1024)
+
+int rt_enabled = 0;
+
+void rt_prefault(volatile void *p, size_t len) {
+	volatile char *c = p;
+	long page = sysconf(_SC_PAGESIZE);
+	size_t i;
+
+	for (i = 0; i < len; i += page)
+		(void)c[i];
+}
+
+static void rt_prefault_stack(void) {
+	volatile char stack[RT_STACK_PREFAULT];
+	size_t i;
+
+	for (i = 0; i < sizeof(stack); i += 4096)
+		stack[i] = 0;
+}
+
+int rt_enable(int cpu, int priority) {
+	static char stdout_buf[1 << 16];
+	struct sched_param sp;
+	cpu_set_t set;
+	int ret = 0;
+
+	if (cpu >= 0) {
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+			perror("Unable to pin to CPU");
+			ret = -1;
+		}
+	}
+
+	memset(&sp, 0, sizeof(sp));
+	sp.sched_priority = priority;
+	if (sched_setscheduler(0, SCHED_FIFO, &sp) < 0) {
+		perror("Unable to set SCHED_FIFO");
+		ret = -1;
+	}
+
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+		perror("Unable to lock memory");
+		ret = -1;
+	}
+	rt_prefault_stack();
+
+	// whatever still prints in a loop goes out in one write at the end
+	fflush(stdout);
+	setvbuf(stdout, stdout_buf, _IOFBF, sizeof(stdout_buf));
+
+	rt_enabled = 1;
+	return ret;
+}
+
+
+void rt_hist_init(struct rt_hist *h) {
+	memset(h, 0, sizeof(*h));
+	h->min = UINT64_MAX;
+}
+
+void rt_hist_add(struct rt_hist *h, uint64_t ns) {
+	uint64_t us = ns / 1000;
+	int b = 0;
+
+	while (us && b < RT_HIST_BUCKETS - 1) {
+		us >>= 1;
+		b++;
+	}
+	h->buckets[b]++;
+	h->count++;
+	h->sum += ns;
+	if (ns < h->min)
+		h->min = ns;
+	if (ns > h->max)
+		h->max = ns;
+}
+
+static uint64_t rt_hist_percentile(struct rt_hist *h, int pct) {
+	uint64_t want = (h->count * pct + 99) / 100;
+	uint64_t seen = 0;
+	int b;
+
+	for (b = 0; b < RT_HIST_BUCKETS; b++) {
+		seen += h->buckets[b];
+		if (seen >= want)
+			return b ? (1000ULL << b) : 1000;  // bucket upper bound
+	}
+	return h->max;
+}
+
+void rt_hist_print(const char *title, struct rt_hist *h) {
+	uint64_t peak = 0;
+	int b, last = 0;
+
+	if (!h->count) {
+		printf("%s: no samples\n", title);
+		return;
+	}
+	printf("%s: %llu samples, min %llu ns, avg %llu ns, p99 < %llu ns, max %llu ns\n",
+	       title, (unsigned long long)h->count, (unsigned long long)h->min,
+	       (unsigned long long)(h->sum / h->count),
+	       (unsigned long long)rt_hist_percentile(h, 99),
+	       (unsigned long long)h->max);
+
+	for (b = 0; b < RT_HIST_BUCKETS; b++) {
+		if (h->buckets[b] > peak)
+			peak = h->buckets[b];
+		if (h->buckets[b])
+			last = b;
+	}
+	for (b = 0; b <= last; b++) {
+		int bar = h->buckets[b] * 50 / peak;
+
+		if (b == 0)
+			printf("  %8s < %6llu us %10llu ", "", 1ULL, (unsigned long long)h->buckets[b]);
+		else
+			printf("  %8llu - %6llu us %10llu ", 1ULL << (b - 1), 1ULL << b,
+			       (unsigned long long)h->buckets[b]);
+		while (bar--)
+			putchar('#');
+		putchar('\n');
+	}
+}
+
+
+void rt_period_start(struct rt_period *p, long period_ns) {
+	clock_gettime(CLOCK_MONOTONIC, &p->next);
+	p->period_ns = period_ns;
+}
+
+uint64_t rt_period_wait(struct rt_period *p) {
+	uint64_t deadline, now;
+
+	p->next.tv_nsec += p->period_ns;
+	while (p->next.tv_nsec >= 1000000000L) {
+		p->next.tv_nsec -= 1000000000L;
+		p->next.tv_sec++;
+	}
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &p->next, NULL) == EINTR)
+		;
+
+	now = stats_now();
+	deadline = (uint64_t)p->next.tv_sec * 1000000000ULL + p->next.tv_nsec;
+	if (now < deadline)
+		return 0;
+	// an overrun: start the next period from here rather than bursting
+	if (now - deadline > (uint64_t)p->period_ns)
+		clock_gettime(CLOCK_MONOTONIC, &p->next);
+	return now - deadline;
+}
@@ -0,0 +1,52 @@
+#ifndef __RT_H__
+#define __RT_H__
+
+///
+// Real-time execution mode for the long-running loops.
+//
+// rt_enable() moves the process to SCHED_FIFO, pins it to one CPU, locks
+// and pre-faults its memory and switches stdout to full buffering.  While
+// it is on, the CS0 window stays mapped and the I2C adapters stay open
+// between accesses, so the hot path makes no open/mmap calls.
+//
+// struct rt_hist collects wakeup latency (or any other duration) into
+// power-of-two buckets, so normal and RT runs of a loop can be compared.
+///
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+#define RT_DEFAULT_PRIORITY  80
+#define RT_HIST_BUCKETS      24  // < 1us, then doubling up to ~8s
+
+extern int rt_enabled;
+
+// cpu < 0 leaves the affinity alone
+int rt_enable(int cpu, int priority);
+// touch every page of a buffer or mapping so the loop never faults on it
+void rt_prefault(volatile void *p, size_t len);
+
+struct rt_hist {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+	uint64_t buckets[RT_HIST_BUCKETS];
+};
+
+void rt_hist_init(struct rt_hist *h);
+void rt_hist_add(struct rt_hist *h, uint64_t ns);
+void rt_hist_print(const char *title, struct rt_hist *h);
+
+// absolute-deadline periodic timer
+struct rt_period {
+	struct timespec next;
+	long period_ns;
+};
+
+void rt_period_start(struct rt_period *p, long period_ns);
+// sleep until the next deadline; returns how late the wakeup was, in ns
+uint64_t rt_period_wait(struct rt_period *p);
+
+#endif /* __RT_H__ */
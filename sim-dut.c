@@ -0,0 +1,446 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "sim-dut.h"
+
+#define UART_QUEUE  64
+
+// an output pin as the DUT sees it: high when its port is not driven
+static int line(uint16_t port, uint16_t ctl, int pin) {
+	if (!(ctl & (pin < 8 ? 0x1 : 0x2)))
+		return 1;
+	return (port >> pin) & 1;
+}
+
+
+/*
+ * SPI shift register.  The byte shifted out is the one last shifted in,
+ * SIM_DUT_SPI_ID at the start of each transfer.
+ */
+static struct {
+	struct vec_spi cfg;
+	int cs, sck;
+	uint8_t in, out, last;
+	int in_bits, out_bits;
+	int miso;
+	struct sim_dut dut;
+} spi;
+
+static void spi_shift_out(void) {
+	if (spi.out_bits == 8) {
+		spi.out = spi.last;
+		spi.out_bits = 0;
+	}
+	spi.miso = (spi.out >> 7) & 1;
+	spi.out <<= 1;
+	spi.out_bits++;
+}
+
+static void spi_output(void *ctx, uint16_t port, uint16_t ctl) {
+	int cpol = (spi.cfg.mode >> 1) & 1, cpha = spi.cfg.mode & 1;
+	int cs = line(port, ctl, spi.cfg.cs);
+	int sck = line(port, ctl, spi.cfg.sck);
+
+	if (cs) {
+		spi.cs = 1;
+		spi.sck = sck;
+		return;
+	}
+	if (spi.cs) {
+		spi.cs = 0;
+		spi.last = SIM_DUT_SPI_ID;
+		spi.in_bits = 0;
+		spi.out_bits = 8;
+		if (!cpha)
+			spi_shift_out();
+	}
+	if (sck == spi.sck)
+		return;
+	spi.sck = sck;
+
+	// CPHA 0 samples on the leading edge, CPHA 1 on the trailing one
+	if ((sck != cpol) != cpha) {
+		spi.in = (spi.in << 1) | line(port, ctl, spi.cfg.mosi);
+		if (++spi.in_bits == 8) {
+			spi.last = spi.in;
+			spi.in_bits = 0;
+		}
+	}
+	else {
+		spi_shift_out();
+	}
+}
+
+static uint8_t spi_input(void *ctx) {
+	if (spi.cs || spi.miso)
+		return 0xff;
+	return 0xff & ~(1 << spi.cfg.miso);
+}
+
+struct sim_dut *sim_dut_spi(const struct vec_spi *cfg) {
+	memset(&spi, 0, sizeof(spi));
+	spi.cfg = *cfg;
+	spi.cs = 1;
+	spi.sck = (cfg->mode >> 1) & 1;
+	spi.dut.output = spi_output;
+	spi.dut.input = spi_input;
+	return &spi.dut;
+}
+
+
+/*
+ * I2C EEPROM.  It only acts on changes of SCL and of the SDA line, which
+ * it may be pulling low itself.
+ */
+enum i2c_state { I2C_IDLE, I2C_ADDR, I2C_WRITE, I2C_ACK_OUT, I2C_READ, I2C_ACK_IN };
+
+static struct {
+	struct vec_i2c cfg;
+	uint8_t addr;
+	uint8_t mem[256];
+	uint8_t ptr;
+	int have_ptr;
+	enum i2c_state state;
+	int reading;    // the address byte asked for a read
+	int scl, sda;   // the lines as last seen
+	int drive_low;  // the EEPROM is pulling SDA low
+	uint8_t shift;
+	int bits;
+	int nack;
+	struct sim_dut dut;
+} i2c;
+
+static void i2c_send_bit(void) {
+	i2c.drive_low = !((i2c.shift >> 7) & 1);
+	i2c.shift <<= 1;
+	i2c.bits++;
+}
+
+static void i2c_load(void) {
+	i2c.shift = i2c.mem[i2c.ptr++];
+	i2c.bits = 0;
+	i2c.state = I2C_READ;
+	i2c_send_bit();
+}
+
+static void i2c_scl_fall(void) {
+	switch (i2c.state) {
+	case I2C_ADDR:
+	case I2C_WRITE:
+		if (i2c.bits < 8)
+			break;
+		if (i2c.state == I2C_ADDR) {
+			if ((i2c.shift >> 1) != i2c.addr) {
+				i2c.state = I2C_IDLE;
+				break;
+			}
+			i2c.reading = i2c.shift & 1;
+			i2c.have_ptr = 0;
+		}
+		else if (!i2c.have_ptr) {
+			i2c.ptr = i2c.shift;
+			i2c.have_ptr = 1;
+		}
+		else {
+			i2c.mem[i2c.ptr++] = i2c.shift;
+		}
+		i2c.drive_low = 1;
+		i2c.state = I2C_ACK_OUT;
+		break;
+	case I2C_ACK_OUT:
+		i2c.drive_low = 0;
+		if (i2c.reading) {
+			i2c.reading = 0;
+			i2c_load();
+		}
+		else {
+			i2c.state = I2C_WRITE;
+			i2c.bits = 0;
+		}
+		break;
+	case I2C_READ:
+		if (i2c.bits < 8) {
+			i2c_send_bit();
+		}
+		else {
+			i2c.drive_low = 0;
+			i2c.state = I2C_ACK_IN;
+		}
+		break;
+	case I2C_ACK_IN:
+		if (i2c.nack)
+			i2c.state = I2C_IDLE;
+		else
+			i2c_load();
+		break;
+	default:
+		break;
+	}
+}
+
+static void i2c_output(void *ctx, uint16_t port, uint16_t ctl) {
+	int scl = line(port, ctl, i2c.cfg.scl);
+	int sda = line(port, ctl, i2c.cfg.sda) && !i2c.drive_low;
+
+	if (scl && i2c.scl && sda != i2c.sda) {
+		// START or STOP
+		i2c.drive_low = 0;
+		i2c.state = sda ? I2C_IDLE : I2C_ADDR;
+		i2c.shift = 0;
+		i2c.bits = 0;
+	}
+	else if (scl && !i2c.scl) {
+		if (i2c.state == I2C_ADDR || i2c.state == I2C_WRITE) {
+			i2c.shift = (i2c.shift << 1) | sda;
+			i2c.bits++;
+		}
+		else if (i2c.state == I2C_ACK_IN) {
+			i2c.nack = sda;
+		}
+	}
+	else if (!scl && i2c.scl) {
+		i2c_scl_fall();
+	}
+	i2c.scl = scl;
+	i2c.sda = line(port, ctl, i2c.cfg.sda) && !i2c.drive_low;
+}
+
+static uint8_t i2c_input(void *ctx) {
+	return i2c.sda ? 0xff : 0xff & ~(1 << i2c.cfg.sda_in);
+}
+
+struct sim_dut *sim_dut_i2c(const struct vec_i2c *cfg, uint8_t addr) {
+	int i;
+
+	memset(&i2c, 0, sizeof(i2c));
+	i2c.cfg = *cfg;
+	i2c.addr = addr;
+	i2c.scl = i2c.sda = 1;
+	for (i = 0; i < 256; i++)
+		i2c.mem[i] = 0xff;
+	i2c.dut.output = i2c_output;
+	i2c.dut.input = i2c_input;
+	return &i2c.dut;
+}
+
+
+/*
+ * UART echo.  Time is counted in port writes, one tick each, so the bit
+ * length is the master's bit_vectors.
+ */
+static struct {
+	struct vec_uart cfg;
+	int frame;
+	// receiver
+	int rx_active;
+	int rx_t;
+	uint16_t rx_bits;
+	// transmitter
+	uint8_t queue[UART_QUEUE];
+	int head, count;
+	uint16_t tx_bits;   // frame, LSB first
+	int tx_t;           // ticks into it, -1 when idle
+	int tx_line;
+	struct sim_dut dut;
+} uart;
+
+static uint16_t uart_frame(uint8_t byte) {
+	uint16_t f = byte << 1;
+	int p = __builtin_popcount(byte) & 1;
+	int b = 9;
+
+	if (uart.cfg.parity)
+		f |= (uart.cfg.parity == 1 ? !p : p) << b++;
+	for (; b < uart.frame; b++)
+		f |= 1 << b;
+	return f;
+}
+
+static int uart_frame_ok(uint16_t f) {
+	int b;
+
+	if (f & 1)
+		return 0;
+	for (b = uart.frame - uart.cfg.stop_bits; b < uart.frame; b++)
+		if (!(f & (1 << b)))
+			return 0;
+	return !uart.cfg.parity || f == uart_frame((f >> 1) & 0xff);
+}
+
+static void uart_output(void *ctx, uint16_t port, uint16_t ctl) {
+	int bv = uart.cfg.bit_vectors;
+	int rx = line(port, ctl, uart.cfg.tx);
+	int k;
+
+	if (!uart.rx_active) {
+		if (!rx) {
+			uart.rx_active = 1;
+			uart.rx_t = 0;
+			uart.rx_bits = 0;
+		}
+	}
+	else {
+		uart.rx_t++;
+	}
+	if (uart.rx_active && uart.rx_t % bv == bv / 2) {
+		k = uart.rx_t / bv;
+		uart.rx_bits |= rx << k;
+		if (k == uart.frame - 1) {
+			uart.rx_active = 0;
+			if (uart_frame_ok(uart.rx_bits) && uart.count < UART_QUEUE)
+				uart.queue[(uart.head + uart.count++) % UART_QUEUE] =
+					((uart.rx_bits >> 1) & 0xff) ^ SIM_DUT_UART_XOR;
+		}
+	}
+
+	if (uart.tx_t < 0 && uart.count) {
+		uart.tx_bits = uart_frame(uart.queue[uart.head]);
+		uart.head = (uart.head + 1) % UART_QUEUE;
+		uart.count--;
+		uart.tx_t = 0;
+	}
+	if (uart.tx_t >= 0) {
+		uart.tx_line = (uart.tx_bits >> (uart.tx_t / bv)) & 1;
+		if (++uart.tx_t == uart.frame * bv)
+			uart.tx_t = -1;
+	}
+	else {
+		uart.tx_line = 1;
+	}
+}
+
+static uint8_t uart_input(void *ctx) {
+	return uart.tx_line ? 0xff : 0xff & ~(1 << uart.cfg.rx);
+}
+
+struct sim_dut *sim_dut_uart(const struct vec_uart *cfg) {
+	memset(&uart, 0, sizeof(uart));
+	uart.cfg = *cfg;
+	uart.frame = 1 + 8 + (cfg->parity ? 1 : 0) + cfg->stop_bits;
+	uart.tx_t = -1;
+	uart.tx_line = 1;
+	uart.dut.output = uart_output;
+	uart.dut.input = uart_input;
+	return &uart.dut;
+}
+
+
+/*
+ * JTAG TAP with a 6-bit IR: IDCODE (also selected by Test-Logic-Reset),
+ * BYPASS, and USER, a 32-bit register that reads back what was last
+ * updated into it.  TMS and TDI are taken on TCK rising, TDO changes on
+ * TCK falling.
+ */
+#define TAP_IR_LEN  6
+
+static struct {
+	struct jtag_pins cfg;
+	int tck;
+	enum jtag_state state;
+	uint8_t ir, ir_shift;
+	uint64_t dr;
+	int dr_len;
+	uint32_t user;
+	int tdo;
+	struct sim_dut dut;
+} tap;
+
+static void tap_capture_dr(void) {
+	switch (tap.ir) {
+	case SIM_DUT_JTAG_IDCODE_IR:
+		tap.dr = SIM_DUT_JTAG_IDCODE;
+		tap.dr_len = 32;
+		break;
+	case SIM_DUT_JTAG_USER_IR:
+		tap.dr = tap.user;
+		tap.dr_len = 32;
+		break;
+	default:
+		tap.dr = 0;
+		tap.dr_len = 1;
+		break;
+	}
+}
+
+static void tap_output(void *ctx, uint16_t port, uint16_t ctl) {
+	int tck = line(port, ctl, tap.cfg.tck);
+	int tms, tdi;
+
+	if (tck == tap.tck)
+		return;
+	tap.tck = tck;
+	if (!tck) {
+		if (tap.state == JTAG_IRSHIFT)
+			tap.tdo = tap.ir_shift & 1;
+		else if (tap.state == JTAG_DRSHIFT)
+			tap.tdo = tap.dr & 1;
+		else
+			tap.tdo = 1;
+		return;
+	}
+
+	tms = line(port, ctl, tap.cfg.tms);
+	tdi = line(port, ctl, tap.cfg.tdi);
+	switch (tap.state) {
+	case JTAG_RESET:
+		tap.ir = SIM_DUT_JTAG_IDCODE_IR;
+		break;
+	case JTAG_IRCAPTURE:
+		tap.ir_shift = 0x01;
+		break;
+	case JTAG_IRSHIFT:
+		tap.ir_shift = (tap.ir_shift >> 1) | (tdi << (TAP_IR_LEN - 1));
+		break;
+	case JTAG_IRUPDATE:
+		tap.ir = tap.ir_shift;
+		break;
+	case JTAG_DRCAPTURE:
+		tap_capture_dr();
+		break;
+	case JTAG_DRSHIFT:
+		tap.dr = (tap.dr >> 1) | ((uint64_t)tdi << (tap.dr_len - 1));
+		break;
+	case JTAG_DRUPDATE:
+		if (tap.ir == SIM_DUT_JTAG_USER_IR)
+			tap.user = tap.dr;
+		break;
+	default:
+		break;
+	}
+	tap.state = jtag_next(tap.state, tms);
+}
+
+static uint8_t tap_input(void *ctx) {
+	return tap.tdo ? 0xff : 0xff & ~(1 << tap.cfg.tdo);
+}
+
+struct sim_dut *sim_dut_jtag(const struct jtag_pins *cfg) {
+	memset(&tap, 0, sizeof(tap));
+	tap.cfg = *cfg;
+	tap.state = JTAG_RESET;
+	tap.ir = SIM_DUT_JTAG_IDCODE_IR;
+	tap.tdo = 1;
+	tap.dut.output = tap_output;
+	tap.dut.input = tap_input;
+	return &tap.dut;
+}
+
+
+struct sim_dut *sim_dut_named(const char *name) {
+	struct vec_spi spi_cfg = vec_spi_pins;
+
+	if (!strncmp(name, "spi", 3) && (!name[3] || (name[3] >= '0' && name[3] <= '3' && !name[4]))) {
+		if (name[3])
+			spi_cfg.mode = name[3] - '0';
+		return sim_dut_spi(&spi_cfg);
+	}
+	if (!strcmp(name, "i2c"))
+		return sim_dut_i2c(&vec_i2c_pins, SIM_DUT_I2C_ADDR);
+	if (!strcmp(name, "uart"))
+		return sim_dut_uart(&vec_uart_pins);
+	if (!strcmp(name, "jtag"))
+		return sim_dut_jtag(&jtag_default_pins);
+	fprintf(stderr, "Unknown simulated DUT %s\n", name);
+	return NULL;
+}
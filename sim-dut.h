@@ -0,0 +1,41 @@
+#ifndef __SIM_DUT_H__
+#define __SIM_DUT_H__
+
+///
+// Devices to attach to the simulated GPBB ports with sim_attach_dut(),
+// for exercising the vector stream bus masters (vector.h) without a board.
+//
+//   spi   a shift register: answers SIM_DUT_SPI_ID to the first byte of a
+//         transfer and each byte received to the one after it, in any mode
+//   i2c   a 256-byte EEPROM; a write sets the address pointer with its first
+//         byte and stores the rest, a read returns bytes from the pointer
+//   uart  echoes every frame it receives, XORed with SIM_DUT_UART_XOR
+//   jtag  a TAP with IDCODE, BYPASS and a 32-bit USER scratch register
+//
+// Each watches the same pins the master drives, as given in its config.
+///
+
+#include <stdint.h>
+
+#include "sim.h"
+#include "vector.h"
+#include "jtag.h"
+
+#define SIM_DUT_SPI_ID     0xa5
+#define SIM_DUT_I2C_ADDR   0x50
+#define SIM_DUT_UART_XOR   0x20
+
+#define SIM_DUT_JTAG_IDCODE     0x0a5b6093
+#define SIM_DUT_JTAG_IDCODE_IR  0x09
+#define SIM_DUT_JTAG_USER_IR    0x02  // anything else is BYPASS
+
+struct sim_dut *sim_dut_spi(const struct vec_spi *cfg);
+struct sim_dut *sim_dut_i2c(const struct vec_i2c *cfg, uint8_t addr);
+struct sim_dut *sim_dut_uart(const struct vec_uart *cfg);
+struct sim_dut *sim_dut_jtag(const struct jtag_pins *cfg);
+
+// "spi" (or "spi0"-"spi3" for the mode), "i2c", "uart" or "jtag" on the default
+// wiring; NULL if unknown
+struct sim_dut *sim_dut_named(const char *name);
+
+#endif /* __SIM_DUT_H__ */
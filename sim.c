@@ -0,0 +1,358 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <linux/i2c-dev.h>
+
+#include "sim.h"
+#include "novena-gpbb.h"
+#include "dac101c085.h"
+#include "stats.h"
+
+#define SIM_WINDOW      0x2000
+#define SIM_STORE_SIZE  4096  // sparse words, power of two
+
+#define EIM_CS0RCR1     0x021b8008
+#define EIM_CS0WCR1     0x021b8010
+#define EIM_CS1RCR1     0x021b8020
+#define EIM_CS1WCR1     0x021b8028
+#define EIM_WSC(x)      (((x) >> 24) & 0x3f)
+
+int sim_enabled = 0;
+
+static enum sim_source sim_source = SIM_SRC_LOOPBACK;
+static uint8_t sim_const;
+static uint8_t sim_counter;
+static struct sim_dut *sim_dut;
+static int sim_latency;
+
+static uint16_t cs0_regs[SIM_WINDOW / 2];
+static uint64_t cs1_loop[2];
+
+static struct {
+	uint32_t addr;  // word address | 1, so 0 marks an empty slot
+	uint32_t value;
+} sim_store[SIM_STORE_SIZE];
+
+static struct {
+	uint8_t regs[256];
+	uint8_t ptr;
+	uint64_t conv_done;  // ns timestamp the running conversion completes
+	uint16_t held;       // sampled when the conversion starts
+	uint16_t adc[8];
+} fpga_i2c;
+
+static uint16_t dac_word[2];
+
+static void sim_delay(uint64_t ns) {
+	uint64_t end = stats_now() + ns;
+
+	while (stats_now() < end)
+		;
+}
+
+int sim_enable(const char *source) {
+	char *end;
+
+	if (!source || !strcmp(source, "loopback")) {
+		sim_source = SIM_SRC_LOOPBACK;
+	}
+	else if (!strcmp(source, "counter")) {
+		sim_source = SIM_SRC_COUNTER;
+	}
+	else {
+		sim_const = strtoul(source, &end, 16);
+		if (*end) {
+			fprintf(stderr, "Unknown sim source %s\n", source);
+			return -1;
+		}
+		sim_source = SIM_SRC_CONST;
+	}
+
+	// power-on state of the design
+	cs0_regs[F(FPGA_R_V_MINOR)] = 0x0001;
+	cs0_regs[F(FPGA_R_V_MAJOR)] = 0x0005;
+	fpga_i2c.regs[FPGA_I2C_V_MIN_L] = 0x01;
+	fpga_i2c.regs[FPGA_I2C_V_MAJ_L] = 0x05;
+	fpga_i2c.regs[FPGA_I2C_ADC_VALID] = 1;
+
+	sim_enabled = 1;
+	return 0;
+}
+
+void sim_set_latency(int on) {
+	sim_latency = on;
+}
+
+void sim_attach_dut(struct sim_dut *dut) {
+	sim_dut = dut;
+	if (dut)
+		sim_source = SIM_SRC_DUT;
+	else if (sim_source == SIM_SRC_DUT)
+		sim_source = SIM_SRC_LOOPBACK;
+}
+
+void sim_set_adc(int channel, uint16_t code) {
+	fpga_i2c.adc[channel & 7] = code & 0x3ff;
+}
+
+
+/*
+ * Sparse storage for everything that is not modelled, one 32-bit word per
+ * slot.  Narrower accesses read-modify-write the containing word.
+ */
+static uint32_t *sim_word(unsigned long addr) {
+	uint32_t key = (addr & ~3UL) | 1;
+	unsigned int i = (key * 2654435761U) >> 20;
+
+	for (;;) {
+		i &= SIM_STORE_SIZE - 1;
+		if (sim_store[i].addr == key)
+			return &sim_store[i].value;
+		if (!sim_store[i].addr) {
+			sim_store[i].addr = key;
+			return &sim_store[i].value;
+		}
+		i++;
+	}
+}
+
+static uint32_t store_read(unsigned long addr, int size) {
+	uint32_t word = *sim_word(addr);
+	int shift = (addr & 3) * 8;
+
+	if (size == 1)
+		return (word >> shift) & 0xff;
+	if (size == 2)
+		return (word >> shift) & 0xffff;
+	return word;
+}
+
+static void store_write(unsigned long addr, int size, uint32_t value) {
+	uint32_t *word = sim_word(addr);
+	int shift = (addr & 3) * 8;
+	uint32_t mask;
+
+	if (size == 1)
+		mask = 0xff << shift;
+	else if (size == 2)
+		mask = 0xffff << shift;
+	else
+		mask = 0xffffffff;
+	*word = (*word & ~mask) | ((value << shift) & mask);
+}
+
+
+/*
+ * One asynchronous EIM access costs the programmed wait states plus the
+ * address and data phases; CS1 moves 64 bits as four 16-bit beats.
+ */
+static void eim_delay(int cs, int write, int beats) {
+	unsigned long reg;
+	uint64_t cycles;
+
+	if (cs == 0)
+		reg = write ? EIM_CS0WCR1 : EIM_CS0RCR1;
+	else
+		reg = write ? EIM_CS1WCR1 : EIM_CS1RCR1;
+	cycles = (EIM_WSC(store_read(reg, 4)) + 2) * beats;
+	sim_delay(cycles * 1000000000ULL / SIM_EIM_CLK_HZ);
+}
+
+static uint8_t dut_input(void) {
+	uint16_t out = cs0_regs[F(FPGA_W_CPU_TO_DUT)];
+	uint16_t ctl = cs0_regs[F(FPGA_W_GPBB_CTL)];
+
+	switch (sim_source) {
+	case SIM_SRC_COUNTER:
+		return sim_counter++;
+	case SIM_SRC_CONST:
+		return sim_const;
+	case SIM_SRC_DUT:
+		return sim_dut->input(sim_dut->ctx);
+	case SIM_SRC_LOOPBACK:
+	default:
+		if (ctl & 0x1)
+			return out & 0xff;
+		if (ctl & 0x2)
+			return out >> 8;
+		return 0xff;  // pulled up
+	}
+}
+
+static uint16_t cs0_read(unsigned long addr) {
+	switch (addr & ~1UL) {
+	case FPGA_R_TEST0:
+		return cs0_regs[F(FPGA_W_TEST0)];
+	case FPGA_R_TEST1:
+		return cs0_regs[F(FPGA_W_TEST1)];
+	case FPGA_R_DUT_TO_CPU:
+		return dut_input();
+	case FPGA_R_GPBB_STAT:
+		return cs0_regs[F(FPGA_W_GPBB_CTL)];
+	default:
+		return cs0_regs[F((addr & ~1UL))];
+	}
+}
+
+static void cs0_write(unsigned long addr, uint16_t value) {
+	if ((addr - FPGA_REG_OFFSET) >= SIM_WINDOW / 2)
+		return;  // read-only half
+	cs0_regs[F((addr & ~1UL))] = value;
+	if (sim_dut && (addr == FPGA_W_CPU_TO_DUT || addr == FPGA_W_GPBB_CTL))
+		sim_dut->output(sim_dut->ctx, cs0_regs[F(FPGA_W_CPU_TO_DUT)],
+				cs0_regs[F(FPGA_W_GPBB_CTL)]);
+}
+
+uint64_t sim_mem_read(unsigned long addr, int size) {
+	uint64_t value;
+
+	if (addr - FPGA_REG_OFFSET < SIM_WINDOW) {
+		if (sim_latency)
+			eim_delay(0, 0, 1);
+		value = cs0_read(addr);
+		if (size == 1)
+			value = (addr & 1) ? value >> 8 : value & 0xff;
+		else if (size == 4)
+			value |= (uint64_t)cs0_read(addr + 2) << 16;
+		return value;
+	}
+	if (addr - FPGA_CS1_REG_OFFSET < SIM_WINDOW) {
+		if (sim_latency)
+			eim_delay(1, 0, 4);
+		// the read half mirrors the loopback words
+		value = cs1_loop[(addr >> 3) & 1];
+		if (size < 8)
+			value = (value >> ((addr & 7) * 8)) & ((1ULL << (size * 8)) - 1);
+		return value;
+	}
+	return store_read(addr, size);
+}
+
+void sim_mem_write(unsigned long addr, int size, uint64_t value) {
+	uint16_t cur;
+	int i;
+
+	if (addr - FPGA_REG_OFFSET < SIM_WINDOW) {
+		if (sim_latency)
+			eim_delay(0, 1, 1);
+		if (size == 1) {
+			cur = cs0_regs[F((addr & ~1UL))];
+			if (addr & 1)
+				value = (cur & 0x00ff) | ((value & 0xff) << 8);
+			else
+				value = (cur & 0xff00) | (value & 0xff);
+		}
+		cs0_write(addr & ~1UL, value);
+		if (size == 4)
+			cs0_write((addr & ~1UL) + 2, value >> 16);
+		return;
+	}
+	if (addr - FPGA_CS1_REG_OFFSET < SIM_WINDOW) {
+		if (sim_latency)
+			eim_delay(1, 1, 4);
+		if (addr - FPGA_CS1_REG_OFFSET >= SIM_WINDOW / 2)
+			return;
+		i = (addr >> 3) & 1;
+		if (size < 8) {
+			uint64_t mask = ((1ULL << (size * 8)) - 1) << ((addr & 7) * 8);
+			value = (cs1_loop[i] & ~mask) | ((value << ((addr & 7) * 8)) & mask);
+		}
+		cs1_loop[i] = value;
+		return;
+	}
+	store_write(addr, size, value);
+}
+
+
+/*
+ * FPGA I2C register file.  Setting bit 3 of ADC_CTL starts a conversion on
+ * the selected channel, which is sampled there and then, like the ADC's
+ * track-and-hold; VALID reads 0 until the conversion completes.  Channels
+ * 0 and 1 are wired to the DAC outputs.
+ */
+static uint8_t fpga_i2c_read(uint8_t reg) {
+	if (reg == FPGA_I2C_ADC_VALID && !fpga_i2c.regs[reg]
+	    && stats_now() >= fpga_i2c.conv_done) {
+		fpga_i2c.regs[FPGA_I2C_ADC_DAT_L] = fpga_i2c.held & 0xff;
+		fpga_i2c.regs[FPGA_I2C_ADC_DAT_H] = fpga_i2c.held >> 8;
+		fpga_i2c.regs[FPGA_I2C_ADC_VALID] = 1;
+	}
+	return fpga_i2c.regs[reg];
+}
+
+static void fpga_i2c_write(uint8_t reg, uint8_t data) {
+	int chan;
+
+	if (reg == FPGA_I2C_ADC_CTL && (data & 0x8)
+	    && !(fpga_i2c.regs[reg] & 0x8)) {
+		chan = data & 7;
+		if (chan == 0)
+			fpga_i2c.held = (dac_word[DAC_A] >> 2) & 0x3ff;
+		else if (chan == 1)
+			fpga_i2c.held = (dac_word[DAC_B] >> 2) & 0x3ff;
+		else
+			fpga_i2c.held = fpga_i2c.adc[chan];
+		fpga_i2c.regs[FPGA_I2C_ADC_VALID] = 0;
+		fpga_i2c.conv_done = stats_now() + (sim_latency ? SIM_ADC_CONV_NS : 0);
+	}
+	if (reg < FPGA_I2C_ADC_DAT_L)
+		fpga_i2c.regs[reg] = data;
+}
+
+static int sim_fpga_i2c(struct i2c_msg *msg) {
+	int i;
+
+	if (msg->flags & I2C_M_RD) {
+		for (i = 0; i < msg->len; i++)
+			msg->buf[i] = fpga_i2c_read(fpga_i2c.ptr++);
+		return 0;
+	}
+	if (msg->len < 1)
+		return 0;
+	fpga_i2c.ptr = msg->buf[0];
+	for (i = 1; i < msg->len; i++)
+		fpga_i2c_write(fpga_i2c.ptr++, msg->buf[i]);
+	return 0;
+}
+
+// DAC101C085: big-endian 16-bit words; a longer write updates the output per word
+static int sim_dac_i2c(struct i2c_msg *msg, int dac) {
+	int i;
+
+	if (msg->flags & I2C_M_RD) {
+		for (i = 0; i < msg->len; i++)
+			msg->buf[i] = (i & 1) ? dac_word[dac] & 0xff : dac_word[dac] >> 8;
+		return 0;
+	}
+	for (i = 0; i + 1 < msg->len; i += 2)
+		dac_word[dac] = ((uint8_t)msg->buf[i] << 8) | (uint8_t)msg->buf[i + 1];
+	return 0;
+}
+
+int sim_i2c_transfer(int bus, struct i2c_msg *msgs, int nmsgs) {
+	int i, ret;
+
+	for (i = 0; i < nmsgs; i++) {
+		if (sim_latency)  // start/address byte plus data, 9 clocks each
+			sim_delay((uint64_t)(msgs[i].len + 1) * 9 * 1000000000ULL
+				  / SIM_I2C_CLK_HZ);
+
+		if (bus == 2 && msgs[i].addr == FPGA_I2C_ADR)
+			ret = sim_fpga_i2c(&msgs[i]);
+		else if (bus == 1 && msgs[i].addr == DAC101C085_A_I2C_ADR)
+			ret = sim_dac_i2c(&msgs[i], DAC_A);
+		else if (bus == 1 && msgs[i].addr == DAC101C085_B_I2C_ADR)
+			ret = sim_dac_i2c(&msgs[i], DAC_B);
+		else
+			ret = -1;  // nobody acks
+
+		if (ret < 0) {
+			fprintf(stderr, "Transaction failed\n");
+			return -1;
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,56 @@
+#ifndef __SIM_H__
+#define __SIM_H__
+
+///
+// Software model of the GPBB hardware.
+//
+// With the sim backend selected, read_kernel_memory()/write_kernel_memory(),
+// the CS0/CS1 register accessors, the EIM GPIO bank and i2c_transfer() are
+// served from an in-process model instead of /dev/mem and /dev/i2c-N:
+//
+//   CS0   FPGA test, GPBB control, DUT port and version registers
+//   CS1   the two 64-bit loopback words
+//   I2C2  the FPGA register file, including ADC conversion/valid handshake
+//   I2C1  the two DAC101C085s, whose codes feed ADC channels 0 and 1
+//
+// Any other physical address (IOMUXC, CCM, EIM timing...) is plain storage.
+// Optionally each access costs the time the real bus would take, derived
+// from the EIM wait-state fields and the I2C clock.
+///
+
+#include <stdint.h>
+
+struct i2c_msg;
+
+enum sim_source {
+	SIM_SRC_LOOPBACK = 0,  // R_DUT_TO_CPU reads back port A while OE A is on
+	SIM_SRC_COUNTER  = 1,  // R_DUT_TO_CPU advances by one on every read
+	SIM_SRC_CONST    = 2,  // R_DUT_TO_CPU returns a fixed value
+	SIM_SRC_DUT      = 3,  // R_DUT_TO_CPU comes from an attached DUT model
+};
+
+// a model of the device on the far side of the GPBB ports
+struct sim_dut {
+	void (*output)(void *ctx, uint16_t cpu_to_dut, uint16_t ctl);
+	uint8_t (*input)(void *ctx);
+	void *ctx;
+};
+
+#define SIM_EIM_CLK_HZ   132000000  // EIM BCLK
+#define SIM_I2C_CLK_HZ   100000
+#define SIM_ADC_CONV_NS  16000      // 16 SCLKs at 1 MHz
+
+extern int sim_enabled;
+
+// source is "loopback", "counter" or a hex constant; NULL means loopback
+int sim_enable(const char *source);
+void sim_set_latency(int on);
+void sim_attach_dut(struct sim_dut *dut);  // NULL detaches it
+void sim_set_adc(int channel, uint16_t code);
+
+uint64_t sim_mem_read(unsigned long addr, int size);
+void sim_mem_write(unsigned long addr, int size, uint64_t value);
+
+int sim_i2c_transfer(int bus, struct i2c_msg *msgs, int nmsgs);
+
+#endif /* __SIM_H__ */
@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "state.h"
+#include "stats.h"
+
+struct gpbb_state_page *state_page = NULL;
+
+int state_publish(const char *name) {
+	struct stat st;
+	int created;
+	int fd;
+
+	state_unpublish();
+
+	fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+	if (fd < 0) {
+		perror("Unable to open state page");
+		return -1;
+	}
+	if (fstat(fd, &st) < 0 || ftruncate(fd, sizeof(struct gpbb_state_page)) < 0) {
+		perror("Unable to size state page");
+		close(fd);
+		return -1;
+	}
+	created = st.st_size < (off_t)sizeof(struct gpbb_state_page);
+
+	state_page = mmap(NULL, sizeof(struct gpbb_state_page),
+			  PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (state_page == MAP_FAILED) {
+		perror("Unable to map state page");
+		state_page = NULL;
+		return -1;
+	}
+
+	if (created || memcmp(state_page->magic, STATE_MAGIC, 8)
+	    || state_page->size != sizeof(struct gpbb_state_page)) {
+		memset(state_page, 0, sizeof(*state_page));
+		state_page->size = sizeof(struct gpbb_state_page);
+		memcpy(state_page->magic, STATE_MAGIC, 8);
+		created = 1;
+	}
+	// a previous owner may have died mid-update
+	if (state_page->seq & 1)
+		state_page->seq++;
+	state_page->owner = getpid();
+	return created;
+}
+
+void state_unpublish(void) {
+	if (!state_page)
+		return;
+	munmap(state_page, sizeof(struct gpbb_state_page));
+	state_page = NULL;
+}
+
+
+/*
+ * Seqlock write side.  There is one owner, so no writer lock: readers only
+ * need to see seq odd for the duration of the update.
+ */
+static struct gpbb_state *state_begin(void) {
+	__atomic_store_n(&state_page->seq, state_page->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	return &state_page->state;
+}
+
+static void state_end(struct gpbb_state *s) {
+	s->updated = stats_now();
+	__atomic_store_n(&state_page->seq, state_page->seq + 1, __ATOMIC_RELEASE);
+}
+
+void state_set_port(uint16_t cpu_to_dut) {
+	struct gpbb_state *s = state_begin();
+
+	s->cpu_to_dut = cpu_to_dut;
+	state_end(s);
+}
+
+void state_set_ctl(uint16_t gpbb_ctl) {
+	struct gpbb_state *s = state_begin();
+
+	s->gpbb_ctl = gpbb_ctl;
+	state_end(s);
+}
+
+void state_set_dac(int dac, uint16_t code) {
+	struct gpbb_state *s = state_begin();
+
+	s->dac[dac & 1] = code;
+	state_end(s);
+}
+
+void state_set_adc(int channel, uint16_t code) {
+	struct gpbb_state *s = state_begin();
+
+	s->adc[channel & 7] = code;
+	s->adc_time[channel & 7] = stats_now();
+	state_end(s);
+}
+
+
+const struct gpbb_state_page *state_attach(const char *name) {
+	struct gpbb_state_page *page;
+	int fd;
+
+	fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0) {
+		if (errno == ENOENT)
+			fprintf(stderr, "No state page %s; is an owner publishing it?\n", name);
+		else
+			perror("Unable to open state page");
+		return NULL;
+	}
+	page = mmap(NULL, sizeof(struct gpbb_state_page), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (page == MAP_FAILED) {
+		perror("Unable to map state page");
+		return NULL;
+	}
+	if (memcmp(page->magic, STATE_MAGIC, 8) || page->size != sizeof(*page)) {
+		fprintf(stderr, "State page %s has an unknown layout\n", name);
+		munmap(page, sizeof(*page));
+		return NULL;
+	}
+	return page;
+}
+
+void state_detach(const struct gpbb_state_page *page) {
+	if (page)
+		munmap((void *)page, sizeof(*page));
+}
+
+// retries while the owner is mid-update; never blocks it
+void state_snapshot(const struct gpbb_state_page *page, struct gpbb_state *out) {
+	uint32_t seq;
+
+	for (;;) {
+		seq = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+		memcpy(out, (const void *)&page->state, sizeof(*out));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&page->seq, __ATOMIC_RELAXED) == seq)
+			return;
+	}
+}
+
+void state_print(const struct gpbb_state *s) {
+	uint64_t now = stats_now();
+	int i;
+
+	printf("port A: %02x  port B: %02x\n", s->cpu_to_dut & 0xff, s->cpu_to_dut >> 8);
+	printf("OE A: %d  OE B: %d  VDDIO: %s\n", s->gpbb_ctl & 1, (s->gpbb_ctl >> 1) & 1,
+	       (s->gpbb_ctl & 0x8000) ? "5V" : "3.3V");
+	printf("DAC A: %d  DAC B: %d\n", s->dac[0] >> 2, s->dac[1] >> 2);
+	for (i = 0; i < 8; i++) {
+		if (!s->adc_time[i])
+			continue;
+		printf("ADC channel %d: %d (%.3f s ago)\n", i, s->adc[i],
+		       (now - s->adc_time[i]) / 1e9);
+	}
+}
@@ -0,0 +1,61 @@
+#ifndef __STATE_H__
+#define __STATE_H__
+
+///
+// Shared GPBB state page.
+//
+// One owner process publishes the port outputs, OE/VDDIO control word, DAC
+// codes and latest ADC samples in a POSIX shared-memory page as it changes
+// them.  Any number of readers map the page read-only and take consistent
+// snapshots under a seqlock: no syscalls, no bus traffic, and a reader
+// never blocks the owner.
+///
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define STATE_SHM_NAME      "/novena-gpbb-state"
+#define STATE_SHM_NAME_SIM  "/novena-gpbb-state-sim"
+#define STATE_MAGIC         "GPBBSTA1"
+
+struct gpbb_state {
+	uint16_t cpu_to_dut;    // FPGA_W_CPU_TO_DUT: port A low byte, port B high
+	uint16_t gpbb_ctl;      // FPGA_W_GPBB_CTL: OE A/B bits 0/1, VDDIO 5V bit 15
+	uint16_t dac[2];        // codes as sent, indexed by dacType
+	uint16_t adc[8];        // last conversion per channel
+	uint64_t adc_time[8];   // CLOCK_MONOTONIC ns of that conversion, 0 = never
+	uint64_t updated;       // CLOCK_MONOTONIC ns of the last change
+};
+
+struct gpbb_state_page {
+	char magic[8];
+	uint32_t size;          // sizeof(struct gpbb_state_page)
+	uint32_t seq;           // odd while the owner is writing
+	pid_t owner;
+	struct gpbb_state state;
+};
+
+extern struct gpbb_state_page *state_page;
+
+// owner side: create or take over the page; 1 if it was newly created
+int state_publish(const char *name);
+void state_unpublish(void);
+
+void state_set_port(uint16_t cpu_to_dut);
+void state_set_ctl(uint16_t gpbb_ctl);
+void state_set_dac(int dac, uint16_t code);
+void state_set_adc(int channel, uint16_t code);
+
+#define STATE(call) \
+	do { \
+		if (state_page) \
+			call; \
+	} while (0)
+
+// reader side
+const struct gpbb_state_page *state_attach(const char *name);
+void state_detach(const struct gpbb_state_page *page);
+void state_snapshot(const struct gpbb_state_page *page, struct gpbb_state *out);
+void state_print(const struct gpbb_state *s);
+
+#endif /* __STATE_H__ */
@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "stats.h"
+
+struct stats_thread {
+	uint64_t count[STATS_NUM_OPS];
+	uint64_t total_ns[STATS_NUM_OPS];
+	uint64_t max_ns[STATS_NUM_OPS];
+	uint32_t hist[STATS_NUM_OPS][STATS_BUCKETS];
+	struct stats_thread *next;
+};
+
+static const char *stats_names[STATS_NUM_OPS] = {
+	[STATS_KMEM_READ]      = "read_kernel_memory",
+	[STATS_KMEM_WRITE]     = "write_kernel_memory",
+	[STATS_EIM_READ]       = "eim_read",
+	[STATS_EIM_WRITE]      = "eim_write",
+	[STATS_ADC_I2C_READ]   = "adc_i2c_read",
+	[STATS_ADC_I2C_WRITE]  = "adc_i2c_write",
+	[STATS_ADC_VALID_WAIT] = "adc_valid_wait",
+	[STATS_DAC_I2C_READ]   = "dac_i2c_read",
+	[STATS_DAC_I2C_WRITE]  = "dac_i2c_write",
+	[STATS_DAC_I2C_BURST]  = "dac_i2c_burst",
+	[STATS_GPIO_DIRECTION] = "gpio_set_direction",
+	[STATS_GPIO_SET]       = "gpio_set_value",
+	[STATS_GPIO_GET]       = "gpio_get_value",
+	[STATS_GPIO_LINES_SET] = "gpio_lines_set",
+	[STATS_GPIO_LINES_GET] = "gpio_lines_get",
+	[STATS_GPIO_WAIT]      = "gpio_wait_edges",
+};
+
+// every thread's block, pushed once at first use and never freed
+static struct stats_thread *stats_threads = NULL;
+static __thread struct stats_thread *stats_self = NULL;
+
+static int stats_text_at_exit;
+static const char *stats_path_at_exit;
+
+uint64_t stats_clock(clockid_t clock) {
+	struct timespec ts;
+
+	clock_gettime(clock, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+uint64_t stats_now(void) {
+	return stats_clock(CLOCK_MONOTONIC);
+}
+
+static int stats_bucket(uint64_t ns) {
+	int octave;
+
+	if (ns < (1 << STATS_SUB_BITS))
+		return ns;
+	octave = 63 - __builtin_clzll(ns) - STATS_SUB_BITS;
+	if (octave >= STATS_OCTAVES)
+		return STATS_BUCKETS - 1;
+	return ((octave + 1) << STATS_SUB_BITS) +
+		((ns >> octave) & ((1 << STATS_SUB_BITS) - 1));
+}
+
+// largest value that lands in bucket b
+static uint64_t stats_bucket_limit(int b) {
+	int octave = (b >> STATS_SUB_BITS) - 1;
+	int sub = b & ((1 << STATS_SUB_BITS) - 1);
+
+	if (octave < 0)
+		return b;
+	return ((uint64_t)((1 << STATS_SUB_BITS) + sub + 1) << octave) - 1;
+}
+
+static struct stats_thread *stats_register(void) {
+	struct stats_thread *self = calloc(1, sizeof(*self));
+
+	if (!self)
+		return NULL;
+	self->next = __atomic_load_n(&stats_threads, __ATOMIC_ACQUIRE);
+	while (!__atomic_compare_exchange_n(&stats_threads, &self->next, self, 0,
+					    __ATOMIC_RELEASE, __ATOMIC_ACQUIRE))
+		;
+	stats_self = self;
+	return self;
+}
+
+void stats_record(enum stats_op op, uint64_t ns) {
+	struct stats_thread *self = stats_self;
+
+	if (!self && !(self = stats_register()))
+		return;
+	self->count[op]++;
+	self->total_ns[op] += ns;
+	if (ns > self->max_ns[op])
+		self->max_ns[op] = ns;
+	self->hist[op][stats_bucket(ns)]++;
+}
+
+void stats_scope_end(struct stats_scope *scope) {
+	stats_record(scope->op, stats_now() - scope->start);
+}
+
+static void stats_merge(struct stats_thread *sum) {
+	struct stats_thread *t;
+	int op, b;
+
+	memset(sum, 0, sizeof(*sum));
+	for (t = __atomic_load_n(&stats_threads, __ATOMIC_ACQUIRE); t; t = t->next) {
+		for (op = 0; op < STATS_NUM_OPS; op++) {
+			sum->count[op] += t->count[op];
+			sum->total_ns[op] += t->total_ns[op];
+			if (t->max_ns[op] > sum->max_ns[op])
+				sum->max_ns[op] = t->max_ns[op];
+			for (b = 0; b < STATS_BUCKETS; b++)
+				sum->hist[op][b] += t->hist[op][b];
+		}
+	}
+}
+
+static uint64_t stats_percentile(struct stats_thread *sum, int op, int pct) {
+	uint64_t want = (sum->count[op] * pct + 99) / 100;
+	uint64_t seen = 0;
+	int b;
+
+	for (b = 0; b < STATS_BUCKETS; b++) {
+		seen += sum->hist[op][b];
+		// a bucket's upper bound can lie past anything actually seen
+		if (seen >= want)
+			return stats_bucket_limit(b) < sum->max_ns[op] ?
+				stats_bucket_limit(b) : sum->max_ns[op];
+	}
+	return sum->max_ns[op];
+}
+
+static void stats_dump_text(struct stats_thread *sum) {
+	int op;
+
+	fprintf(stderr, "%-20s %10s %10s %10s %10s %10s\n",
+		"operation", "calls", "avg(ns)", "p50(ns)", "p99(ns)", "max(ns)");
+	for (op = 0; op < STATS_NUM_OPS; op++) {
+		if (!sum->count[op])
+			continue;
+		fprintf(stderr, "%-20s %10llu %10llu %10llu %10llu %10llu\n",
+			stats_names[op],
+			(unsigned long long)sum->count[op],
+			(unsigned long long)(sum->total_ns[op] / sum->count[op]),
+			(unsigned long long)stats_percentile(sum, op, 50),
+			(unsigned long long)stats_percentile(sum, op, 99),
+			(unsigned long long)sum->max_ns[op]);
+	}
+}
+
+// histogram buckets are emitted sparse, as [upper bound ns, count] pairs
+static int stats_dump_json(struct stats_thread *sum, const char *path) {
+	FILE *f;
+	int op, b;
+	int first = 1;
+
+	f = fopen(path, "w");
+	if (!f) {
+		perror("Unable to write stats file");
+		return -1;
+	}
+
+	fprintf(f, "{\n");
+	for (op = 0; op < STATS_NUM_OPS; op++) {
+		int first_bucket = 1;
+
+		if (!sum->count[op])
+			continue;
+		fprintf(f, "%s  \"%s\": {\"calls\": %llu, \"total_ns\": %llu, "
+			"\"max_ns\": %llu, \"hist\": [",
+			first ? "" : ",\n", stats_names[op],
+			(unsigned long long)sum->count[op],
+			(unsigned long long)sum->total_ns[op],
+			(unsigned long long)sum->max_ns[op]);
+		for (b = 0; b < STATS_BUCKETS; b++) {
+			if (!sum->hist[op][b])
+				continue;
+			fprintf(f, "%s[%llu, %u]", first_bucket ? "" : ", ",
+				(unsigned long long)stats_bucket_limit(b),
+				sum->hist[op][b]);
+			first_bucket = 0;
+		}
+		fprintf(f, "]}");
+		first = 0;
+	}
+	fprintf(f, "\n}\n");
+	fclose(f);
+	return 0;
+}
+
+int stats_dump(const char *path) {
+	struct stats_thread *sum;
+	int ret = 0;
+
+#ifndef GPBB_STATS
+	fprintf(stderr, "statistics not compiled in (build with STATS=1)\n");
+	return -1;
+#endif
+
+	sum = malloc(sizeof(*sum));
+	if (!sum)
+		return -1;
+	stats_merge(sum);
+	if (path)
+		ret = stats_dump_json(sum, path);
+	else
+		stats_dump_text(sum);
+	free(sum);
+	return ret;
+}
+
+static void stats_exit_handler(void) {
+	if (stats_text_at_exit)
+		stats_dump(NULL);
+	if (stats_path_at_exit)
+		stats_dump(stats_path_at_exit);
+}
+
+void stats_dump_at_exit(int text, const char *path) {
+	static int registered;
+
+	if (text)
+		stats_text_at_exit = 1;
+	if (path)
+		stats_path_at_exit = path;
+	if (!registered) {
+		atexit(stats_exit_handler);
+		registered = 1;
+	}
+}
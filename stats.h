@@ -0,0 +1,66 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+
+///
+// Per-operation call counts and latency histograms for the hardware paths.
+//
+// Put STATS_SCOPE(op) at the top of a function and the time until it
+// returns is charged to op.  Counters are per thread and only ever touched
+// by their own thread, so recording takes no lock.  Building without
+// GPBB_STATS (make STATS=0) compiles all of this out.
+///
+
+#include <stdint.h>
+#include <time.h>
+
+enum stats_op {
+	STATS_KMEM_READ,
+	STATS_KMEM_WRITE,
+	STATS_EIM_READ,
+	STATS_EIM_WRITE,
+	STATS_ADC_I2C_READ,
+	STATS_ADC_I2C_WRITE,
+	STATS_ADC_VALID_WAIT,
+	STATS_DAC_I2C_READ,
+	STATS_DAC_I2C_WRITE,
+	STATS_DAC_I2C_BURST,
+	STATS_GPIO_DIRECTION,
+	STATS_GPIO_SET,
+	STATS_GPIO_GET,
+	STATS_GPIO_LINES_SET,
+	STATS_GPIO_LINES_GET,
+	STATS_GPIO_WAIT,
+	STATS_NUM_OPS,
+};
+
+// log-linear: 4 linear steps per power of two, up to 2^41 ns (~36 min)
+#define STATS_SUB_BITS  2
+#define STATS_OCTAVES   40
+#define STATS_BUCKETS   ((1 << STATS_SUB_BITS) * (STATS_OCTAVES + 1))
+
+struct stats_scope {
+	enum stats_op op;
+	uint64_t start;
+};
+
+// CLOCK_MONOTONIC in ns, the time base of everything here
+uint64_t stats_now(void);
+// the same for any other clock (CLOCK_REALTIME, CLOCK_THREAD_CPUTIME_ID, ...)
+uint64_t stats_clock(clockid_t clock);
+void stats_record(enum stats_op op, uint64_t ns);
+void stats_scope_end(struct stats_scope *scope);
+
+// dump everything recorded so far; path NULL means human-readable to stderr
+int stats_dump(const char *path);
+// dump at exit, to stderr and/or to a JSON file
+void stats_dump_at_exit(int text, const char *path);
+
+#ifdef GPBB_STATS
+# define STATS_SCOPE(op) \
+	struct stats_scope __stats_scope __attribute__((cleanup(stats_scope_end))) = \
+		{ (op), stats_now() }
+#else
+# define STATS_SCOPE(op) do {} while (0)
+#endif
+
+#endif /* __STATS_H__ */
@@ -0,0 +1,838 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+
+#include "svf.h"
+#include "stats.h"
+
+#define SVF_MAX_TOKENS    32
+#define SVF_CHECK_BYTES   (1 << 20)  // flush once this much TDO is waiting
+#define SVF_MAX_REPORTS   8
+
+// a scan whose TDO is compared once the stream has run
+struct svf_check {
+	long where;             // SVF line or XSVF offset
+	int nbits;
+	uint8_t *got, *want, *mask;
+};
+
+enum { SIR, SDR, HIR, HDR, TIR, TDR, SCANS };
+
+// one SVF scan command's patterns, LSB first; TDI, MASK and SMASK carry
+// over to the next command of the kind with the same length
+struct svf_scan {
+	int len;
+	uint8_t *tdi, *tdo, *mask;
+	int has_tdo;
+};
+
+struct svf {
+	struct jtag *j;
+	struct svf_stats *st;
+	const char *xsvf;       // the player's name for messages
+
+	struct svf_check *checks;
+	int nchecks, max_checks;
+	size_t check_bytes;
+
+	// SVF
+	char *buf;
+	size_t pos, size;
+	long line;
+	char *tok[SVF_MAX_TOKENS];
+	int ntok;
+	struct svf_scan scan[SCANS];
+	enum jtag_state endir, enddr, run_state, run_end;
+	int trst_warned;
+};
+
+static int bytes_of(int nbits) {
+	return (nbits + 7) / 8;
+}
+
+static void bits_copy(uint8_t *dst, int at, const uint8_t *src, int n) {
+	int i, b;
+
+	for (i = 0; i < n; i++) {
+		b = at + i;
+		if ((src[i / 8] >> (i % 8)) & 1)
+			dst[b / 8] |= 1 << (b % 8);
+		else
+			dst[b / 8] &= ~(1 << (b % 8));
+	}
+}
+
+static void svf_wait(struct svf *p, uint64_t ns) {
+	struct timespec ts;
+
+	p->st->wait_ns += ns;
+	ts.tv_sec = ns / 1000000000ULL;
+	ts.tv_nsec = ns % 1000000000ULL;
+	while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+		;
+}
+
+
+/*
+ * Deferred TDO compares.
+ */
+static int svf_verify(struct svf *p) {
+	struct svf_check *c;
+	int i, b, bad;
+
+	if (jtag_flush(p->j))
+		return -1;
+	for (i = 0; i < p->nchecks; i++) {
+		c = &p->checks[i];
+		for (b = 0, bad = 0; b < bytes_of(c->nbits); b++)
+			if ((c->got[b] ^ c->want[b]) & c->mask[b])
+				bad = 1;
+		if (bad && ++p->st->mismatches <= SVF_MAX_REPORTS) {
+			fprintf(stderr, "%s %s %ld: TDO mismatch in %d bits\n", p->xsvf,
+				p->xsvf[0] == 'X' ? "offset" : "line", c->where, c->nbits);
+			fprintf(stderr, "  got  ");
+			for (b = bytes_of(c->nbits) - 1; b >= 0; b--)
+				fprintf(stderr, "%02x", c->got[b]);
+			fprintf(stderr, "\n  want ");
+			for (b = bytes_of(c->nbits) - 1; b >= 0; b--)
+				fprintf(stderr, "%02x", c->want[b] & c->mask[b]);
+			fprintf(stderr, "\n");
+		}
+		free(c->got);
+		free(c->want);
+		free(c->mask);
+	}
+	p->nchecks = 0;
+	p->check_bytes = 0;
+	return p->st->mismatches ? 1 : 0;
+}
+
+// queue a scan whose TDO is compared at the next svf_verify();
+// want and mask are taken over
+static int svf_scan_check(struct svf *p, int ir, const uint8_t *tdi, uint8_t *want,
+			  uint8_t *mask, int nbits, enum jtag_state end, long where) {
+	struct svf_check *c;
+	int max;
+
+	if (p->nchecks == p->max_checks) {
+		max = p->max_checks ? p->max_checks * 2 : 64;
+		c = realloc(p->checks, max * sizeof(*c));
+		if (!c)
+			goto nomem;
+		p->checks = c;
+		p->max_checks = max;
+	}
+	c = &p->checks[p->nchecks];
+	c->got = calloc(1, bytes_of(nbits));
+	if (!c->got)
+		goto nomem;
+	c->where = where;
+	c->nbits = nbits;
+	c->want = want;
+	c->mask = mask;
+	p->nchecks++;
+	p->check_bytes += bytes_of(nbits);
+
+	jtag_shift(p->j, ir, tdi, c->got, nbits, end);
+	if (p->check_bytes >= SVF_CHECK_BYTES)
+		return svf_verify(p) < 0 ? -1 : 0;
+	return 0;
+
+nomem:
+	fprintf(stderr, "Unable to allocate TDO compare\n");
+	free(want);
+	free(mask);
+	return -1;
+}
+
+
+/*
+ * SVF
+ */
+static int svf_error(struct svf *p, const char *what) {
+	fprintf(stderr, "SVF line %ld: %s\n", p->line, what);
+	return -1;
+}
+
+static void svf_free_tokens(struct svf *p) {
+	while (p->ntok)
+		free(p->tok[--p->ntok]);
+}
+
+// the next statement's tokens, "(...)" as one token without the parentheses
+// or white space; 0 at the end of the file
+static int svf_statement(struct svf *p) {
+	char *t;
+	size_t start, n;
+
+	svf_free_tokens(p);
+	for (;;) {
+		while (p->pos < p->size && isspace((unsigned char)p->buf[p->pos]))
+			if (p->buf[p->pos++] == '\n')
+				p->line++;
+		if (p->pos >= p->size)
+			return p->ntok ? svf_error(p, "missing ;") : 0;
+
+		if (p->buf[p->pos] == '!' ||
+		    (p->buf[p->pos] == '/' && p->pos + 1 < p->size && p->buf[p->pos + 1] == '/')) {
+			while (p->pos < p->size && p->buf[p->pos] != '\n')
+				p->pos++;
+			continue;
+		}
+		if (p->buf[p->pos] == ';') {
+			p->pos++;
+			if (p->ntok)
+				return 1;
+			continue;
+		}
+		if (p->ntok == SVF_MAX_TOKENS)
+			return svf_error(p, "statement too long");
+
+		if (p->buf[p->pos] == '(') {
+			start = ++p->pos;
+			while (p->pos < p->size && p->buf[p->pos] != ')')
+				p->pos++;
+			if (p->pos >= p->size)
+				return svf_error(p, "missing )");
+			t = malloc(p->pos - start + 1);
+			if (!t)
+				return svf_error(p, "out of memory");
+			for (n = 0; start < p->pos; start++) {
+				if (p->buf[start] == '\n')
+					p->line++;
+				if (!isspace((unsigned char)p->buf[start]))
+					t[n++] = p->buf[start];
+			}
+			t[n] = '\0';
+			p->pos++;
+		}
+		else {
+			start = p->pos;
+			while (p->pos < p->size && !isspace((unsigned char)p->buf[p->pos]) &&
+			       p->buf[p->pos] != ';' && p->buf[p->pos] != '(')
+				p->pos++;
+			t = strndup(p->buf + start, p->pos - start);
+			if (!t)
+				return svf_error(p, "out of memory");
+		}
+		p->tok[p->ntok++] = t;
+	}
+}
+
+// hex, rightmost digit first, into an LSB-first pattern of len bits
+static uint8_t *svf_hex(struct svf *p, const char *hex, int len) {
+	uint8_t *bits = calloc(1, bytes_of(len) + 1);
+	int n = strlen(hex), i, d, b = 0;
+
+	if (!bits) {
+		svf_error(p, "out of memory");
+		return NULL;
+	}
+	for (i = n - 1; i >= 0 && b < len; i--, b += 4) {
+		if (!isxdigit((unsigned char)hex[i])) {
+			free(bits);
+			svf_error(p, "bad hex digit");
+			return NULL;
+		}
+		d = isdigit((unsigned char)hex[i]) ? hex[i] - '0' : (tolower(hex[i]) - 'a' + 10);
+		bits[b / 8] |= d << (b % 8);
+	}
+	return bits;
+}
+
+static uint8_t *svf_ones(int len) {
+	uint8_t *bits = malloc(bytes_of(len) + 1);
+
+	if (bits)
+		memset(bits, 0xff, bytes_of(len) + 1);
+	return bits;
+}
+
+// SIR/SDR/HIR/HDR/TIR/TDR length [TDI (..)] [TDO (..)] [MASK (..)] [SMASK (..)]
+static int svf_parse_scan(struct svf *p, struct svf_scan *sc) {
+	int len = p->ntok > 1 ? strtol(p->tok[1], NULL, 10) : -1;
+	uint8_t **field, *v;
+	int i;
+
+	if (len < 0)
+		return svf_error(p, "bad scan length");
+	if (len != sc->len || !sc->tdi) {
+		free(sc->tdi);
+		free(sc->mask);
+		sc->tdi = calloc(1, bytes_of(len) + 1);
+		sc->mask = svf_ones(len);
+		if (!sc->tdi || !sc->mask)
+			return svf_error(p, "out of memory");
+		sc->len = len;
+	}
+	sc->has_tdo = 0;
+
+	for (i = 2; i + 1 < p->ntok; i += 2) {
+		if (!strcasecmp(p->tok[i], "TDI"))
+			field = &sc->tdi;
+		else if (!strcasecmp(p->tok[i], "TDO"))
+			field = &sc->tdo;
+		else if (!strcasecmp(p->tok[i], "MASK"))
+			field = &sc->mask;
+		else if (!strcasecmp(p->tok[i], "SMASK"))
+			continue;  // TDI bits are always driven
+		else
+			return svf_error(p, "unknown scan field");
+		v = svf_hex(p, p->tok[i + 1], len);
+		if (!v)
+			return -1;
+		free(*field);
+		*field = v;
+		if (field == &sc->tdo)
+			sc->has_tdo = 1;
+	}
+	if (i != p->ntok)
+		return svf_error(p, "scan field without a value");
+	return 0;
+}
+
+// header, data and trailer shifted as one, header first
+static int svf_run_scan(struct svf *p, int ir) {
+	struct svf_scan *h = &p->scan[ir ? HIR : HDR];
+	struct svf_scan *d = &p->scan[ir ? SIR : SDR];
+	struct svf_scan *t = &p->scan[ir ? TIR : TDR];
+	struct svf_scan *part[3] = { h, d, t };
+	int total = h->len + d->len + t->len;
+	enum jtag_state end = ir ? p->endir : p->enddr;
+	uint8_t *tdi, *want, *mask;
+	int i, at, check = 0;
+
+	if (!total)
+		return 0;
+	tdi = calloc(1, bytes_of(total) + 1);
+	want = calloc(1, bytes_of(total) + 1);
+	mask = calloc(1, bytes_of(total) + 1);
+	if (!tdi || !want || !mask) {
+		free(tdi);
+		free(want);
+		free(mask);
+		return svf_error(p, "out of memory");
+	}
+	for (i = 0, at = 0; i < 3; at += part[i]->len, i++) {
+		if (!part[i]->len)
+			continue;
+		bits_copy(tdi, at, part[i]->tdi, part[i]->len);
+		if (part[i]->has_tdo) {
+			bits_copy(want, at, part[i]->tdo, part[i]->len);
+			bits_copy(mask, at, part[i]->mask, part[i]->len);
+			check = 1;
+		}
+	}
+
+	if (check) {
+		i = svf_scan_check(p, ir, tdi, want, mask, total, end, p->line);
+	}
+	else {
+		jtag_shift(p->j, ir, tdi, NULL, total, end);
+		free(want);
+		free(mask);
+		i = 0;
+	}
+	// the scan is compiled already; only its TDO waits for the stream
+	free(tdi);
+	return i;
+}
+
+static int svf_state(struct svf *p, const char *name, enum jtag_state *state) {
+	*state = jtag_state_parse(name);
+	return *state == JTAG_STATES ? svf_error(p, "unknown state") : 0;
+}
+
+static int svf_stable(enum jtag_state s) {
+	return s == JTAG_RESET || s == JTAG_IDLE || s == JTAG_DRPAUSE || s == JTAG_IRPAUSE;
+}
+
+// RUNTEST [run_state] [count TCK|SCK] [min SEC [MAXIMUM max SEC]] [ENDSTATE end]
+static int svf_runtest(struct svf *p) {
+	enum jtag_state run = p->run_state, end = JTAG_STATES;
+	double count = 0, min_time = 0;
+	int i = 1;
+
+	if (i < p->ntok && jtag_state_parse(p->tok[i]) != JTAG_STATES) {
+		run = jtag_state_parse(p->tok[i++]);
+		p->run_end = run;
+	}
+	if (i + 1 < p->ntok && (!strcasecmp(p->tok[i + 1], "TCK") ||
+				!strcasecmp(p->tok[i + 1], "SCK"))) {
+		count = atof(p->tok[i]);
+		i += 2;
+	}
+	if (i + 1 < p->ntok && !strcasecmp(p->tok[i + 1], "SEC")) {
+		min_time = atof(p->tok[i]);
+		i += 2;
+	}
+	if (i + 2 < p->ntok && !strcasecmp(p->tok[i], "MAXIMUM"))
+		i += 3;
+	if (i + 1 < p->ntok && !strcasecmp(p->tok[i], "ENDSTATE")) {
+		if (svf_state(p, p->tok[i + 1], &end))
+			return -1;
+		i += 2;
+	}
+	if (i != p->ntok || !svf_stable(run))
+		return svf_error(p, "bad RUNTEST");
+	if (end != JTAG_STATES)
+		p->run_end = end;
+	p->run_state = run;
+	// the count is a time at the file's TCK rate, and the bit-bang clock
+	// may well be faster than that
+	if (p->st->frequency > 0 && count / p->st->frequency > min_time)
+		min_time = count / p->st->frequency;
+
+	jtag_goto(p->j, run);
+	jtag_clock(p->j, count);
+	if (min_time > 0) {
+		// it has to be real time: run what is queued, then wait
+		if (svf_verify(p) < 0)
+			return -1;
+		svf_wait(p, min_time * 1e9);
+	}
+	jtag_goto(p->j, p->run_end);
+	return 0;
+}
+
+static int svf_execute(struct svf *p) {
+	const char *cmd = p->tok[0];
+	enum jtag_state s;
+	int i;
+
+	if (!strcasecmp(cmd, "SIR") || !strcasecmp(cmd, "SDR")) {
+		i = toupper(cmd[1]) == 'I';
+		if (svf_parse_scan(p, &p->scan[i ? SIR : SDR]))
+			return -1;
+		return svf_run_scan(p, i);
+	}
+	if (!strcasecmp(cmd, "HIR"))
+		return svf_parse_scan(p, &p->scan[HIR]);
+	if (!strcasecmp(cmd, "HDR"))
+		return svf_parse_scan(p, &p->scan[HDR]);
+	if (!strcasecmp(cmd, "TIR"))
+		return svf_parse_scan(p, &p->scan[TIR]);
+	if (!strcasecmp(cmd, "TDR"))
+		return svf_parse_scan(p, &p->scan[TDR]);
+	if (!strcasecmp(cmd, "ENDIR") || !strcasecmp(cmd, "ENDDR")) {
+		if (p->ntok != 2 || svf_state(p, p->tok[1], &s))
+			return -1;
+		if (!svf_stable(s))
+			return svf_error(p, "not a stable state");
+		if (toupper(cmd[3]) == 'I')
+			p->endir = s;
+		else
+			p->enddr = s;
+		return 0;
+	}
+	if (!strcasecmp(cmd, "STATE")) {
+		for (i = 1; i < p->ntok; i++) {
+			if (svf_state(p, p->tok[i], &s))
+				return -1;
+			jtag_goto(p->j, s);
+		}
+		return 0;
+	}
+	if (!strcasecmp(cmd, "RUNTEST"))
+		return svf_runtest(p);
+	if (!strcasecmp(cmd, "FREQUENCY")) {
+		p->st->frequency = p->ntok > 1 ? atof(p->tok[1]) : 0;
+		return 0;
+	}
+	if (!strcasecmp(cmd, "TRST")) {
+		if (p->ntok > 1 && strcasecmp(p->tok[1], "OFF") &&
+		    strcasecmp(p->tok[1], "ABSENT") && !p->trst_warned++)
+			fprintf(stderr, "SVF line %ld: no TRST pin, TRST %s ignored\n",
+				p->line, p->tok[1]);
+		return 0;
+	}
+	fprintf(stderr, "SVF line %ld: %s not supported\n", p->line, cmd);
+	return -1;
+}
+
+static char *read_file(const char *path, size_t *size) {
+	FILE *f = fopen(path, "rb");
+	char *buf = NULL;
+	long n;
+
+	if (!f) {
+		perror(path);
+		return NULL;
+	}
+	if (fseek(f, 0, SEEK_END) == 0 && (n = ftell(f)) >= 0 && fseek(f, 0, SEEK_SET) == 0) {
+		buf = malloc(n + 1);
+		if (buf && fread(buf, 1, n, f) != (size_t)n) {
+			free(buf);
+			buf = NULL;
+		}
+		*size = n;
+	}
+	if (!buf)
+		fprintf(stderr, "Unable to read %s\n", path);
+	fclose(f);
+	return buf;
+}
+
+static void svf_cleanup(struct svf *p) {
+	int i;
+
+	svf_free_tokens(p);
+	for (i = 0; i < p->nchecks; i++) {
+		free(p->checks[i].got);
+		free(p->checks[i].want);
+		free(p->checks[i].mask);
+	}
+	free(p->checks);
+	for (i = 0; i < SCANS; i++) {
+		free(p->scan[i].tdi);
+		free(p->scan[i].tdo);
+		free(p->scan[i].mask);
+	}
+	free(p->buf);
+}
+
+int svf_play(struct jtag *j, const char *path, struct svf_stats *st) {
+	struct svf p;
+	uint64_t t0 = stats_now();
+	int ret;
+
+	memset(st, 0, sizeof(*st));
+	memset(&p, 0, sizeof(p));
+	p.j = j;
+	p.st = st;
+	p.xsvf = "SVF";
+	p.line = 1;
+	p.endir = p.enddr = p.run_state = p.run_end = JTAG_IDLE;
+	p.buf = read_file(path, &p.size);
+	if (!p.buf)
+		return -1;
+
+	while ((ret = svf_statement(&p)) > 0) {
+		st->statements++;
+		if ((ret = svf_execute(&p)) < 0)
+			break;
+	}
+	if (!ret)
+		ret = svf_verify(&p);
+	st->elapsed_ns = stats_now() - t0;
+	svf_cleanup(&p);
+	return ret;
+}
+
+
+/*
+ * XSVF: the binary form, one opcode byte and its arguments at a time.
+ * Values are big-endian, so the last byte holds the first bits shifted.
+ */
+enum {
+	XCOMPLETE = 0, XTDOMASK, XSIR, XSDR, XRUNTEST, XREPEAT = 7, XSDRSIZE,
+	XSDRTDO, XSETSDRMASKS, XSDRINC, XSDRB, XSDRC, XSDRE, XSDRTDOB, XSDRTDOC,
+	XSDRTDOE, XSTATE, XENDIR, XENDDR, XSIR2, XCOMMENT, XWAIT,
+};
+
+struct xsvf {
+	struct svf p;
+	const uint8_t *data;
+	size_t pos, size;
+	int sdrsize;
+	uint8_t *tdomask, *tdi, *tdo;  // sdrsize bits each, LSB first
+	int repeat;
+	uint32_t runtest;       // us
+	enum jtag_state endir, enddr;
+};
+
+static int xsvf_error(struct xsvf *x, const char *what) {
+	fprintf(stderr, "XSVF offset %zu: %s\n", x->pos, what);
+	return -1;
+}
+
+static int xsvf_bytes(struct xsvf *x, size_t n, const uint8_t **p) {
+	if (x->pos + n > x->size)
+		return xsvf_error(x, "truncated");
+	*p = x->data + x->pos;
+	x->pos += n;
+	return 0;
+}
+
+static int xsvf_u(struct xsvf *x, int n, uint32_t *v) {
+	const uint8_t *b;
+
+	if (xsvf_bytes(x, n, &b))
+		return -1;
+	for (*v = 0; n--; b++)
+		*v = (*v << 8) | *b;
+	return 0;
+}
+
+// a big-endian value of nbits into an LSB-first pattern
+static int xsvf_value(struct xsvf *x, int nbits, uint8_t *bits) {
+	const uint8_t *b;
+	int n = bytes_of(nbits), i;
+
+	if (xsvf_bytes(x, n, &b))
+		return -1;
+	for (i = 0; i < n; i++)
+		bits[i] = b[n - 1 - i];
+	return 0;
+}
+
+static int xsvf_sdrsize(struct xsvf *x, uint32_t size) {
+	int n = bytes_of(size) + 1;
+
+	free(x->tdomask);
+	free(x->tdi);
+	free(x->tdo);
+	x->sdrsize = size;
+	x->tdomask = calloc(1, n);
+	x->tdi = calloc(1, n);
+	x->tdo = calloc(1, n);
+	if (!x->tdomask || !x->tdi || !x->tdo)
+		return xsvf_error(x, "out of memory");
+	return 0;
+}
+
+static int xsvf_runtest(struct xsvf *x, uint32_t us) {
+	if (!us)
+		return 0;
+	jtag_goto(x->p.j, JTAG_IDLE);
+	if (svf_verify(&x->p) < 0)
+		return -1;
+	svf_wait(&x->p, us * 1000ULL);
+	return 0;
+}
+
+static uint8_t *xsvf_dup(struct xsvf *x, const uint8_t *bits) {
+	uint8_t *d = malloc(bytes_of(x->sdrsize) + 1);
+
+	if (d)
+		memcpy(d, bits, bytes_of(x->sdrsize) + 1);
+	return d;
+}
+
+// XSDR/XSDRTDO: shift, compare against x->tdo, retry up to XREPEAT times
+// through Pause-DR, then XRUNTEST or ENDDR
+static int xsvf_sdr(struct xsvf *x, long where) {
+	struct jtag *j = x->p.j;
+	uint8_t *got, *want, *mask;
+	int attempt, b, bad = 1;
+
+	if (!x->repeat) {
+		// nothing to retry, so the compare can wait like an SVF one
+		want = xsvf_dup(x, x->tdo);
+		mask = xsvf_dup(x, x->tdomask);
+		if (!want || !mask) {
+			free(want);
+			free(mask);
+			return xsvf_error(x, "out of memory");
+		}
+		if (svf_scan_check(&x->p, 0, x->tdi, want, mask, x->sdrsize,
+				   x->runtest ? JTAG_IDLE : x->enddr, where))
+			return -1;
+		return xsvf_runtest(x, x->runtest);
+	}
+
+	got = calloc(1, bytes_of(x->sdrsize) + 1);
+	if (!got)
+		return xsvf_error(x, "out of memory");
+	for (attempt = 0; attempt <= x->repeat && bad; attempt++) {
+		if (attempt) {
+			// Exit1-DR, Pause-DR, Exit2-DR, Shift-DR and again
+			jtag_goto(j, JTAG_DRPAUSE);
+			jtag_goto(j, JTAG_DREXIT2);
+		}
+		jtag_shift(j, 0, x->tdi, got, x->sdrsize, JTAG_DREXIT1);
+		if (svf_verify(&x->p) < 0) {
+			free(got);
+			return -1;
+		}
+		for (b = 0, bad = 0; b < bytes_of(x->sdrsize); b++)
+			if ((got[b] ^ x->tdo[b]) & x->tdomask[b])
+				bad = 1;
+	}
+	free(got);
+	if (bad) {
+		x->p.st->mismatches++;
+		fprintf(stderr, "XSVF offset %ld: TDO mismatch after %d attempts\n", where, attempt);
+		return 1;
+	}
+	jtag_goto(j, x->runtest ? JTAG_IDLE : x->enddr);
+	return xsvf_runtest(x, x->runtest);
+}
+
+// XSDRB/C/E and XSDRTDOB/C/E: one piece of a scan too long for one command
+static int xsvf_sdr_piece(struct xsvf *x, int op, long where) {
+	int tdo = op >= XSDRTDOB, piece = (op - XSDRB) % 3;  // 0 begin, 1 continue, 2 end
+	enum jtag_state end = piece == 2 ? x->enddr : JTAG_DRSHIFT;
+	uint8_t *want, *mask;
+
+	if (xsvf_value(x, x->sdrsize, x->tdi) || (tdo && xsvf_value(x, x->sdrsize, x->tdo)))
+		return -1;
+	if (piece == 0)
+		jtag_goto(x->p.j, JTAG_DRSHIFT);
+	if (!tdo) {
+		jtag_shift(x->p.j, 0, x->tdi, NULL, x->sdrsize, end);
+		return 0;
+	}
+	want = xsvf_dup(x, x->tdo);
+	mask = xsvf_dup(x, x->tdomask);
+	if (!want || !mask) {
+		free(want);
+		free(mask);
+		return xsvf_error(x, "out of memory");
+	}
+	return svf_scan_check(&x->p, 0, x->tdi, want, mask, x->sdrsize, end, where);
+}
+
+static int xsvf_execute(struct xsvf *x, int op, long where) {
+	static const enum jtag_state end_ir[2] = { JTAG_IDLE, JTAG_IRPAUSE };
+	static const enum jtag_state end_dr[2] = { JTAG_IDLE, JTAG_DRPAUSE };
+	const uint8_t *b;
+	uint8_t *bits;
+	uint32_t v, state, end;
+	int ret;
+
+	switch (op) {
+	case XTDOMASK:
+		return xsvf_value(x, x->sdrsize, x->tdomask);
+	case XSIR:
+	case XSIR2:
+		if (xsvf_u(x, op == XSIR ? 1 : 2, &v))
+			return -1;
+		bits = calloc(1, bytes_of(v) + 1);
+		if (!bits)
+			return xsvf_error(x, "out of memory");
+		ret = xsvf_value(x, v, bits);
+		if (!ret)
+			jtag_shift(x->p.j, 1, bits, NULL, v, x->runtest ? JTAG_IDLE : x->endir);
+		free(bits);
+		return ret ? ret : xsvf_runtest(x, x->runtest);
+	case XSDR:
+		if (xsvf_value(x, x->sdrsize, x->tdi))
+			return -1;
+		return xsvf_sdr(x, where);
+	case XSDRTDO:
+		if (xsvf_value(x, x->sdrsize, x->tdi) || xsvf_value(x, x->sdrsize, x->tdo))
+			return -1;
+		return xsvf_sdr(x, where);
+	case XRUNTEST:
+		return xsvf_u(x, 4, &x->runtest);
+	case XREPEAT:
+		if (xsvf_u(x, 1, &v))
+			return -1;
+		x->repeat = v;
+		return 0;
+	case XSDRSIZE:
+		if (xsvf_u(x, 4, &v))
+			return -1;
+		return xsvf_sdrsize(x, v);
+	case XSDRB: case XSDRC: case XSDRE:
+	case XSDRTDOB: case XSDRTDOC: case XSDRTDOE:
+		return xsvf_sdr_piece(x, op, where);
+	case XSTATE:
+		if (xsvf_u(x, 1, &state))
+			return -1;
+		if (state >= JTAG_STATES)
+			return xsvf_error(x, "bad state");
+		jtag_goto(x->p.j, state);
+		return 0;
+	case XENDIR:
+	case XENDDR:
+		if (xsvf_u(x, 1, &v))
+			return -1;
+		if (v > 1)
+			return xsvf_error(x, "bad end state");
+		if (op == XENDIR)
+			x->endir = end_ir[v];
+		else
+			x->enddr = end_dr[v];
+		return 0;
+	case XCOMMENT:
+		do {
+			if (xsvf_bytes(x, 1, &b))
+				return -1;
+		} while (*b);
+		return 0;
+	case XWAIT:
+		if (xsvf_u(x, 1, &state) || xsvf_u(x, 1, &end) || xsvf_u(x, 4, &v))
+			return -1;
+		if (state >= JTAG_STATES || end >= JTAG_STATES)
+			return xsvf_error(x, "bad state");
+		jtag_goto(x->p.j, state);
+		if (svf_verify(&x->p) < 0)
+			return -1;
+		svf_wait(&x->p, v * 1000ULL);
+		jtag_goto(x->p.j, end);
+		return 0;
+	default:
+		return xsvf_error(x, "instruction not supported");
+	}
+}
+
+int xsvf_play(struct jtag *j, const char *path, struct svf_stats *st) {
+	struct xsvf x;
+	uint64_t t0 = stats_now();
+	const uint8_t *op;
+	long where;
+	int ret = 0;
+
+	memset(st, 0, sizeof(*st));
+	memset(&x, 0, sizeof(x));
+	x.p.j = j;
+	x.p.st = st;
+	x.p.xsvf = "XSVF";
+	x.endir = x.enddr = JTAG_IDLE;
+	x.repeat = 32;
+	x.p.buf = read_file(path, &x.size);
+	if (!x.p.buf)
+		return -1;
+	x.data = (const uint8_t *)x.p.buf;
+	if (xsvf_sdrsize(&x, 0))
+		goto done;
+
+	for (;;) {
+		where = x.pos;
+		if (xsvf_bytes(&x, 1, &op)) {
+			ret = -1;
+			break;
+		}
+		st->statements++;
+		if (*op == XCOMPLETE)
+			break;
+		ret = xsvf_execute(&x, *op, where);
+		if (ret)
+			break;
+	}
+	if (ret >= 0) {
+		int v = svf_verify(&x.p);
+
+		if (v)
+			ret = v;
+	}
+done:
+	st->elapsed_ns = stats_now() - t0;
+	free(x.tdomask);
+	free(x.tdi);
+	free(x.tdo);
+	svf_cleanup(&x.p);
+	return ret;
+}
+
+void svf_report(const struct jtag *j, const struct svf_stats *st) {
+	double run = j->run_ns / 1e9, busy = (st->elapsed_ns - st->wait_ns) / 1e9;
+
+	printf("%d statements, %llu TCKs in %llu stores (%.2f per TCK), %d TDO mismatches\n",
+	       st->statements, (unsigned long long)j->tcks, (unsigned long long)j->ops,
+	       j->tcks ? (double)j->ops / j->tcks : 0.0, st->mismatches);
+	printf("TCK rate %.3f MHz while streaming, %.3f MHz overall excluding %.3f s of waits "
+	       "(%.3f s elapsed)\n",
+	       run > 0 ? j->tcks / run / 1e6 : 0.0, busy > 0 ? j->tcks / busy / 1e6 : 0.0,
+	       st->wait_ns / 1e9, st->elapsed_ns / 1e9);
+	if (st->frequency > 0 && run > 0 && j->tcks / run > st->frequency)
+		printf("warning: the file asks for at most %.3f MHz TCK; RUNTEST waits were "
+		       "stretched to match, scans need a larger hold\n", st->frequency / 1e6);
+}
@@ -0,0 +1,40 @@
+#ifndef __SVF_H__
+#define __SVF_H__
+
+///
+// SVF and XSVF players on the batched JTAG probe (jtag.h).
+//
+// Scans are queued, not run one by one: expected TDO values are kept
+// with the buffer their scan will fill, and compared after each flush.
+// The stream is flushed when it gets large, before any wait that has to
+// take real time (RUNTEST with a minimum time, XRUNTEST, XWAIT), before
+// an XSDRTDO that may need to be retried, and at the end; a TDO mismatch
+// is reported against the line or offset of the scan that caused it.
+//
+// SVF: SIR, SDR, HIR, HDR, TIR, TDR, ENDIR, ENDDR, STATE, RUNTEST,
+// FREQUENCY and TRST (there is no TRST pin, so only OFF and ABSENT mean
+// anything).  After a FREQUENCY, a RUNTEST's TCK count also lasts at least
+// as long as it would at that rate; scans run at whatever rate the hold
+// gives.  XSVF: everything but XSETSDRMASKS and XSDRINC.
+///
+
+#include <stdint.h>
+
+#include "jtag.h"
+
+struct svf_stats {
+	int statements;
+	int mismatches;
+	double frequency;       // the file's FREQUENCY, 0 if none
+	uint64_t wait_ns;       // asked for by RUNTEST/XRUNTEST/XWAIT
+	uint64_t elapsed_ns;
+};
+
+// 0 when every TDO compare passed, 1 on a mismatch, -1 on a bad file
+int svf_play(struct jtag *j, const char *path, struct svf_stats *st);
+int xsvf_play(struct jtag *j, const char *path, struct svf_stats *st);
+
+// TCKs, stream and overall TCK rate, time waited
+void svf_report(const struct jtag *j, const struct svf_stats *st);
+
+#endif /* __SVF_H__ */
@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+
+#include "sweep.h"
+#include "adc108s022.h"
+#include "dac101c085.h"
+#include "rt.h"
+#include "stats.h"
+
+#define ADC_FULL_SCALE  1023
+
+static void sweep_wait_until(uint64_t deadline) {
+	struct timespec ts;
+
+	ts.tv_sec = deadline / 1000000000ULL;
+	ts.tv_nsec = deadline % 1000000000ULL;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+}
+
+static void sweep_report(struct sweep_config *cfg, unsigned int *adc, int n) {
+	double lsb, inl, dnl, max_inl = 0, max_dnl = 0;
+	int lo, hi, i, max_inl_at, max_dnl_at, nonmono = 0;
+	FILE *out = stdout;
+
+	// endpoints of the unclipped part of the curve
+	for (lo = 0; lo < n && (adc[lo] == 0 || adc[lo] >= ADC_FULL_SCALE); lo++)
+		;
+	for (hi = n - 1; hi > lo && (adc[hi] == 0 || adc[hi] >= ADC_FULL_SCALE); hi--)
+		;
+	lsb = hi > lo ? ((double)adc[hi] - adc[lo]) / (hi - lo) : 0;
+	max_inl_at = max_dnl_at = lo;
+
+	if (cfg->curve_path) {
+		out = fopen(cfg->curve_path, "w");
+		if (!out)
+			perror("Unable to open sweep curve file");
+	}
+	if (out)
+		fprintf(out, "# dac adc inl dnl\n");
+
+	for (i = 0; i < n; i++) {
+		inl = dnl = 0;
+		if (lsb > 0 && i >= lo && i <= hi) {
+			inl = (adc[i] - (double)adc[lo]) / lsb - (i - lo);
+			if (i < hi)
+				dnl = ((double)adc[i + 1] - adc[i]) / lsb - 1;
+			if (fabs(inl) > fabs(max_inl)) {
+				max_inl = inl;
+				max_inl_at = i;
+			}
+			if (i < hi && fabs(dnl) > fabs(max_dnl)) {
+				max_dnl = dnl;
+				max_dnl_at = i;
+			}
+			if (i < hi && adc[i + 1] < adc[i])
+				nonmono++;
+		}
+		if (out)
+			fprintf(out, "%u %u %.3f %.3f\n", cfg->first + i, adc[i], inl, dnl);
+	}
+	if (out && out != stdout)
+		fclose(out);
+
+	if (lsb <= 0) {
+		printf("sweep: no unclipped rising range; is DAC %c looped to ADC channel %d?\n",
+		       cfg->dac == DAC_A ? 'A' : 'B', cfg->adc_channel);
+		return;
+	}
+	printf("linear range: DAC %u..%u -> ADC %u..%u, gain %.4f ADC/DAC code, offset %.2f ADC codes\n",
+	       cfg->first + lo, cfg->first + hi, adc[lo], adc[hi], lsb,
+	       adc[lo] - lsb * (cfg->first + lo));
+	printf("INL %+.3f LSB at code %u, DNL %+.3f LSB at code %u, %d non-monotonic steps\n",
+	       max_inl, cfg->first + max_inl_at, max_dnl,
+	       cfg->first + max_dnl_at, nonmono);
+}
+
+int sweep_run(struct sweep_config *cfg) {
+	unsigned int *adc;
+	uint64_t settle = cfg->settle_us * 1000ULL;
+	uint64_t start, settled, elapsed;
+	int n = cfg->last - cfg->first + 1;
+	int chan, sample, i;
+
+	if (cfg->last < cfg->first || cfg->last > 1023)
+		return -1;
+	adc = calloc(n, sizeof(*adc));
+	if (!adc) {
+		perror("Unable to allocate sweep buffer");
+		return -1;
+	}
+	rt_prefault(adc, n * sizeof(*adc));
+
+	adc_chan(cfg->adc_channel);
+	start = stats_now();
+	dac_set(cfg->dac, cfg->first);
+	settled = stats_now() + settle;
+
+	for (i = 0; i < n; i++) {
+		sweep_wait_until(settled);
+		chan = adc_start();
+		// next code on I2C1 while this conversion completes behind I2C2
+		if (i + 1 < n) {
+			dac_set(cfg->dac, cfg->first + i + 1);
+			settled = stats_now() + settle;
+		}
+		// a hole in the curve would read as INL, so give up instead
+		sample = adc_finish(chan);
+		if (sample < 0) {
+			fprintf(stderr, "sweep: ADC read failed at DAC code %u: %s\n",
+				cfg->first + i, strerror(-sample));
+			free(adc);
+			return -1;
+		}
+		adc[i] = sample;
+	}
+	elapsed = stats_now() - start;
+
+	printf("sweep: DAC %c codes %u..%u -> ADC channel %d, %ld us settling (%s)\n",
+	       cfg->dac == DAC_A ? 'A' : 'B', cfg->first, cfg->last, cfg->adc_channel,
+	       cfg->settle_us, rt_enabled ? "RT" : "normal");
+	sweep_report(cfg, adc, n);
+	printf("%d points in %.3f s, %.1f points/s\n", n, elapsed / 1e9, n / (elapsed / 1e9));
+
+	free(adc);
+	return 0;
+}
@@ -0,0 +1,31 @@
+#ifndef __SWEEP_H__
+#define __SWEEP_H__
+
+///
+// DAC -> ADC transfer characterisation.
+//
+// With a DAC output looped back into an ADC channel, sweep_run() steps the
+// DAC through a code range and reads the ADC once per code after a
+// settling time.  Each DAC write goes out on I2C1 while the previous code's
+// conversion runs behind I2C2; the ADC has already sampled by then, and
+// the new code's settling time runs during adc_finish().  The channel is
+// selected once, so there is no channel-switch discard per point.
+//
+// The result is the transfer curve and an endpoint-fit INL/DNL summary in
+// DAC LSBs, over the codes where the ADC is not clipped at 0 or full scale.
+///
+
+#include "dac101c085.h"
+
+struct sweep_config {
+	dacType dac;
+	unsigned int adc_channel;
+	unsigned int first;     // DAC codes, inclusive
+	unsigned int last;
+	long settle_us;         // from the DAC write completing to the conversion
+	const char *curve_path; // NULL: curve to stdout
+};
+
+int sweep_run(struct sweep_config *cfg);
+
+#endif /* __SWEEP_H__ */
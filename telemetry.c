@@ -0,0 +1,478 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "telemetry.h"
+#include "novena-gpbb.h"
+#include "i2c.h"
+#include "sim.h"
+#include "state.h"
+#include "trace.h"
+#include "stats.h"
+#include "uio.h"
+
+#define TELEM_DEFAULT_CAPACITY  65536
+#define TELEM_ADC_TRIES         3   // batches a channel gets before it reads 0xffff
+
+const struct telem_reg telem_eim_regs[TELEM_EIM_REGS] = {
+	{ 0x021b8000, "cs0gcr1" },
+	{ 0x021b8004, "cs0gcr2" },
+	{ 0x021b8008, "cs0rcr1" },
+	{ 0x021b800c, "cs0rcr2" },
+	{ 0x021b8010, "cs0wcr1" },
+	{ 0x021b8014, "cs0wcr2" },
+	{ 0x021b8018, "cs1gcr1" },
+	{ 0x021b801c, "cs1gcr2" },
+	{ 0x021b8020, "cs1rcr1" },
+	{ 0x021b8024, "cs1rcr2" },
+	{ 0x021b8028, "cs1wcr1" },
+	{ 0x021b802c, "cs1wcr2" },
+	{ 0x021b8090, "wcr" },
+	{ 0x021b8094, "wiar" },
+};
+
+// one conversion's share of a chained I2C_RDWR
+struct telem_conv {
+	uint8_t ctl[2][2];   // channel (clears the start bit), then channel | start
+	uint8_t valid_reg;
+	uint8_t valid;
+	uint8_t dat_reg;
+	uint8_t dat[2];
+};
+
+struct telem {
+	struct telem_config cfg;
+	volatile uint16_t *cs0;
+	struct telem_header *ring;
+	size_t ring_size;
+	struct telem_record *records;
+	char *text_tmp;
+	int adc_chan;         // channel the FPGA last converted, -1 if unknown
+	uint64_t seq;
+	uint64_t i2c_transfers;
+	uint64_t adc_retries;
+	struct telem_conv conv[TELEM_ADC_PER_XFER];
+	struct i2c_msg msgs[TELEM_ADC_PER_XFER * 6 + 1];
+	uint8_t ctl_clear[2];
+};
+
+static volatile sig_atomic_t telem_stop;
+
+static void telem_signal(int sig) {
+	telem_stop = 1;
+}
+
+static uint16_t telem_cs0(struct telem *t, unsigned long reg) {
+	uint16_t val;
+
+	if (sim_enabled)
+		val = sim_mem_read(reg, 2);
+	else
+		val = t->cs0[F(reg)];
+	TRACE(TRACE_BUS_MEM, TRACE_READ, 2, reg, val);
+	return val;
+}
+
+static int telem_ring_map(struct telem *t) {
+	struct telem_header hdr;
+	uint32_t capacity = t->cfg.ring_capacity ? t->cfg.ring_capacity : TELEM_DEFAULT_CAPACITY;
+	int fd;
+
+	fd = open(t->cfg.ring_path, O_RDWR | O_CREAT, 0644);
+	if (fd < 0) {
+		perror("Unable to open telemetry ring");
+		return -1;
+	}
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, TELEM_MAGIC, sizeof(hdr.magic));
+	hdr.record_size = sizeof(struct telem_record);
+	hdr.capacity = capacity;
+	hdr.period_ns = t->cfg.period_ns;
+	hdr.adc_mask = t->cfg.adc_mask;
+	hdr.eim = t->cfg.eim;
+	t->ring_size = TELEM_HEADER_SIZE + (size_t)capacity * sizeof(struct telem_record);
+	if (ftruncate(fd, 0) < 0 || ftruncate(fd, t->ring_size) < 0 ||
+	    pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) {
+		perror("Unable to size telemetry ring");
+		close(fd);
+		return -1;
+	}
+	t->ring = mmap(NULL, t->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (t->ring == MAP_FAILED) {
+		perror("Unable to mmap telemetry ring");
+		t->ring = NULL;
+		return -1;
+	}
+	t->records = (struct telem_record *)((char *)t->ring + TELEM_HEADER_SIZE);
+	return 0;
+}
+
+struct telem *telem_open(const struct telem_config *cfg, volatile uint16_t *cs0) {
+	struct telem *t;
+
+	if (!cs0 && !sim_enabled)
+		return NULL;
+	t = calloc(1, sizeof(*t));
+	if (!t)
+		return NULL;
+	t->cfg = *cfg;
+	t->cfg.adc_mask &= (1 << TELEM_ADC_CHANNELS) - 1;
+	t->cs0 = cs0;
+	t->adc_chan = -1;
+	if (t->cfg.eim && uio_active) {
+		// the whole point of UIO is not needing /dev/mem
+		fprintf(stderr, "EIM registers are not readable through UIO; leaving them out\n");
+		t->cfg.eim = 0;
+	}
+
+	if (t->cfg.ring_path && telem_ring_map(t) < 0)
+		goto fail;
+	if (t->cfg.text_path) {
+		t->text_tmp = malloc(strlen(t->cfg.text_path) + 5);
+		if (!t->text_tmp)
+			goto fail;
+		sprintf(t->text_tmp, "%s.tmp", t->cfg.text_path);
+	}
+	return t;
+
+fail:
+	telem_close(t);
+	return NULL;
+}
+
+void telem_close(struct telem *t) {
+	if (!t)
+		return;
+	if (t->ring) {
+		msync(t->ring, t->ring_size, MS_ASYNC);
+		munmap(t->ring, t->ring_size);
+	}
+	if (t->cfg.eim)
+		release_kernel_memory();
+	free(t->text_tmp);
+	free(t);
+}
+
+/*
+ * Convert n channels in one I2C_RDWR.  Each conversion clears the start
+ * bit while selecting its channel, sets it, then reads VALID (which latches
+ * the result) and the two data bytes; the transfer ends by clearing the
+ * start bit again, as adc_finish() leaves it.  valid[i] is 0 for a
+ * conversion that had not finished by the time VALID was read.
+ */
+static int telem_adc_xfer(struct telem *t, const int *chans, int n, uint16_t *code, int *valid) {
+	struct i2c_msg *m = t->msgs;
+	int i, k;
+
+	for (i = 0; i < n; i++) {
+		struct telem_conv *c = &t->conv[i];
+
+		c->ctl[0][0] = FPGA_I2C_ADC_CTL;
+		c->ctl[0][1] = chans[i];
+		c->ctl[1][0] = FPGA_I2C_ADC_CTL;
+		c->ctl[1][1] = chans[i] | 0x8;
+		c->valid_reg = FPGA_I2C_ADC_VALID;
+		c->dat_reg = FPGA_I2C_ADC_DAT_L;
+		for (k = 0; k < 2; k++)
+			*m++ = (struct i2c_msg){ FPGA_I2C_ADR, 0, 2, c->ctl[k] };
+		*m++ = (struct i2c_msg){ FPGA_I2C_ADR, 0, 1, &c->valid_reg };
+		*m++ = (struct i2c_msg){ FPGA_I2C_ADR, I2C_M_RD, 1, &c->valid };
+		*m++ = (struct i2c_msg){ FPGA_I2C_ADR, 0, 1, &c->dat_reg };
+		*m++ = (struct i2c_msg){ FPGA_I2C_ADR, I2C_M_RD, 2, c->dat };
+	}
+	t->ctl_clear[0] = FPGA_I2C_ADC_CTL;
+	t->ctl_clear[1] = chans[n - 1];
+	*m++ = (struct i2c_msg){ FPGA_I2C_ADR, 0, 2, t->ctl_clear };
+
+	t->i2c_transfers++;
+	if (i2c_transfer(I2C_BUS_FPGA, FPGA_I2C_ADR, t->msgs, m - t->msgs) < 0)
+		return -1;
+	t->adc_chan = chans[n - 1];
+
+	for (i = 0; i < n; i++) {
+		struct telem_conv *c = &t->conv[i];
+
+		valid[i] = c->valid != 0;
+		code[i] = c->dat[0] | (c->dat[1] << 8);
+		TRACE(TRACE_BUS_I2C2, TRACE_WRITE, 1, TRACE_I2C_ADDR(FPGA_I2C_ADR, FPGA_I2C_ADC_CTL),
+		      chans[i] | 0x8);
+		TRACE(TRACE_BUS_I2C2, TRACE_READ, 1, TRACE_I2C_ADDR(FPGA_I2C_ADR, FPGA_I2C_ADC_VALID),
+		      c->valid);
+		// one byte per record, the way adc_finish() reads them, so
+		// a replay reads each register back on its own
+		TRACE(TRACE_BUS_I2C2, TRACE_READ, 1, TRACE_I2C_ADDR(FPGA_I2C_ADR, FPGA_I2C_ADC_DAT_L),
+		      c->dat[0]);
+		TRACE(TRACE_BUS_I2C2, TRACE_READ, 1, TRACE_I2C_ADDR(FPGA_I2C_ADR, FPGA_I2C_ADC_DAT_H),
+		      c->dat[1]);
+	}
+	return 0;
+}
+
+/*
+ * Convert the channels still pending in as few transfers as the message
+ * limit allows.  A conversion on a channel other than the one
+ * before it is preceded by a throw-away one, so the pipelined channel
+ * select of the ADC108S022 has caught up when the kept one runs.
+ */
+static int telem_adc_pass(struct telem *t, int *pending, uint16_t *adc) {
+	int chans[TELEM_ADC_PER_XFER], slot[TELEM_ADC_PER_XFER], valid[TELEM_ADC_PER_XFER];
+	uint16_t code[TELEM_ADC_PER_XFER];
+	int ch, n = 0, last = t->adc_chan, i;
+
+	for (ch = 0; ch <= TELEM_ADC_CHANNELS; ch++) {
+		int need = ch < TELEM_ADC_CHANNELS && pending[ch] ? (ch != last) + 1 : 0;
+
+		if (n && (ch == TELEM_ADC_CHANNELS || n + need > TELEM_ADC_PER_XFER)) {
+			if (telem_adc_xfer(t, chans, n, code, valid) < 0)
+				return -1;
+			for (i = 0; i < n; i++) {
+				if (slot[i] < 0)
+					continue;
+				if (!valid[i])
+					continue;  // stays pending
+				adc[slot[i]] = code[i];
+				pending[slot[i]] = 0;
+				STATE(state_set_adc(slot[i], code[i]));
+			}
+			n = 0;
+		}
+		if (!need)
+			continue;
+		if (ch != last) {
+			chans[n] = ch;
+			slot[n++] = -1;
+		}
+		chans[n] = ch;
+		slot[n++] = ch;
+		last = ch;
+	}
+	return 0;
+}
+
+static int telem_adc(struct telem *t, uint16_t *adc) {
+	int pending[TELEM_ADC_CHANNELS];
+	int ch, left = 0, tries;
+
+	for (ch = 0; ch < TELEM_ADC_CHANNELS; ch++)
+		pending[ch] = (t->cfg.adc_mask >> ch) & 1;
+	for (tries = 0; tries < TELEM_ADC_TRIES; tries++) {
+		if (tries)
+			t->adc_retries += left;
+		if (telem_adc_pass(t, pending, adc) < 0)
+			return -1;
+		for (left = 0, ch = 0; ch < TELEM_ADC_CHANNELS; ch++)
+			left += pending[ch];
+		if (!left)
+			return 0;
+		// the FPGA may have lost track of the channel along the way
+		t->adc_chan = -1;
+	}
+	for (ch = 0; ch < TELEM_ADC_CHANNELS; ch++)
+		if (pending[ch])
+			adc[ch] = 0xffff;
+	return 0;
+}
+
+int telem_read(struct telem *t, struct telem_record *rec) {
+	uint64_t t0 = stats_now();
+	int i, ret = 0;
+
+	memset(rec, 0, sizeof(*rec));
+	rec->seq = t->seq++;
+	rec->timestamp = stats_clock(CLOCK_REALTIME);
+
+	// CS0: four loads from the mapped window
+	rec->gpbb_stat = telem_cs0(t, FPGA_R_GPBB_STAT);
+	rec->dut_to_cpu = telem_cs0(t, FPGA_R_DUT_TO_CPU);
+	rec->fpga_major = telem_cs0(t, FPGA_R_V_MAJOR);
+	rec->fpga_minor = telem_cs0(t, FPGA_R_V_MINOR);
+
+	// EIM: one page, mapped by the first read and kept by the rest
+	if (t->cfg.eim)
+		for (i = 0; i < TELEM_EIM_REGS; i++)
+			rec->eim[i] = read_kernel_memory(telem_eim_regs[i].addr, 0, 4);
+
+	if (t->cfg.adc_mask && telem_adc(t, rec->adc) < 0)
+		ret = -1;
+
+	rec->read_ns = stats_now() - t0;
+	return ret;
+}
+
+static void telem_ring_put(struct telem *t, const struct telem_record *rec) {
+	uint64_t head = t->ring->head;
+
+	t->records[head % t->ring->capacity] = *rec;
+	__atomic_store_n(&t->ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+static int telem_text_put(struct telem *t, const struct telem_record *rec, const struct telem_stats *st) {
+	FILE *f;
+	int i;
+
+	f = fopen(t->text_tmp, "w");
+	if (!f) {
+		perror("Unable to write telemetry text");
+		return -1;
+	}
+	fprintf(f, "# HELP gpbb_gpbb_stat FPGA_R_GPBB_STAT\n"
+		"# TYPE gpbb_gpbb_stat gauge\n"
+		"gpbb_gpbb_stat %u\n", rec->gpbb_stat);
+	fprintf(f, "# HELP gpbb_dut_to_cpu FPGA_R_DUT_TO_CPU\n"
+		"# TYPE gpbb_dut_to_cpu gauge\n"
+		"gpbb_dut_to_cpu %u\n", rec->dut_to_cpu);
+	fprintf(f, "# HELP gpbb_fpga_version FPGA version registers\n"
+		"# TYPE gpbb_fpga_version gauge\n"
+		"gpbb_fpga_version{part=\"major\"} %u\n"
+		"gpbb_fpga_version{part=\"minor\"} %u\n", rec->fpga_major, rec->fpga_minor);
+	if (t->cfg.adc_mask) {
+		fprintf(f, "# HELP gpbb_adc_code ADC108S022 code, 65535 if the conversion never completed\n"
+			"# TYPE gpbb_adc_code gauge\n");
+		for (i = 0; i < TELEM_ADC_CHANNELS; i++)
+			if (t->cfg.adc_mask & (1 << i))
+				fprintf(f, "gpbb_adc_code{channel=\"%d\"} %u\n", i, rec->adc[i]);
+	}
+	if (t->cfg.eim) {
+		fprintf(f, "# HELP gpbb_eim_reg EIM configuration register\n"
+			"# TYPE gpbb_eim_reg gauge\n");
+		for (i = 0; i < TELEM_EIM_REGS; i++)
+			fprintf(f, "gpbb_eim_reg{reg=\"%s\"} %u\n", telem_eim_regs[i].name, rec->eim[i]);
+	}
+	fprintf(f, "# HELP gpbb_telemetry_seq Snapshots taken\n"
+		"# TYPE gpbb_telemetry_seq counter\n"
+		"gpbb_telemetry_seq %llu\n", (unsigned long long)rec->seq + 1);
+	fprintf(f, "# HELP gpbb_telemetry_timestamp_seconds Wall clock at the snapshot\n"
+		"# TYPE gpbb_telemetry_timestamp_seconds gauge\n"
+		"gpbb_telemetry_timestamp_seconds %.6f\n", rec->timestamp / 1e9);
+	fprintf(f, "# HELP gpbb_telemetry_read_seconds Time the snapshot's reads took\n"
+		"# TYPE gpbb_telemetry_read_seconds gauge\n"
+		"gpbb_telemetry_read_seconds %.9f\n", rec->read_ns / 1e9);
+	fprintf(f, "# HELP gpbb_telemetry_cpu_ratio Poller CPU time over wall time so far\n"
+		"# TYPE gpbb_telemetry_cpu_ratio gauge\n"
+		"gpbb_telemetry_cpu_ratio %.6f\n",
+		st->wall_ns ? (double)st->cpu_ns / st->wall_ns : 0.0);
+	if (fclose(f) || rename(t->text_tmp, t->cfg.text_path) < 0) {
+		perror("Unable to write telemetry text");
+		return -1;
+	}
+	return 0;
+}
+
+int telem_run(struct telem *t, uint64_t count, struct telem_stats *st) {
+	struct sigaction sa, old_int, old_term;
+	struct telem_record rec;
+	struct rt_period period;
+	uint64_t wall0, cpu0, t0, t1, text_last = 0;
+	int ret = 0, text_due = 0;
+
+	memset(st, 0, sizeof(*st));
+	rt_hist_init(&st->wakeup);
+	rt_hist_init(&st->read);
+
+	if (!count) {
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = telem_signal;
+		sigemptyset(&sa.sa_mask);
+		sigaction(SIGINT, &sa, &old_int);
+		sigaction(SIGTERM, &sa, &old_term);
+	}
+	telem_stop = 0;
+
+	wall0 = stats_now();
+	cpu0 = stats_clock(CLOCK_THREAD_CPUTIME_ID);
+	if (t->cfg.period_ns)
+		rt_period_start(&period, t->cfg.period_ns);
+	while (!telem_stop && (!count || st->cycles < count)) {
+		if (st->cycles && t->cfg.period_ns) {
+			uint64_t late = rt_period_wait(&period);
+
+			rt_hist_add(&st->wakeup, late);
+			if (late > (uint64_t)t->cfg.period_ns)
+				st->overruns++;
+			if (telem_stop)
+				break;
+		}
+
+		if (telem_read(t, &rec) < 0)
+			ret = -1;
+		rt_hist_add(&st->read, rec.read_ns);
+
+		t0 = stats_now();
+		if (t->ring)
+			telem_ring_put(t, &rec);
+		t1 = stats_now();
+		st->ring_ns += t1 - t0;
+		st->cycles++;
+
+		text_due = t->text_tmp != NULL;
+		if (text_due && (!st->text_writes ||
+				 t1 - text_last >= (uint64_t)t->cfg.text_interval_ns)) {
+			st->wall_ns = t1 - wall0;
+			st->cpu_ns = stats_clock(CLOCK_THREAD_CPUTIME_ID) - cpu0;
+			if (telem_text_put(t, &rec, st) < 0)
+				ret = -1;
+			text_last = t1;
+			text_due = 0;
+			st->text_writes++;
+			st->text_ns += stats_now() - t1;
+		}
+		if (ret < 0)
+			break;
+	}
+	st->wall_ns = stats_now() - wall0;
+	st->cpu_ns = stats_clock(CLOCK_THREAD_CPUTIME_ID) - cpu0;
+	st->i2c_transfers = t->i2c_transfers;
+	st->adc_retries = t->adc_retries;
+	// leave the scraper the last snapshot, not the last one due
+	if (text_due && !ret && telem_text_put(t, &rec, st) < 0)
+		ret = -1;
+
+	if (!count) {
+		sigaction(SIGINT, &old_int, NULL);
+		sigaction(SIGTERM, &old_term, NULL);
+	}
+	return ret;
+}
+
+// snapshots per second; the first one starts the clock rather than ending a period
+double telem_rate(const struct telem_stats *st) {
+	uint64_t n = st->cycles > 1 ? st->cycles - 1 : st->cycles;
+
+	return st->wall_ns ? n * 1e9 / st->wall_ns : 0.0;
+}
+
+void telem_report(const struct telem_config *cfg, const struct telem_stats *st, FILE *out) {
+	double wall = st->wall_ns / 1e9;
+	uint64_t n = st->cycles ? st->cycles : 1;
+
+	fprintf(out, "%llu snapshots in %.3f s (%.1f/s", (unsigned long long)st->cycles, wall,
+		wall > 0 ? telem_rate(st) : 0.0);
+	if (cfg->period_ns)
+		fprintf(out, ", period %.3f ms", cfg->period_ns / 1e6);
+	else
+		fprintf(out, ", free-running");
+	fprintf(out, ")\n");
+	fprintf(out, "poller CPU: %.3f ms, %.6f of one core\n", st->cpu_ns / 1e6,
+		st->wall_ns ? (double)st->cpu_ns / st->wall_ns : 0.0);
+	fprintf(out, "per snapshot: reads %llu ns, ring %llu ns, %.2f I2C transfers\n",
+		(unsigned long long)(st->read.sum / n), (unsigned long long)(st->ring_ns / n),
+		(double)st->i2c_transfers / n);
+	if (st->text_writes)
+		fprintf(out, "text file: %llu written, %llu ns each\n",
+			(unsigned long long)st->text_writes,
+			(unsigned long long)(st->text_ns / st->text_writes));
+	if (st->adc_retries || st->overruns)
+		fprintf(out, "ADC conversions redone: %llu, overruns: %llu\n",
+			(unsigned long long)st->adc_retries, (unsigned long long)st->overruns);
+	if (sim_enabled)
+		fprintf(out, "(sim: -sim_latency bus time is busy-waited, so it counts as CPU)\n");
+}
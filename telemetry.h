@@ -0,0 +1,112 @@
+#ifndef __TELEMETRY_H__
+#define __TELEMETRY_H__
+
+///
+// Periodic telemetry poller.
+//
+// Every period one snapshot is taken of the FPGA status, input port and
+// version registers, a set of ADC channels and the EIM chip-select
+// configuration, then appended to a ring file and written out as a text
+// exposition file for a local scraper.
+//
+// A cycle is grouped by where its reads go, so it costs as few bus
+// transactions and system calls as they allow:
+//
+//   CS0    plain loads from the already-mapped register window
+//   EIM    read_kernel_memory() on one 64K page, which stays mapped from
+//          cycle to cycle as nothing in between touches another
+//   ADC    whole conversions (start, VALID, both data bytes) chained into
+//          one I2C_RDWR, up to TELEM_ADC_PER_XFER of them; a channel
+//          change costs one extra conversion, thrown away as adc_chan()
+//          does, so a single channel needs none after the first cycle
+//
+// The ring file is a 4096-byte header and an array of fixed-size records,
+// mmap()ed like the trace ring (trace.h); the text file is written beside
+// its path and rename()d over it, so a reader never sees half of one.
+// That costs an open, a rename and a directory update, far more than a
+// snapshot's reads, so it is written at the scraper's pace rather than
+// the poller's: text_interval_ns apart, whatever the period.
+// The poller times itself and reports its CPU time as a fraction of one
+// core at the rate it ran.
+///
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "rt.h"
+
+#define TELEM_MAGIC        "GPBBTLM1"
+#define TELEM_HEADER_SIZE  4096
+#define TELEM_ADC_CHANNELS 8
+#define TELEM_EIM_REGS     14
+#define TELEM_ADC_PER_XFER 6   // conversions per I2C_RDWR: 6 messages each + 1, of at most 42
+
+struct telem_record {
+	uint64_t seq;
+	uint64_t timestamp;     // CLOCK_REALTIME ns at the start of the cycle
+	uint32_t read_ns;       // the cycle's reads, files excluded
+	uint16_t gpbb_stat;     // FPGA_R_GPBB_STAT
+	uint16_t dut_to_cpu;    // FPGA_R_DUT_TO_CPU
+	uint16_t fpga_major;    // FPGA_R_V_MAJOR / FPGA_R_V_MINOR
+	uint16_t fpga_minor;
+	uint16_t adc[TELEM_ADC_CHANNELS];  // those in the header's adc_mask
+	uint16_t pad[2];
+	uint32_t eim[TELEM_EIM_REGS];      // telem_eim_regs[] order; 0 without EIM
+};
+
+struct telem_header {
+	char magic[8];
+	uint32_t record_size;
+	uint32_t capacity;      // records the ring holds
+	uint64_t period_ns;
+	uint32_t adc_mask;
+	uint32_t eim;           // 1 if the EIM registers are read
+	uint64_t head;          // records ever written; the ring keeps the last capacity
+};
+
+struct telem_config {
+	long period_ns;         // 0 free-runs
+	uint32_t adc_mask;      // bit n converts channel n every cycle
+	int eim;                // read the EIM configuration registers
+	const char *ring_path;  // NULL for no ring file
+	uint32_t ring_capacity; // 0 for the default
+	const char *text_path;  // NULL for no text file
+	long text_interval_ns;  // at most one text file per interval; 0: every snapshot
+};
+
+struct telem_stats {
+	uint64_t cycles;
+	uint64_t wall_ns;
+	uint64_t cpu_ns;        // this thread's CPU time over wall_ns
+	uint64_t ring_ns;       // summed over cycles
+	uint64_t text_ns;
+	uint64_t text_writes;
+	uint64_t i2c_transfers;
+	uint64_t adc_retries;   // conversions redone because VALID was still 0
+	uint64_t overruns;      // cycles that started a whole period late
+	struct rt_hist wakeup;
+	struct rt_hist read;    // per-cycle read time
+};
+
+struct telem_reg {
+	unsigned long addr;
+	const char *name;
+};
+
+extern const struct telem_reg telem_eim_regs[TELEM_EIM_REGS];
+
+struct telem;
+
+// cs0 is the mapped CS0 window (any non-NULL under -sim)
+struct telem *telem_open(const struct telem_config *cfg, volatile uint16_t *cs0);
+void telem_close(struct telem *t);
+
+// one snapshot, not stored anywhere
+int telem_read(struct telem *t, struct telem_record *rec);
+// poll every period count times (0: until SIGINT or SIGTERM)
+int telem_run(struct telem *t, uint64_t count, struct telem_stats *st);
+
+double telem_rate(const struct telem_stats *st);
+void telem_report(const struct telem_config *cfg, const struct telem_stats *st, FILE *out);
+
+#endif /* __TELEMETRY_H__ */
@@ -0,0 +1,379 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trace.h"
+#include "novena-gpbb.h"
+#include "adc108s022.h"
+#include "dac101c085.h"
+#include "stats.h"
+#include "sim.h"
+
+#define TRACE_DEFAULT_CAPACITY (1 << 20)
+
+struct trace_ring *trace_active = NULL;
+static struct trace_ring *trace_recording = NULL;
+
+void trace_emit(int bus, int dir, int width, uint32_t addr, uint64_t value) {
+	struct trace_ring *ring = trace_active;
+	struct trace_record *rec;
+	uint64_t slot;
+
+	slot = __atomic_fetch_add(&ring->header->head, 1, __ATOMIC_RELAXED);
+	rec = &ring->records[slot % ring->header->capacity];
+	rec->timestamp = stats_now();
+	rec->value = value;
+	rec->addr = addr;
+	rec->bus = bus;
+	rec->dir = dir;
+	rec->width = width;
+	rec->pad = 0;
+}
+
+static struct trace_ring *trace_map(const char *path, uint32_t capacity, int create) {
+	struct trace_ring *ring;
+	struct trace_header hdr;
+	struct stat st;
+	int fd;
+
+	fd = open(path, create ? (O_RDWR | O_CREAT) : O_RDONLY, 0644);
+	if (fd < 0) {
+		perror("Unable to open trace file");
+		return NULL;
+	}
+	if (fstat(fd, &st) < 0) {
+		close(fd);
+		return NULL;
+	}
+
+	if (create && (capacity || st.st_size < TRACE_HEADER_SIZE)) {
+		// a fresh ring
+		if (!capacity)
+			capacity = TRACE_DEFAULT_CAPACITY;
+		memset(&hdr, 0, sizeof(hdr));
+		memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+		hdr.record_size = sizeof(struct trace_record);
+		hdr.capacity = capacity;
+		if (ftruncate(fd, 0) < 0 ||
+		    ftruncate(fd, TRACE_HEADER_SIZE +
+			      (off_t)capacity * sizeof(struct trace_record)) < 0 ||
+		    pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) {
+			perror("Unable to size trace file");
+			close(fd);
+			return NULL;
+		}
+		fstat(fd, &st);
+	}
+
+	ring = calloc(1, sizeof(*ring));
+	if (!ring) {
+		close(fd);
+		return NULL;
+	}
+	ring->size = st.st_size;
+	ring->header = mmap(NULL, ring->size,
+			    create ? (PROT_READ | PROT_WRITE) : PROT_READ,
+			    MAP_SHARED, fd, 0);
+	close(fd);
+	if (ring->header == MAP_FAILED) {
+		perror("Unable to mmap trace file");
+		free(ring);
+		return NULL;
+	}
+	ring->records = (struct trace_record *)((char *)ring->header + TRACE_HEADER_SIZE);
+
+	if (memcmp(ring->header->magic, TRACE_MAGIC, sizeof(ring->header->magic)) ||
+	    ring->header->record_size != sizeof(struct trace_record) ||
+	    TRACE_HEADER_SIZE + (size_t)ring->header->capacity *
+	    sizeof(struct trace_record) > ring->size) {
+		fprintf(stderr, "%s is not a trace file\n", path);
+		trace_close(ring);
+		return NULL;
+	}
+	return ring;
+}
+
+int trace_start(const char *path, uint32_t capacity) {
+	trace_stop();
+	trace_recording = trace_map(path, capacity, 1);
+	if (!trace_recording)
+		return -1;
+	trace_active = trace_recording;
+	return 0;
+}
+
+void trace_stop(void) {
+	trace_active = NULL;
+	if (trace_recording) {
+		msync(trace_recording->header, trace_recording->size, MS_ASYNC);
+		trace_close(trace_recording);
+		trace_recording = NULL;
+	}
+}
+
+struct trace_ring *trace_open(const char *path) {
+	return trace_map(path, 0, 0);
+}
+
+void trace_close(struct trace_ring *ring) {
+	if (!ring)
+		return;
+	munmap(ring->header, ring->size);
+	free(ring);
+}
+
+// records still in the ring
+uint64_t trace_count(struct trace_ring *ring) {
+	uint64_t head = ring->header->head;
+
+	return head < ring->header->capacity ? head : ring->header->capacity;
+}
+
+// i-th oldest record still in the ring
+struct trace_record *trace_get(struct trace_ring *ring, uint64_t i) {
+	uint64_t head = ring->header->head;
+	uint64_t first = head > ring->header->capacity ? head - ring->header->capacity : 0;
+
+	return &ring->records[(first + i) % ring->header->capacity];
+}
+
+static uint64_t trace_width_mask(int width) {
+	return width >= 8 ? ~0ULL : (1ULL << (width * 8)) - 1;
+}
+
+// CS1 only takes whole 64-bit words, which read_kernel_memory() can't do
+static int trace_replay_cs1(struct trace_record *rec, volatile uint64_t *cs1, int *skipped) {
+	uint64_t got;
+
+	if (!sim_enabled && !cs1) {
+		(*skipped)++;
+		return 0;
+	}
+	if (rec->dir == TRACE_WRITE) {
+		if (sim_enabled)
+			sim_mem_write(rec->addr, 8, rec->value);
+		else
+			cs1[F1(rec->addr)] = rec->value;
+		return 0;
+	}
+	if (sim_enabled)
+		got = sim_mem_read(rec->addr, 8);
+	else
+		memcpy(&got, (void *)&cs1[F1(rec->addr)], 8);
+	return got != rec->value;
+}
+
+// run one record through the regular access layers; 1 if a read differed
+static int trace_replay_one(struct trace_record *rec, volatile uint64_t *cs1, int *skipped) {
+	uint64_t mask = trace_width_mask(rec->width);
+	unsigned char data;
+	unsigned short code;
+	uint64_t got = 0;
+	dacType dac;
+
+	switch (rec->bus) {
+	case TRACE_BUS_MEM:
+		if (rec->width == 8)
+			return trace_replay_cs1(rec, cs1, skipped);
+		if (rec->width != 1 && rec->width != 2 && rec->width != 4) {
+			(*skipped)++;
+			return 0;
+		}
+		if (rec->dir == TRACE_WRITE) {
+			write_kernel_memory(rec->addr, rec->value, 0, rec->width);
+			return 0;
+		}
+		got = read_kernel_memory(rec->addr, 0, rec->width);
+		break;
+
+	case TRACE_BUS_I2C2:
+		if (rec->dir == TRACE_WRITE) {
+			adc108s022_write_byte(rec->addr & 0xff, rec->value);
+			return 0;
+		}
+		adc108s022_read_byte(rec->addr & 0xff, &data);
+		got = data;
+		break;
+
+	case TRACE_BUS_I2C1:
+		dac = ((rec->addr >> 8) == DAC101C085_B_I2C_ADR) ? DAC_B : DAC_A;
+		if (rec->dir == TRACE_WRITE) {
+			dac101c085_write_byte(rec->value, dac);
+			return 0;
+		}
+		dac101c085_read_byte(&code, dac);
+		got = code;
+		break;
+
+	default:
+		(*skipped)++;
+		return 0;
+	}
+
+	return (got & mask) != (rec->value & mask);
+}
+
+int trace_replay(const char *path, int timed, volatile uint64_t *cs1) {
+	struct trace_ring *ring;
+	struct trace_record *rec;
+	struct timespec due;
+	uint64_t n, i, t0, start;
+	uint64_t mismatches = 0;
+	int skipped = 0;
+	double elapsed;
+
+	ring = trace_open(path);
+	if (!ring)
+		return -1;
+	n = trace_count(ring);
+	if (!n) {
+		printf("%s: empty trace\n", path);
+		trace_close(ring);
+		return 0;
+	}
+
+	// don't record the replay into whatever trace is running
+	trace_stop();
+
+	t0 = trace_get(ring, 0)->timestamp;
+	start = stats_now();
+	for (i = 0; i < n; i++) {
+		rec = trace_get(ring, i);
+		if (timed) {
+			uint64_t ns = start + (rec->timestamp - t0);
+
+			due.tv_sec = ns / 1000000000ULL;
+			due.tv_nsec = ns % 1000000000ULL;
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) == EINTR)
+				;
+		}
+		mismatches += trace_replay_one(rec, cs1, &skipped);
+	}
+	elapsed = (stats_now() - start) / 1e9;
+
+	printf("replayed %llu records in %.3f s (%.0f ops/s, recorded span %.3f s)\n",
+	       (unsigned long long)n, elapsed, elapsed > 0 ? n / elapsed : 0.0,
+	       (trace_get(ring, n - 1)->timestamp - t0) / 1e9);
+	printf("%llu reads returned a different value, %d records skipped\n",
+	       (unsigned long long)mismatches, skipped);
+
+	trace_close(ring);
+	return 0;
+}
+
+struct trace_addr_stats {
+	uint64_t key;        // (bus << 32) | addr, 0 marks an empty slot
+	uint64_t reads;
+	uint64_t writes;
+	uint64_t redundant_reads;
+	uint64_t redundant_writes;
+	uint64_t last;       // last value seen read or written
+	int known;
+};
+
+#define TRACE_SUM_SLOTS (1 << 16)
+
+static int trace_sum_cmp(const void *a, const void *b) {
+	const struct trace_addr_stats *x = a, *y = b;
+	uint64_t nx = x->reads + x->writes, ny = y->reads + y->writes;
+
+	if (nx != ny)
+		return nx < ny ? 1 : -1;
+	return x->key < y->key ? -1 : x->key > y->key;
+}
+
+int trace_summarize(const char *path) {
+	static const char *bus_names[] = { "mem", "i2c-1", "i2c-2" };
+	struct trace_addr_stats *slots, *s;
+	struct trace_ring *ring;
+	struct trace_record *rec;
+	uint64_t n, i, key, h, mask;
+	uint64_t tot_r = 0, tot_w = 0, tot_rr = 0, tot_rw = 0;
+	int used = 0;
+
+	ring = trace_open(path);
+	if (!ring)
+		return -1;
+	slots = calloc(TRACE_SUM_SLOTS, sizeof(*slots));
+	if (!slots) {
+		trace_close(ring);
+		return -1;
+	}
+
+	n = trace_count(ring);
+	for (i = 0; i < n; i++) {
+		rec = trace_get(ring, i);
+		// +1 keeps bus 0 / address 0 distinct from an empty slot
+		key = ((uint64_t)rec->bus << 32 | rec->addr) + 1;
+		for (h = (key * 0x9e3779b97f4a7c15ULL) >> 48; ; h = (h + 1) % TRACE_SUM_SLOTS) {
+			s = &slots[h];
+			if (s->key == key)
+				break;
+			if (!s->key) {
+				if (++used == TRACE_SUM_SLOTS) {
+					fprintf(stderr, "too many distinct addresses in trace\n");
+					free(slots);
+					trace_close(ring);
+					return -1;
+				}
+				s->key = key;
+				break;
+			}
+		}
+
+		mask = trace_width_mask(rec->width);
+		if (rec->dir == TRACE_READ) {
+			s->reads++;
+			if (s->known && (s->last & mask) == (rec->value & mask))
+				s->redundant_reads++;
+		}
+		else {
+			s->writes++;
+			if (s->known && (s->last & mask) == (rec->value & mask))
+				s->redundant_writes++;
+		}
+		s->last = rec->value;
+		s->known = 1;
+	}
+
+	// compact and sort busiest first
+	for (i = 0, h = 0; h < TRACE_SUM_SLOTS; h++)
+		if (slots[h].key)
+			slots[i++] = slots[h];
+	qsort(slots, used, sizeof(*slots), trace_sum_cmp);
+
+	printf("%-6s %-10s %10s %10s %10s %10s\n",
+	       "bus", "address", "reads", "writes", "red.reads", "red.writes");
+	for (i = 0; i < (uint64_t)used; i++) {
+		int bus = (slots[i].key - 1) >> 32;
+
+		printf("%-6s 0x%08x %10llu %10llu %10llu %10llu\n",
+		       bus < 3 ? bus_names[bus] : "?",
+		       (unsigned)((slots[i].key - 1) & 0xffffffff),
+		       (unsigned long long)slots[i].reads,
+		       (unsigned long long)slots[i].writes,
+		       (unsigned long long)slots[i].redundant_reads,
+		       (unsigned long long)slots[i].redundant_writes);
+		tot_r += slots[i].reads;
+		tot_w += slots[i].writes;
+		tot_rr += slots[i].redundant_reads;
+		tot_rw += slots[i].redundant_writes;
+	}
+	printf("%llu records (%llu dropped by ring wrap), %d addresses: "
+	       "%llu reads (%llu redundant), %llu writes (%llu redundant)\n",
+	       (unsigned long long)n,
+	       (unsigned long long)(ring->header->head - n), used,
+	       (unsigned long long)tot_r, (unsigned long long)tot_rr,
+	       (unsigned long long)tot_w, (unsigned long long)tot_rw);
+
+	free(slots);
+	trace_close(ring);
+	return 0;
+}
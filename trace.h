@@ -0,0 +1,78 @@
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+///
+// Register/I2C access tracer.
+//
+// When a trace ring is open, every access made by the register and I2C
+// layers appends one fixed-size record to a memory-mapped ring file.  With
+// no ring open a TRACE() costs one pointer test.
+///
+
+#include <stdint.h>
+
+enum trace_bus {
+	TRACE_BUS_MEM  = 0,  // physical address space (EIM, IOMUXC, CCM...)
+	TRACE_BUS_I2C1 = 1,  // /dev/i2c-1: DAC101C085s
+	TRACE_BUS_I2C2 = 2,  // /dev/i2c-2: FPGA register file, ADC108S022
+};
+
+enum trace_dir {
+	TRACE_READ  = 0,
+	TRACE_WRITE = 1,
+};
+
+// for I2C records, addr is (slave << 8) | register
+#define TRACE_I2C_ADDR(slave, reg)  (((slave) << 8) | ((reg) & 0xff))
+
+struct trace_record {
+	uint64_t timestamp;  // CLOCK_MONOTONIC ns
+	uint64_t value;
+	uint32_t addr;
+	uint8_t bus;
+	uint8_t dir;
+	uint8_t width;       // bytes
+	uint8_t pad;
+};
+
+#define TRACE_MAGIC "GPBBTRC1"
+#define TRACE_HEADER_SIZE 4096
+
+struct trace_header {
+	char magic[8];
+	uint32_t record_size;
+	uint32_t capacity;   // records the ring holds
+	uint64_t head;       // records ever written; the ring keeps the last capacity
+};
+
+struct trace_ring {
+	struct trace_header *header;
+	struct trace_record *records;
+	size_t size;
+};
+
+extern struct trace_ring *trace_active;
+
+#define TRACE(bus, dir, width, addr, value) \
+	do { \
+		if (trace_active) \
+			trace_emit((bus), (dir), (width), (addr), (value)); \
+	} while (0)
+
+void trace_emit(int bus, int dir, int width, uint32_t addr, uint64_t value);
+
+// start recording into path, a ring of capacity records (0: keep existing size)
+int trace_start(const char *path, uint32_t capacity);
+void trace_stop(void);
+
+struct trace_ring *trace_open(const char *path);
+void trace_close(struct trace_ring *ring);
+uint64_t trace_count(struct trace_ring *ring);
+struct trace_record *trace_get(struct trace_ring *ring, uint64_t i);
+
+// cs1 is the CS1 window for the 64-bit records; without one (and outside
+// the sim) they are counted as skipped
+int trace_replay(const char *path, int timed, volatile uint64_t *cs1);
+int trace_summarize(const char *path);
+
+#endif /* __TRACE_H__ */
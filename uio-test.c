@@ -0,0 +1,199 @@
+///
+// UIO backend tests without a UIO device.
+//
+// uio_enable_fds() is handed a memfd for the CS0 window and an eventfd for
+// its interrupt, and a child process plays the FPGA: after a delay it sets
+// a status bit in the shared map and, when there is an interrupt, fires the
+// eventfd.  The cases check that uio_wait_event() wakes on the eventfd and
+// times out without it, that a regwait with policy.event set wakes on the
+// interrupt rather than its backoff, and that the same wait still completes
+// through the backoff when there is no interrupt: no irq fd at all, or one
+// that reads EIO the way UIO does for a device without one (a pty whose
+// other side is closed).  A last case checks that a backoff longer than
+// the timeout still returns at the deadline.  Exit status is the number of
+// failed checks.
+///
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/eventfd.h>
+
+#include "novena-gpbb.h"
+#include "uio.h"
+#include "regwait.h"
+#include "stats.h"
+
+#define TEST_WINDOW  0x2000
+#define TEST_REG     FPGA_R_GPBB_STAT
+#define TEST_DELAY   (50 * 1000000ULL)  // until the child sets the bit
+
+static int failures;
+
+#define CHECK(cond, ...) \
+	do { \
+		if (!(cond)) { \
+			failures++; \
+			printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+			printf(__VA_ARGS__); \
+			printf("\n"); \
+		} \
+	} while (0)
+
+static int test_read(void *ctx, unsigned int *value) {
+	*value = *(volatile uint16_t *)ctx;
+	return 0;
+}
+
+// map the CS0 window from a fresh memfd; returns the status register
+static volatile uint16_t *test_map(int irq_fd) {
+	struct uio_map map = { FPGA_REG_OFFSET, TEST_WINDOW, NULL };
+	int fd;
+
+	fd = memfd_create("gpbb-uio-test", 0);
+	if (fd < 0 || ftruncate(fd, TEST_WINDOW)) {
+		perror("memfd");
+		return NULL;
+	}
+	if (uio_enable_fds(fd, irq_fd, &map, 1))
+		return NULL;
+	return uio_reg(TEST_REG, 2);
+}
+
+// the FPGA: set bit 0 of reg after delay_ns, then raise the interrupt
+static pid_t test_fire(volatile uint16_t *reg, int irq_fd, uint64_t delay_ns) {
+	struct timespec ts = { delay_ns / 1000000000ULL, delay_ns % 1000000000ULL };
+	uint64_t one = 1;
+	pid_t pid;
+
+	pid = fork();
+	if (pid)
+		return pid;
+	nanosleep(&ts, NULL);
+	*reg = 1;
+	if (irq_fd >= 0 && write(irq_fd, &one, sizeof(one)) != sizeof(one))
+		_exit(1);
+	_exit(0);
+}
+
+static int test_wait(volatile uint16_t *reg, const struct regwait_policy *policy,
+		     struct regwait_stats *stats, uint64_t *elapsed) {
+	uint64_t t0 = stats_now();
+	int ret;
+
+	memset(stats, 0, sizeof(*stats));
+	ret = regwait(test_read, (void *)reg, 1, 1, policy, stats, NULL);
+	*elapsed = stats_now() - t0;
+	return ret;
+}
+
+static void test_eventfd(void) {
+	// a backoff this long would blow the 400 ms budget below
+	struct regwait_policy policy = { 1, 500000000ULL, 500000000ULL, 2000000000ULL,
+					 uio_event, NULL };
+	struct regwait_stats stats;
+	volatile uint16_t *reg;
+	uint64_t one = 1, elapsed;
+	int efd, ret;
+	pid_t pid;
+
+	efd = eventfd(0, 0);
+	CHECK(efd >= 0, "eventfd: %s", strerror(errno));
+	reg = test_map(efd);
+	CHECK(reg != NULL, "memfd map with an eventfd");
+	if (efd < 0 || !reg)
+		return;
+	CHECK(uio_reg(FPGA_REG_OFFSET + TEST_WINDOW - 1, 2) == NULL, "access past the map");
+
+	CHECK(uio_wait_event(20000000ULL) == -ETIMEDOUT, "no event, times out");
+	CHECK(write(efd, &one, sizeof(one)) == sizeof(one), "fire the eventfd");
+	CHECK(uio_wait_event(1000000000ULL) == 0, "wakes on the eventfd");
+	CHECK(uio_wait_event(20000000ULL) == -ETIMEDOUT, "the event was consumed");
+
+	*reg = 0;
+	pid = test_fire(reg, efd, TEST_DELAY);
+	ret = test_wait(reg, &policy, &stats, &elapsed);
+	waitpid(pid, NULL, 0);
+	CHECK(ret == 0, "regwait on the interrupt: %d", ret);
+	CHECK(stats.polls == 2, "one poll before and one after the interrupt, got %llu",
+	      (unsigned long long)stats.polls);
+	CHECK(elapsed >= TEST_DELAY && elapsed < 400000000ULL,
+	      "woken by the interrupt after %llu ns", (unsigned long long)elapsed);
+	close(efd);
+}
+
+static void test_no_irq(int irq_fd, const char *what) {
+	struct regwait_policy policy = { 1, 1000000, 8000000, 2000000000ULL, uio_event, NULL };
+	struct regwait_stats stats;
+	volatile uint16_t *reg;
+	uint64_t elapsed;
+	int ret;
+	pid_t pid;
+
+	reg = test_map(irq_fd);
+	CHECK(reg != NULL, "memfd map, %s", what);
+	if (!reg)
+		return;
+
+	*reg = 0;
+	pid = test_fire(reg, -1, TEST_DELAY);
+	ret = test_wait(reg, &policy, &stats, &elapsed);
+	waitpid(pid, NULL, 0);
+	CHECK(ret == 0, "regwait falls back to polling, %s: %d", what, ret);
+	CHECK(stats.polls > 2, "%s: the backoff polled %llu times", what,
+	      (unsigned long long)stats.polls);
+	CHECK(elapsed >= TEST_DELAY, "%s: done after %llu ns", what,
+	      (unsigned long long)elapsed);
+	CHECK(uio_wait_event(1000000) == -ENOSYS, "%s: no interrupt to wait for", what);
+}
+
+static void test_timeout(void) {
+	// the first backoff sleep alone is twenty times the timeout
+	struct regwait_policy policy = { 1, 200000000ULL, 500000000ULL, 10000000ULL, NULL, NULL };
+	struct regwait_stats stats;
+	volatile uint16_t *reg;
+	uint64_t elapsed;
+	int ret;
+
+	reg = test_map(-1);
+	CHECK(reg != NULL, "memfd map for the timeout");
+	if (!reg)
+		return;
+
+	*reg = 0;
+	ret = test_wait(reg, &policy, &stats, &elapsed);
+	CHECK(ret == -ETIMEDOUT, "regwait times out: %d", ret);
+	CHECK(elapsed >= 10000000ULL && elapsed < 100000000ULL,
+	      "timed out after %llu ns, not after the backoff", (unsigned long long)elapsed);
+}
+
+int main(int argc, char **argv) {
+	int pty, slave;
+
+	test_eventfd();
+	test_no_irq(-1, "no irq fd");
+
+	// once the pty's other side has been opened and closed again, it
+	// polls readable and reads EIO
+	pty = posix_openpt(O_RDWR | O_NOCTTY);
+	if (pty >= 0 && !grantpt(pty) && !unlockpt(pty) &&
+	    (slave = open(ptsname(pty), O_RDWR | O_NOCTTY)) >= 0) {
+		close(slave);
+		test_no_irq(pty, "irq fd reads EIO");
+	}
+	else {
+		printf("uio-test: no pty, EIO fallback not tested\n");
+	}
+	test_timeout();
+
+	printf("uio-test: %s (%d failed)\n", failures ? "FAIL" : "ok", failures);
+	return failures;
+}
@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+
+#include "uio.h"
+
+struct uio_dev *uio_active = NULL;
+static struct uio_dev uio_dev;
+
+static int uio_sysfs_ulong(int n, int map, const char *attr, unsigned long *value) {
+	char path[128];
+	FILE *f;
+	int ok;
+
+	snprintf(path, sizeof(path), "/sys/class/uio/uio%d/maps/map%d/%s", n, map, attr);
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+	ok = fscanf(f, "%lx", value) == 1;
+	fclose(f);
+	return ok ? 0 : -1;
+}
+
+static int uio_mmap(struct uio_dev *u, int i, off_t offset) {
+	void *p;
+
+	p = mmap(NULL, u->map[i].size, PROT_READ | PROT_WRITE, MAP_SHARED, u->fd, offset);
+	if (p == MAP_FAILED) {
+		perror("Unable to mmap UIO region");
+		return -1;
+	}
+	u->map[i].addr = p;
+	return 0;
+}
+
+int uio_enable(const char *dev) {
+	struct uio_dev *u = &uio_dev;
+	char path[32];
+	unsigned long addr, size;
+	long page = sysconf(_SC_PAGESIZE);
+	int n, i;
+
+	if (!strncmp(dev, "/dev/uio", 8))
+		dev += 8;
+	n = strtol(dev, NULL, 10);
+	snprintf(path, sizeof(path), "/dev/uio%d", n);
+
+	memset(u, 0, sizeof(*u));
+	u->fd = open(path, O_RDWR);
+	if (u->fd < 0) {
+		perror("Unable to open UIO device");
+		return -1;
+	}
+	u->irq_fd = u->fd;
+	u->irq = 1;
+	u->irq_read_size = 4;
+
+	// UIO selects map N with an mmap offset of N pages
+	for (i = 0; i < UIO_MAX_MAPS; i++) {
+		if (uio_sysfs_ulong(n, i, "addr", &addr) || uio_sysfs_ulong(n, i, "size", &size))
+			break;
+		u->map[i].phys = addr;
+		u->map[i].size = size;
+		if (uio_mmap(u, i, i * page))
+			goto fail;
+		u->nmaps++;
+	}
+	if (!u->nmaps) {
+		fprintf(stderr, "%s has no memory maps\n", path);
+		goto fail;
+	}
+	uio_active = u;
+	return 0;
+
+fail:
+	for (i = 0; i < u->nmaps; i++)
+		munmap((void *)u->map[i].addr, u->map[i].size);
+	close(u->fd);
+	return -1;
+}
+
+int uio_enable_fds(int mem_fd, int irq_fd, struct uio_map *maps, int n) {
+	struct uio_dev *u = &uio_dev;
+	long page = sysconf(_SC_PAGESIZE);
+	off_t offset = 0;
+	int i;
+
+	if (n < 1 || n > UIO_MAX_MAPS)
+		return -1;
+	memset(u, 0, sizeof(*u));
+	u->fd = mem_fd;
+	u->irq_fd = irq_fd;
+	u->irq = irq_fd >= 0;
+	u->irq_read_size = 4;
+	for (i = 0; i < n; i++) {
+		u->map[i] = maps[i];
+		if (uio_mmap(u, i, offset))
+			return -1;
+		maps[i].addr = u->map[i].addr;
+		offset += (maps[i].size + page - 1) & ~(page - 1);
+		u->nmaps++;
+	}
+	uio_active = u;
+	return 0;
+}
+
+volatile void *uio_reg(unsigned long phys, int size) {
+	struct uio_map *m;
+	int i;
+
+	if (!uio_active)
+		return NULL;
+	for (i = 0; i < uio_active->nmaps; i++) {
+		m = &uio_active->map[i];
+		if (phys >= m->phys && phys + size <= m->phys + m->size)
+			return (volatile uint8_t *)m->addr + (phys - m->phys);
+	}
+	return NULL;
+}
+
+int uio_wait_event(uint64_t timeout_ns) {
+	struct uio_dev *u = uio_active;
+	struct pollfd pfd;
+	uint64_t count;
+	uint32_t enable = 1;
+	ssize_t ret;
+
+	if (!u || !u->irq)
+		return -ENOSYS;
+
+	// re-arm; a driver without irqcontrol refuses, which is fine
+	if (u->irq_fd == u->fd)
+		ret = write(u->irq_fd, &enable, sizeof(enable));
+
+	pfd.fd = u->irq_fd;
+	pfd.events = POLLIN;
+	ret = poll(&pfd, 1, (timeout_ns + 999999) / 1000000);
+	if (ret == 0)
+		return -ETIMEDOUT;
+	if (ret < 0)
+		return errno == EINTR ? -ETIMEDOUT : -errno;
+
+	ret = read(u->irq_fd, &count, u->irq_read_size);
+	if (ret < 0 && errno == EINVAL && u->irq_read_size == 4) {
+		// an eventfd only reads in 8 bytes
+		u->irq_read_size = 8;
+		ret = read(u->irq_fd, &count, u->irq_read_size);
+	}
+	if (ret < 0 && errno == EIO) {
+		// UIO's answer when the device has no interrupt
+		u->irq = 0;
+		return -ENOSYS;
+	}
+	return ret < 0 ? -errno : 0;
+}
+
+int uio_event(void *ctx, uint64_t timeout_ns) {
+	return uio_wait_event(timeout_ns);
+}
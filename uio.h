@@ -0,0 +1,54 @@
+#ifndef __UIO_H__
+#define __UIO_H__
+
+///
+// UIO backend for the EIM register windows.
+//
+// With -uio, the CS0 and CS1 windows are mapped through a UIO device
+// (maps 0 and 1 of /dev/uioN) instead of /dev/mem, so no root is needed
+// for register access, and the kernel driver is expected to have set up
+// the EIM pads and timing.  Waits on FPGA events block in poll() on the
+// UIO fd when the device has an interrupt; without one, uio_wait_event()
+// says so and callers keep polling the register.
+//
+// uio_enable_fds() builds the same thing from any mappable fd and any fd
+// that becomes readable on an event, e.g. a memfd and an eventfd.
+///
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define UIO_MAX_MAPS  2  // CS0, CS1
+
+struct uio_map {
+	unsigned long phys;     // physical address the map stands for
+	size_t size;
+	volatile void *addr;
+};
+
+struct uio_dev {
+	int fd;                 // mmap()ed for the maps
+	int irq_fd;             // poll()ed and read() for events
+	int irq;                // 0 once the device turned out to have no interrupt
+	size_t irq_read_size;   // 4 for UIO's event count, 8 for an eventfd
+	int nmaps;
+	struct uio_map map[UIO_MAX_MAPS];
+};
+
+extern struct uio_dev *uio_active;
+
+// dev is /dev/uioN or just N
+int uio_enable(const char *dev);
+// maps[i].phys and .size given; the regions are laid out one after the
+// other, page aligned, in mem_fd
+int uio_enable_fds(int mem_fd, int irq_fd, struct uio_map *maps, int n);
+
+// the mapped address of a register, or NULL when no map covers it
+volatile void *uio_reg(unsigned long phys, int size);
+
+// 0 on an event, -ETIMEDOUT, or -ENOSYS if there is no interrupt to wait for
+int uio_wait_event(uint64_t timeout_ns);
+// the same, in the shape regwait's policy.event wants
+int uio_event(void *ctx, uint64_t timeout_ns);
+
+#endif /* __UIO_H__ */
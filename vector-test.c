@@ -0,0 +1,149 @@
+///
+// Vector stream bus master tests against the simulated DUTs.
+//
+// Each case compiles a transaction with vec_spi(), vec_i2c() or vec_uart(),
+// runs it through the sim with the matching sim-dut.h model attached to
+// the same pins and decodes what came back: the SPI shift register's ID
+// byte and echo in every mode, the I2C EEPROM's ACKs and the bytes read
+// back after a write, a NACK from an address nobody answers, and the UART
+// echo with and without parity.  Exit status is the number of failed
+// checks.
+///
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "vector.h"
+#include "sim.h"
+#include "sim-dut.h"
+
+#define TEST_MAX  64  // bytes in the longest transaction
+
+static int failures;
+
+#define CHECK(cond, ...) \
+	do { \
+		if (!(cond)) { \
+			failures++; \
+			printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+			printf(__VA_ARGS__); \
+			printf("\n"); \
+		} \
+	} while (0)
+
+static uint8_t tx[TEST_MAX + 1];
+
+// run s against dut; the samples are returned for the caller to free
+static uint8_t *test_run(struct vec_stream *s, struct sim_dut *dut) {
+	uint8_t *samples = calloc(s->nbits + 1, 1);
+
+	if (!samples)
+		return NULL;
+	sim_attach_dut(dut);
+	vec_run(s, NULL, samples);
+	sim_attach_dut(NULL);
+	return samples;
+}
+
+static void test_spi(int mode, int len) {
+	struct vec_spi spi = vec_spi_pins;
+	struct vec_stream s;
+	uint8_t rx[TEST_MAX], *samples;
+
+	spi.mode = mode;
+	vec_init(&s, 0, 0);
+	CHECK(vec_spi(&s, &spi, tx, len) == 0 && !s.error, "spi%d: compile %d bytes", mode, len);
+	samples = test_run(&s, sim_dut_spi(&spi));
+	if (samples) {
+		vec_decode(&s, samples, rx);
+		CHECK(s.rx_len == len, "spi%d: %d bytes to decode, want %d", mode, s.rx_len, len);
+		CHECK(rx[0] == SIM_DUT_SPI_ID, "spi%d: ID byte %02x", mode, rx[0]);
+		CHECK(!memcmp(rx + 1, tx, len - 1), "spi%d: %d-byte echo", mode, len);
+	}
+	free(samples);
+	vec_free(&s);
+}
+
+static void test_i2c(void) {
+	struct vec_stream s;
+	uint8_t wr[TEST_MAX + 1], rx[2 * TEST_MAX + 8], *samples;
+	int i, nacks = 0;
+
+	// write the bytes at 0, then read them back
+	wr[0] = 0;
+	memcpy(wr + 1, tx, TEST_MAX);
+	vec_init(&s, 0, 0);
+	CHECK(vec_i2c(&s, &vec_i2c_pins, SIM_DUT_I2C_ADDR, wr, TEST_MAX + 1, 0) == 0 &&
+	      vec_i2c(&s, &vec_i2c_pins, SIM_DUT_I2C_ADDR, wr, 1, TEST_MAX) == 0,
+	      "i2c: compile");
+	samples = test_run(&s, sim_dut_i2c(&vec_i2c_pins, SIM_DUT_I2C_ADDR));
+	if (samples) {
+		vec_decode(&s, samples, rx);
+		// address and TEST_MAX + 1 ACKs for the write, the data read,
+		// then the address and pointer ACKs of the read
+		for (i = 0; i < s.rx_len; i++)
+			if (i < TEST_MAX + 2 ? rx[i] : i >= 2 * TEST_MAX + 2 && rx[i])
+				nacks++;
+		CHECK(!nacks, "i2c: %d bytes not ACKed", nacks);
+		CHECK(!memcmp(rx + TEST_MAX + 2, tx, TEST_MAX), "i2c: read back what was written");
+	}
+	free(samples);
+	vec_free(&s);
+
+	// the EEPROM must not answer another address
+	vec_init(&s, 0, 0);
+	CHECK(vec_i2c(&s, &vec_i2c_pins, SIM_DUT_I2C_ADDR + 1, wr, 1, 0) == 0, "i2c: compile");
+	samples = test_run(&s, sim_dut_i2c(&vec_i2c_pins, SIM_DUT_I2C_ADDR));
+	if (samples) {
+		vec_decode(&s, samples, rx);
+		CHECK(rx[0], "i2c: address %02x was ACKed", SIM_DUT_I2C_ADDR + 1);
+	}
+	free(samples);
+	vec_free(&s);
+}
+
+static void test_uart(int parity, int stop_bits) {
+	struct vec_uart uart = vec_uart_pins;
+	struct vec_stream s;
+	uint8_t rx[TEST_MAX], *samples;
+	int i, n = 0, errors = -1;
+
+	uart.parity = parity;
+	uart.stop_bits = stop_bits;
+	vec_init(&s, 0, 0);
+	CHECK(vec_uart(&s, &uart, tx, TEST_MAX, 2) == 0 && !s.error, "uart: compile");
+	samples = test_run(&s, sim_dut_uart(&uart));
+	if (samples) {
+		n = vec_uart_decode(&uart, samples, s.nbits, rx, TEST_MAX, &errors);
+		for (i = 0; i < n; i++)
+			rx[i] ^= SIM_DUT_UART_XOR;
+	}
+	CHECK(n == TEST_MAX && !errors, "uart parity %d, %d stop: %d frames, %d errors",
+	      parity, stop_bits, n, errors);
+	CHECK(n == TEST_MAX && !memcmp(rx, tx, n), "uart parity %d, %d stop: echo",
+	      parity, stop_bits);
+	free(samples);
+	vec_free(&s);
+}
+
+int main(int argc, char **argv) {
+	int i, mode;
+
+	for (i = 0; i < TEST_MAX; i++)
+		tx[i] = 'a' + i % 26;
+	sim_enable(NULL);
+
+	for (mode = 0; mode < 4; mode++) {
+		test_spi(mode, 1);
+		test_spi(mode, TEST_MAX);
+	}
+	test_i2c();
+	test_uart(0, 1);
+	test_uart(1, 1);
+	test_uart(2, 2);
+
+	printf("vector-test: %s (%d failed)\n", failures ? "FAIL" : "ok", failures);
+	return failures;
+}
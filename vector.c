@@ -0,0 +1,455 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "vector.h"
+#include "novena-gpbb.h"
+#include "sim.h"
+#include "stats.h"
+
+#define VEC_MIN_OPS  256
+
+#define PIN(p)     (1U << (p))
+#define PORT_OE(p) ((p) < 8 ? 0x1 : 0x2)  // GPBB_CTL OE bit of an output pin
+
+const struct vec_spi vec_spi_pins = { 0, 0, 1, 2, 0 };  // mode 0; A0 SCK, A1 MOSI, A2 /CS; in0 MISO
+const struct vec_i2c vec_i2c_pins = { 4, 8, 1 };        // A4 SCL, B0 SDA; in1 SDA
+const struct vec_uart vec_uart_pins = { 3, 2, 4, 0, 1 }; // A3 TX; in2 RX; 4 ops/bit, 8N1
+
+void vec_init(struct vec_stream *s, uint16_t port, uint8_t oe) {
+	memset(s, 0, sizeof(*s));
+	s->port = port;
+	s->oe = oe & 0x3;
+}
+
+void vec_free(struct vec_stream *s) {
+	free(s->ops);
+	free(s->bits);
+	memset(s, 0, sizeof(*s));
+}
+
+static void vec_op(struct vec_stream *s, uint32_t op) {
+	uint32_t *ops;
+	int max;
+
+	if (s->nops == s->max_ops) {
+		max = s->max_ops ? s->max_ops * 2 : VEC_MIN_OPS;
+		ops = realloc(s->ops, max * sizeof(*ops));
+		if (!ops) {
+			s->error = 1;
+			return;
+		}
+		s->ops = ops;
+		s->max_ops = max;
+	}
+	s->ops[s->nops++] = op;
+}
+
+void vec_emit(struct vec_stream *s) {
+	vec_op(s, s->port);
+}
+
+void vec_set(struct vec_stream *s, int pin, int level) {
+	if (level)
+		s->port |= PIN(pin);
+	else
+		s->port &= ~PIN(pin);
+}
+
+void vec_oe(struct vec_stream *s, uint8_t oe) {
+	if (oe == s->oe)
+		return;
+	s->oe = oe;
+	vec_op(s, VEC_CTL | oe);
+}
+
+void vec_sample(struct vec_stream *s, int byte, int bit, int pin) {
+	struct vec_bit *bits;
+	int max;
+
+	if (!s->nops || s->error)
+		return;
+	if (s->nbits == s->max_bits) {
+		max = s->max_bits ? s->max_bits * 2 : VEC_MIN_OPS;
+		bits = realloc(s->bits, max * sizeof(*bits));
+		if (!bits) {
+			s->error = 1;
+			return;
+		}
+		s->bits = bits;
+		s->max_bits = max;
+	}
+	s->ops[s->nops - 1] |= VEC_SAMPLE;
+	s->bits[s->nbits].byte = byte;
+	s->bits[s->nbits].bit = bit;
+	s->bits[s->nbits].pin = pin;
+	s->nbits++;
+}
+
+
+/*
+ * SPI: two ops per bit.  With CPHA 0 the first puts MOSI out with SCK
+ * idle (the trailing edge of the bit before) and the second is the
+ * leading edge, after which MISO is sampled; with CPHA 1 the first is the
+ * leading edge with MOSI and the second the trailing, sampling edge.
+ */
+int vec_spi(struct vec_stream *s, const struct vec_spi *cfg, const uint8_t *tx, int len) {
+	int cpol = (cfg->mode >> 1) & 1, cpha = cfg->mode & 1;
+	int rx = s->rx_len;
+	int i, b, bit;
+
+	// idle levels first, so turning the outputs on does not glitch them
+	vec_set(s, cfg->sck, cpol);
+	vec_set(s, cfg->cs, 1);
+	vec_emit(s);
+	vec_oe(s, s->oe | PORT_OE(cfg->sck) | PORT_OE(cfg->mosi) | PORT_OE(cfg->cs));
+	vec_set(s, cfg->cs, 0);
+	vec_emit(s);
+
+	for (i = 0; i < len; i++) {
+		for (b = 7; b >= 0; b--) {
+			bit = (tx[i] >> b) & 1;
+			vec_set(s, cfg->mosi, bit);
+			vec_set(s, cfg->sck, cpha ? !cpol : cpol);
+			vec_emit(s);
+			vec_set(s, cfg->sck, cpha ? cpol : !cpol);
+			vec_emit(s);
+			vec_sample(s, rx + i, b, cfg->miso);
+		}
+	}
+
+	vec_set(s, cfg->sck, cpol);
+	vec_emit(s);
+	vec_set(s, cfg->cs, 1);
+	vec_emit(s);
+
+	s->rx_len += len;
+	s->tx_bits += len * 8;
+	return s->error ? -1 : 0;
+}
+
+
+/*
+ * I2C: SDA low is its port's OE on with the pin at 0, SDA high is OE off
+ * and the pull-up, so only the ops that change a line are emitted.
+ */
+static void i2c_sda(struct vec_stream *s, const struct vec_i2c *cfg, int level) {
+	if (level)
+		vec_oe(s, s->oe & ~PORT_OE(cfg->sda));
+	else
+		vec_oe(s, s->oe | PORT_OE(cfg->sda));
+}
+
+static void i2c_scl(struct vec_stream *s, const struct vec_i2c *cfg, int level) {
+	vec_set(s, cfg->scl, level);
+	vec_emit(s);
+}
+
+// SCL is low on return, SDA as the ACK left it
+static void i2c_write_byte(struct vec_stream *s, const struct vec_i2c *cfg, uint8_t byte,
+			   int ack) {
+	int b;
+
+	for (b = 7; b >= 0; b--) {
+		i2c_sda(s, cfg, (byte >> b) & 1);
+		i2c_scl(s, cfg, 1);
+		i2c_scl(s, cfg, 0);
+	}
+	i2c_sda(s, cfg, 1);
+	i2c_scl(s, cfg, 1);
+	vec_sample(s, ack, 0, cfg->sda_in);
+	i2c_scl(s, cfg, 0);
+}
+
+static void i2c_read_byte(struct vec_stream *s, const struct vec_i2c *cfg, int byte, int ack) {
+	int b;
+
+	i2c_sda(s, cfg, 1);
+	for (b = 7; b >= 0; b--) {
+		i2c_scl(s, cfg, 1);
+		vec_sample(s, byte, b, cfg->sda_in);
+		i2c_scl(s, cfg, 0);
+	}
+	i2c_sda(s, cfg, !ack);
+	i2c_scl(s, cfg, 1);
+	i2c_scl(s, cfg, 0);
+}
+
+static void i2c_start(struct vec_stream *s, const struct vec_i2c *cfg) {
+	i2c_sda(s, cfg, 1);
+	i2c_scl(s, cfg, 1);
+	i2c_sda(s, cfg, 0);
+	i2c_scl(s, cfg, 0);
+}
+
+int vec_i2c(struct vec_stream *s, const struct vec_i2c *cfg, uint8_t addr,
+	    const uint8_t *wr, int wlen, int rlen) {
+	int rx = s->rx_len;
+	int ack = rx + rlen;
+	int i;
+
+	// SCL driven and high, SDA released, with its pin at 0 for when it is not
+	vec_set(s, cfg->sda, 0);
+	vec_set(s, cfg->scl, 1);
+	vec_emit(s);
+	vec_oe(s, (s->oe | PORT_OE(cfg->scl)) & ~PORT_OE(cfg->sda));
+
+	if (wlen) {
+		i2c_start(s, cfg);
+		i2c_write_byte(s, cfg, addr << 1, ack++);
+		for (i = 0; i < wlen; i++)
+			i2c_write_byte(s, cfg, wr[i], ack++);
+	}
+	if (rlen) {
+		i2c_start(s, cfg);
+		i2c_write_byte(s, cfg, (addr << 1) | 1, ack++);
+		for (i = 0; i < rlen; i++)
+			i2c_read_byte(s, cfg, rx + i, i < rlen - 1);
+	}
+
+	// STOP
+	i2c_sda(s, cfg, 0);
+	i2c_scl(s, cfg, 1);
+	i2c_sda(s, cfg, 1);
+
+	s->rx_len = ack;
+	s->tx_bits += ((wlen ? wlen + 1 : 0) + (rlen ? rlen + 1 : 0)) * 9;
+	return s->error ? -1 : 0;
+}
+
+
+/*
+ * UART: every bit is bit_vectors identical ops, each sampling RX, so the
+ * line is oversampled by bit_vectors and frames are found afterwards.
+ */
+static int uart_frame_bits(const struct vec_uart *cfg) {
+	return 1 + 8 + (cfg->parity ? 1 : 0) + cfg->stop_bits;
+}
+
+static int uart_parity(const struct vec_uart *cfg, uint8_t byte) {
+	int p = __builtin_popcount(byte) & 1;
+
+	return cfg->parity == 1 ? !p : p;
+}
+
+static void uart_bit(struct vec_stream *s, const struct vec_uart *cfg, int level) {
+	int v;
+
+	vec_set(s, cfg->tx, level);
+	for (v = 0; v < cfg->bit_vectors; v++) {
+		vec_emit(s);
+		if (cfg->rx >= 0)
+			vec_sample(s, VEC_RAW, 0, cfg->rx);
+	}
+}
+
+int vec_uart(struct vec_stream *s, const struct vec_uart *cfg, const uint8_t *tx,
+	     int len, int idle_frames) {
+	int i, b;
+
+	vec_set(s, cfg->tx, 1);
+	vec_emit(s);
+	vec_oe(s, s->oe | PORT_OE(cfg->tx));
+	uart_bit(s, cfg, 1);
+	for (i = 0; i < len; i++) {
+		uart_bit(s, cfg, 0);
+		for (b = 0; b < 8; b++)
+			uart_bit(s, cfg, (tx[i] >> b) & 1);
+		if (cfg->parity)
+			uart_bit(s, cfg, uart_parity(cfg, tx[i]));
+		for (b = 0; b < cfg->stop_bits; b++)
+			uart_bit(s, cfg, 1);
+	}
+	for (i = 0; i < idle_frames * uart_frame_bits(cfg); i++)
+		uart_bit(s, cfg, 1);
+
+	s->tx_bits += len * uart_frame_bits(cfg);
+	return s->error ? -1 : 0;
+}
+
+int vec_uart_decode(const struct vec_uart *cfg, const uint8_t *samples, int n,
+		    uint8_t *rx, int max, int *errors) {
+	int bv = cfg->bit_vectors, frame = uart_frame_bits(cfg);
+	int i = 0, nrx = 0, prev = 1, level, b, ok;
+	uint8_t byte;
+
+#define UART_BIT(k)  ((samples[i + (k) * bv + bv / 2] >> cfg->rx) & 1)
+	if (errors)
+		*errors = 0;
+	while (i + frame * bv <= n && nrx < max) {
+		level = (samples[i] >> cfg->rx) & 1;
+		if (!prev || level) {
+			prev = level;
+			i++;
+			continue;
+		}
+		// a falling edge: the start bit begins here
+		byte = 0;
+		for (b = 0; b < 8; b++)
+			byte |= UART_BIT(1 + b) << b;
+		ok = UART_BIT(0) == 0;
+		if (cfg->parity)
+			ok &= UART_BIT(9) == uart_parity(cfg, byte);
+		for (b = frame - cfg->stop_bits; b < frame; b++)
+			ok &= UART_BIT(b) == 1;
+		if (ok)
+			rx[nrx++] = byte;
+		else if (errors)
+			(*errors)++;
+		// look for the next edge from the middle of the last stop bit
+		i += (frame - 1) * bv + bv / 2;
+		prev = 1;
+	}
+#undef UART_BIT
+	return nrx;
+}
+
+
+static void vec_run_sim(const struct vec_stream *s, uint8_t *samples) {
+	uint16_t ctl = sim_mem_read(FPGA_W_GPBB_CTL, 2) & ~0x3;
+	const uint32_t *op, *end = s->ops + s->nops;
+
+	for (op = s->ops; op < end; op++) {
+		if (*op & VEC_CTL)
+			sim_mem_write(FPGA_W_GPBB_CTL, 2, ctl | (*op & 0x3));
+		else
+			sim_mem_write(FPGA_W_CPU_TO_DUT, 2, *op & 0xffff);
+		if (*op & VEC_SAMPLE)
+			*samples++ = sim_mem_read(FPGA_R_DUT_TO_CPU, 2);
+	}
+}
+
+void vec_run(const struct vec_stream *s, volatile uint16_t *cs0, uint8_t *samples) {
+	volatile uint16_t *port = cs0 + F(FPGA_W_CPU_TO_DUT);
+	volatile uint16_t *ctl_reg = cs0 + F(FPGA_W_GPBB_CTL);
+	volatile uint16_t *in = cs0 + F(FPGA_R_DUT_TO_CPU);
+	const uint32_t *op, *end = s->ops + s->nops;
+	uint16_t ctl;
+	uint32_t v;
+
+	if (sim_enabled) {
+		vec_run_sim(s, samples);
+		return;
+	}
+
+	// VDDIO and the other control bits stay as they are
+	ctl = *ctl_reg & ~0x3;
+	for (op = s->ops; op < end; op++) {
+		v = *op;
+		if (v & VEC_CTL)
+			*ctl_reg = ctl | (v & 0x3);
+		else
+			*port = v;
+		if (v & VEC_SAMPLE)
+			*samples++ = *in;
+	}
+}
+
+void vec_decode(const struct vec_stream *s, const uint8_t *samples, uint8_t *rx) {
+	const struct vec_bit *b;
+	int i;
+
+	memset(rx, 0, s->rx_len);
+	for (i = 0; i < s->nbits; i++) {
+		b = &s->bits[i];
+		if (b->byte != VEC_RAW)
+			rx[b->byte] |= ((samples[i] >> b->pin) & 1) << b->bit;
+	}
+}
+
+
+/*
+ * Benchmark: the same loop replaying a stream of bare port writes gives
+ * the raw EIM write rate the protocol streams are measured against.
+ */
+static double vec_time(const struct vec_stream *s, volatile uint16_t *cs0, uint8_t *samples,
+		       int iterations) {
+	uint64_t t0 = stats_now();
+	int it;
+
+	for (it = 0; it < iterations; it++)
+		vec_run(s, cs0, samples);
+	return (stats_now() - t0) / 1e9 / iterations;
+}
+
+static void vec_report(const char *name, const struct vec_stream *s, double t, double raw) {
+	printf("%-10s %8d %8.2f %10.1f %10.3f %7.1f%%\n", name, s->nops,
+	       (double)s->nops / s->tx_bits, s->tx_bits / t / 1e3, s->nops / t / 1e6,
+	       s->nops / t / raw * 100);
+}
+
+#define VEC_BENCH_I2C_ADDR  0x50  // an EEPROM's
+
+void vec_bench(volatile uint16_t *cs0, int bytes, int iterations) {
+	struct vec_stream s;
+	struct vec_spi spi = vec_spi_pins;
+	struct vec_uart uart = vec_uart_pins;
+	uint8_t *tx, *samples, *buf;
+	char name[16];
+	double t, raw;
+	int i;
+
+	tx = malloc(bytes + 1);
+	buf = malloc(bytes + 1);
+	// the largest stream: UART at 2 frames per byte, one sample per op
+	samples = malloc((bytes + 2) * 2 * 12 * uart.bit_vectors + 64);
+	if (!tx || !buf || !samples) {
+		perror("Unable to allocate vector buffers");
+		goto done;
+	}
+	for (i = 0; i < bytes; i++)
+		tx[i] = 'a' + i % 26;
+
+	// raw: toggle port A bit 7, 16 writes per byte
+	vec_init(&s, 0, 0);
+	vec_oe(&s, 0x1);
+	for (i = 0; i < bytes * 16; i++) {
+		vec_set(&s, 7, i & 1);
+		vec_emit(&s);
+	}
+	s.tx_bits = bytes * 16;
+	raw = s.nops / vec_time(&s, cs0, samples, iterations);
+	vec_free(&s);
+	printf("%d-byte transactions, %d iterations; raw EIM writes: %.3f M/s\n",
+	       bytes, iterations, raw / 1e6);
+	printf("%-10s %8s %8s %10s %10s %8s\n",
+	       "protocol", "ops", "ops/bit", "kbit/s", "Mops/s", "of raw");
+
+	for (spi.mode = 0; spi.mode < 4; spi.mode++) {
+		vec_init(&s, 0, 0);
+		if (vec_spi(&s, &spi, tx, bytes))
+			goto nomem;
+		t = vec_time(&s, cs0, samples, iterations);
+		snprintf(name, sizeof(name), "spi%d", spi.mode);
+		vec_report(name, &s, t, raw);
+		vec_free(&s);
+	}
+
+	// write the bytes at 0, then read them back
+	buf[0] = 0;
+	memcpy(buf + 1, tx, bytes);
+	vec_init(&s, 0, 0);
+	if (vec_i2c(&s, &vec_i2c_pins, VEC_BENCH_I2C_ADDR, buf, bytes + 1, 0) ||
+	    vec_i2c(&s, &vec_i2c_pins, VEC_BENCH_I2C_ADDR, buf, 1, bytes))
+		goto nomem;
+	t = vec_time(&s, cs0, samples, iterations);
+	vec_report("i2c", &s, t, raw);
+	vec_free(&s);
+
+	vec_init(&s, 0, 0);
+	if (vec_uart(&s, &uart, tx, bytes, 2))
+		goto nomem;
+	t = vec_time(&s, cs0, samples, iterations);
+	vec_report("uart", &s, t, raw);
+	vec_free(&s);
+	goto done;
+
+nomem:
+	fprintf(stderr, "Unable to allocate vector stream\n");
+	vec_free(&s);
+done:
+	free(tx);
+	free(buf);
+	free(samples);
+}
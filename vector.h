@@ -0,0 +1,109 @@
+#ifndef __VECTOR_H__
+#define __VECTOR_H__
+
+///
+// Bit-banged bus masters on the GPBB ports, as precompiled vector streams.
+//
+// A transaction (an SPI transfer, an I2C write and/or read, UART frames)
+// is compiled ahead of time into a list of ops, each one write of
+// FPGA_W_CPU_TO_DUT (or of the OE bits of FPGA_W_GPBB_CTL), optionally
+// followed by a read of FPGA_R_DUT_TO_CPU.  vec_run() replays the list
+// through one mapping of the CS0 window in a loop that does nothing but
+// those accesses; the samples are turned back into bytes afterwards.
+//
+// Output pins are bits 0-15 of CPU_TO_DUT (port A is 0-7, port B 8-15),
+// input pins bits 0-7 of the input port.  A port has a single output
+// enable, so I2C puts SDA alone on one port and makes it open drain by
+// switching that port's OE; SCL is driven and not stretched.
+///
+
+#include <stdint.h>
+
+#define VEC_SAMPLE  (1U << 16)  // read DUT_TO_CPU after this op
+#define VEC_CTL     (1U << 17)  // the low bits are OE bits for GPBB_CTL
+
+#define VEC_RAW     -1          // struct vec_bit.byte of an undecoded sample
+
+// where the bit in one sample goes
+struct vec_bit {
+	int32_t byte;           // in the rx buffer, or VEC_RAW
+	uint8_t bit;
+	uint8_t pin;            // input port bit
+};
+
+struct vec_stream {
+	uint32_t *ops;
+	int nops, max_ops;
+	struct vec_bit *bits;   // one per VEC_SAMPLE op
+	int nbits, max_bits;
+	int rx_len;             // bytes vec_decode() fills in
+	int tx_bits;            // protocol bits the stream moves, for rates
+	uint16_t port;          // CPU_TO_DUT after the last op
+	uint8_t oe;             // OE bits after the last op
+	int error;              // an op did not fit; the stream is incomplete
+};
+
+struct vec_spi {
+	int mode;               // 0-3; CPOL is bit 1, CPHA bit 0
+	int sck, mosi, cs;      // output pins; cs is active low
+	int miso;               // input pin
+};
+
+struct vec_i2c {
+	int scl, sda;           // output pins, on different ports
+	int sda_in;             // input pin wired to SDA
+};
+
+struct vec_uart {
+	int tx;                 // output pin
+	int rx;                 // input pin, or -1 not to sample
+	int bit_vectors;        // ops per bit; sets the baud rate
+	int parity;             // 0 none, 1 odd, 2 even
+	int stop_bits;
+};
+
+// the wiring -vspi, -vi2c and -vuart use
+extern const struct vec_spi vec_spi_pins;
+extern const struct vec_i2c vec_i2c_pins;
+extern const struct vec_uart vec_uart_pins;
+
+// start a stream from the port value and OE bits currently set
+void vec_init(struct vec_stream *s, uint16_t port, uint8_t oe);
+void vec_free(struct vec_stream *s);
+
+// building blocks for other protocols: set an output pin in the port value,
+// append a write of it, append an OE change (if it is one), and sample the
+// input port after the last op into bit of rx[byte]
+void vec_set(struct vec_stream *s, int pin, int level);
+void vec_emit(struct vec_stream *s);
+void vec_oe(struct vec_stream *s, uint8_t oe);
+void vec_sample(struct vec_stream *s, int byte, int bit, int pin);
+
+// compile transactions onto the end of a stream; -1 if it ran out of memory
+// SPI: rx[i] gets the byte clocked in while tx[i] went out
+int vec_spi(struct vec_stream *s, const struct vec_spi *cfg, const uint8_t *tx, int len);
+// I2C: START, address and wlen bytes if wlen, (repeated) START and rlen
+// bytes read if rlen, STOP.  rx gets the rlen bytes read, then one byte per
+// byte written (address bytes included) that is 0 if it was ACKed
+int vec_i2c(struct vec_stream *s, const struct vec_i2c *cfg, uint8_t addr,
+	    const uint8_t *wr, int wlen, int rlen);
+// UART: the frames, then idle_frames frame times of idle line, sampling
+// rx all along; vec_uart_decode() picks received frames out of the samples
+int vec_uart(struct vec_stream *s, const struct vec_uart *cfg, const uint8_t *tx,
+	     int len, int idle_frames);
+
+// run the ops through the CS0 window cs0 (ignored under -sim); samples
+// gets one input port byte per VEC_SAMPLE op
+void vec_run(const struct vec_stream *s, volatile uint16_t *cs0, uint8_t *samples);
+// the sampled bits into rx (s->rx_len bytes)
+void vec_decode(const struct vec_stream *s, const uint8_t *samples, uint8_t *rx);
+// bytes found in the samples of a vec_uart() stream; errors counts frames
+// with a bad parity or stop bit, which are dropped
+int vec_uart_decode(const struct vec_uart *cfg, const uint8_t *samples, int n,
+		    uint8_t *rx, int max, int *errors);
+
+// raw EIM write rate, then each protocol's bit rate against it; what the
+// streams move is checked by vector-test, against the sim DUTs
+void vec_bench(volatile uint16_t *cs0, int bytes, int iterations);
+
+#endif /* __VECTOR_H__ */
@@ -0,0 +1,324 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/uio.h>
+
+#include "writer.h"
+#include "rt.h"
+#include "stats.h"
+
+#define WRITER_BATCH  16  // buffers per writev()
+#define WRITER_ALIGN  4096
+
+struct writer {
+	int fd;
+	int direct;             // O_DIRECT currently set on fd
+	struct writer_config cfg;
+	uint8_t *pool;
+	size_t *len;            // bytes queued in each buffer
+
+	pthread_mutex_t lock;
+	pthread_cond_t queued;  // writer thread: work or closing
+	pthread_cond_t freed;   // producer: a buffer came back
+	int *free_list;         // stack of free buffer indices
+	int nfree;
+	int *queue;             // ring of full buffer indices
+	int head, count;
+	int closing;
+	pthread_t thread;
+
+	uint64_t start;
+	struct writer_stats stats;
+};
+
+static uint8_t *writer_buffer(struct writer *w, int i) {
+	return w->pool + (size_t)i * w->cfg.buffer_size;
+}
+
+static int writer_submit(struct writer *w, int *idx, int n) {
+	struct iovec iov[WRITER_BATCH];
+	size_t total = 0;
+	ssize_t ret;
+	uint64_t t0;
+	int i, flags;
+
+	for (i = 0; i < n; i++) {
+		iov[i].iov_base = writer_buffer(w, idx[i]);
+		iov[i].iov_len = w->len[idx[i]];
+		total += iov[i].iov_len;
+	}
+
+	// O_DIRECT takes whole blocks; a short final buffer goes through the cache
+	if (w->direct && (total % WRITER_ALIGN)) {
+		flags = fcntl(w->fd, F_GETFL);
+		fcntl(w->fd, F_SETFL, flags & ~O_DIRECT);
+		w->direct = 0;
+	}
+
+	t0 = stats_now();
+	while (total) {
+		ret = writev(w->fd, iov, n);
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return ret < 0 ? errno : EIO;
+		total -= ret;
+		w->stats.bytes += ret;
+		// a short write: skip what went out and go again
+		while (n && (size_t)ret >= iov[0].iov_len) {
+			ret -= iov[0].iov_len;
+			memmove(iov, iov + 1, --n * sizeof(*iov));
+		}
+		if (n) {
+			iov[0].iov_base = (uint8_t *)iov[0].iov_base + ret;
+			iov[0].iov_len -= ret;
+		}
+	}
+	rt_hist_add(&w->stats.write_time, stats_now() - t0);
+	return 0;
+}
+
+static void *writer_thread(void *arg) {
+	struct writer *w = arg;
+	int idx[WRITER_BATCH];
+	int n, i, err;
+
+	pthread_mutex_lock(&w->lock);
+	for (;;) {
+		while (!w->count && !w->closing)
+			pthread_cond_wait(&w->queued, &w->lock);
+		if (!w->count)
+			break;
+
+		for (n = 0; n < w->count && n < WRITER_BATCH; n++)
+			idx[n] = w->queue[(w->head + n) % w->cfg.buffers];
+		pthread_mutex_unlock(&w->lock);
+
+		// after an error the data is thrown away, but buffers still cycle
+		err = w->stats.error ? 0 : writer_submit(w, idx, n);
+
+		pthread_mutex_lock(&w->lock);
+		if (err)
+			w->stats.error = err;
+		else if (!w->stats.error)
+			w->stats.buffers += n;
+		w->head = (w->head + n) % w->cfg.buffers;
+		w->count -= n;
+		for (i = 0; i < n; i++)
+			w->free_list[w->nfree++] = idx[i];
+		pthread_cond_signal(&w->freed);
+	}
+	pthread_mutex_unlock(&w->lock);
+	return NULL;
+}
+
+struct writer *writer_open(const char *path, const struct writer_config *cfg) {
+	struct writer *w;
+	int i;
+
+	if (cfg->buffers < 2 || !cfg->buffer_size || cfg->buffer_size % WRITER_ALIGN) {
+		fprintf(stderr, "writer: need 2 or more buffers of a multiple of %d bytes\n",
+			WRITER_ALIGN);
+		return NULL;
+	}
+	w = calloc(1, sizeof(*w));
+	if (!w) {
+		perror("Unable to allocate writer");
+		return NULL;
+	}
+	w->cfg = *cfg;
+	rt_hist_init(&w->stats.write_time);
+
+	w->fd = -1;
+	if (cfg->direct) {
+		w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+		w->direct = w->stats.direct = w->fd >= 0;
+	}
+	if (w->fd < 0)
+		w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (w->fd < 0) {
+		perror("Unable to open stream file");
+		free(w);
+		return NULL;
+	}
+
+	if (posix_memalign((void **)&w->pool, WRITER_ALIGN, cfg->buffers * cfg->buffer_size))
+		w->pool = NULL;
+	w->len = calloc(cfg->buffers, sizeof(*w->len));
+	w->free_list = calloc(cfg->buffers, sizeof(*w->free_list));
+	w->queue = calloc(cfg->buffers, sizeof(*w->queue));
+	if (!w->pool || !w->len || !w->free_list || !w->queue) {
+		fprintf(stderr, "Unable to allocate writer buffers\n");
+		goto fail;
+	}
+	// fault the pool in now rather than in the acquisition loop
+	memset(w->pool, 0, cfg->buffers * cfg->buffer_size);
+	for (i = 0; i < cfg->buffers; i++)
+		w->free_list[i] = cfg->buffers - 1 - i;
+	w->nfree = cfg->buffers;
+
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_cond_init(&w->queued, NULL);
+	pthread_cond_init(&w->freed, NULL);
+	if (pthread_create(&w->thread, NULL, writer_thread, w)) {
+		perror("Unable to start writer thread");
+		goto fail;
+	}
+	w->start = stats_now();
+	return w;
+
+fail:
+	close(w->fd);
+	free(w->pool);
+	free(w->len);
+	free(w->free_list);
+	free(w->queue);
+	free(w);
+	return NULL;
+}
+
+void *writer_get(struct writer *w) {
+	uint64_t t0;
+	void *buf;
+
+	pthread_mutex_lock(&w->lock);
+	if (!w->nfree) {
+		if (w->cfg.drop) {
+			w->stats.drops++;
+			pthread_mutex_unlock(&w->lock);
+			return NULL;
+		}
+		t0 = stats_now();
+		while (!w->nfree)
+			pthread_cond_wait(&w->freed, &w->lock);
+		w->stats.stalls++;
+		w->stats.stall_ns += stats_now() - t0;
+	}
+	buf = writer_buffer(w, w->free_list[--w->nfree]);
+	pthread_mutex_unlock(&w->lock);
+	return buf;
+}
+
+void writer_put(struct writer *w, void *buf, size_t len) {
+	int i = ((uint8_t *)buf - w->pool) / w->cfg.buffer_size;
+
+	pthread_mutex_lock(&w->lock);
+	w->len[i] = len;
+	w->queue[(w->head + w->count++) % w->cfg.buffers] = i;
+	if (w->count > w->stats.max_queued)
+		w->stats.max_queued = w->count;
+	pthread_cond_signal(&w->queued);
+	pthread_mutex_unlock(&w->lock);
+}
+
+void writer_failed(struct writer *w, uint64_t n) {
+	pthread_mutex_lock(&w->lock);
+	w->stats.failed += n;
+	pthread_mutex_unlock(&w->lock);
+}
+
+int writer_close(struct writer *w, struct writer_stats *stats) {
+	int ret;
+
+	pthread_mutex_lock(&w->lock);
+	w->closing = 1;
+	pthread_cond_signal(&w->queued);
+	pthread_mutex_unlock(&w->lock);
+	pthread_join(w->thread, NULL);
+
+	if (close(w->fd) < 0 && !w->stats.error)
+		w->stats.error = errno;
+	w->stats.elapsed_ns = stats_now() - w->start;
+	ret = w->stats.error ? -1 : 0;
+	if (w->stats.error)
+		fprintf(stderr, "Unable to write stream file: %s\n", strerror(w->stats.error));
+	if (stats)
+		*stats = w->stats;
+
+	pthread_mutex_destroy(&w->lock);
+	pthread_cond_destroy(&w->queued);
+	pthread_cond_destroy(&w->freed);
+	free(w->pool);
+	free(w->len);
+	free(w->free_list);
+	free(w->queue);
+	free(w);
+	return ret;
+}
+
+void writer_stats_print(const struct writer_stats *s) {
+	printf("writer: %llu bytes in %llu buffers, %.1f MB/s%s; max queue %d; "
+	       "%llu stalls (%.3f ms), %llu drops, %llu failed reads\n",
+	       (unsigned long long)s->bytes, (unsigned long long)s->buffers,
+	       s->elapsed_ns ? s->bytes * 1e3 / s->elapsed_ns : 0.0,
+	       s->direct ? ", O_DIRECT" : "", s->max_queued,
+	       (unsigned long long)s->stalls, s->stall_ns / 1e6,
+	       (unsigned long long)s->drops, (unsigned long long)s->failed);
+}
+
+
+/*
+ * Benchmark: a producer paced at increasing input rates, in drop mode so
+ * the rate the writer can sustain shows up as the point drops begin.
+ */
+static void writer_bench_one(const char *label, const char *path, int direct) {
+	struct writer_config cfg = {
+		WRITER_DEFAULT_BUFFER_SIZE, WRITER_DEFAULT_BUFFERS, direct, 1,
+	};
+	struct writer_stats st;
+	struct writer *w;
+	struct timespec ts;
+	uint64_t start, due, total, sent;
+	uint8_t *buf;
+	int mbps;
+
+	printf("%s: %s\n", label, path);
+	printf("%10s %10s %10s %8s %10s %12s\n",
+	       "in MB/s", "out MB/s", "buffers", "drops", "max queue", "max write");
+	for (mbps = 16; mbps <= 4096; mbps *= 2) {
+		w = writer_open(path, &cfg);
+		if (!w)
+			return;
+		// a quarter of a second at this rate, capped at 512 MB
+		total = (uint64_t)mbps * 1000000 / 4;
+		if (total > 512ULL << 20)
+			total = 512ULL << 20;
+		start = stats_now();
+		for (sent = 0; sent < total; sent += cfg.buffer_size) {
+			due = start + sent * 1000 / mbps;
+			ts.tv_sec = due / 1000000000ULL;
+			ts.tv_nsec = due % 1000000000ULL;
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+				;
+			buf = writer_get(w);
+			if (!buf)
+				continue;
+			memset(buf, sent / cfg.buffer_size, cfg.buffer_size);
+			writer_put(w, buf, cfg.buffer_size);
+		}
+		writer_close(w, &st);
+		unlink(path);
+
+		printf("%10d %10.1f %10llu %8llu %10d %9llu us%s\n", mbps,
+		       st.bytes * 1e3 / st.elapsed_ns, (unsigned long long)st.buffers,
+		       (unsigned long long)st.drops, st.max_queued,
+		       (unsigned long long)(st.write_time.count ? st.write_time.max / 1000 : 0),
+		       st.direct ? "  O_DIRECT" : "");
+		if (st.error)
+			return;
+	}
+}
+
+void writer_bench(const char *disk_path, int direct) {
+	printf("%d x %d KiB buffers; max write is the slowest writev()\n",
+	       WRITER_DEFAULT_BUFFERS, WRITER_DEFAULT_BUFFER_SIZE / 1024);
+	writer_bench_one("tmpfs", "/dev/shm/gpbb-writebench", 0);
+	writer_bench_one("disk", disk_path, direct);
+}
@@ -0,0 +1,58 @@
+#ifndef __WRITER_H__
+#define __WRITER_H__
+
+///
+// Double-buffered file writer for the streaming modes.
+//
+// The acquisition loop takes a page-aligned buffer from a preallocated
+// pool, fills it in place and hands it back with writer_put(); a writer
+// thread submits queued buffers in one writev() (or with O_DIRECT, which
+// falls back to buffered I/O on filesystems without it) and returns them
+// to the pool.  When the pool is empty the producer either waits, which
+// is counted as a stall, or in drop mode gets NULL and the data is
+// counted as dropped.
+///
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rt.h"
+
+struct writer_config {
+	size_t buffer_size;    // a multiple of the page size
+	int buffers;
+	int direct;            // try O_DIRECT
+	int drop;              // never wait for a buffer
+};
+
+#define WRITER_DEFAULT_BUFFER_SIZE  (256 * 1024)
+#define WRITER_DEFAULT_BUFFERS      16
+
+struct writer_stats {
+	uint64_t buffers;      // written
+	uint64_t bytes;
+	uint64_t stalls;       // writer_get() calls that had to wait
+	uint64_t stall_ns;
+	uint64_t drops;        // writer_get() calls that returned NULL
+	uint64_t failed;       // samples the source could not read, see writer_failed()
+	int max_queued;        // deepest the write queue got
+	int direct;            // O_DIRECT was in effect
+	int error;             // errno of the first failed write, or 0
+	uint64_t elapsed_ns;   // open to close
+	struct rt_hist write_time;  // per writev()
+};
+
+struct writer;
+
+struct writer *writer_open(const char *path, const struct writer_config *cfg);
+void *writer_get(struct writer *w);
+void writer_put(struct writer *w, void *buf, size_t len);
+// counts n samples in the stream that hold a placeholder for a failed read
+void writer_failed(struct writer *w, uint64_t n);
+// waits for the queue to drain; stats may be NULL
+int writer_close(struct writer *w, struct writer_stats *stats);
+
+void writer_stats_print(const struct writer_stats *s);
+void writer_bench(const char *disk_path, int direct);
+
+#endif /* __WRITER_H__ */